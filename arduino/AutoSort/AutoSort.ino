@@ -8,6 +8,7 @@
  */
 
 #include <Arduino.h>
+#include <EEPROM.h>  // Identity cache for fast rejoin after reset
 
 // Detect board type at compile time
 #if defined(ARDUINO_UNOR4_WIFI)
@@ -32,6 +33,11 @@ extern "C" {
 #include "shared/core/node.h"
 #include "shared/core/proto.c"
 #include "shared/core/node.c"
+#include "shared/core/pubsub.c"
+#include "shared/core/timesync.c"
+#include "shared/core/mac.c"
+#include "shared/core/trace.c"
+#include "shared/core/rng.c"
 #include "shared/platform/arduino/hal_arduino.c"
 }
 
@@ -61,6 +67,13 @@ extern "C" {
 Bus* bus = nullptr;
 Node node;
 
+// node_service() timing, printed every LOOP_STATS_MS to compare bus backends
+static const uint32_t LOOP_STATS_MS = 10000;
+static uint32_t loop_count = 0;
+static uint32_t loop_total_us = 0;
+static uint32_t loop_max_us = 0;
+static uint32_t loop_stats_start_ms = 0;
+
 void setup() {
   Serial.begin(DEBUG_BAUD);
   delay(2000);
@@ -78,6 +91,13 @@ void setup() {
   #ifdef USE_SOFTWARE_SERIAL
     bus_set_baud(bus, BUS_BAUD);
   #endif
+
+  // Listen before talking until the coordinator hands out a TDMA schedule
+  // (CONFIG_CSMA in config.h). On the R4, MAC_CSMA_ECHO also catches
+  // collisions when TX and RX share one wire.
+  #if CONFIG_CSMA
+    bus_set_csma(bus, MAC_CSMA_ON);
+  #endif
   
   Serial.println("DEBUG: [" BOARD_TYPE "] About to init node with instance " + String(INSTANCE_INDEX));
   node_init(&node, bus, INSTANCE_INDEX);
@@ -92,6 +112,25 @@ void setup() {
 }
 
 void loop() {
+  uint32_t t0 = micros();
   node_service(&node);
+  uint32_t elapsed_us = micros() - t0;
+
+  loop_count++;
+  loop_total_us += elapsed_us;
+  if (elapsed_us > loop_max_us) {
+    loop_max_us = elapsed_us;
+  }
+  if (millis() - loop_stats_start_ms >= LOOP_STATS_MS) {
+    // node_service() waits up to 50ms for a frame; anything above that is time stuck on the wire
+    Serial.println("DEBUG: [" BOARD_TYPE "] LOOP avg=" + String(loop_total_us / loop_count) +
+                   "us max=" + String(loop_max_us) + "us over " + String(loop_count) + " passes");
+    loop_count = 0;
+    loop_total_us = 0;
+    loop_max_us = 0;
+    loop_stats_start_ms = millis();
+  }
+
+  hal_yield();  // Idle time: write out queued trace records (LOG_TRACE builds)
   delay(10); // Small service interval
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
  * - Simple send/receive API with timeout support
  * - Frame-based messaging with built-in validation
  * - Support for both point-to-point and broadcast communication
+ * - No heap: every platform keeps its buses in a static pool
  */
 
 #ifndef BUS_INTERFACE_H
@@ -18,6 +19,8 @@
 
 #include <stdint.h>
 
+#include "config.h"
+#include "mac.h"
 #include "proto.h"
 
 #ifdef __cplusplus
@@ -33,6 +36,13 @@ extern "C" {
  */
 typedef struct Bus Bus;
 
+/**
+ * Bus handles that can exist at once (per profile, config.h). Platforms keep
+ * them, and any driver objects they need, in a pool sized by this, so bus
+ * creation never touches the heap.
+ */
+#define BUS_POOL_SIZE CONFIG_BUS_POOL
+
 /**
  * @brief Initialize global bus subsystem (platform-specific)
  *
@@ -75,11 +85,11 @@ void bus_global_shutdown(void);
  * @param node_index Unique index for this node (0, 1, 2, ...)
  * @param rx_pin Platform-specific receive pin/address
  * @param tx_pin Platform-specific transmit pin/address
- * @return 0 on success, negative on error
+ * @return 0 on success, negative on error (e.g. all BUS_POOL_SIZE buses in use)
  *
  * Platform Examples:
- * - Simulation: Create message queue for this node index
- * - Arduino: Initialize SoftwareSerial with specified pins
+ * - Simulation: Take the next bus and message queue from the static pool
+ * - Arduino: Construct SoftwareSerial with specified pins in pool storage
  * - ESP32: Setup UART with specified GPIO pins
  */
 int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin);
@@ -87,14 +97,14 @@ int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin);
 /**
  * @brief Destroy a bus instance and free its resources
  *
- * Cleans up platform-specific resources associated with this bus.
- * The bus handle becomes invalid after this call.
+ * Cleans up platform-specific resources associated with this bus and
+ * returns it to the pool. The bus handle becomes invalid after this call.
  *
  * @param bus Bus handle to destroy (may be NULL)
  *
  * Platform Examples:
- * - Simulation: No cleanup needed (global queues persist)
- * - Arduino: Delete SoftwareSerial object
+ * - Simulation: Detach from the line (the pool is reset by bus_global_init())
+ * - Arduino: Destroy the SoftwareSerial object
  * - ESP32: Disable UART peripheral
  */
 void bus_destroy(Bus* bus);
@@ -110,6 +120,45 @@ void bus_destroy(Bus* bus);
  */
 void bus_set_baud(Bus* bus, uint32_t baud);
 
+/**
+ * @brief Enable, update or disable TDMA transmit scheduling
+ *
+ * With a schedule installed, bus_send() queues frames (see mac.h) and the
+ * bus transmits them during this node's slot, from within later
+ * bus_send()/bus_recv() calls. Frames still queued when TDMA is disabled
+ * are sent at the next opportunity.
+ *
+ * @param bus Bus handle to configure
+ * @param sched Schedule published by the coordinator, or NULL to disable
+ * @param my_id Our assigned ID, which selects the slot
+ *
+ * Platform Examples:
+ * - Simulation: Slots timed against the node's simulated network clock
+ * - Arduino: Slots timed against hal_network_millis()
+ */
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id);
+
+/**
+ * @brief Select carrier sense for frames sent outside a TDMA schedule
+ *
+ * With carrier sense on, bus_send() queues the frame in the same hold queue
+ * TDMA uses (returning 0 if it is full) and the backend sends it once the
+ * line has been idle and a random backoff has run out (see mac.h), checking
+ * again whenever bus_send() or bus_recv() is called. With MAC_CSMA_ECHO a
+ * frame is dropped after MAC_CSMA_MAX_ATTEMPTS collisions. TDMA, when
+ * active, takes precedence.
+ *
+ * @param bus Bus handle to configure
+ * @param mode MAC_CSMA_OFF (default), MAC_CSMA_ON or MAC_CSMA_ECHO
+ *
+ * Platform Examples:
+ * - Simulation: Senses other nodes' frames once their first character is on the line
+ * - Arduino UNO: Senses received bytes; MAC_CSMA_ECHO behaves like MAC_CSMA_ON since
+ *   SoftwareSerial cannot receive while it transmits
+ * - Arduino UNO R4: MAC_CSMA_ECHO needs TX and RX on one shared wire
+ */
+void bus_set_csma(Bus* bus, MacCsmaMode mode);
+
 /**
  * @brief Send a frame over the bus
  *
@@ -120,11 +169,12 @@ void bus_set_baud(Bus* bus, uint32_t baud);
  *
  * @param bus Bus handle to send on
  * @param frame Pointer to frame to transmit
- * @return 1 on success, 0 on failure
+ * @return 1 on success (sent, or queued for our TDMA slot), 0 on failure
  *
  * Platform Examples:
  * - Simulation: Broadcast frame to all node message queues
  * - Arduino: Serialize frame to UART TX
+ * - Arduino UNO R4: Queue the frame; it is written once the line is free
  * - ESP32: Send frame over WiFi broadcast
  */
 int bus_send(Bus* bus, const Frame* frame);
@@ -144,6 +194,7 @@ int bus_send(Bus* bus, const Frame* frame);
  * Platform Examples:
  * - Simulation: Pop frame from node's message queue with timeout
  * - Arduino: Parse incoming UART bytes into frame with timeout
+ * - Arduino UNO R4: Return a frame already assembled from the UART buffer
  * - ESP32: Receive WiFi packet and deserialize to frame
  */
 int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms);
@@ -0,0 +1,94 @@
+/**
+ * @file config.h
+ * @brief Build profiles that size the fixed tables for each target
+ *
+ * All node, MAC, pub/sub, trace and bus storage is static, so the numbers
+ * below decide most of a target's RAM use. A profile picks them for a class of
+ * board:
+ *
+ * - CONFIG_PROFILE_TINY: ATmega328P (2 KB RAM). Small member table, short
+ *   log lines, fewer and shorter pub/sub messages, a shorter drift history
+ *   and no relay support (the board has only one bus).
+ * - CONFIG_PROFILE_R4: UNO R4 (32 KB RAM). The full protocol limits.
+ * - CONFIG_PROFILE_SIM: PC simulation. Full limits, a large trace ring
+ *   shared by every simulated node, and timeline events.
+ *
+ * The profile follows the compiler target unless CONFIG_PROFILE is set
+ * (e.g. -DCONFIG_PROFILE=CONFIG_PROFILE_TINY to measure the ATmega layout on
+ * a PC, see `make size`).
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONFIG_PROFILE_TINY 1 /**< ATmega328P class, 2 KB RAM */
+#define CONFIG_PROFILE_R4 2   /**< UNO R4 class, 32 KB RAM */
+#define CONFIG_PROFILE_SIM 3  /**< PC simulation */
+
+#ifndef CONFIG_PROFILE
+#if defined(__AVR__)
+#define CONFIG_PROFILE CONFIG_PROFILE_TINY
+#elif defined(ARDUINO)
+#define CONFIG_PROFILE CONFIG_PROFILE_R4
+#else
+#define CONFIG_PROFILE CONFIG_PROFILE_SIM
+#endif
+#endif
+
+#if CONFIG_PROFILE == CONFIG_PROFILE_TINY
+#define CONFIG_NAME "tiny"
+#define CONFIG_NODE_MAX_DEDUP 12      /**< Members a coordinator remembers */
+#define CONFIG_NODE_RELAY 0           /**< Relay support (node_set_relay()) compiled in */
+#define CONFIG_NODE_RELAY_CACHE 4     /**< Recent frames a relay remembers */
+#define CONFIG_TIMESYNC_SAMPLES 5     /**< Time sync samples kept for the drift fit */
+#define CONFIG_MAC_TX_QUEUE 6         /**< Frames held for a slot */
+#define CONFIG_PUBSUB_MAX_MESSAGE 32  /**< Largest pub/sub message */
+#define CONFIG_PUBSUB_REASM_SLOTS 2   /**< Messages reassembled at once */
+#define CONFIG_PUBSUB_MAX_SUBS 4      /**< Topic subscriptions */
+#define CONFIG_LOG_MAX 80             /**< Longest formatted log line (see HAL_LOG_MAX) */
+#define CONFIG_TRACE_RING_SIZE 96     /**< Bytes of queued trace records */
+#define CONFIG_BUS_POOL 1             /**< Bus handles in the static pool */
+#define CONFIG_EVENTS 0               /**< Timeline events (HAL_EVENT()) compiled in */
+#elif CONFIG_PROFILE == CONFIG_PROFILE_R4
+#define CONFIG_NAME "r4"
+#define CONFIG_NODE_MAX_DEDUP 32
+#define CONFIG_NODE_RELAY 1
+#define CONFIG_NODE_RELAY_CACHE 16
+#define CONFIG_TIMESYNC_SAMPLES 8
+#define CONFIG_MAC_TX_QUEUE 8
+#define CONFIG_PUBSUB_MAX_MESSAGE 64
+#define CONFIG_PUBSUB_REASM_SLOTS 4
+#define CONFIG_PUBSUB_MAX_SUBS 8
+#define CONFIG_LOG_MAX 96
+#define CONFIG_TRACE_RING_SIZE 256
+#define CONFIG_BUS_POOL 1
+#define CONFIG_EVENTS 0
+#elif CONFIG_PROFILE == CONFIG_PROFILE_SIM
+#define CONFIG_NAME "sim"
+#define CONFIG_NODE_MAX_DEDUP 32
+#define CONFIG_NODE_RELAY 1
+#define CONFIG_NODE_RELAY_CACHE 16
+#define CONFIG_TIMESYNC_SAMPLES 8
+#define CONFIG_MAC_TX_QUEUE 8
+#define CONFIG_PUBSUB_MAX_MESSAGE 64
+#define CONFIG_PUBSUB_REASM_SLOTS 4
+#define CONFIG_PUBSUB_MAX_SUBS 8
+#define CONFIG_LOG_MAX 96
+#define CONFIG_TRACE_RING_SIZE 1024
+#define CONFIG_BUS_POOL 32
+#define CONFIG_EVENTS 1
+#else
+#error "Unknown CONFIG_PROFILE"
+#endif
+
+/**
+ * Carrier sense in the Arduino sketch (bus_set_csma()). 1 (the default)
+ * listens before talking until the coordinator hands out a TDMA schedule;
+ * 0 transmits at once as before, for TDMA-only deployments or a line shared
+ * with boards on older firmware. The simulator takes --csma instead.
+ */
+#ifndef CONFIG_CSMA
+#define CONFIG_CSMA 1
+#endif
+
+#endif  // CONFIG_H
@@ -17,11 +17,138 @@
 #define HAL_H
 
 #include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @name Log levels
+ *
+ * LOG_LEVEL selects at build time which of LOG_INFO() and LOG_DEBUG() are
+ * compiled in (the Makefile sets it from `make LOG_LEVEL=...`). Calls above
+ * the threshold are type-checked but generate no code, so per-frame debug
+ * output costs nothing in a release build.
+ * @{
+ */
+#define LOG_LEVEL_NONE 0  /**< No log output */
+#define LOG_LEVEL_INFO 1  /**< Role changes, assignments, sync results */
+#define LOG_LEVEL_DEBUG 2 /**< Per-frame tracing */
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * Longest formatted log line, including the terminator (per profile,
+ * config.h). Longer lines are cut off, so it must hold the longest line the
+ * core and the bus backends format: 74 characters for the coordinator's
+ * nonce comparison with two 10-digit nonces, 67 for a full frame's hex dump.
+ */
+#define HAL_LOG_MAX CONFIG_LOG_MAX
+
+/**
+ * Arguments of a log call as passed to hal_logf()/hal_trace(). On AVR the
+ * format string is moved to flash with PSTR(): otherwise every format string
+ * is copied into the 2 KB of RAM at startup. HAL_FMT_CHAR() reads one
+ * character of such a format. The trailing 0 only lets the macro split off
+ * the format without GNU extensions; nothing reads it.
+ */
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define HAL_LOG_ARGS(...) HAL_LOG_ARGS_P_(__VA_ARGS__, 0)
+#define HAL_LOG_ARGS_P_(fmt, ...) PSTR(fmt), __VA_ARGS__
+#define HAL_FMT_CHAR(p) ((char) pgm_read_byte(p))
+#else
+#define HAL_LOG_ARGS(...) __VA_ARGS__
+#define HAL_FMT_CHAR(p) (*(p))
+#endif
+
+/** Lets the compiler check log arguments against the format */
+#if defined(__GNUC__) && !defined(__AVR__)
+#define HAL_PRINTF_LIKE(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define HAL_PRINTF_LIKE(fmt, args)
+#endif
+
+#ifdef LOG_TRACE
+/**
+ * Binary trace build: log calls become hal_trace() records (see trace.h).
+ * Every source file that logs defines LOG_FILE_ID, a number unique in the
+ * firmware, after its includes; utilities/trace_table.py reads it back.
+ */
+#define HAL_LOG_ID ((uint16_t) (((uint16_t) LOG_FILE_ID << 11) | __LINE__))
+#define HAL_LOGF(...) hal_trace(HAL_LOG_ID, HAL_LOG_ARGS(__VA_ARGS__))
+#else
+/**
+ * Format a message and pass it to hal_log(). The line buffer lives in
+ * hal_logf(), not in every function that logs, so it is on the stack once.
+ */
+#define HAL_LOGF(...) hal_logf(HAL_LOG_ARGS(__VA_ARGS__))
+#endif
+
+/** Discard a message at compile time, keeping its arguments type-checked */
+#define HAL_LOG_NOTHING(...)         \
+    do {                             \
+        if (0) {                     \
+            HAL_LOGF(__VA_ARGS__);   \
+        }                            \
+    } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) HAL_LOGF(__VA_ARGS__)
+#else
+#define LOG_INFO(...) HAL_LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) HAL_LOGF(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) HAL_LOG_NOTHING(__VA_ARGS__)
+#endif
+/** @} */
+
+/**
+ * @name Timeline events
+ *
+ * HAL_EVENT() marks a point on the node's timeline: a role change, the
+ * start or end of one of the waits in the election and join process, a
+ * frame on the bus, or a retry. The simulation turns them into a trace
+ * viewer timeline (hal_event()); profiles without CONFIG_EVENTS compile the
+ * calls to nothing, so the boards pay neither flash nor time for them.
+ * @{
+ */
+
+/** @brief What a timeline event marks; a and b are the HAL_EVENT() arguments */
+typedef enum {
+    HAL_EVENT_ROLE = 0,      /**< Role changed: a = NodeRole, b = assigned ID */
+    HAL_EVENT_BEGIN = 1,     /**< A wait started: a = HalEventWait */
+    HAL_EVENT_END = 2,       /**< The latest wait ended: a = HalEventWait, b = 1 if it succeeded */
+    HAL_EVENT_TX = 3,        /**< Frame put on the line: a = type, b = airtime in µs */
+    HAL_EVENT_RX = 4,        /**< Frame received: a = type, b = source */
+    HAL_EVENT_COLLISION = 5, /**< Our frame overlapped another and was lost: a = type */
+    HAL_EVENT_RETRY = 6      /**< Frame sent again for lack of an answer or echo: a = type */
+} HalEvent;
+
+/** @brief Waits that HAL_EVENT_BEGIN and HAL_EVENT_END bracket */
+typedef enum {
+    HAL_WAIT_RECLAIM = 0, /**< For the coordinator to confirm a cached ID */
+    HAL_WAIT_JITTER = 1,  /**< Startup delay of 150ms per instance index */
+    HAL_WAIT_LISTEN = 2,  /**< For a CLAIM or HEARTBEAT from a running network */
+    HAL_WAIT_CLAIM = 3,   /**< For a higher CLAIM after ours (succeeded = we won) */
+    HAL_WAIT_JOIN = 4     /**< For the ASSIGN answering our JOIN */
+} HalEventWait;
+
+#if CONFIG_EVENTS
+#define HAL_EVENT(kind, a, b) hal_event((kind), (uint32_t) (a), (uint32_t) (b))
+#else
+#define HAL_EVENT(kind, a, b) ((void) 0)
+#endif
+/** @} */
+
 /**
  * @brief Initialize the hardware abstraction layer
  *
@@ -52,6 +179,34 @@ void hal_init(void);
  */
 uint32_t hal_millis(void);
 
+/**
+ * @brief Get the network-wide time in milliseconds
+ *
+ * Returns the node's estimate of the coordinator's clock. Until the node has
+ * synchronized (see timesync.h) this is the same as hal_millis(). Use it for
+ * cross-board latency measurements and slot-based scheduling.
+ *
+ * @return Estimated coordinator time in milliseconds
+ *
+ * Platform Examples:
+ * - Simulation: Per-node correction applied to the node's simulated clock
+ * - Arduino: Correction applied to millis()
+ */
+uint32_t hal_network_millis(void);
+
+/**
+ * @brief Set the correction that maps local time to network time
+ *
+ * After this call hal_network_millis() returns
+ * ref_network_ms + (hal_millis() - ref_local_ms) * (1 + drift_ppm / 1e6).
+ * Passing (0, 0, 0) resets the network clock to the local clock.
+ *
+ * @param ref_local_ms Local time (hal_millis()) of the reference point
+ * @param ref_network_ms Network time at the reference point
+ * @param drift_ppm How much faster the network clock runs than ours, in ppm
+ */
+void hal_set_network_clock(uint32_t ref_local_ms, uint32_t ref_network_ms, int32_t drift_ppm);
+
 /**
  * @brief Block for the specified number of milliseconds
  *
@@ -90,12 +245,28 @@ void hal_yield(void);
  * @return 32-bit pseudo-random value
  *
  * Platform Examples:
- * - Simulation: Combined rand() calls
- * - Arduino: Combined random() calls
+ * - Simulation: Per-node xoshiro128** generator (rng.h)
+ * - Arduino: xoshiro128** seeded from ADC noise and timer jitter
  * - ESP32: esp_random()
  */
 uint32_t hal_random32(void);
 
+/**
+ * @brief Seed the calling node's random number generator
+ *
+ * hal_init() seeds from whatever entropy the platform has. Call this
+ * afterwards to make hal_random32() repeat a known sequence, e.g. to rerun a
+ * test scenario bit for bit.
+ *
+ * @param seed Seed value (any value, including 0)
+ *
+ * Platform Examples:
+ * - Simulation: Generator of the node bound to the calling thread
+ *   (hal_sim_set_seed() seeds every node from one master seed)
+ * - Arduino: The board's generator
+ */
+void hal_random_seed(uint64_t seed);
+
 /**
  * @brief Log a message to the platform's output system
  *
@@ -111,6 +282,83 @@ uint32_t hal_random32(void);
  */
 void hal_log(const char* msg);
 
+/**
+ * @brief Format a message and log it with hal_log() (LOG_INFO()/LOG_DEBUG())
+ *
+ * Output longer than HAL_LOG_MAX - 1 characters is truncated.
+ *
+ * @param fmt printf-style format (in flash on AVR, see HAL_LOG_ARGS())
+ *
+ * Platform Examples:
+ * - Simulation: vsnprintf() into a stack buffer
+ * - Arduino: vsnprintf_P() on AVR, vsnprintf() elsewhere
+ */
+void hal_logf(const char* fmt, ...) HAL_PRINTF_LIKE(1, 2);
+
+/**
+ * @brief Load the network identity saved by hal_identity_store()
+ *
+ * Lets a node that was reset (e.g. by a brownout) try to reclaim its previous
+ * ID instead of repeating the full election and JOIN sequence.
+ *
+ * @param slot Storage slot, normally the node's instance index
+ * @param id Output: last assigned ID
+ * @param epoch Output: network epoch the ID was assigned in
+ * @return 1 if a valid identity was loaded, 0 if none is stored
+ *
+ * Platform Examples:
+ * - Simulation: Small text file per slot (when a directory is configured)
+ * - Arduino: EEPROM (emulated in data flash on the UNO R4)
+ * - ESP32: NVS key/value store
+ */
+int hal_identity_load(uint8_t slot, uint8_t* id, uint16_t* epoch);
+
+/**
+ * @brief Persist the node's network identity across resets
+ *
+ * Called whenever the node is assigned an ID. Storing ID 0 clears the slot.
+ * Implementations should skip the write when nothing changed to spare
+ * EEPROM/flash wear.
+ *
+ * @param slot Storage slot, normally the node's instance index
+ * @param id Assigned ID (0 = forget the identity)
+ * @param epoch Network epoch the ID was assigned in
+ */
+void hal_identity_store(uint8_t slot, uint8_t id, uint16_t epoch);
+
+/**
+ * @brief Queue a binary log record (LOG_TRACE builds)
+ *
+ * Encodes the call site ID, hal_millis() and the arguments with
+ * trace_encode() and appends the record to a ring buffer without waiting
+ * for the log output. The platform writes the ring out in idle time
+ * (hal_yield()); records that find the ring full are dropped and counted.
+ *
+ * @param id Call site ID (HAL_LOG_ID)
+ * @param fmt printf-style format, only used to learn the argument types (in
+ *            flash on AVR, read with HAL_FMT_CHAR())
+ *
+ * Platform Examples:
+ * - Simulation: Shared ring written to stdout
+ * - Arduino: Ring written to Serial as far as its transmit buffer has room
+ */
+void hal_trace(uint16_t id, const char* fmt, ...) HAL_PRINTF_LIKE(2, 3);
+
+/**
+ * @brief Record a timeline event of the calling node (HAL_EVENT())
+ *
+ * Only called in profiles with CONFIG_EVENTS. Must be cheap: it runs on the
+ * node's own thread, inside the waits it measures.
+ *
+ * @param kind What happened (HalEvent)
+ * @param a First argument, see HalEvent
+ * @param b Second argument, see HalEvent
+ *
+ * Platform Examples:
+ * - Simulation: Chrome trace-event JSON, one track per node (hal_sim_set_timeline())
+ */
+void hal_event(uint8_t kind, uint32_t a, uint32_t b);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,219 @@
+/**
+ * @file mac.c
+ * @brief TDMA slot arithmetic, transmit hold queue and CSMA backoff
+ *
+ * All timing is in network time, so boards agree on slot boundaries to
+ * within the time sync error; MAC_GUARD_MS at the end of each slot keeps a
+ * late sender from running into the next slot.
+ */
+
+#include "mac.h"
+
+#include <string.h>
+
+#include "hal.h"
+
+/**
+ * @brief Switch to the announced schedule once its start time has passed
+ */
+static void promote(MacTdma* mac, uint32_t now) {
+    if (mac->has_next && (int32_t) (now - mac->next.start_ms) >= 0) {
+        mac->current = mac->next;
+        mac->has_current = 1;
+        mac->has_next = 0;
+    }
+}
+
+static int same_schedule(const MacSchedule* a, const MacSchedule* b) {
+    return a->start_ms == b->start_ms && a->slot_ms == b->slot_ms &&
+           a->num_slots == b->num_slots && a->coord_units == b->coord_units;
+}
+
+uint8_t mac_slot_for_id(const MacSchedule* sched, uint8_t id) {
+    if (id == 1) {
+        return 0;
+    }
+    if (id < 2 || id >= sched->num_slots) {
+        return 1;  // Unassigned, or joined after the schedule was built
+    }
+    return id;
+}
+
+uint32_t mac_frame_ms(const MacSchedule* sched) {
+    return (uint32_t) (sched->num_slots - 1 + sched->coord_units) * sched->slot_ms;
+}
+
+void mac_tdma_init(MacTdma* mac) {
+    memset(mac, 0, sizeof(*mac));
+    mac->contend_ms = (uint8_t) hal_random32();
+}
+
+void mac_tdma_configure(MacTdma* mac, const MacSchedule* sched, uint8_t my_id, uint32_t now) {
+    mac->my_id = my_id;
+    if (!sched) {
+        mac->has_current = 0;
+        mac->has_next = 0;
+        return;
+    }
+    promote(mac, now);  // A due schedule must not be lost to its successor
+    if ((mac->has_current && same_schedule(&mac->current, sched)) ||
+        (mac->has_next && same_schedule(&mac->next, sched))) {
+        return;
+    }
+    mac->next = *sched;
+    mac->has_next = 1;
+    promote(mac, now);
+}
+
+int mac_tdma_active(MacTdma* mac, uint32_t now) {
+    promote(mac, now);
+    return mac->has_current;
+}
+
+uint32_t mac_tdma_wait_ms(MacTdma* mac, uint32_t now, uint16_t airtime_ms) {
+    if (!mac_tdma_active(mac, now)) {
+        return 0;
+    }
+
+    const MacSchedule* s = &mac->current;
+    uint32_t frame_len = mac_frame_ms(s);
+    uint32_t pos = (now - s->start_ms) % frame_len;
+
+    uint8_t slot = mac_slot_for_id(s, mac->my_id);
+    uint32_t begin = slot == 0 ? 0 : (uint32_t) (s->coord_units + slot - 1) * s->slot_ms;
+    uint32_t len = (uint32_t) (slot == 0 ? s->coord_units : 1) * s->slot_ms;
+
+    // The frame must finish a guard time before the slot ends
+    int32_t window = (int32_t) len - MAC_GUARD_MS - airtime_ms;
+    if (window < 1) {
+        window = 1;  // Frame longer than the slot: start it at the slot boundary
+    }
+
+    if (slot == 1 && window > 1) {
+        // Shared slot: start somewhere random in it rather than at the boundary
+        uint32_t offset = mac->contend_ms % (uint32_t) window;
+        begin += offset;
+        window -= (int32_t) offset;
+    }
+
+    if (pos >= begin && pos < begin + (uint32_t) window) {
+        return 0;
+    }
+    return (begin + frame_len - pos) % frame_len;
+}
+
+static int is_stream(const Frame* frame) {
+    return frame->type == MSG_DATA || frame->type == MSG_SYNC;
+}
+
+int mac_tdma_enqueue(MacTdma* mac, const Frame* frame) {
+    uint8_t limit = MAC_TX_QUEUE - 1;  // Last entry: heartbeats only
+    if (frame->type == MSG_HEARTBEAT) {
+        limit = MAC_TX_QUEUE;
+    } else if (is_stream(frame)) {
+        limit = MAC_TX_QUEUE - MAC_TX_RESERVED;  // Streams that resend on refusal
+    }
+    if (mac->count >= limit) {
+        return 0;
+    }
+
+    // Control frames overtake queued streams
+    uint8_t pos = mac->count;
+    if (!is_stream(frame)) {
+        while (pos > 0 && is_stream(&mac->queue[(mac->head + pos - 1) % MAC_TX_QUEUE])) {
+            pos--;
+        }
+        if (pos == 0 && mac->count) {
+            mac->csma.armed = 0;  // The backoff drawn belongs to the displaced frame
+            mac->csma.attempt = 0;
+        }
+    }
+    for (uint8_t i = mac->count; i > pos; --i) {
+        mac->queue[(mac->head + i) % MAC_TX_QUEUE] =
+            mac->queue[(mac->head + i - 1) % MAC_TX_QUEUE];
+    }
+    mac->queue[(mac->head + pos) % MAC_TX_QUEUE] = *frame;
+    mac->count++;
+    return 1;
+}
+
+Frame* mac_tdma_peek(MacTdma* mac) {
+    return mac->count ? &mac->queue[mac->head] : NULL;
+}
+
+void mac_tdma_pop(MacTdma* mac) {
+    if (mac->count) {
+        mac->head = (uint8_t) ((mac->head + 1) % MAC_TX_QUEUE);
+        mac->count--;
+        mac->contend_ms = (uint8_t) hal_random32();
+    }
+}
+
+/**
+ * @brief Coordinator control frames take the line first, like a Wi-Fi access point
+ */
+static int has_priority(const Frame* frame) {
+    return frame->source == 1 && frame->type != MSG_DATA;
+}
+
+uint16_t mac_csma_backoff_slots(const Frame* frame, uint8_t attempt) {
+    if (has_priority(frame) && attempt == 0) {
+        return 0;
+    }
+    // Control traffic draws from a smaller window so it wins most contests
+    uint8_t exp = frame->type == MSG_DATA ? MAC_CSMA_MIN_EXP : MAC_CSMA_MIN_EXP - 2;
+    exp = (uint8_t) (exp + attempt);
+    if (exp > MAC_CSMA_MAX_EXP) {
+        exp = MAC_CSMA_MAX_EXP;
+    }
+    return (uint16_t) (hal_random32() % (1UL << exp));
+}
+
+int mac_csma_step(MacCsma* csma, const Frame* frame, int idle) {
+    if (!csma->armed) {
+        csma->slots = mac_csma_backoff_slots(frame, csma->attempt);
+        csma->armed = 1;
+    }
+    if (!idle) {
+        csma->deferred = 0;
+        return 0;
+    }
+    if (!csma->deferred && !has_priority(frame)) {
+        csma->deferred = 1;  // Leave the first idle slot to the coordinator
+        return 0;
+    }
+    if (csma->slots) {
+        csma->slots--;
+        return 0;
+    }
+    return 1;
+}
+
+int mac_csma_sent(MacCsma* csma, int collided) {
+    csma->armed = 0;
+    csma->deferred = 0;
+    if (collided && csma->mode == MAC_CSMA_ECHO && ++csma->attempt < MAC_CSMA_MAX_ATTEMPTS) {
+        return 1;
+    }
+    csma->attempt = 0;
+    return 0;
+}
+
+uint8_t mac_schedule_encode(const MacSchedule* sched, uint8_t* payload) {
+    payload[0] = sched->slot_ms;
+    payload[1] = sched->num_slots;
+    payload[2] = sched->coord_units;
+    u32_to_bytes(sched->start_ms, &payload[3]);
+    return 7;
+}
+
+int mac_schedule_decode(const uint8_t* payload, uint8_t len, MacSchedule* sched) {
+    if (len < 7 || payload[0] == 0 || payload[1] < 2 || payload[2] == 0) {
+        return 0;
+    }
+    sched->slot_ms = payload[0];
+    sched->num_slots = payload[1];
+    sched->coord_units = payload[2];
+    sched->start_ms = bytes_to_u32(&payload[3]);
+    return 1;
+}
@@ -0,0 +1,263 @@
+/**
+ * @file mac.h
+ * @brief Medium access control: coordinator-scheduled TDMA
+ *
+ * On a shared UART line two boards that transmit at once corrupt both
+ * frames. In TDMA mode the coordinator divides network time (see
+ * timesync.h) into repeating frames of slots and gives each assigned ID its
+ * own slot, so members never talk over each other. The schedule is
+ * published in SCHEDULE messages and handed to the bus with bus_set_tdma();
+ * bus backends then hold outgoing frames in a small queue until the node's
+ * slot comes around.
+ *
+ * Slot layout of one TDMA frame:
+ * [Coordinator][Contention][ID 2][ID 3]...[ID num_slots - 1]
+ *
+ * - The coordinator slot is coord_units slots long: it answers every
+ *   member's TIME requests and carries all control traffic
+ * - The contention slot is shared by IDs the schedule does not cover yet;
+ *   each frame there starts at a random offset so two such nodes rarely
+ *   collide twice in a row
+ *
+ * SCHEDULE Payload (7 bytes):
+ * [Slot ms][Slots][Coordinator units][Start (4B)]
+ *
+ * - Start: network time at which the schedule takes effect. A new schedule
+ *   is announced ahead of time so every member switches together.
+ *
+ * Without a schedule, bus backends can use carrier sense instead
+ * (bus_set_csma()): wait until the line has been quiet for
+ * MAC_CSMA_IDLE_CHARS character times, back off a random number of
+ * backoff slots, and send only if the line is still quiet. The backoff
+ * window doubles with each attempt. Where the wiring loops our own
+ * transmission back to RX, MAC_CSMA_ECHO also compares the echo with what
+ * was sent and retries on a mismatch, i.e. a collision.
+ */
+
+#ifndef MAC_H
+#define MAC_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Frames a bus can hold while waiting for its slot (per profile, config.h) */
+#define MAC_TX_QUEUE CONFIG_MAC_TX_QUEUE
+
+/** Queue entries DATA and SYNC streams may not use, kept free for control traffic */
+#define MAC_TX_RESERVED 3
+
+/** Idle time left at the end of every slot to absorb clock error between boards */
+#define MAC_GUARD_MS 8
+
+/** Quiet time, in character times, that marks the line as idle */
+#define MAC_CSMA_IDLE_CHARS 2
+
+/** Length of one backoff slot, in character times */
+#define MAC_CSMA_SLOT_CHARS 2
+
+/** First backoff window is 2^MAC_CSMA_MIN_EXP slots */
+#define MAC_CSMA_MIN_EXP 5
+
+/** Backoff window stops doubling at 2^MAC_CSMA_MAX_EXP slots */
+#define MAC_CSMA_MAX_EXP 6
+
+/** Transmissions of one frame, including echo-detected collisions, before it is dropped */
+#define MAC_CSMA_MAX_ATTEMPTS 8
+
+/** @brief Carrier-sense mode for transmission outside TDMA */
+typedef enum {
+    MAC_CSMA_OFF = 0,  /**< Send immediately (fire and forget) */
+    MAC_CSMA_ON = 1,   /**< Listen before talk with random backoff */
+    MAC_CSMA_ECHO = 2  /**< As MAC_CSMA_ON, plus collision detection by reading back our echo */
+} MacCsmaMode;
+
+/** @brief Per-bus carrier-sense state for the frame at the head of the hold queue */
+typedef struct {
+    MacCsmaMode mode; /**< Carrier-sense mode (MAC_CSMA_OFF: send immediately) */
+    uint8_t attempt;  /**< Collisions detected so far for the head frame */
+    uint8_t armed;    /**< A backoff has been drawn for the head frame */
+    uint8_t deferred; /**< The line has been idle for one slot since it was last busy */
+    uint16_t slots;   /**< Idle backoff slots still to wait */
+} MacCsma;
+
+/** @brief TDMA frame schedule */
+typedef struct {
+    uint32_t start_ms;   /**< Network time at which the schedule takes effect */
+    uint8_t slot_ms;     /**< Length of one slot */
+    uint8_t num_slots;   /**< Slots per frame, including coordinator and contention slots */
+    uint8_t coord_units; /**< Length of the coordinator slot, in slots */
+} MacSchedule;
+
+/** @brief Per-bus MAC state: active schedule, our slot, carrier sense and the hold queue */
+typedef struct {
+    MacSchedule current; /**< Schedule in force */
+    MacSchedule next;    /**< Announced schedule waiting for its start time */
+    uint8_t has_current; /**< A schedule is in force (TDMA enabled) */
+    uint8_t has_next;    /**< A schedule is waiting for its start time */
+    uint8_t my_id;       /**< Our assigned ID (selects the slot) */
+    uint8_t contend_ms;  /**< Random start offset in the contention slot, redrawn per frame */
+    MacCsma csma;        /**< Carrier sense for the head frame, used when no schedule is in force */
+
+    Frame queue[MAC_TX_QUEUE]; /**< Frames waiting for our slot (or a quiet line) */
+    uint8_t head;              /**< Index of the oldest queued frame */
+    uint8_t count;             /**< Number of queued frames */
+} MacTdma;
+
+/**
+ * @brief Slot index used by an ID
+ *
+ * @param sched Schedule in force
+ * @param id Assigned ID (1 = coordinator, 0 = none)
+ * @return Slot index in the frame
+ */
+uint8_t mac_slot_for_id(const MacSchedule* sched, uint8_t id);
+
+/**
+ * @brief Length of one TDMA frame (time between two turns of the same slot)
+ *
+ * @param sched Schedule
+ * @return Frame length in milliseconds
+ */
+uint32_t mac_frame_ms(const MacSchedule* sched);
+
+/**
+ * @brief Reset TDMA state (disabled, empty queue)
+ *
+ * @param mac TDMA state
+ */
+void mac_tdma_init(MacTdma* mac);
+
+/**
+ * @brief Install a schedule (call from bus_set_tdma())
+ *
+ * A schedule whose start is still in the future waits until then; the one
+ * in force (or free transmission, if none) is used meanwhile. Installing the
+ * same schedule again is harmless.
+ *
+ * @param mac TDMA state
+ * @param sched New schedule, or NULL to disable TDMA
+ * @param my_id Our assigned ID
+ * @param now Current network time (hal_network_millis())
+ */
+void mac_tdma_configure(MacTdma* mac, const MacSchedule* sched, uint8_t my_id, uint32_t now);
+
+/**
+ * @brief Check whether TDMA currently governs transmission
+ *
+ * @param mac TDMA state
+ * @param now Current network time
+ * @return 1 if frames must wait for our slot, 0 if they may be sent freely
+ */
+int mac_tdma_active(MacTdma* mac, uint32_t now);
+
+/**
+ * @brief Time until a frame of the given airtime may start
+ *
+ * @param mac TDMA state
+ * @param now Current network time
+ * @param airtime_ms Time the frame occupies the line
+ * @return 0 if it may be sent now, otherwise milliseconds until our next slot
+ */
+uint32_t mac_tdma_wait_ms(MacTdma* mac, uint32_t now, uint16_t airtime_ms);
+
+/**
+ * @brief Hold a frame until our slot
+ *
+ * DATA and standby SYNC streams only get MAC_TX_QUEUE - MAC_TX_RESERVED
+ * entries so a busy publisher or table transfer cannot crowd out time sync
+ * replies, and the last entry is kept for HEARTBEAT: a dropped heartbeat
+ * looks like a dead coordinator to the standby. Control frames are queued
+ * ahead of any waiting DATA and SYNC frames for the same reason; a stream
+ * frame pushed back from the head starts its carrier-sense backoff afresh.
+ *
+ * @param mac TDMA state
+ * @param frame Frame to queue (copied)
+ * @return 1 if queued, 0 if the queue is full
+ */
+int mac_tdma_enqueue(MacTdma* mac, const Frame* frame);
+
+/**
+ * @brief Oldest queued frame
+ *
+ * @param mac TDMA state
+ * @return Frame to send next, or NULL if the queue is empty
+ */
+Frame* mac_tdma_peek(MacTdma* mac);
+
+/**
+ * @brief Remove the oldest queued frame (after sending it)
+ *
+ * @param mac TDMA state
+ */
+void mac_tdma_pop(MacTdma* mac);
+
+/**
+ * @brief Random backoff before a carrier-sense attempt
+ *
+ * Binary exponential backoff: uniform in [0, 2^(MAC_CSMA_MIN_EXP + attempt))
+ * slots for DATA, capped at 2^MAC_CSMA_MAX_EXP. Control frames start from a
+ * window a quarter that size: the coordinator has to answer every member,
+ * and a heartbeat stuck behind application traffic triggers a failover.
+ *
+ * @param frame Frame about to be sent
+ * @param attempt Collisions so far for this frame (0 for the first try)
+ * @return Backoff in slots of MAC_CSMA_SLOT_CHARS character times
+ */
+uint16_t mac_csma_backoff_slots(const Frame* frame, uint8_t attempt);
+
+/**
+ * @brief Advance carrier sense for the frame at the head of the hold queue
+ *
+ * Call once per backoff slot while a frame is held. The first call draws the
+ * backoff; each call that finds the line idle counts one slot down, and a
+ * busy line freezes the countdown, so nodes that lost a contest keep their
+ * place for the next one. After the line was busy, members let one idle slot
+ * pass before counting: the coordinator's control frames go in that slot,
+ * so they never collide with member traffic.
+ *
+ * @param csma Carrier-sense state
+ * @param frame Frame at the head of the queue
+ * @param idle Line has been quiet for MAC_CSMA_IDLE_CHARS character times
+ * @return 1 if the frame may be sent now, 0 to keep waiting
+ */
+int mac_csma_step(MacCsma* csma, const Frame* frame, int idle);
+
+/**
+ * @brief Record the outcome of sending the head frame
+ *
+ * @param csma Carrier-sense state
+ * @param collided The echo check saw a collision (always 0 without MAC_CSMA_ECHO)
+ * @return 1 if the frame must stay queued and be sent again, 0 to pop it
+ */
+int mac_csma_sent(MacCsma* csma, int collided);
+
+/**
+ * @brief Encode a schedule into a SCHEDULE payload
+ *
+ * @param sched Schedule
+ * @param payload Output buffer (at least 7 bytes)
+ * @return Payload length
+ */
+uint8_t mac_schedule_encode(const MacSchedule* sched, uint8_t* payload);
+
+/**
+ * @brief Decode a SCHEDULE payload
+ *
+ * @param payload Payload bytes
+ * @param len Payload length
+ * @param sched Output schedule
+ * @return 1 if the payload holds a usable schedule, 0 otherwise
+ */
+int mac_schedule_decode(const uint8_t* payload, uint8_t len, MacSchedule* sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MAC_H
@@ -4,7 +4,8 @@
  *
  * This file implements the heart of the distributed system - the node state machine
  * that handles coordinator election, member joining, and ID assignment. The code is
- * platform-agnostic and contains zero ifdefs.
+ * platform-agnostic; the only conditionals leave out relay support on profiles
+ * without CONFIG_NODE_RELAY.
  *
  * State Machine:
  * - SEEKING: Node is looking for a coordinator or trying to become one
@@ -14,39 +15,132 @@
 
 #include "node.h"
 
-#include <stdio.h>
 #include <string.h>
 
 #include "hal.h"
 
+#undef LOG_FILE_ID
+#define LOG_FILE_ID 1  // Binary trace call site IDs (hal.h)
+
 /**
- * @brief Check if coordinator has already seen a JOIN request nonce (deduplication)
- *
- * This prevents the coordinator from assigning multiple IDs to the same node
- * that might retransmit JOIN messages. Uses a simple ring buffer for storage.
+ * @brief Look up a JOIN request nonce in the coordinator's member table
  *
  * @param n Pointer to the coordinator node
- * @param nonce The JOIN request nonce to check
- * @return 1 if nonce was already seen, 0 if it's new (and now recorded)
+ * @param nonce The JOIN request nonce to look for
+ * @return Table index of the nonce, or -1 if it hasn't been seen
  */
-static int coordinator_seen_nonce(Node* n, uint32_t nonce) {
-    // Check if we've seen this nonce before
+static int coordinator_find_nonce(const Node* n, uint32_t nonce) {
+    if (nonce == 0) {
+        return -1;  // Marks entries re-added from a member's traffic (nonce unknown)
+    }
     for (uint8_t i = 0; i < n->seen_count; ++i) {
         if (n->seen_join_nonce[i] == nonce) {
-            return 1;  // Already seen - duplicate request
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Record a JOIN request nonce and the ID assigned to it
+ *
+ * The entries double as the member table replicated to the hot standby, so
+ * the table never forgets more than one entry at a time. A retired entry
+ * (ID 0) is reused first, then a free one. When the table is full, the entry
+ * idle for the most liveness sweeps is replaced, the oldest among equals
+ * (never the standby's). A replaced entry is streamed to the standby again.
+ *
+ * @param n Pointer to the coordinator node
+ * @param nonce The JOIN request nonce to record (0 = unknown)
+ * @param id The ID assigned for this nonce
+ * @return Table index of the new entry
+ */
+static uint8_t coordinator_record_nonce(Node* n, uint32_t nonce, uint8_t id) {
+    uint8_t slot = n->seen_count;
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == NODE_MAX_DEDUP) {
+        // Full: walk from the eviction cursor so equally idle entries go in turn
+        int best = -1;
+        for (uint8_t k = 0; k < NODE_MAX_DEDUP; ++k) {
+            uint8_t i = (uint8_t) ((n->seen_evict + k) % NODE_MAX_DEDUP);
+            if (n->seen_join_id[i] == n->standby_id) {
+                continue;
+            }
+            uint8_t idle = n->seen_idle[i] & NODE_SEEN_IDLE;
+            if (best < 0 || idle > (n->seen_idle[best] & NODE_SEEN_IDLE)) {
+                best = i;
+            }
+        }
+        slot = best < 0 ? n->seen_evict : (uint8_t) best;
+        n->seen_evict = (uint8_t) ((slot + 1) % NODE_MAX_DEDUP);
+    }
+
+    n->seen_join_nonce[slot] = nonce;
+    n->seen_join_id[slot] = id;
+    n->seen_idle[slot] = 0;
+    if (slot == n->seen_count) {
+        n->seen_count++;
+    } else if (n->sync_cursor > slot) {
+        n->sync_cursor = slot;  // Replicate the overwritten entry
+    }
+    return slot;
+}
+
+/**
+ * @brief Whether a member table entry belongs to a member heard recently
+ *
+ * @param n Pointer to the coordinator node
+ * @param i Member table index
+ */
+static int coordinator_entry_live(const Node* n, uint8_t i) {
+    return n->seen_join_id[i] >= 2 &&
+           (n->seen_idle[i] & NODE_SEEN_IDLE) < NODE_MEMBER_IDLE_SWEEPS;
+}
+
+/**
+ * @brief Pick the ID for a new member
+ *
+ * The lowest ID whose holder has gone silent is handed out again, so the ID
+ * range (and with it the TDMA frame) tracks the live members rather than
+ * every board that ever joined. Only IDs still in the member table are
+ * reused: for those we know the holder is gone. Their entries are retired.
+ *
+ * @param n Pointer to the coordinator node
+ * @param reused Output: 1 if the ID was held before
+ * @return The ID
+ */
+static uint8_t coordinator_next_id(Node* n, uint8_t* reused) {
+    uint8_t id = 0;
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        uint8_t candidate = n->seen_join_id[i];
+        if (candidate >= 2 && !coordinator_entry_live(n, i) && (id == 0 || candidate < id)) {
+            id = candidate;
         }
     }
+    for (uint8_t i = 0; id != 0 && i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == id && coordinator_entry_live(n, i)) {
+            id = 0;  // Rebound by a RECLAIM since: still in use
+        }
+    }
+    *reused = id != 0;
+    if (id == 0) {
+        return n->next_assign_id++;
+    }
 
-    // New nonce - record it for future deduplication
-    if (n->seen_count < NODE_MAX_DEDUP) {
-        // Still have space in the buffer
-        n->seen_join_nonce[n->seen_count++] = nonce;
-    } else {
-        // Buffer full - overwrite oldest entry (ring buffer behavior)
-        n->seen_join_nonce[n->seen_count % NODE_MAX_DEDUP] = nonce;
-        n->seen_count = (uint8_t) ((n->seen_count + 1) % NODE_MAX_DEDUP);
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == id) {
+            n->seen_join_id[i] = 0;
+            if (n->sync_cursor > i) {
+                n->sync_cursor = i;  // Replicate the retirement
+            }
+        }
     }
-    return 0;  // New nonce, now recorded
+    return id;
 }
 
 /**
@@ -80,6 +174,296 @@ static void make_frame(Frame* f, MessageType type, uint8_t source, const void* p
     proto_finalize(f);
 }
 
+#if CONFIG_NODE_RELAY
+/**
+ * @brief Does a relay carry this message type to the other bus?
+ *
+ * Only the control plane (HELLO to RECLAIM) floods. Data, time sync and
+ * TDMA schedules are timed for the bus they were sent on.
+ */
+static int relay_forwards(uint8_t type) {
+    return type >= MSG_HELLO && type <= MSG_RECLAIM;
+}
+
+/**
+ * @brief The nonce that tells two frames from one source apart
+ *
+ * HELLO, CLAIM, JOIN, ASSIGN and RECLAIM carry a request nonce. A
+ * coordinator's CLAIM defense is keyed on the challenger's nonce it echoes,
+ * so each defense counts as its own frame. For the other types the payload
+ * is hashed (FNV-1a), so e.g. each member table delta counts as its own frame.
+ *
+ * @param f Valid control frame with the hop count cleared
+ * @return Nonce to key the duplicate cache on
+ */
+static uint32_t relay_nonce(const Frame* f) {
+    if (f->type == MSG_CLAIM && f->payload_len >= 8) {
+        return bytes_to_u32(&f->payload[4]);
+    }
+    if ((f->type == MSG_HELLO || f->type == MSG_CLAIM || f->type == MSG_JOIN) &&
+        f->payload_len >= 4) {
+        return bytes_to_u32(f->payload);
+    }
+    if (f->type == MSG_ASSIGN && f->payload_len >= 5) {
+        return bytes_to_u32(&f->payload[1]);
+    }
+    if (f->type == MSG_RECLAIM && f->payload_len >= 7) {
+        return bytes_to_u32(&f->payload[3]);
+    }
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < f->payload_len; ++i) {
+        hash = (hash ^ f->payload[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Look a frame up in the relay's duplicate cache and record it
+ *
+ * A small LRU table: a hit refreshes the entry, a miss takes a free entry
+ * or the least recently seen one.
+ *
+ * @param n Pointer to the relay node
+ * @param f Valid frame with the hop count cleared
+ * @return 1 if the frame was seen in the last NODE_RELAY_DEDUP_MS, 0 otherwise
+ */
+static int relay_seen(Node* n, const Frame* f) {
+    uint32_t nonce = relay_nonce(f);
+    uint32_t now = hal_millis();
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < n->relay_seen_count; ++i) {
+        NodeRelaySeen* e = &n->relay_seen[i];
+        if (e->nonce == nonce && e->source == f->source && e->type == f->type) {
+            int duplicate = (now - e->seen_ms) < NODE_RELAY_DEDUP_MS;
+            e->seen_ms = now;
+            return duplicate;
+        }
+        if ((now - e->seen_ms) > (now - n->relay_seen[victim].seen_ms)) {
+            victim = i;
+        }
+    }
+    if (n->relay_seen_count < NODE_RELAY_CACHE) {
+        victim = n->relay_seen_count++;
+    }
+    n->relay_seen[victim].nonce = nonce;
+    n->relay_seen[victim].seen_ms = now;
+    n->relay_seen[victim].source = f->source;
+    n->relay_seen[victim].type = f->type;
+    return 0;
+}
+
+/**
+ * @brief Copy a control frame onto a relay's other bus, one hop further
+ *
+ * @param n Pointer to the relay node
+ * @param to Bus to copy it onto
+ * @param f Control frame with the hop count cleared
+ * @param hops Relays it had crossed when we heard it
+ */
+static void relay_forward(Node* n, Bus* to, const Frame* f, uint8_t hops) {
+    if (hops >= n->relay_max_hops) {
+        n->relay_hop_limited++;
+        return;
+    }
+    Frame copy = *f;
+    proto_set_hops(&copy, (uint8_t) (hops + 1));
+    bus_send(to, &copy);
+    n->relay_forwarded++;
+}
+#endif
+
+/**
+ * @brief Send a frame on the node's bus, and across the relay if we are one
+ *
+ * @param n Pointer to the node
+ * @param f Finalized frame
+ * @return What bus_send() returned for our own bus
+ */
+static int node_send(Node* n, const Frame* f) {
+    int sent = bus_send(n->bus, f);
+#if CONFIG_NODE_RELAY
+    if (n->relay_bus && sent == 1 && relay_forwards(proto_type(f))) {
+        relay_seen(n, f);  // So the copy that comes back is recognized
+        relay_forward(n, n->relay_bus, f, 0);
+    }
+#endif
+    return sent;
+}
+
+/**
+ * @brief Check a received frame and do a relay's work on it
+ *
+ * Only control frames go through the duplicate cache; everything else is
+ * handed to the state machine as it came.
+ *
+ * @param n Pointer to the node
+ * @param f Frame received; the hop count is cleared if it is valid
+ * @param from Bus it arrived on
+ * @return 1 if the state machine should handle it, 0 if invalid or a duplicate
+ */
+static int node_accept(Node* n, Frame* f, Bus* from) {
+    if (!proto_is_valid(f)) {
+        return 0;
+    }
+    uint8_t hops = proto_hops(f);
+    if (hops) {
+        proto_set_hops(f, 0);
+    }
+#if CONFIG_NODE_RELAY
+    if (n->relay_bus && relay_forwards(proto_type(f))) {
+        if (relay_seen(n, f)) {
+            n->relay_duplicates++;
+            return 0;
+        }
+        relay_forward(n, from == n->bus ? n->relay_bus : n->bus, f, hops);
+    }
+#else
+    (void) n;
+    (void) from;
+#endif
+    return 1;
+}
+
+/**
+ * @brief Receive the next frame for the state machine
+ *
+ * Skips invalid frames and clears the hop count, so f->type is the plain
+ * message type. A relay waits on both buses, forwarding what it hears and
+ * dropping duplicates before the state machine sees them.
+ *
+ * @param n Pointer to the node
+ * @param f Output: the frame received
+ * @param timeout_ms How long to wait for one
+ * @return 1 if a frame was received, 0 on timeout
+ */
+static int node_recv(Node* n, Frame* f, uint16_t timeout_ms) {
+#if !CONFIG_NODE_RELAY
+    uint32_t start = hal_millis();
+    for (;;) {
+        uint32_t waited = hal_millis() - start;
+        uint16_t left = waited < timeout_ms ? (uint16_t) (timeout_ms - waited) : 0;
+        if (!bus_recv(n->bus, f, left)) {
+            return 0;
+        }
+        if (node_accept(n, f, n->bus)) {
+            return 1;
+        }
+    }
+#else
+    uint32_t start = hal_millis();
+    for (;;) {
+        uint32_t waited = hal_millis() - start;
+        uint16_t left = waited < timeout_ms ? (uint16_t) (timeout_ms - waited) : 0;
+        Bus* from = n->bus;
+        int got;
+        if (!n->relay_bus) {
+            got = bus_recv(n->bus, f, left);
+        } else if (bus_recv(n->relay_bus, f, 0)) {
+            from = n->relay_bus;
+            got = 1;
+        } else {
+            got = bus_recv(n->bus, f, left < NODE_RELAY_POLL_MS ? left : NODE_RELAY_POLL_MS);
+        }
+        if (got && node_accept(n, f, from)) {
+            return 1;
+        }
+        if (!got && (!n->relay_bus || left == 0)) {
+            return 0;
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Send an ASSIGN frame to a joining (or reclaiming) member
+ *
+ * Payload: [id][request nonce (4B)][epoch (2B)]
+ *
+ * @param n Pointer to the coordinator node
+ * @param id ID being assigned
+ * @param nonce Nonce from the JOIN/RECLAIM request, echoed back
+ */
+static void coordinator_send_assign(Node* n, uint8_t id, uint32_t nonce) {
+    uint8_t payload[7];
+    payload[0] = id;                        // Assigned ID
+    u32_to_bytes(nonce, &payload[1]);       // Echo back the request nonce
+    payload[5] = (uint8_t) (n->epoch >> 8);  // Network epoch, for the member's identity cache
+    payload[6] = (uint8_t) n->epoch;
+
+    Frame assign;
+    make_frame(&assign, MSG_ASSIGN, 1, payload, 7);
+    node_send(n, &assign);
+}
+
+/**
+ * @brief Accept an ASSIGN addressed to us and persist the new identity
+ *
+ * @param n Pointer to the seeking node
+ * @param in Valid ASSIGN frame whose echoed nonce matches our request
+ */
+static void member_accept_assign(Node* n, const Frame* in) {
+    n->assigned_id = in->payload[0];
+    if (in->payload_len >= 7) {
+        n->epoch = (uint16_t) ((in->payload[5] << 8) | in->payload[6]);
+    }
+    n->role = NODE_MEMBER;
+    HAL_EVENT(HAL_EVENT_ROLE, NODE_MEMBER, n->assigned_id);
+    hal_identity_store(n->instance_index, n->assigned_id, n->epoch);
+    if (n->has_schedule) {
+        bus_set_tdma(n->bus, &n->schedule, n->assigned_id);  // Move to our own slot
+    }
+}
+
+/**
+ * @brief Try to reclaim an ID persisted before a reset
+ *
+ * Sends a RECLAIM with the cached ID and epoch. The coordinator confirms with
+ * a normal ASSIGN (same ID, our fresh nonce) if the epoch still matches, so
+ * a rebooted member is back in one round trip. If nothing arrives within
+ * NODE_RECLAIM_WINDOW_MS the caller falls back to the full election/JOIN.
+ *
+ * @param n Pointer to the node (state already reset by node_begin())
+ * @return 1 if the ID was reclaimed and the node is now a MEMBER, 0 otherwise
+ */
+static int node_try_reclaim(Node* n) {
+    uint8_t id;
+    uint16_t epoch;
+    if (!hal_identity_load(n->instance_index, &id, &epoch) || id < 2) {
+        return 0;  // Nothing cached, or we were coordinator (ID 1 is never reclaimed)
+    }
+
+    n->join_nonce = hal_random32();
+    uint8_t payload[7];
+    payload[0] = id;
+    payload[1] = (uint8_t) (epoch >> 8);
+    payload[2] = (uint8_t) epoch;
+    u32_to_bytes(n->join_nonce, &payload[3]);
+    Frame reclaim;
+    make_frame(&reclaim, MSG_RECLAIM, 0, payload, 7);
+    node_send(n, &reclaim);
+
+    LOG_INFO("RECLAIM id=%u epoch=%u", id, epoch);
+
+    Frame in;
+    uint32_t start = hal_millis();
+    HAL_EVENT(HAL_EVENT_BEGIN, HAL_WAIT_RECLAIM, 0);
+    while ((hal_millis() - start) < NODE_RECLAIM_WINDOW_MS) {
+        if (node_recv(n, &in, 50) && in.type == MSG_ASSIGN && in.payload_len >= 5 &&
+            bytes_to_u32(&in.payload[1]) == n->join_nonce) {
+            HAL_EVENT(HAL_EVENT_END, HAL_WAIT_RECLAIM, 1);
+            member_accept_assign(n, &in);
+
+            LOG_INFO("RECLAIM confirmed → MEMBER (ID=%u) in %lums", n->assigned_id,
+                     (unsigned long) (hal_millis() - start));
+            return 1;
+        }
+    }
+
+    HAL_EVENT(HAL_EVENT_END, HAL_WAIT_RECLAIM, 0);
+    LOG_INFO("RECLAIM not confirmed - falling back to election");
+    return 0;
+}
+
 /**
  * @brief Initialize a node with its bus connection and instance index
  *
@@ -99,6 +483,67 @@ void node_init(Node* n, Bus* bus, uint8_t instance_index) {
     n->instance_index = instance_index;
 }
 
+/**
+ * @brief Register the application data plane hook
+ *
+ * @param n Pointer to the node
+ * @param handler Callback for MSG_DATA frames (NULL to drop them)
+ * @param ctx User context passed to the callback
+ */
+void node_set_data_handler(Node* n, NodeDataHandler handler, void* ctx) {
+    n->data_handler = handler;
+    n->data_ctx = ctx;
+}
+
+/**
+ * @brief Enable coordinator-scheduled TDMA bus access
+ *
+ * @param n Pointer to the node
+ * @param slot_ms Slot length in milliseconds (0 = free transmission)
+ */
+void node_set_tdma(Node* n, uint8_t slot_ms) {
+    n->tdma_slot_ms = slot_ms;
+}
+
+#if CONFIG_NODE_RELAY
+/**
+ * @brief Make the node a relay between its own bus and a second one
+ *
+ * @param n Pointer to the node
+ * @param second Second bus (NULL = stop relaying)
+ * @param max_hops Hop limit (clamped to PROTO_MAX_HOPS)
+ */
+void node_set_relay(Node* n, Bus* second, uint8_t max_hops) {
+    n->relay_bus = second;
+    n->relay_max_hops = max_hops > PROTO_MAX_HOPS ? PROTO_MAX_HOPS : max_hops;
+    n->relay_seen_count = 0;
+}
+#endif
+
+/**
+ * @brief Length of the coordinator slot for a schedule of num_slots slots
+ */
+static uint8_t coord_units_for(uint8_t num_slots) {
+    return (uint8_t) (1 + (num_slots - 2) / NODE_MEMBERS_PER_COORD_SLOT);
+}
+
+/**
+ * @brief How long node_begin() listens for a coordinator, and for a CLAIM defense
+ *
+ * A coordinator only talks in its own slot, so with TDMA configured the
+ * windows cover the longest frame a coordinator can schedule.
+ *
+ * @param n Pointer to the node
+ */
+static uint32_t node_listen_ms(const Node* n) {
+    MacSchedule longest;
+    longest.slot_ms = n->tdma_slot_ms;
+    longest.num_slots = NODE_MAX_SLOTS;
+    longest.coord_units = coord_units_for(NODE_MAX_SLOTS);
+    uint32_t frame_ms = mac_frame_ms(&longest);
+    return frame_ms > NODE_LISTEN_MS ? frame_ms : NODE_LISTEN_MS;
+}
+
 /**
  * @brief Start the node and begin the coordinator election process
  *
@@ -112,80 +557,105 @@ void node_init(Node* n, Bus* bus, uint8_t instance_index) {
  * @param n Pointer to the initialized node
  */
 void node_begin(Node* n) {
-    // Add startup jitter to prevent all nodes from starting simultaneously
-    // Each node waits 150ms * instance_index before proceeding
-    hal_delay((uint32_t) n->instance_index * 150);
-
     // Initialize node state for the election process
     n->role = NODE_SEEKING;
+    HAL_EVENT(HAL_EVENT_ROLE, NODE_SEEKING, 0);
     n->assigned_id = 0;
+    n->epoch = 0;
     n->random_nonce = hal_random32();  // For tie-breaking in coordinator election
     n->seen_count = 0;
+    n->seen_evict = 0;
+    n->standby_id = 0;
+    n->sync_cursor = 0;
+    n->is_standby = 0;
+    n->last_heartbeat_ms = 0;
+    n->last_sweep_ms = hal_millis();
+    n->standby_heard_ms = 0;
     n->last_join_ms = 0;
+    timesync_init(&n->timesync);
+    n->has_schedule = 0;
+    bus_set_tdma(n->bus, NULL, 0);  // Transmit freely until a schedule is known
     n->in_election = 1;  // Prevent node_service() from consuming messages during election
 
-    // Phase 1: Listen for existing CLAIM messages (500ms window - increased for reliability)
+    // Fast path: a rebooted member reclaims its cached ID in one round trip
+    if (node_try_reclaim(n)) {
+        n->in_election = 0;
+        return;
+    }
+
+    // Add startup jitter to prevent all nodes from starting simultaneously
+    // Each node waits 150ms * instance_index before proceeding
+    HAL_EVENT(HAL_EVENT_BEGIN, HAL_WAIT_JITTER, 0);
+    hal_delay((uint32_t) n->instance_index * 150);
+    HAL_EVENT(HAL_EVENT_END, HAL_WAIT_JITTER, 1);
+
+    // Phase 1: Listen for existing CLAIM messages (node_listen_ms())
     // This detects if another node is already trying to become coordinator
     Frame in;
     int heard_claim = 0;
     uint32_t listen_start = hal_millis();
-    uint32_t listen_end = listen_start + 1000;
+    uint32_t listen_end = listen_start + node_listen_ms(n);
     uint32_t last_debug = 0;
 
+    HAL_EVENT(HAL_EVENT_BEGIN, HAL_WAIT_LISTEN, 0);
     while (hal_millis() < listen_end) {
         uint32_t now = hal_millis();
         
         // Debug output every 100ms during listen phase
         if (now - last_debug >= 100) {
-            char debug_msg[64];
-            snprintf(debug_msg, sizeof(debug_msg), "DEBUG: Listening for CLAIM... elapsed=%ums", now - listen_start);
-            hal_log(debug_msg);
+            LOG_DEBUG("DEBUG: Listening for CLAIM... elapsed=%lums",
+                      (unsigned long) (now - listen_start));
             last_debug = now;
         }
         
-        if (bus_recv(n->bus, &in, 50)) {
-            if (proto_is_valid(&in) && in.type == MSG_CLAIM) {
-                hal_log("DEBUG: *** HEARD CLAIM MESSAGE! *** Breaking out of listen phase");
+        if (node_recv(n, &in, 50)) {
+            // A HEARTBEAT means a coordinator is already running - treat it like a
+            // CLAIM. So does any frame from a node with an ID: with TDMA the
+            // coordinator's slot may come round only after this window, but
+            // members talk in their own slots in between.
+            if (in.type == MSG_SCHEDULE && in.source == 1 &&
+                mac_schedule_decode(in.payload, in.payload_len, &n->schedule)) {
+                n->has_schedule = 1;
+                bus_set_tdma(n->bus, &n->schedule, 0);  // JOIN in the contention slot
+            }
+            if (in.type == MSG_CLAIM || in.type == MSG_HEARTBEAT || in.source != 0) {
+                LOG_DEBUG("DEBUG: *** HEARD CLAIM MESSAGE! *** Breaking out of listen phase");
                 heard_claim = 1;
                 break;
             } else {
-                char debug_msg[64];
-                snprintf(debug_msg, sizeof(debug_msg), "DEBUG: Received non-CLAIM frame during listen: type=%d", in.type);
-                hal_log(debug_msg);
+                LOG_DEBUG("DEBUG: Received non-CLAIM frame during listen: type=%d", in.type);
             }
         }
         hal_yield();  // Allow other tasks to run while waiting
     }
+    HAL_EVENT(HAL_EVENT_END, HAL_WAIT_LISTEN, heard_claim);
     
-    char debug_msg[80];
-    snprintf(debug_msg, sizeof(debug_msg), "DEBUG: Listen phase complete. Duration=%ums, heard_claim=%d", 
-             hal_millis() - listen_start, heard_claim);
-    hal_log(debug_msg);
+    LOG_DEBUG("DEBUG: Listen phase complete. Duration=%lums, heard_claim=%d",
+              (unsigned long) (hal_millis() - listen_start), heard_claim);
 
     // Phase 2: Coordinator Election
     if (!heard_claim) {
-        hal_log("DEBUG: No CLAIM heard - proceeding to send our CLAIM");
+        LOG_DEBUG("DEBUG: No CLAIM heard - proceeding to send our CLAIM");
         // No existing coordinator detected - attempt to claim the role
         uint8_t payload[4];
         u32_to_bytes(n->random_nonce, payload);
         Frame claim;
         make_frame(&claim, MSG_CLAIM, 0, payload, 4);
-        hal_log("DEBUG: About to send CLAIM message");
-        bus_send(n->bus, &claim);
+        LOG_DEBUG("DEBUG: About to send CLAIM message");
+        node_send(n, &claim);
 
-        char msg[64];
-        snprintf(msg, sizeof(msg), "Node[%u] CLAIM nonce=%u", n->instance_index, n->random_nonce);
-        hal_log(msg);
+        LOG_INFO("Node[%u] CLAIM nonce=%lu", n->instance_index,
+                 (unsigned long) n->random_nonce);
 
-        // Phase 3: Conflict Detection Window (1000ms)
+        // Phase 3: Conflict Detection Window (node_listen_ms())
         // If another node claims with a higher nonce, we yield to them
         // Extended timeout for ATmega328P: coordinator takes ~60-90ms to respond + bus delays
         int lost = 0;
-        uint32_t conflict_end = hal_millis() + 1000;
+        uint32_t conflict_end = hal_millis() + node_listen_ms(n);
 
+        HAL_EVENT(HAL_EVENT_BEGIN, HAL_WAIT_CLAIM, 0);
         while (hal_millis() < conflict_end) {
-            if (bus_recv(n->bus, &in, 50) && proto_is_valid(&in) && in.type == MSG_CLAIM &&
-                in.payload_len >= 4) {
+            if (node_recv(n, &in, 50) && in.type == MSG_CLAIM && in.payload_len >= 4) {
                 uint32_t other_nonce = bytes_to_u32(in.payload);
                 // If we hear a CLAIM from source ID 1 (the canonical coordinator ID), yield immediately.
                 // This prevents taking over when a coordinator is already established, regardless of nonce.
@@ -201,16 +671,22 @@ void node_begin(Node* n) {
             }
             hal_yield();
         }
+        HAL_EVENT(HAL_EVENT_END, HAL_WAIT_CLAIM, !lost);
 
         // Phase 4: Coordinator Role Assignment
         if (!lost) {
             // We won the election - become coordinator
             n->role = NODE_COORDINATOR;
+            HAL_EVENT(HAL_EVENT_ROLE, NODE_COORDINATOR, 1);
             n->assigned_id = 1;     // Coordinator always gets ID 1
             n->next_assign_id = 2;  // Next ID to assign to members
+            n->epoch = (uint16_t) hal_random32();  // New network, new epoch
+            if (n->epoch == 0) {
+                n->epoch = 1;  // 0 means "unknown"
+            }
+            hal_identity_store(n->instance_index, n->assigned_id, n->epoch);
 
-            snprintf(msg, sizeof(msg), "Node[%u] → COORDINATOR (ID=1)", n->instance_index);
-            hal_log(msg);
+            LOG_INFO("Node[%u] → COORDINATOR (ID=1)", n->instance_index);
         }
     }
 
@@ -218,29 +694,422 @@ void node_begin(Node* n) {
     if (n->role == NODE_SEEKING) {
         // We didn't become coordinator - join as a member
 
-        // Send HELLO to announce our presence
-        Frame hello;
-        make_frame(&hello, MSG_HELLO, 0, NULL, 0);
-        bus_send(n->bus, &hello);
-        hal_log("HELLO");
-
-        // Send JOIN request with a unique nonce
+        // Send HELLO to announce our presence, with the nonce of the JOIN that
+        // follows so relays can tell one node's HELLO from another's
         n->join_nonce = hal_random32();
         uint8_t payload[4];
         u32_to_bytes(n->join_nonce, payload);
+        Frame hello;
+        make_frame(&hello, MSG_HELLO, 0, payload, 4);
+        node_send(n, &hello);
+        LOG_INFO("HELLO");
+
+        // Send JOIN request with a unique nonce
         Frame join;
         make_frame(&join, MSG_JOIN, 0, payload, 4);
-        bus_send(n->bus, &join);
+        node_send(n, &join);
         n->last_join_ms = hal_millis();
+        n->join_jitter_ms = (uint8_t) (hal_random32() % NODE_JOIN_JITTER_MS);
+        HAL_EVENT(HAL_EVENT_BEGIN, HAL_WAIT_JOIN, 0);  // Ends when the ASSIGN arrives
 
-        char msg[64];
-        snprintf(msg, sizeof(msg), "JOIN (nonce=%u)", n->join_nonce);
-        hal_log(msg);
+        LOG_INFO("JOIN (nonce=%lu)", (unsigned long) n->join_nonce);
     }
     
     n->in_election = 0;  // Allow node_service() to process messages now
 }
 
+/**
+ * @brief Keep the TDMA schedule in step with the member table and publish it
+ *
+ * Every live member ID gets a slot, up to the highest one and at most
+ * NODE_MAX_SLOTS in all: members not heard for a few liveness sweeps give
+ * theirs up, and their IDs go to the next members that join, so churn does
+ * not stretch the frame. When that
+ * changes, a new schedule is announced NODE_SCHEDULE_LEAD_MS ahead so
+ * members switch together. The schedule rides along with every heartbeat:
+ * nodes that are still joining transmit blind until they hear it, and blind
+ * frames are what collide.
+ *
+ * @param n Pointer to the coordinator node
+ */
+static void coordinator_send_schedule(Node* n) {
+    if (n->tdma_slot_ms == 0) {
+        return;
+    }
+
+    uint8_t num_slots = 2;
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (coordinator_entry_live(n, i) && n->seen_join_id[i] >= num_slots) {
+            num_slots = (uint8_t) (n->seen_join_id[i] + 1);
+        }
+    }
+    if (num_slots > NODE_MAX_SLOTS) {
+        num_slots = NODE_MAX_SLOTS;  // Higher IDs share the contention slot
+    }
+    uint8_t coord_units = coord_units_for(num_slots);
+    uint32_t now = hal_network_millis();
+
+    // Let an announced schedule take effect before replacing it, or a burst
+    // of JOINs would keep pushing its start time out
+    int pending = n->has_schedule && (int32_t) (now - n->schedule.start_ms) < 0;
+    if (!pending && (!n->has_schedule || n->schedule.num_slots != num_slots ||
+                     n->schedule.slot_ms != n->tdma_slot_ms)) {
+        n->schedule.slot_ms = n->tdma_slot_ms;
+        n->schedule.num_slots = num_slots;
+        n->schedule.coord_units = coord_units;
+        // Nobody follows a first schedule yet, so it can start right away
+        n->schedule.start_ms = n->has_schedule ? now + NODE_SCHEDULE_LEAD_MS : now;
+        n->has_schedule = 1;
+
+        LOG_INFO("TDMA schedule: %u slots of %ums", num_slots, n->tdma_slot_ms);
+    }
+    bus_set_tdma(n->bus, &n->schedule, 1);
+
+    uint8_t payload[7];
+    Frame sched;
+    make_frame(&sched, MSG_SCHEDULE, 1, payload, mac_schedule_encode(&n->schedule, payload));
+    node_send(n, &sched);
+}
+
+/**
+ * @brief Broadcast a coordinator HEARTBEAT and (re)designate the hot standby
+ *
+ * The standby is the lowest assigned member ID in the member table. The
+ * heartbeat tells it which table size and next ID to expect, so it can ask
+ * for any deltas it missed.
+ *
+ * Payload: [standby_id][next_assign_id][table_count][epoch (2B)]
+ *
+ * @param n Pointer to the coordinator node
+ */
+static void coordinator_send_heartbeat(Node* n) {
+    if (n->standby_id == 0) {
+        for (uint8_t i = 0; i < n->seen_count; ++i) {
+            uint8_t id = n->seen_join_id[i];
+            if (id != 0 && (n->standby_id == 0 || id < n->standby_id)) {
+                n->standby_id = id;
+            }
+        }
+        if (n->standby_id != 0) {
+            n->sync_cursor = 0;  // Stream the full table to the new standby
+            n->standby_heard_ms = hal_millis();
+
+            LOG_INFO("STANDBY → id=%u", n->standby_id);
+        }
+    }
+
+    // The schedule goes first: members answer the heartbeat straight away
+    // and, before TDMA is running, would talk over anything sent after it
+    coordinator_send_schedule(n);
+
+    uint8_t payload[5];
+    payload[0] = n->standby_id;
+    payload[1] = n->next_assign_id;
+    payload[2] = n->seen_count;
+    payload[3] = (uint8_t) (n->epoch >> 8);
+    payload[4] = (uint8_t) n->epoch;
+
+    Frame hb;
+    make_frame(&hb, MSG_HEARTBEAT, 1, payload, 5);
+    node_send(n, &hb);
+    n->last_heartbeat_ms = hal_millis();
+}
+
+/**
+ * @brief Retire a hot standby that stopped answering heartbeats
+ *
+ * Its member table entry is retired so the next heartbeat names the
+ * next-lowest live ID instead. Should the board come back after a reset it
+ * can still RECLAIM its ID.
+ *
+ * @param n Pointer to the coordinator node
+ */
+static void coordinator_drop_standby(Node* n) {
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == n->standby_id) {
+            n->seen_join_id[i] = 0;
+        }
+    }
+
+    LOG_INFO("STANDBY id=%u silent → retired", n->standby_id);
+
+    n->standby_id = 0;
+}
+
+/**
+ * @brief Stream one member table entry to the hot standby
+ *
+ * Entries go out one per service pass so a large table never stalls the
+ * coordinator. New assignments are appended to the table and therefore
+ * streamed as incremental deltas.
+ *
+ * Payload: [index][id][join_nonce (4B)]
+ *
+ * @param n Pointer to the coordinator node
+ */
+static void coordinator_send_sync(Node* n) {
+    uint8_t i = n->sync_cursor;
+    uint8_t payload[6];
+    payload[0] = i;
+    payload[1] = n->seen_join_id[i];
+    u32_to_bytes(n->seen_join_nonce[i], &payload[2]);
+
+    Frame sync;
+    make_frame(&sync, MSG_SYNC, 1, payload, 6);
+    if (node_send(n, &sync) == 1) {
+        n->sync_cursor++;  // Retry next pass if the TDMA queue was full
+    }
+}
+
+/**
+ * @brief Handle a coordinator frame on a member (heartbeat, time and replication)
+ *
+ * Every member tracks heartbeats, time sync replies and the TDMA schedule.
+ * The member named as standby also keeps a replica of the member table:
+ * entries are accepted in order, and it answers every heartbeat with the
+ * size of its replica. That answer doubles as a resync request after a gap
+ * (or when the table is smaller than the heartbeat advertises) and shows
+ * the coordinator that its standby is alive.
+ *
+ * @param n Pointer to the member node
+ * @param in Valid frame received from the coordinator
+ */
+static void member_handle_coordinator(Node* n, const Frame* in) {
+    if (in->type == MSG_TIME || in->type == MSG_SCHEDULE) {
+        if (in->type == MSG_TIME) {
+            timesync_handle_reply(&n->timesync, in, n->assigned_id);
+        } else if (mac_schedule_decode(in->payload, in->payload_len, &n->schedule)) {
+            n->has_schedule = 1;
+        }
+        // Until our first TIME sample the slot timing rests on the rough
+        // clock from an overheard reply (or, before that, our own clock)
+        if (n->has_schedule) {
+            bus_set_tdma(n->bus, &n->schedule, n->assigned_id);
+        }
+    } else if (in->type == MSG_HEARTBEAT && in->payload_len >= 3) {
+        n->last_heartbeat_ms = hal_millis();
+
+        uint8_t was_standby = n->is_standby;
+        n->is_standby = in->payload[0] == n->assigned_id;
+        if (!n->is_standby) {
+            return;
+        }
+        if (!was_standby) {
+            n->seen_count = 0;  // Fresh replica
+            LOG_INFO("Designated hot STANDBY");
+        }
+
+        n->next_assign_id = in->payload[1];
+        if (in->payload_len >= 5) {
+            n->epoch = (uint16_t) ((in->payload[3] << 8) | in->payload[4]);
+        }
+        // Answer with our table size: the coordinator resumes from there if we
+        // missed deltas, and retires a standby it no longer hears
+        uint8_t payload[1] = {n->seen_count};
+        Frame ack;
+        make_frame(&ack, MSG_SYNC, n->assigned_id, payload, 1);
+        node_send(n, &ack);
+    } else if (in->type == MSG_SYNC && in->payload_len >= 6 && n->is_standby) {
+        uint8_t i = in->payload[0];
+        if (i > n->seen_count || i >= NODE_MAX_DEDUP) {
+            return;  // Gap - the next heartbeat will request it again
+        }
+        n->seen_join_id[i] = in->payload[1];
+        n->seen_join_nonce[i] = bytes_to_u32(&in->payload[2]);
+        if (i == n->seen_count) {
+            n->seen_count++;
+        }
+    }
+}
+
+/**
+ * @brief Promote the hot standby to coordinator
+ *
+ * The replicated member table and next ID carry over, so existing members
+ * keep their IDs and retried JOINs are answered with the ID they were
+ * already given. Our own member entry is retired since we now hold ID 1.
+ *
+ * @param n Pointer to the standby node
+ */
+static void standby_take_over(Node* n) {
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == n->assigned_id) {
+            n->seen_join_id[i] = 0;
+        }
+    }
+
+    LOG_INFO("Node[%u] STANDBY → COORDINATOR (was ID=%u)", n->instance_index, n->assigned_id);
+
+    n->role = NODE_COORDINATOR;
+    HAL_EVENT(HAL_EVENT_ROLE, NODE_COORDINATOR, 1);
+    n->assigned_id = 1;
+    hal_identity_store(n->instance_index, n->assigned_id, n->epoch);
+    n->is_standby = 0;
+    n->standby_id = 0;
+    n->sync_cursor = 0;
+    memset(n->seen_idle, 0, sizeof(n->seen_idle));  // Liveness is not replicated
+    n->last_sweep_ms = hal_millis();
+    if (n->has_schedule && n->tdma_slot_ms == 0) {
+        n->tdma_slot_ms = n->schedule.slot_ms;  // Keep the network's TDMA schedule running
+    }
+    coordinator_send_heartbeat(n);  // Announce ourselves right away
+}
+
+/**
+ * @brief Handle one valid frame according to the node's current role
+ *
+ * @param n Pointer to the node
+ * @param in Valid frame received from the bus
+ */
+static void node_handle_frame(Node* n, const Frame* in) {
+    LOG_DEBUG("DEBUG: node_service received frame type=%d from source=%d", in->type, in->source);
+
+    // Any frame from a member shows it is still alive. A member whose entry
+    // was replaced in a full table, or missing from the replica we took over
+    // from, is added back.
+    if (n->role == NODE_COORDINATOR && in->source >= 2 && in->source < n->next_assign_id) {
+        if (in->source == n->standby_id) {
+            n->standby_heard_ms = hal_millis();
+        }
+        uint8_t known = 0;
+        for (uint8_t i = 0; i < n->seen_count; ++i) {
+            if (n->seen_join_id[i] == in->source) {
+                n->seen_idle[i] &= NODE_SEEN_REUSED;
+                known = 1;
+            }
+        }
+        if (!known) {
+            coordinator_record_nonce(n, 0, in->source);
+        }
+    }
+
+    // Application data goes to the data plane once we have an ID
+    if (in->type == MSG_DATA) {
+        if (n->role != NODE_SEEKING && n->data_handler) {
+            n->data_handler(n->data_ctx, in);
+        }
+        return;
+    }
+
+    if (n->role == NODE_COORDINATOR) {
+        // Coordinator Logic: Handle CLAIM messages from new nodes trying to become coordinator
+        // Our own defense comes back to us on a bus that echoes, and must not
+        // be defended against in turn
+        if (in->type == MSG_CLAIM && in->payload_len >= 4 && in->source != n->assigned_id &&
+            bytes_to_u32(in->payload) != n->random_nonce) {
+            uint32_t incoming_nonce = bytes_to_u32(in->payload);
+            LOG_DEBUG("DEBUG: COORDINATOR comparing nonces - incoming=%lu, ours=%lu",
+                      (unsigned long) incoming_nonce, (unsigned long) n->random_nonce);
+            
+            // COORDINATOR ALWAYS defends its position - never steps down after election
+            LOG_DEBUG("DEBUG: CLAIM received - defending coordinator position");
+            uint8_t payload[8];
+            u32_to_bytes(n->random_nonce, payload);
+            u32_to_bytes(incoming_nonce, &payload[4]);  // Whom we answer (keys relay dedup)
+            Frame claim;
+            make_frame(&claim, MSG_CLAIM, 1, payload, 8);
+            node_send(n, &claim);
+        }
+        // Handle JOIN requests from new members
+        else if (in->type == MSG_JOIN && in->payload_len >= 4) {
+            uint32_t nonce = bytes_to_u32(in->payload);
+
+            // Check if we've already assigned an ID for this nonce (deduplication).
+            // The member retries until it hears an ASSIGN, so repeat the original one.
+            int seen = coordinator_find_nonce(n, nonce);
+            uint8_t id = seen >= 0 ? n->seen_join_id[seen] : 0;
+            if (seen < 0) {
+                // Assign a free ID to this member
+                uint8_t reused;
+                id = coordinator_next_id(n, &reused);
+                uint8_t slot = coordinator_record_nonce(n, nonce, id);
+                if (reused) {
+                    n->seen_idle[slot] |= NODE_SEEN_REUSED;
+                }
+            }
+
+            if (id != 0) {
+                coordinator_send_assign(n, id, nonce);
+
+                if (seen < 0) {
+                    LOG_INFO("ASSIGN → id=%u", id);
+                }
+            }
+        }
+        // Handle RECLAIM requests from members rebooting with a cached ID
+        else if (in->type == MSG_RECLAIM && in->payload_len >= 7) {
+            uint8_t id = in->payload[0];
+            uint16_t epoch = (uint16_t) ((in->payload[1] << 8) | in->payload[2]);
+            uint32_t nonce = bytes_to_u32(&in->payload[3]);
+
+            int slot = -1;
+            for (uint8_t i = 0; i < n->seen_count; ++i) {
+                if (n->seen_join_id[i] == id) {
+                    slot = i;
+                }
+            }
+            // An ID that went to another board while its cached holder was
+            // away cannot be reclaimed from that board either
+            int taken = slot >= 0 && coordinator_entry_live(n, (uint8_t) slot) &&
+                        (n->seen_idle[slot] & NODE_SEEN_REUSED);
+
+            // Only IDs handed out in this network epoch can be reclaimed;
+            // anything else is ignored and the node falls back to JOIN
+            if (epoch == n->epoch && id >= 2 && id < n->next_assign_id && !taken) {
+                // Rebind the ID to the new nonce so retries are deduplicated
+                if (slot >= 0) {
+                    n->seen_join_nonce[slot] = nonce;
+                    n->seen_idle[slot] &= NODE_SEEN_REUSED;
+                    if (n->sync_cursor > slot) {
+                        n->sync_cursor = (uint8_t) slot;  // Replicate the rebind
+                    }
+                } else {
+                    coordinator_record_nonce(n, nonce, id);
+                }
+                coordinator_send_assign(n, id, nonce);
+
+                LOG_INFO("RECLAIM → id=%u", id);
+            }
+        }
+        // Answer time synchronization requests from members
+        else if (in->type == MSG_TIME_REQ) {
+            timesync_handle_request(n->bus, in);
+        }
+        // Handle heartbeat answers (resync requests) from the hot standby
+        else if (in->type == MSG_SYNC && in->payload_len == 1 && in->source == n->standby_id) {
+            if (in->payload[0] < n->sync_cursor) {
+                n->sync_cursor = in->payload[0];
+            }
+        }
+
+    } else if (n->role == NODE_SEEKING) {
+        // Keep JOIN retries in the contention slot of a TDMA network
+        if (in->type == MSG_SCHEDULE && in->source == 1 &&
+            mac_schedule_decode(in->payload, in->payload_len, &n->schedule)) {
+            n->has_schedule = 1;
+            bus_set_tdma(n->bus, &n->schedule, 0);
+        } else if (in->type == MSG_TIME && in->source == 1) {
+            timesync_handle_reply(&n->timesync, in, 0);  // Rough clock for slot timing
+        }
+        // Member Logic: Handle ASSIGN responses from coordinator
+        else if (in->type == MSG_ASSIGN && in->payload_len >= 5) {
+            uint32_t echoed = bytes_to_u32(&in->payload[1]);
+
+            // Verify this ASSIGN is for us by checking the echoed nonce
+            if (echoed == n->join_nonce) {
+                // Successfully assigned an ID - become a member
+                HAL_EVENT(HAL_EVENT_END, HAL_WAIT_JOIN, 1);
+                member_accept_assign(n, in);
+
+                LOG_INFO("ASSIGN received → MEMBER (ID=%u)", n->assigned_id);
+            }
+        }
+    } else if (n->role == NODE_MEMBER && in->source == 1) {
+        // Member Logic: Track coordinator heartbeats and replicate state if standby
+        member_handle_coordinator(n, in);
+    }
+}
+
 /**
  * @brief Service the node state machine (call this regularly in main loop)
  *
@@ -261,80 +1130,71 @@ void node_service(Node* n) {
         return;
     }
 
-    // Process any incoming messages with a short timeout to stay responsive
-    if (bus_recv(n->bus, &in, 50) && proto_is_valid(&in)) {
-        char debug_msg[64];
-        snprintf(debug_msg, sizeof(debug_msg), "DEBUG: node_service received frame type=%d from source=%d", in.type, in.source);
-        hal_log(debug_msg);
-        if (n->role == NODE_COORDINATOR) {
-            // Coordinator Logic: Handle CLAIM messages from new nodes trying to become coordinator
-            if (in.type == MSG_CLAIM && in.payload_len >= 4) {
-                uint32_t incoming_nonce = bytes_to_u32(in.payload);
-                char nonce_msg[80];
-                snprintf(nonce_msg, sizeof(nonce_msg), "DEBUG: COORDINATOR comparing nonces - incoming=%u, ours=%u", incoming_nonce, n->random_nonce);
-                hal_log(nonce_msg);
-                
-                // COORDINATOR ALWAYS defends its position - never steps down after election
-                hal_log("DEBUG: CLAIM received - defending coordinator position");
-                uint8_t payload[4];
-                u32_to_bytes(n->random_nonce, payload);
-                Frame claim;
-                make_frame(&claim, MSG_CLAIM, 1, payload, 4);
-                bus_send(n->bus, &claim);
-            }
-            // Handle JOIN requests from new members
-            else if (in.type == MSG_JOIN && in.payload_len >= 4) {
-                uint32_t nonce = bytes_to_u32(in.payload);
+    // Process incoming messages: wait briefly for the first one so we stay
+    // responsive, then drain whatever else is already queued without blocking
+    uint16_t timeout_ms = 50;
+    for (uint8_t burst = 0; burst < NODE_SERVICE_BURST && node_recv(n, &in, timeout_ms);
+         ++burst) {
+        timeout_ms = 0;
+        node_handle_frame(n, &in);
+    }
 
-                // Check if we've already assigned an ID for this nonce (deduplication)
-                if (coordinator_seen_nonce(n, nonce)) {
-                    return;  // Already handled this request
+    // Coordinator duties: periodic heartbeat and standby replication
+    if (n->role == NODE_COORDINATOR) {
+        if ((hal_millis() - n->last_heartbeat_ms) >= NODE_HEARTBEAT_MS) {
+            coordinator_send_heartbeat(n);
+        }
+        if (n->standby_id != 0 && n->sync_cursor < n->seen_count) {
+            coordinator_send_sync(n);
+        }
+        // Under TDMA the standby's answer may wait up to a whole frame for its slot
+        uint32_t standby_timeout_ms = NODE_STANDBY_TIMEOUT_MS;
+        if (n->has_schedule) {
+            standby_timeout_ms += mac_frame_ms(&n->schedule);
+        }
+        if (n->standby_id != 0 && (hal_millis() - n->standby_heard_ms) >= standby_timeout_ms) {
+            coordinator_drop_standby(n);
+        }
+        // Members not heard for a while give up their TDMA slot
+        if ((hal_millis() - n->last_sweep_ms) >= NODE_MEMBER_SWEEP_MS) {
+            for (uint8_t i = 0; i < n->seen_count; ++i) {
+                if ((n->seen_idle[i] & NODE_SEEN_IDLE) < NODE_MEMBER_IDLE_SWEEPS) {
+                    n->seen_idle[i]++;
                 }
-
-                // Assign the next available ID to this member
-                uint8_t id = n->next_assign_id++;
-                uint8_t payload[5];
-                payload[0] = id;                     // Assigned ID
-                memcpy(&payload[1], in.payload, 4);  // Echo back the JOIN nonce
-
-                Frame assign;
-                make_frame(&assign, MSG_ASSIGN, 1, payload, 5);
-                bus_send(n->bus, &assign);
-
-                char msg[32];
-                snprintf(msg, sizeof(msg), "ASSIGN → id=%u", id);
-                hal_log(msg);
             }
+            n->last_sweep_ms = hal_millis();
+        }
+    }
 
-        } else if (n->role == NODE_SEEKING) {
-            // Member Logic: Handle ASSIGN responses from coordinator
-            if (in.type == MSG_ASSIGN && in.payload_len >= 5) {
-                uint8_t assigned = in.payload[0];
-                uint32_t echoed = bytes_to_u32(&in.payload[1]);
-
-                // Verify this ASSIGN is for us by checking the echoed nonce
-                if (echoed == n->join_nonce) {
-                    // Successfully assigned an ID - become a member
-                    n->assigned_id = assigned;
-                    n->role = NODE_MEMBER;
-
-                    char msg[64];
-                    snprintf(msg, sizeof(msg), "ASSIGN received → MEMBER (ID=%u)", n->assigned_id);
-                    hal_log(msg);
-                }
-            }
+    // Members keep their network clock synchronized to the coordinator
+    if (n->role == NODE_MEMBER) {
+        timesync_poll(&n->timesync, n->bus, n->assigned_id);
+    }
+
+    // Failover: the standby takes over once the coordinator's heartbeats stop.
+    // Under TDMA a heartbeat may wait up to a whole frame for the coordinator slot.
+    if (n->role == NODE_MEMBER && n->is_standby) {
+        uint32_t takeover_ms = NODE_TAKEOVER_MS;
+        if (n->has_schedule) {
+            takeover_ms += mac_frame_ms(&n->schedule);
+        }
+        if ((hal_millis() - n->last_heartbeat_ms) >= takeover_ms) {
+            standby_take_over(n);
         }
-        // NODE_MEMBER nodes don't need to process messages in this basic implementation
     }
 
     // Retry Logic: If still seeking and haven't heard back, retry JOIN periodically
-    if (n->role == NODE_SEEKING && (hal_millis() - n->last_join_ms) >= 250) {
-        // Resend JOIN request every 250ms until we get an ASSIGN response
+    // Jitter keeps seekers that started together from retrying in lockstep and colliding
+    if (n->role == NODE_SEEKING &&
+        (hal_millis() - n->last_join_ms) >= (uint32_t) (NODE_JOIN_RETRY_MS + n->join_jitter_ms)) {
+        // Resend JOIN request every ~250ms until we get an ASSIGN response
         uint8_t payload[4];
         u32_to_bytes(n->join_nonce, payload);
         Frame join;
         make_frame(&join, MSG_JOIN, 0, payload, 4);
-        bus_send(n->bus, &join);
+        HAL_EVENT(HAL_EVENT_RETRY, MSG_JOIN, 0);
+        node_send(n, &join);
         n->last_join_ms = hal_millis();
+        n->join_jitter_ms = (uint8_t) (hal_random32() % NODE_JOIN_JITTER_MS);
     }
 }
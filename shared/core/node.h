@@ -4,13 +4,15 @@
  *
  * This header defines the core node data structures and API for implementing
  * a distributed coordinator election and member management system. The design
- * is completely platform-agnostic with zero preprocessor conditionals.
+ * is platform-agnostic; the only conditionals are the build profile's
+ * options (config.h).
  *
  * Key Concepts:
  * - Nodes start in SEEKING state and either become COORDINATOR or MEMBER
  * - Coordinator election uses random nonces for tie-breaking
  * - Members retry JOIN requests until they receive an ID assignment
  * - All communication happens through the abstract bus interface
+ * - A relay node joins a second bus and floods control frames across it
  */
 
 #ifndef NODE_H
@@ -19,7 +21,10 @@
 #include <stdint.h>
 
 #include "bus_interface.h"
+#include "config.h"
+#include "mac.h"
 #include "proto.h"
+#include "timesync.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,8 +42,114 @@ typedef enum {
     NODE_MEMBER = 2       /**< Node has received an ID and participates in the network */
 } NodeRole;
 
-/** Maximum number of JOIN request nonces to remember for deduplication */
-#define NODE_MAX_DEDUP 32
+/** Member table entries: JOIN nonces and the IDs they got (per profile, config.h) */
+#define NODE_MAX_DEDUP CONFIG_NODE_MAX_DEDUP
+
+/** Interval between coordinator HEARTBEAT broadcasts */
+#define NODE_HEARTBEAT_MS 500
+
+/**
+ * Heartbeat silence after which the hot standby takes over. The standby
+ * waits out one missed heartbeat, then promotes itself within the next
+ * heartbeat interval, so takeover lands within two heartbeat intervals of
+ * the coordinator's death. A threshold of one interval would promote the
+ * standby whenever a single heartbeat ran late.
+ */
+#define NODE_TAKEOVER_MS (2 * NODE_HEARTBEAT_MS)
+
+/**
+ * Silence after which the coordinator gives up on its hot standby. The
+ * standby answers every heartbeat, so this is several missed heartbeats;
+ * its entry is retired and the next-lowest ID becomes standby.
+ */
+#define NODE_STANDBY_TIMEOUT_MS (6 * NODE_HEARTBEAT_MS)
+
+/** Interval between JOIN retries while waiting for an ASSIGN */
+#define NODE_JOIN_RETRY_MS 250
+
+/** Maximum random delay added to each JOIN retry */
+#define NODE_JOIN_JITTER_MS 128
+
+/** How long a rebooted node waits for the coordinator to confirm a RECLAIM */
+#define NODE_RECLAIM_WINDOW_MS 300
+
+/** Maximum frames handled per node_service() call (bounds time spent draining the bus) */
+#define NODE_SERVICE_BURST 8
+
+/**
+ * How far ahead a new TDMA schedule is announced. Covers a few heartbeats
+ * so every member hears it before the switch even if a copy is lost.
+ */
+#define NODE_SCHEDULE_LEAD_MS (4 * NODE_HEARTBEAT_MS)
+
+/**
+ * Interval of the coordinator's member liveness sweep. Members send at least
+ * a TIME request every TIMESYNC_INTERVAL_MAX_MS, so a member not heard for
+ * NODE_MEMBER_IDLE_SWEEPS sweeps has gone: it loses its TDMA slot and its
+ * ID goes to the next member that joins.
+ */
+#define NODE_MEMBER_SWEEP_MS (2 * TIMESYNC_INTERVAL_MAX_MS)
+
+/** Sweeps without a frame after which a member no longer counts as live */
+#define NODE_MEMBER_IDLE_SWEEPS 2
+
+/** seen_idle bits: liveness sweeps since the member was last heard */
+#define NODE_SEEN_IDLE 0x7F
+
+/** seen_idle flag: the ID was handed out again after its earlier holder went silent */
+#define NODE_SEEN_REUSED 0x80
+
+/** Members per extra slot of coordinator airtime (for TIME replies and control traffic) */
+#define NODE_MEMBERS_PER_COORD_SLOT 2
+
+/**
+ * Most slots in a TDMA schedule: the coordinator and contention slots plus
+ * one per member table entry. Higher IDs share the contention slot. The cap
+ * bounds the frame, so a starting node knows how long to listen.
+ */
+#define NODE_MAX_SLOTS (NODE_MAX_DEDUP + 2)
+
+/**
+ * Shortest listen and CLAIM conflict windows of node_begin(). With TDMA
+ * configured both last at least one frame of NODE_MAX_SLOTS slots, since a
+ * coordinator's heartbeat or CLAIM defense waits for its slot.
+ */
+#define NODE_LISTEN_MS 1000
+
+/** Recent frames a relay remembers to suppress duplicates (per profile, config.h) */
+#define NODE_RELAY_CACHE CONFIG_NODE_RELAY_CACHE
+
+/**
+ * How long a relay treats a frame it has seen as a duplicate. Copies that
+ * looped back arrive within a few frame times; it stays below
+ * NODE_JOIN_RETRY_MS so a retried JOIN, which repeats its nonce, still
+ * gets through.
+ */
+#define NODE_RELAY_DEDUP_MS 200
+
+/** How often a relay waiting for frames checks its second bus */
+#define NODE_RELAY_POLL_MS 2
+
+/** Default hop limit of node_set_relay(): enough for a line of four relays */
+#define NODE_RELAY_MAX_HOPS 4
+
+/**
+ * @brief Callback receiving application data frames (see pubsub.h)
+ *
+ * @param ctx User context given to node_set_data_handler()
+ * @param frame Valid MSG_DATA frame
+ */
+typedef void (*NodeDataHandler)(void* ctx, const Frame* frame);
+
+/**
+ * @brief A frame a relay has seen recently, keyed by (source, type, nonce)
+ */
+typedef struct {
+    uint32_t nonce;   /**< Request nonce the frame carries, or a hash of its payload */
+    uint32_t seen_ms; /**< When it was last heard (expiry and LRU order) */
+    uint8_t source;   /**< Source node ID */
+    uint8_t type;     /**< Message type */
+} NodeRelaySeen;
 
 /**
  * @brief Complete node state structure
@@ -53,6 +164,7 @@ typedef struct {
     uint8_t instance_index; /**< Unique instance identifier for startup jitter */
     NodeRole role;          /**< Current role in the distributed system */
     uint8_t assigned_id;    /**< Network ID (0 = unassigned, 1+ = assigned) */
+    uint16_t epoch;         /**< Network epoch chosen by the coordinator (0 = unknown) */
 
     // Coordinator election state
     uint32_t random_nonce; /**< Random nonce for coordinator election tie-breaking */
@@ -62,12 +174,49 @@ typedef struct {
     uint8_t next_assign_id; /**< Next ID to assign to joining members (starts at 2) */
 
     // JOIN request deduplication (prevents double-assignment)
-    uint32_t seen_join_nonce[NODE_MAX_DEDUP]; /**< Ring buffer of seen JOIN nonces */
-    uint8_t seen_count;                       /**< Number of nonces in buffer */
+    // Each nonce is stored with the ID it was given, so this doubles as the
+    // member table that is replicated to the hot standby.
+    uint32_t seen_join_nonce[NODE_MAX_DEDUP]; /**< JOIN nonce of each entry (0 = unknown) */
+    uint8_t seen_join_id[NODE_MAX_DEDUP];     /**< ID assigned to each seen nonce (0 = retired) */
+    uint8_t seen_idle[NODE_MAX_DEDUP];        /**< Coordinator: NODE_SEEN_IDLE / _REUSED bits */
+    uint8_t seen_count;                       /**< Entries in use */
+    uint8_t seen_evict;                       /**< Coordinator: where a full table evicts from */
+    uint32_t last_sweep_ms;                   /**< Coordinator: last liveness sweep */
+
+    // Heartbeat and hot-standby replication
+    uint8_t standby_id;         /**< Coordinator: member designated as hot standby (0 = none) */
+    uint8_t sync_cursor;        /**< Coordinator: next member table entry to stream to standby */
+    uint8_t is_standby;         /**< Member: set while the coordinator names us as standby */
+    uint32_t last_heartbeat_ms; /**< Coordinator: last HEARTBEAT sent; member: last one heard */
+    uint32_t standby_heard_ms;  /**< Coordinator: last frame heard from the standby */
 
     // Member-specific state
     uint32_t join_nonce;   /**< Unique nonce for our JOIN request */
     uint32_t last_join_ms; /**< Timestamp of last JOIN transmission (for retry logic) */
+    uint8_t join_jitter_ms; /**< Random extra delay before the next JOIN retry */
+
+    // Network time synchronization (members follow the coordinator's clock)
+    TimeSync timesync; /**< Offset/drift estimate, installed via hal_set_network_clock() */
+
+    // TDMA bus access
+    uint8_t tdma_slot_ms;  /**< Slot length to schedule when coordinator (0 = TDMA off) */
+    uint8_t has_schedule;  /**< A schedule was built (coordinator) or heard (member) */
+    MacSchedule schedule;  /**< Latest TDMA schedule */
+
+    // Application data plane
+    NodeDataHandler data_handler; /**< Receives MSG_DATA frames once we have an ID */
+    void* data_ctx;               /**< User context for data_handler */
+
+#if CONFIG_NODE_RELAY
+    // Relay to a second bus (see node_set_relay())
+    Bus* relay_bus;                              /**< Second bus (NULL = not a relay) */
+    uint8_t relay_max_hops;                      /**< Frames that crossed this many stay put */
+    uint8_t relay_seen_count;                    /**< Entries in use in relay_seen */
+    NodeRelaySeen relay_seen[NODE_RELAY_CACHE];  /**< Recently seen frames, for dedup */
+    uint32_t relay_forwarded;                    /**< Frames copied onto the other bus */
+    uint32_t relay_duplicates;                   /**< Copies dropped as already seen */
+    uint32_t relay_hop_limited;                  /**< Frames not forwarded: hop limit reached */
+#endif
 } Node;
 
 /**
@@ -83,10 +232,59 @@ typedef struct {
  */
 void node_init(Node* n, Bus* bus, uint8_t instance_index);
 
+/**
+ * @brief Register the application data plane hook
+ *
+ * node_service() passes every valid MSG_DATA frame to this callback once the
+ * node is COORDINATOR or MEMBER. pubsub_init() installs its own handler here.
+ *
+ * @param n Pointer to the node
+ * @param handler Callback for MSG_DATA frames (NULL to drop them)
+ * @param ctx User context passed to the callback
+ */
+void node_set_data_handler(Node* n, NodeDataHandler handler, void* ctx);
+
+/**
+ * @brief Enable coordinator-scheduled TDMA bus access
+ *
+ * If this node becomes coordinator it gives every assigned ID a slot of
+ * slot_ms and publishes the schedule. Members and joining nodes follow
+ * whatever schedule the coordinator publishes, TDMA enabled or not. Call before
+ * node_begin(). The slot must fit one frame at the bus baud rate plus
+ * MAC_GUARD_MS.
+ *
+ * @param n Pointer to the node
+ * @param slot_ms Slot length in milliseconds (0 = free transmission)
+ */
+void node_set_tdma(Node* n, uint8_t slot_ms);
+
+#if CONFIG_NODE_RELAY
+/**
+ * @brief Make the node a relay between its own bus and a second one
+ *
+ * The node keeps its role on its own bus and also floods control frames
+ * (HELLO to RECLAIM) between the two: every one it hears or sends on either
+ * bus is copied onto the other with its hop count raised by one, unless it
+ * has already crossed max_hops relays. Frames seen in the last
+ * NODE_RELAY_DEDUP_MS, by source, type and nonce, are dropped, so copies
+ * that loop back through another relay stop there. Data, time sync and
+ * TDMA schedules stay on their own bus, so relayed networks run without
+ * TDMA. Call after node_init() and before node_begin(). Only built when
+ * the profile enables CONFIG_NODE_RELAY.
+ *
+ * @param n Pointer to the node
+ * @param second Second bus (NULL = stop relaying)
+ * @param max_hops Hop limit, at most PROTO_MAX_HOPS (0 = relay nothing)
+ */
+void node_set_relay(Node* n, Bus* second, uint8_t max_hops);
+#endif
+
 /**
  * @brief Start the node and begin the coordinator election process
  *
  * This function implements the core distributed algorithm:
+ * 0. If an identity was persisted before a reset, try to reclaim it in one
+ *    round trip (RECLAIM → ASSIGN) and skip the rest
  * 1. Listen for existing coordinator announcements
  * 2. If none found, attempt to claim coordinator role
  * 3. Handle tie-breaking with other claimants using random nonces
@@ -103,10 +301,16 @@ void node_begin(Node* n);
  * @brief Service the node state machine (call regularly in main loop)
  *
  * This function handles ongoing node operations based on current role:
- * - COORDINATOR: Process JOIN requests and assign unique IDs
- * - MEMBER: Handle ASSIGN responses from coordinator
+ * - COORDINATOR: Process JOIN requests, assign unique IDs, send heartbeats,
+ *   answer TIME requests and stream member table deltas to the hot standby
+ * - MEMBER: Track heartbeats and synchronize to the coordinator's clock; the
+ *   standby replicates the member table and takes over as coordinator if
+ *   heartbeats stop
  * - SEEKING: Retry JOIN requests until assignment received
  *
+ * Waits up to 50ms for the first frame, then handles up to NODE_SERVICE_BURST
+ * already-queued frames without blocking.
+ *
  * This function is non-blocking and should be called regularly (every 10-50ms)
  * to maintain responsive communication with other nodes.
  *
@@ -16,6 +16,7 @@
 #ifndef PROTO_H
 #define PROTO_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -28,6 +29,18 @@ extern "C" {
 /** Maximum payload size in bytes (keeps frames small for embedded systems) */
 #define MAX_PAYLOAD_SIZE 8
 
+/** Longest frame on the wire: sof + type + source + len + payload + checksum */
+#define PROTO_MAX_FRAME_BYTES (5 + MAX_PAYLOAD_SIZE)
+
+/** Bits of the type byte holding the message type (MessageType enum) */
+#define PROTO_TYPE_MASK 0x1F
+
+/** The bits above it count the relays a frame has crossed (see node_set_relay()) */
+#define PROTO_HOPS_SHIFT 5
+
+/** Most relays a frame can cross */
+#define PROTO_MAX_HOPS (0xFF >> PROTO_HOPS_SHIFT)
+
 /**
  * @brief Message types used in the distributed coordination protocol
  *
@@ -36,11 +49,18 @@ extern "C" {
  * and member management.
  */
 typedef enum {
-    MSG_HELLO = 1,    /**< Member announces presence to the network */
-    MSG_CLAIM = 2,    /**< Node claims coordinator role (includes tie-break nonce) */
+    MSG_HELLO = 1,    /**< Member announces presence to the network (with its JOIN nonce) */
+    MSG_CLAIM = 2,    /**< Node claims coordinator role (tie-break nonce; a defense adds the
+                           challenger's) */
     MSG_JOIN = 3,     /**< Member requests ID assignment (includes unique nonce) */
-    MSG_ASSIGN = 4,   /**< Coordinator assigns ID to member (echoes JOIN nonce) */
-    MSG_HEARTBEAT = 5 /**< Coordinator periodic heartbeat (future extension) */
+    MSG_ASSIGN = 4,    /**< Coordinator assigns ID to member (echoes JOIN nonce, adds epoch) */
+    MSG_HEARTBEAT = 5, /**< Coordinator periodic heartbeat (names the hot standby) */
+    MSG_SYNC = 6,      /**< Member table delta streamed to the standby (or resync request) */
+    MSG_RECLAIM = 7,   /**< Rebooted member asks to keep its cached ID (answered by ASSIGN) */
+    MSG_DATA = 8,      /**< Application message fragment (see pubsub.h) */
+    MSG_TIME_REQ = 9,  /**< Member asks the coordinator for its time (see timesync.h) */
+    MSG_TIME = 10,     /**< Coordinator timestamp, broadcast in reply to TIME_REQ */
+    MSG_SCHEDULE = 11  /**< Coordinator's TDMA slot schedule (see mac.h) */
 } MessageType;
 
 /**
@@ -54,7 +74,7 @@ typedef enum {
  */
 typedef struct {
     uint8_t sof;                       /**< Start-of-frame marker (always SOF) */
-    uint8_t type;                      /**< Message type (MessageType enum) */
+    uint8_t type;                      /**< Message type (MessageType enum), relay hops on top */
     uint8_t source;                    /**< Source node ID (0 = unassigned) */
     uint8_t payload_len;               /**< Payload length (0-MAX_PAYLOAD_SIZE) */
     uint8_t payload[MAX_PAYLOAD_SIZE]; /**< Variable payload data */
@@ -93,6 +113,110 @@ void proto_finalize(Frame* f);
  */
 int proto_is_valid(const Frame* f);
 
+/**
+ * @brief Message type of a frame, without the relay hop count
+ *
+ * @param f Pointer to the frame
+ * @return The MessageType in the low bits of the type byte
+ */
+uint8_t proto_type(const Frame* f);
+
+/**
+ * @brief Number of relays a frame has crossed
+ *
+ * @param f Pointer to the frame
+ * @return Hop count from the top bits of the type byte (0 = sent on this bus)
+ */
+uint8_t proto_hops(const Frame* f);
+
+/**
+ * @brief Set the hop count of a frame and recompute its checksum
+ *
+ * Relays forward a copy with the count raised by one; receivers set it back
+ * to 0 after validation, leaving the plain message type in f->type.
+ *
+ * @param f Pointer to a finalized frame
+ * @param hops New hop count (at most PROTO_MAX_HOPS)
+ */
+void proto_set_hops(Frame* f, uint8_t hops);
+
+/**
+ * @brief Header fields of one frame, as decoded by proto_decode_batch()
+ */
+typedef struct {
+    uint8_t valid;       /**< 1 if the frame passes proto_is_valid(), else 0 */
+    uint8_t type;        /**< Message type (MessageType enum) */
+    uint8_t source;      /**< Source node ID */
+    uint8_t payload_len; /**< Payload length */
+    uint32_t lead;       /**< First 4 payload bytes big-endian (e.g. a CLAIM or JOIN nonce),
+                              with bytes past payload_len read as zero */
+} ProtoFrameInfo;
+
+/**
+ * @brief Validate and decode an array of received frames in one pass
+ *
+ * Gives the same verdict as proto_is_valid() for every frame, without
+ * data-dependent branches and a word at a time rather than a byte at a
+ * time. Meant for hosts that drain hundreds of frames per wakeup; the
+ * 64-bit arithmetic gains nothing on an 8-bit board.
+ *
+ * @param frames Frames to check
+ * @param n Number of frames
+ * @param out One ProtoFrameInfo per frame
+ * @return Number of valid frames
+ */
+size_t proto_decode_batch(const Frame* frames, size_t n, ProtoFrameInfo* out);
+
+/**
+ * @brief Name a message type, for logs and host tools
+ *
+ * @param type Message type (MSG_*)
+ * @return The name without the MSG_ prefix (e.g. "JOIN"), or NULL if unknown
+ */
+const char* proto_type_name(uint8_t type);
+
+/**
+ * @brief Serialize a frame into the bytes sent on the wire
+ *
+ * Writes only the used payload bytes, so the result does not depend on
+ * struct padding.
+ *
+ * @param f Frame to serialize (finalized)
+ * @param out Output buffer of PROTO_MAX_FRAME_BYTES bytes
+ * @return Number of bytes written (5 + payload_len)
+ */
+uint8_t proto_serialize(const Frame* f, uint8_t out[PROTO_MAX_FRAME_BYTES]);
+
+/**
+ * @brief Incremental frame parser for a byte stream
+ *
+ * Feed received bytes one at a time with proto_parse_byte(). Bytes before
+ * a SOF are skipped as noise, and a length byte above MAX_PAYLOAD_SIZE
+ * means the SOF was not a frame start, so the parser goes back to hunting.
+ * Backends that time out partial frames call proto_parser_reset().
+ */
+typedef struct {
+    Frame frame; /**< Frame being assembled, complete after a 1 or -1 return */
+    uint8_t pos; /**< Bytes of frame seen so far (0 = hunting for SOF) */
+} ProtoParser;
+
+/**
+ * @brief Drop any partial frame and hunt for the next SOF
+ *
+ * @param p Parser state
+ */
+void proto_parser_reset(ProtoParser* p);
+
+/**
+ * @brief Feed one received byte to the parser
+ *
+ * @param p Parser state
+ * @param b Received byte
+ * @return 1 if b completed a valid frame (in p->frame), -1 if it completed
+ *         one with a bad checksum, 0 otherwise
+ */
+int proto_parse_byte(ProtoParser* p, uint8_t b);
+
 /**
  * @brief Convert 32-bit value to big-endian byte array
  *
@@ -0,0 +1,261 @@
+/**
+ * @file pubsub.c
+ * @brief Publish/subscribe messaging with fragmentation and reassembly
+ *
+ * Outgoing messages are cut into MSG_DATA fragments of up to
+ * PUBSUB_FRAG_DATA bytes. Incoming single-fragment messages are delivered
+ * straight from the frame; longer ones are collected in a small fixed pool
+ * of reassembly buffers keyed by (source, message id). When the pool is full
+ * the stalest partial message is evicted, so memory use never grows.
+ */
+
+#include "pubsub.h"
+
+#include <string.h>
+
+#include "bus_interface.h"
+#include "hal.h"
+
+/** Fragment byte: set on the last fragment of a message */
+#define FRAG_LAST 0x80
+
+/** Fragment byte: mask for the fragment index */
+#define FRAG_INDEX_MASK 0x7F
+
+/** Fragments needed for the largest message */
+#define MAX_FRAGS ((PUBSUB_MAX_MESSAGE + PUBSUB_FRAG_DATA - 1) / PUBSUB_FRAG_DATA)
+
+/**
+ * @brief Node data hook: forward DATA frames to the endpoint
+ */
+static void pubsub_on_frame(void* ctx, const Frame* frame) {
+    pubsub_handle_frame((PubSub*) ctx, frame);
+}
+
+/**
+ * @brief Hand a complete message to the matching callback(s)
+ *
+ * Topic messages go to every subscription on that topic. Messages addressed
+ * to our ID or broadcast go to the direct handler.
+ */
+static void deliver(PubSub* ps, uint8_t source, uint8_t address, const uint8_t* data,
+                    uint8_t len) {
+    int delivered = 0;
+
+    if (address & 0x80) {
+        for (uint8_t i = 0; i < PUBSUB_MAX_SUBS; ++i) {
+            if (ps->subs[i].address == address && ps->subs[i].handler) {
+                ps->subs[i].handler(ps->subs[i].ctx, source, address, data, len);
+                delivered = 1;
+            }
+        }
+    } else if (address == PUBSUB_BROADCAST || address == ps->node->assigned_id) {
+        if (ps->direct_handler) {
+            ps->direct_handler(ps->direct_ctx, source, address, data, len);
+            delivered = 1;
+        }
+    }
+
+    if (delivered) {
+        ps->messages_delivered++;
+    }
+}
+
+/**
+ * @brief Check whether this node wants messages sent to an address
+ *
+ * Lets us skip reassembly (and pool pressure) for traffic nobody here reads.
+ */
+static int wants_address(const PubSub* ps, uint8_t address) {
+    if (address & 0x80) {
+        for (uint8_t i = 0; i < PUBSUB_MAX_SUBS; ++i) {
+            if (ps->subs[i].address == address) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return address == PUBSUB_BROADCAST || address == ps->node->assigned_id;
+}
+
+/**
+ * @brief Find the reassembly slot for a message, allocating one if needed
+ *
+ * Expired slots are reclaimed first; if the pool is still full the partial
+ * message heard from least recently is evicted and its fragments counted as
+ * dropped. Under TDMA a sender whose hold queue is full resumes only in its
+ * next slot, so messages get a frame longer before they expire.
+ *
+ * @return Slot to use (never NULL), with heard_ms set to now
+ */
+static PubSubReassembly* find_slot(PubSub* ps, uint8_t source, uint8_t msg_id) {
+    uint32_t now = hal_millis();
+    uint32_t timeout_ms = PUBSUB_REASM_TIMEOUT_MS;
+    if (ps->node->has_schedule) {
+        timeout_ms += mac_frame_ms(&ps->node->schedule);
+    }
+    PubSubReassembly* free_slot = NULL;
+    PubSubReassembly* oldest = NULL;
+
+    for (uint8_t i = 0; i < PUBSUB_REASM_SLOTS; ++i) {
+        PubSubReassembly* r = &ps->pool[i];
+        if (r->in_use && (now - r->heard_ms) >= timeout_ms) {
+            ps->fragments_dropped++;
+            r->in_use = 0;  // Timed out - a fragment was lost
+        }
+        if (!r->in_use) {
+            if (!free_slot) {
+                free_slot = r;
+            }
+            continue;
+        }
+        if (r->source == source && r->msg_id == msg_id) {
+            r->heard_ms = now;
+            return r;
+        }
+        if (!oldest || (int32_t) (r->heard_ms - oldest->heard_ms) < 0) {
+            oldest = r;
+        }
+    }
+
+    PubSubReassembly* r = free_slot;
+    if (!r) {
+        ps->fragments_dropped++;  // Pool exhausted - evict the oldest partial message
+        r = oldest;
+    }
+    memset(r, 0, sizeof(*r));
+    r->in_use = 1;
+    r->source = source;
+    r->msg_id = msg_id;
+    r->last_frag = 0xFF;
+    r->heard_ms = now;
+    return r;
+}
+
+void pubsub_init(PubSub* ps, Node* node) {
+    memset(ps, 0, sizeof(*ps));
+    ps->node = node;
+    node_set_data_handler(node, pubsub_on_frame, ps);
+}
+
+int pubsub_subscribe(PubSub* ps, uint8_t topic, PubSubHandler handler, void* ctx) {
+    for (uint8_t i = 0; i < PUBSUB_MAX_SUBS; ++i) {
+        if (ps->subs[i].address == 0) {
+            ps->subs[i].address = PUBSUB_TOPIC(topic);
+            ps->subs[i].handler = handler;
+            ps->subs[i].ctx = ctx;
+            return 0;
+        }
+    }
+    return -1;  // Subscription table full
+}
+
+void pubsub_set_direct_handler(PubSub* ps, PubSubHandler handler, void* ctx) {
+    ps->direct_handler = handler;
+    ps->direct_ctx = ctx;
+}
+
+/**
+ * @brief Hand one fragment to the bus, servicing the node while the bus refuses it
+ *
+ * @return 1 once the bus accepted the fragment, 0 on timeout or if the node lost its ID
+ */
+static int send_fragment(PubSub* ps, const Frame* f) {
+    uint32_t timeout_ms = PUBSUB_SEND_TIMEOUT_MS;
+    if (ps->node->has_schedule) {
+        timeout_ms += mac_frame_ms(&ps->node->schedule);  // Our slot may be a frame away
+    }
+    uint32_t start = hal_millis();
+
+    while (bus_send(ps->node->bus, f) != 1) {
+        if (ps->waiting || ps->node->assigned_id != f->source ||
+            (hal_millis() - start) >= timeout_ms) {
+            return 0;
+        }
+        ps->waiting = 1;
+        node_service(ps->node);  // Drains the hold queue as our slot or a quiet line comes
+        ps->waiting = 0;
+    }
+    return 1;
+}
+
+int pubsub_publish(PubSub* ps, uint8_t address, const void* data, uint8_t len) {
+    if (ps->node->assigned_id == 0 || len == 0 || len > PUBSUB_MAX_MESSAGE) {
+        return 0;
+    }
+
+    const uint8_t* bytes = (const uint8_t*) data;
+    uint8_t msg_id = ps->next_msg_id++;
+    uint8_t offset = 0;
+
+    for (uint8_t frag = 0; offset < len; ++frag) {
+        uint8_t chunk = (uint8_t) (len - offset);
+        if (chunk > PUBSUB_FRAG_DATA) {
+            chunk = PUBSUB_FRAG_DATA;
+        }
+
+        Frame f;
+        memset(&f, 0, sizeof(f));
+        f.type = MSG_DATA;
+        f.source = ps->node->assigned_id;
+        f.payload_len = (uint8_t) (3 + chunk);
+        f.payload[0] = address;
+        f.payload[1] = msg_id;
+        f.payload[2] = (uint8_t) (frag | (offset + chunk == len ? FRAG_LAST : 0));
+        memcpy(&f.payload[3], &bytes[offset], chunk);
+        proto_finalize(&f);
+
+        if (!send_fragment(ps, &f)) {
+            return 0;
+        }
+        offset = (uint8_t) (offset + chunk);
+    }
+
+    ps->messages_sent++;
+    return 1;
+}
+
+void pubsub_handle_frame(PubSub* ps, const Frame* frame) {
+    if (frame->payload_len < 4 || frame->source == ps->node->assigned_id) {
+        return;  // Malformed, or our own broadcast looping back
+    }
+
+    uint8_t address = frame->payload[0];
+    uint8_t msg_id = frame->payload[1];
+    uint8_t frag = frame->payload[2] & FRAG_INDEX_MASK;
+    uint8_t is_last = frame->payload[2] & FRAG_LAST;
+    uint8_t chunk = (uint8_t) (frame->payload_len - 3);
+    const uint8_t* data = &frame->payload[3];
+
+    if (!wants_address(ps, address)) {
+        return;
+    }
+
+    // Fast path: the whole message fits in one frame
+    if (frag == 0 && is_last) {
+        deliver(ps, frame->source, address, data, chunk);
+        return;
+    }
+
+    if (frag >= MAX_FRAGS || (!is_last && chunk != PUBSUB_FRAG_DATA) ||
+        frag * PUBSUB_FRAG_DATA + chunk > PUBSUB_MAX_MESSAGE) {
+        ps->fragments_dropped++;
+        return;
+    }
+
+    PubSubReassembly* r = find_slot(ps, frame->source, msg_id);
+    r->address = address;
+    memcpy(&r->data[frag * PUBSUB_FRAG_DATA], data, chunk);
+    r->received |= (uint16_t) (1u << frag);
+    if (is_last) {
+        r->last_frag = frag;
+        r->last_len = chunk;
+    }
+
+    // Complete once the last fragment and everything before it arrived
+    if (r->last_frag != 0xFF && r->received == (uint16_t) ((1u << (r->last_frag + 1)) - 1)) {
+        uint8_t len = (uint8_t) (r->last_frag * PUBSUB_FRAG_DATA + r->last_len);
+        r->in_use = 0;
+        deliver(ps, r->source, r->address, r->data, len);
+    }
+}
@@ -0,0 +1,175 @@
+/**
+ * @file pubsub.h
+ * @brief Application messaging layer (publish/subscribe) on top of protocol frames
+ *
+ * Once a node has an ID it can exchange application messages with the rest
+ * of the network. Messages are addressed either to a topic (any node that
+ * subscribed receives it) or to a node ID, and may be larger than a single
+ * frame: they are split into MSG_DATA fragments and reassembled on the
+ * receiving side in a fixed pool of buffers (no heap).
+ *
+ * DATA Payload Format (4-8 bytes):
+ * [Address][MsgId][Fragment][Data...]
+ *  1B       1B     1B        1-5B
+ *
+ * - Address: 0 = broadcast, 1-127 = node ID, 0x80 | topic = topic
+ * - MsgId: per-sender sequence number, identifies the fragments of one message
+ * - Fragment: bit 7 set on the last fragment, bits 0-6 = fragment index
+ */
+
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "node.h"
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Largest application message that can be sent or reassembled (per profile, config.h) */
+#define PUBSUB_MAX_MESSAGE CONFIG_PUBSUB_MAX_MESSAGE
+
+/** Number of messages that can be reassembled concurrently */
+#define PUBSUB_REASM_SLOTS CONFIG_PUBSUB_REASM_SLOTS
+
+/** Number of topic subscriptions per node */
+#define PUBSUB_MAX_SUBS CONFIG_PUBSUB_MAX_SUBS
+
+/** Incomplete messages that gained no fragment for this long (plus a TDMA frame) are discarded */
+#define PUBSUB_REASM_TIMEOUT_MS 1000
+
+/** A publish gives up once the bus refused a fragment for this long (plus a TDMA frame) */
+#define PUBSUB_SEND_TIMEOUT_MS 2000
+
+/** Application bytes carried by one DATA frame */
+#define PUBSUB_FRAG_DATA (MAX_PAYLOAD_SIZE - 3)
+
+/** Address value for messages delivered to every node */
+#define PUBSUB_BROADCAST 0
+
+/** Build the address byte for a topic (0-127) */
+#define PUBSUB_TOPIC(t) ((uint8_t) (0x80 | (t)))
+
+/**
+ * @brief Callback invoked for every complete message
+ *
+ * @param ctx User context given at registration
+ * @param source Sender's node ID
+ * @param address Address the message was sent to (topic, node ID or broadcast)
+ * @param data Message bytes (valid only during the callback)
+ * @param len Message length in bytes
+ */
+typedef void (*PubSubHandler)(void* ctx, uint8_t source, uint8_t address, const uint8_t* data,
+                              uint8_t len);
+
+/** @brief Reassembly buffer for one multi-fragment message */
+typedef struct {
+    uint8_t in_use;     /**< Slot holds a partial message */
+    uint8_t source;     /**< Sender's node ID */
+    uint8_t address;    /**< Message address */
+    uint8_t msg_id;     /**< Sender's message sequence number */
+    uint8_t last_frag;  /**< Index of the last fragment (0xFF until it arrives) */
+    uint8_t last_len;   /**< Data bytes in the last fragment */
+    uint16_t received;  /**< Bitmask of fragments received */
+    uint32_t heard_ms;  /**< Arrival of the latest fragment (for timeout/eviction) */
+    uint8_t data[PUBSUB_MAX_MESSAGE]; /**< Message bytes */
+} PubSubReassembly;
+
+/** @brief Topic subscription */
+typedef struct {
+    uint8_t address;       /**< Topic address (PUBSUB_TOPIC(t)), 0 = unused */
+    PubSubHandler handler; /**< Callback for messages on this topic */
+    void* ctx;             /**< User context for the callback */
+} PubSubSubscription;
+
+/**
+ * @brief Messaging endpoint attached to one node
+ *
+ * All storage is inline so the endpoint can live in a static or global
+ * variable on microcontrollers.
+ */
+typedef struct {
+    Node* node;           /**< Node whose bus and ID are used */
+    uint8_t next_msg_id;  /**< Sequence number for the next outgoing message */
+    uint8_t waiting;      /**< pubsub_publish() is servicing the node for a refused fragment */
+
+    PubSubSubscription subs[PUBSUB_MAX_SUBS]; /**< Topic subscriptions */
+    PubSubHandler direct_handler;             /**< Messages to our ID or broadcast */
+    void* direct_ctx;                         /**< User context for direct_handler */
+
+    PubSubReassembly pool[PUBSUB_REASM_SLOTS]; /**< Fixed reassembly buffers */
+
+    // Statistics
+    uint32_t messages_sent;      /**< Messages published */
+    uint32_t messages_delivered; /**< Complete messages handed to a callback */
+    uint32_t fragments_dropped;  /**< Fragments lost to eviction, timeout or bad headers */
+} PubSub;
+
+/**
+ * @brief Initialize a messaging endpoint and attach it to a node
+ *
+ * Registers with the node so node_service() hands it every DATA frame.
+ *
+ * @param ps Endpoint to initialize
+ * @param node Node to send and receive through
+ */
+void pubsub_init(PubSub* ps, Node* node);
+
+/**
+ * @brief Subscribe to a topic
+ *
+ * @param ps Messaging endpoint
+ * @param topic Topic number (0-127)
+ * @param handler Callback for complete messages on the topic
+ * @param ctx User context passed to the callback
+ * @return 0 on success, -1 if the subscription table is full
+ */
+int pubsub_subscribe(PubSub* ps, uint8_t topic, PubSubHandler handler, void* ctx);
+
+/**
+ * @brief Set the callback for messages addressed to this node or broadcast
+ *
+ * @param ps Messaging endpoint
+ * @param handler Callback (NULL to ignore such messages)
+ * @param ctx User context passed to the callback
+ */
+void pubsub_set_direct_handler(PubSub* ps, PubSubHandler handler, void* ctx);
+
+/**
+ * @brief Send a message, fragmenting it across as many frames as needed
+ *
+ * Blocks until every fragment was handed to the bus. With carrier sense or
+ * TDMA the bus holds only a few DATA frames at a time, so while it refuses
+ * a fragment this calls node_service() to let the queue drain and keep the
+ * node answering; handlers it runs may not publish in turn (that publish
+ * fails if it has to wait).
+ *
+ * @param ps Messaging endpoint
+ * @param address PUBSUB_TOPIC(t), a node ID, or PUBSUB_BROADCAST
+ * @param data Message bytes
+ * @param len Message length (1-PUBSUB_MAX_MESSAGE)
+ * @return 1 on success, 0 if the node has no ID yet, the message is too
+ *         large, or the bus refused a fragment for PUBSUB_SEND_TIMEOUT_MS
+ */
+int pubsub_publish(PubSub* ps, uint8_t address, const void* data, uint8_t len);
+
+/**
+ * @brief Process one received DATA frame
+ *
+ * Called by node_service() through the node's data hook; exposed for
+ * platforms that receive frames outside the node state machine.
+ *
+ * @param ps Messaging endpoint
+ * @param frame Valid MSG_DATA frame
+ */
+void pubsub_handle_frame(PubSub* ps, const Frame* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PUBSUB_H
@@ -0,0 +1,46 @@
+/**
+ * @file rng.c
+ * @brief xoshiro128** generator seeded with splitmix64
+ *
+ * Reference: D. Blackman and S. Vigna, "Scrambled Linear Pseudorandom
+ * Number Generators" (xoshiro128** 1.1).
+ */
+
+#include "rng.h"
+
+static uint32_t rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(Rng* rng, uint64_t seed) {
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+    rng->s[0] = (uint32_t) a;
+    rng->s[1] = (uint32_t) (a >> 32);
+    rng->s[2] = (uint32_t) b;
+    rng->s[3] = (uint32_t) (b >> 32);
+    if (!(rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3])) {
+        rng->s[0] = 1;  // The all-zero state would only ever produce zeros
+    }
+}
+
+uint32_t rng_next(Rng* rng) {
+    uint32_t* s = rng->s;
+    uint32_t result = rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+    return result;
+}
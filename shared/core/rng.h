@@ -0,0 +1,51 @@
+/**
+ * @file rng.h
+ * @brief Small seeded pseudo-random generator (xoshiro128**)
+ *
+ * Each node owns its generator state, so nodes never contend for a shared
+ * one and a run can be repeated exactly from its seed. xoshiro128** needs
+ * only 32-bit shifts, rotates and one multiply per value, which suits the
+ * 8-bit AVR, and its 16 bytes of state fit any board.
+ *
+ * Not suitable for cryptography; nonces and backoff only need values that
+ * differ between nodes and look random to the protocol.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Generator state */
+typedef struct {
+    uint32_t s[4]; /**< xoshiro128** state, never all zero */
+} Rng;
+
+/**
+ * @brief Seed a generator
+ *
+ * The seed is spread over the state with splitmix64, so nearby seeds
+ * (0, 1, 2, ...) still give unrelated sequences.
+ *
+ * @param rng Generator
+ * @param seed Any value, including 0
+ */
+void rng_seed(Rng* rng, uint64_t seed);
+
+/**
+ * @brief Next 32-bit value
+ *
+ * @param rng Seeded generator
+ * @return Uniformly distributed value
+ */
+uint32_t rng_next(Rng* rng);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RNG_H
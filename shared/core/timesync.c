@@ -0,0 +1,264 @@
+/**
+ * @file timesync.c
+ * @brief NTP-lite time synchronization between members and the coordinator
+ *
+ * A member sends TIME_REQ at local time t1; the coordinator receives it at
+ * network time t2 and replies at t3, sending T = (t2 + t3) / 2; the reply
+ * arrives at local time t4. With a symmetric path the coordinator's clock
+ * read T + (t4 - t1) / 2 at t4 and the path delay was
+ * (t4 - t1) - (t3 - t2). Offsets from
+ * successive samples are blended into the running correction to smooth out
+ * scheduling jitter. The drift between the two oscillators is the slope of
+ * a least-squares line through the offsets of the last few samples; a
+ * single sample's error is a few ms, so two samples tens of seconds apart
+ * would give hundreds of ppm of noise.
+ */
+
+#include "timesync.h"
+
+#include <string.h>
+
+#include "hal.h"
+
+#undef LOG_FILE_ID
+#define LOG_FILE_ID 2  // Binary trace call site IDs (hal.h)
+
+/**
+ * @brief Network time at a local instant according to the current correction
+ */
+static uint32_t predict_network(const TimeSync* ts, uint32_t local_ms) {
+    int32_t elapsed = (int32_t) (local_ms - ts->ref_local_ms);
+    int64_t corrected = (int64_t) elapsed + (int64_t) elapsed * ts->drift_ppm / 1000000;
+    return ts->ref_network_ms + (uint32_t) corrected;
+}
+
+/**
+ * @brief Least-squares slope of offset over local time across the kept samples
+ *
+ * Samples more than TIMESYNC_DRIFT_OUTLIER_MS off the first line are left
+ * out of a second fit, so one reply delayed on a single side does not tilt
+ * the line.
+ *
+ * @return 1 with the slope in ppm in *ppm, 0 if the samples span too little time
+ */
+static int fit_drift(const TimeSync* ts, int32_t* ppm) {
+    // Work relative to the newest sample so the sums stay small
+    const TimeSyncSample* last =
+        &ts->fit[(ts->fit_next + TIMESYNC_DRIFT_SAMPLES - 1) % TIMESYNC_DRIFT_SAMPLES];
+    uint8_t used = 0xFF;  // Bit i: sample i is in the fit
+    int64_t slope = 0;
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        int64_t n = 0, sum_x = 0, sum_y = 0;
+        int32_t oldest = 0;
+        for (uint8_t i = 0; i < ts->fit_count; i++) {
+            if (!(used & (1u << i)))
+                continue;
+            int32_t x = (int32_t) (ts->fit[i].local_ms - last->local_ms);
+            n++;
+            sum_x += x;
+            sum_y += ts->fit[i].offset_ms;
+            if (x < oldest)
+                oldest = x;
+        }
+        if (n < 3 || (uint32_t) -oldest < TIMESYNC_DRIFT_SPAN_MS) {
+            if (pass == 0)
+                return 0;
+            break;  // Too few samples left: keep the first fit
+        }
+
+        // Deviations from the means, scaled by n to stay in integers
+        int64_t sxx = 0, sxy = 0;
+        for (uint8_t i = 0; i < ts->fit_count; i++) {
+            if (!(used & (1u << i)))
+                continue;
+            int64_t dx = (int64_t) (int32_t) (ts->fit[i].local_ms - last->local_ms) * n - sum_x;
+            int64_t dy = (int64_t) ts->fit[i].offset_ms * n - sum_y;
+            sxx += dx * dx / n;
+            sxy += dx * dy / n;
+        }
+        slope = sxy / (sxx / 1000000);  // The span check keeps sxx well above 10^6
+
+        for (uint8_t i = 0; pass == 0 && i < ts->fit_count; i++) {
+            int64_t dx = (int64_t) (int32_t) (ts->fit[i].local_ms - last->local_ms) * n - sum_x;
+            int64_t residual = (int64_t) ts->fit[i].offset_ms * n - sum_y - dx * slope / 1000000;
+            if (residual > TIMESYNC_DRIFT_OUTLIER_MS * n ||
+                residual < -TIMESYNC_DRIFT_OUTLIER_MS * n)
+                used &= (uint8_t) ~(1u << i);
+        }
+        if (used == 0xFF)
+            break;
+    }
+    if (slope > TIMESYNC_DRIFT_MAX_PPM)
+        slope = TIMESYNC_DRIFT_MAX_PPM;
+    if (slope < -TIMESYNC_DRIFT_MAX_PPM)
+        slope = -TIMESYNC_DRIFT_MAX_PPM;
+    *ppm = (int32_t) slope;
+    return 1;
+}
+
+/**
+ * @brief Add an accepted sample to the fit and apply the drift once estimates agree
+ */
+static void update_drift(TimeSync* ts, uint32_t local_ms, int32_t offset_ms) {
+    ts->fit[ts->fit_next].local_ms = local_ms;
+    ts->fit[ts->fit_next].offset_ms = offset_ms;
+    ts->fit_next = (uint8_t) ((ts->fit_next + 1) % TIMESYNC_DRIFT_SAMPLES);
+    if (ts->fit_count < TIMESYNC_DRIFT_SAMPLES)
+        ts->fit_count++;
+
+    int32_t ppm;
+    if (!fit_drift(ts, &ppm)) {
+        return;
+    }
+    int32_t change = ppm - ts->drift_estimate_ppm;
+    if (ts->has_estimate && change <= TIMESYNC_DRIFT_AGREE_PPM &&
+        change >= -TIMESYNC_DRIFT_AGREE_PPM) {
+        ts->drift_ppm = ppm;
+    }
+    ts->drift_estimate_ppm = ppm;
+    ts->has_estimate = 1;
+}
+
+void timesync_init(TimeSync* ts) {
+    memset(ts, 0, sizeof(*ts));
+    ts->min_rtt_ms = 0xFFFF;
+    ts->interval_ms = TIMESYNC_INTERVAL_MS;
+    hal_set_network_clock(0, 0, 0);  // Network time = local time until synchronized
+}
+
+void timesync_poll(TimeSync* ts, Bus* bus, uint8_t my_id) {
+    uint32_t now = hal_millis();
+
+    if (ts->pending) {
+        if ((now - ts->request_ms) < TIMESYNC_TIMEOUT_MS) {
+            return;  // Still waiting for the reply
+        }
+        ts->pending = 0;  // Lost - try again on schedule
+    }
+    if (ts->synced && (now - ts->request_ms) < ts->interval_ms) {
+        return;
+    }
+
+    Frame req;
+    memset(&req, 0, sizeof(req));
+    req.type = MSG_TIME_REQ;
+    req.source = my_id;
+    req.payload_len = MAX_PAYLOAD_SIZE;  // t1 is stamped on transmission
+    proto_finalize(&req);
+
+    ts->request_ms = hal_millis();
+    ts->pending = 1;
+    bus_send(bus, &req);
+}
+
+void timesync_handle_request(Bus* bus, const Frame* request) {
+    if (request->payload_len < 2 || request->source == 0) {
+        return;
+    }
+
+    Frame reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = MSG_TIME;
+    reply.source = 1;
+    reply.payload_len = 8;
+    reply.payload[0] = request->source;  // Requester, so others can ignore it
+    reply.payload[1] = request->payload[0];
+    reply.payload[2] = request->payload[1];
+    u32_to_bytes(hal_network_millis(), &reply.payload[3]);  // t2 until stamped
+    proto_finalize(&reply);
+    bus_send(bus, &reply);
+}
+
+void timesync_handle_reply(TimeSync* ts, const Frame* reply, uint8_t my_id) {
+    if (reply->payload_len < 8) {
+        return;
+    }
+    uint32_t t4 = hal_millis();
+
+    if (reply->payload[0] != my_id || !ts->pending) {
+        // Someone else's reply: good enough to line up TDMA slots to within the
+        // path delay until our own first sample arrives
+        if (!ts->synced && !ts->coarse) {
+            uint32_t sent = bytes_to_u32(&reply->payload[3]) + (uint32_t) reply->payload[7] * 2;
+            hal_set_network_clock(t4, sent, 0);
+            ts->coarse = 1;
+        }
+        return;
+    }
+
+    // Rebuild our transmit time t1 from its low 16 bits: it was sent after queuing
+    uint16_t t1_low = (uint16_t) ((reply->payload[1] << 8) | reply->payload[2]);
+    uint32_t t1 = ts->request_ms + (uint16_t) (t1_low - (uint16_t) ts->request_ms);
+    uint32_t midpoint = bytes_to_u32(&reply->payload[3]);
+    uint32_t hold = (uint32_t) reply->payload[7] * 4;
+    if ((int32_t) (t4 - t1) < 0) {
+        return;  // Not the reply to our request
+    }
+    uint32_t elapsed = t4 - t1;
+    uint32_t rtt = elapsed > hold ? elapsed - hold : 0;
+    ts->pending = 0;
+
+    if (rtt > 0xFFFF) {
+        return;
+    }
+    if (rtt < ts->min_rtt_ms) {
+        ts->min_rtt_ms = (uint16_t) rtt;
+    }
+
+    // Quality filter: a slow round trip was probably queued on one side only,
+    // which breaks the symmetric-path assumption. Give up on the old minimum
+    // if the path has genuinely become slower.
+    if (ts->synced && rtt > 2u * ts->min_rtt_ms + TIMESYNC_RTT_SLACK_MS) {
+        if (++ts->rejected < 4) {
+            return;
+        }
+        ts->min_rtt_ms = (uint16_t) rtt;
+    }
+    ts->rejected = 0;
+
+    uint32_t measured = midpoint + elapsed / 2;  // Coordinator time at t4
+    ts->offset_ms = (int32_t) (measured - t4);
+    ts->rtt_ms = (uint16_t) rtt;
+
+    if (!ts->synced) {
+        // First sample: step the clock
+        ts->ref_network_ms = measured;
+        ts->synced = 1;
+
+        LOG_INFO("TIME synced offset=%ldms rtt=%ums", (long) ts->offset_ms, (unsigned) rtt);
+    } else {
+        // Later samples: slew halfway towards the measurement
+        uint32_t predicted = predict_network(ts, t4);
+        ts->ref_network_ms = predicted + (uint32_t) ((int32_t) (measured - predicted) / 2);
+        if (ts->interval_ms < TIMESYNC_INTERVAL_MAX_MS / 2) {
+            ts->interval_ms *= 2;
+        } else {
+            ts->interval_ms = TIMESYNC_INTERVAL_MAX_MS;
+        }
+
+        LOG_DEBUG("DEBUG: TIME offset=%ldms rtt=%ums drift=%ldppm", (long) ts->offset_ms,
+                  (unsigned) rtt, (long) ts->drift_ppm);
+    }
+    update_drift(ts, t4, ts->offset_ms);
+    ts->ref_local_ms = t4;
+    ts->samples++;
+
+    hal_set_network_clock(ts->ref_local_ms, ts->ref_network_ms, ts->drift_ppm);
+}
+
+void timesync_stamp(Frame* frame) {
+    if (frame->type == MSG_TIME_REQ && frame->payload_len >= 2) {
+        uint16_t t1 = (uint16_t) hal_millis();
+        frame->payload[0] = (uint8_t) (t1 >> 8);
+        frame->payload[1] = (uint8_t) t1;
+    } else if (frame->type == MSG_TIME && frame->payload_len >= 8) {
+        uint32_t t2 = bytes_to_u32(&frame->payload[3]);
+        uint32_t hold = hal_network_millis() - t2;
+        uint32_t units = (hold + 2) / 4;
+        u32_to_bytes(t2 + hold / 2, &frame->payload[3]);
+        frame->payload[7] = (uint8_t) (units > 0xFF ? 0xFF : units);
+    } else {
+        return;
+    }
+    proto_finalize(frame);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file timesync.h
+ * @brief Coordinator-driven network time synchronization (NTP-lite)
+ *
+ * Every board's hal_millis() runs free from its own boot. Members
+ * periodically ask the coordinator for its time, less and less often once
+ * synchronized; the coordinator broadcasts a timestamp in reply. From the
+ * round trip the member estimates its offset to the coordinator's clock
+ * (assuming a symmetric path) and, from a line fitted through the offsets of
+ * the last few samples, the relative drift of the two oscillators.
+ * The resulting correction is installed with hal_set_network_clock(), after
+ * which hal_network_millis() returns network time.
+ *
+ * Timestamps are written by the bus backend just before the frame goes on
+ * the wire (timesync_stamp()), so time spent waiting in a transmit queue -
+ * e.g. for a TDMA slot - does not count as path delay. The coordinator
+ * reports the midpoint of the time it held the request, NTP style, and how
+ * long that was, so only the on-wire delay enters the RTT.
+ *
+ * TIME_REQ Payload (8 bytes): [t1 (2B)][Padding (6B)]
+ * TIME Payload (8 bytes):     [Requester ID][t1 (2B)][Coordinator time (4B)][Hold]
+ *
+ * - t1: low 16 bits of the member's local time at transmission, echoed back
+ * - Coordinator time: midpoint between receiving the request and replying
+ * - Hold: time the coordinator held the request, in 4ms units (saturating)
+ * - The request is padded to the size of the reply so both directions have
+ *   the same airtime
+ *
+ * The achievable accuracy is bounded by half the round-trip time of the
+ * accepted sample, reported in rtt_ms.
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+
+#include "bus_interface.h"
+#include "config.h"
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Interval between TIME requests right after the first sync */
+#define TIMESYNC_INTERVAL_MS 1000
+
+/**
+ * Each accepted sample doubles the interval up to this. Once the clocks
+ * agree, a member asks rarely, so 16 members at 4800 baud spend about 5% of
+ * the line's airtime on time sync instead of most of it.
+ */
+#define TIMESYNC_INTERVAL_MAX_MS 16000
+
+/** An unanswered request is abandoned after this long */
+#define TIMESYNC_TIMEOUT_MS 1500
+
+/**
+ * Accepted samples kept for the drift fit (per profile, config.h; 5 to 8).
+ * At TIMESYNC_INTERVAL_MAX_MS apart, 5 samples still span
+ * TIMESYNC_DRIFT_SPAN_MS.
+ */
+#define TIMESYNC_DRIFT_SAMPLES CONFIG_TIMESYNC_SAMPLES
+
+/** The kept samples must span at least this long before drift is estimated */
+#define TIMESYNC_DRIFT_SPAN_MS 60000
+
+/** Samples further than this from the fitted line are left out of the fit */
+#define TIMESYNC_DRIFT_OUTLIER_MS 3
+
+/** Estimates beyond the tolerance of two crystals are clamped to this */
+#define TIMESYNC_DRIFT_MAX_PPM 200
+
+/**
+ * A new estimate is applied only when it is within this of the previous
+ * one; until then the last applied drift (initially none) stays in force.
+ */
+#define TIMESYNC_DRIFT_AGREE_PPM 20
+
+/** Samples slower than 2 * best RTT + this slack are treated as congested */
+#define TIMESYNC_RTT_SLACK_MS 10
+
+/** @brief One accepted sample, kept for the drift fit */
+typedef struct {
+    uint32_t local_ms; /**< Local time the reply arrived */
+    int32_t offset_ms; /**< Measured network minus local time */
+} TimeSyncSample;
+
+/** @brief Time synchronization state of a member */
+typedef struct {
+    uint8_t pending;            /**< A request is waiting for its reply */
+    uint8_t rejected;           /**< Consecutive samples rejected as congested */
+    uint8_t synced;             /**< At least one sample has been accepted */
+    uint8_t coarse;             /**< Clock stepped from an overheard reply, before syncing */
+    uint32_t request_ms;        /**< Local time the pending request was queued */
+    uint32_t interval_ms;       /**< Current interval between requests */
+    uint16_t min_rtt_ms;        /**< Smallest round trip seen (quality filter) */
+    uint16_t rtt_ms;            /**< Round trip of the last accepted sample */
+    uint32_t ref_local_ms;      /**< Correction reference point: local time */
+    uint32_t ref_network_ms;    /**< Correction reference point: network time */
+    int32_t drift_ppm;          /**< Applied network clock rate vs ours, in ppm */
+    int32_t drift_estimate_ppm; /**< Latest least-squares estimate, in ppm */
+    uint8_t has_estimate;       /**< drift_estimate_ppm holds an estimate */
+    uint8_t fit_count;          /**< Samples in the drift fit */
+    uint8_t fit_next;           /**< Slot the next sample replaces */
+    int32_t offset_ms;          /**< Last measured network minus local time */
+    uint16_t samples;           /**< Accepted samples */
+    /** Recent accepted samples (a ring) */
+    TimeSyncSample fit[TIMESYNC_DRIFT_SAMPLES];
+} TimeSync;
+
+/**
+ * @brief Reset time synchronization and the network clock
+ *
+ * @param ts Time sync state
+ */
+void timesync_init(TimeSync* ts);
+
+/**
+ * @brief Send a TIME request when one is due (call from the member's service loop)
+ *
+ * @param ts Time sync state
+ * @param bus Bus to send on
+ * @param my_id Our assigned ID (the coordinator addresses its reply to it)
+ */
+void timesync_poll(TimeSync* ts, Bus* bus, uint8_t my_id);
+
+/**
+ * @brief Answer a TIME request (coordinator side)
+ *
+ * Queues a TIME reply; the bus stamps the coordinator time when it is sent.
+ *
+ * @param bus Bus to send on
+ * @param request Valid MSG_TIME_REQ frame
+ */
+void timesync_handle_request(Bus* bus, const Frame* request);
+
+/**
+ * @brief Process a TIME reply and update the network clock (member side)
+ *
+ * Replies not matching our pending request are ignored, except that the
+ * first one overheard before we are synced steps the network clock to the
+ * coordinator's send time (off by the path delay), which is enough to find
+ * our TDMA slot. Call it for TIME frames heard while joining too (my_id 0).
+ *
+ * @param ts Time sync state
+ * @param reply Valid MSG_TIME frame from the coordinator
+ * @param my_id Our assigned ID
+ */
+void timesync_handle_reply(TimeSync* ts, const Frame* reply, uint8_t my_id);
+
+/**
+ * @brief Fill in transmit timestamps (call from bus_send just before transmission)
+ *
+ * Stamps TIME_REQ and TIME frames with the current time and updates the
+ * checksum; any other frame is left untouched.
+ *
+ * @param frame Frame about to be transmitted
+ */
+void timesync_stamp(Frame* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TIMESYNC_H
@@ -0,0 +1,142 @@
+/**
+ * @file trace.c
+ * @brief Binary log record encoding and the ring buffer records wait in
+ *
+ * Encoding only walks the format string to learn the argument types; the
+ * text itself is rebuilt on the host.
+ */
+
+#include "trace.h"
+
+#include <string.h>
+
+#include "hal.h"
+
+/** Marker, length, ID and timestamp */
+#define HEADER_BYTES 8
+
+/** Longest LEB128 encoding of a 32-bit value */
+#define VARINT_MAX 5
+
+static uint8_t put_varint(uint8_t* out, uint8_t n, uint32_t v) {
+    while (v >= 0x80) {
+        out[n++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t) v;
+    return n;
+}
+
+static uint8_t put_header(uint8_t* out, uint16_t id, uint32_t ms) {
+    out[0] = TRACE_MARKER;
+    out[2] = (uint8_t) id;
+    out[3] = (uint8_t) (id >> 8);
+    out[4] = (uint8_t) ms;
+    out[5] = (uint8_t) (ms >> 8);
+    out[6] = (uint8_t) (ms >> 16);
+    out[7] = (uint8_t) (ms >> 24);
+    return HEADER_BYTES;
+}
+
+static int is_flag(char c) {
+    return c == '-' || c == '+' || c == ' ' || c == '#' || c == '.' || (c >= '0' && c <= '9');
+}
+
+uint8_t trace_encode(uint8_t* out, uint16_t id, uint32_t ms, const char* fmt, va_list ap) {
+    uint8_t n = put_header(out, id, ms);
+
+    // Characters are read with HAL_FMT_CHAR(): on AVR the format is in flash
+    for (const char* p = fmt; HAL_FMT_CHAR(p); p++) {
+        if (HAL_FMT_CHAR(p) != '%') {
+            continue;
+        }
+        p++;
+        while (is_flag(HAL_FMT_CHAR(p))) {
+            p++;
+        }
+        int is_long = 0;
+        char c;
+        while ((c = HAL_FMT_CHAR(p)) == 'l' || c == 'h') {
+            is_long |= c == 'l';
+            p++;
+        }
+        if (c == '\0') {
+            break;
+        }
+        if (c == '%') {
+            continue;
+        }
+        if (n + VARINT_MAX > TRACE_RECORD_MAX) {
+            break;  // Arguments that do not fit show up as missing on the host
+        }
+
+        if (c == 's') {
+            const char* s = va_arg(ap, const char*);
+            size_t len = s ? strlen(s) : 0;
+            size_t room = TRACE_RECORD_MAX - n - 1u;
+            if (len > TRACE_STRING_MAX) {
+                len = TRACE_STRING_MAX;
+            }
+            if (len > room) {
+                len = room;
+            }
+            out[n++] = (uint8_t) len;
+            memcpy(&out[n], s, len);
+            n = (uint8_t) (n + len);
+        } else if (c == 'd' || c == 'i') {
+            int32_t v = is_long ? (int32_t) va_arg(ap, long) : (int32_t) va_arg(ap, int);
+            n = put_varint(out, n, ((uint32_t) v << 1) ^ (uint32_t) (v >> 31));
+        } else {
+            uint32_t v = is_long ? (uint32_t) va_arg(ap, unsigned long) : va_arg(ap, unsigned);
+            n = put_varint(out, n, v);
+        }
+    }
+
+    out[1] = (uint8_t) (n - 2);
+    return n;
+}
+
+void trace_ring_init(TraceRing* ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+static void ring_write(TraceRing* ring, const uint8_t* data, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        ring->buf[(ring->head + ring->count) % TRACE_RING_SIZE] = data[i];
+        ring->count++;
+    }
+}
+
+int trace_ring_push(TraceRing* ring, const uint8_t* record, uint8_t len, uint32_t ms) {
+    uint8_t report[HEADER_BYTES + VARINT_MAX];
+    uint8_t report_len = 0;
+    if (ring->dropped) {
+        report_len = put_varint(report, put_header(report, TRACE_ID_DROPPED, ms), ring->dropped);
+        report[1] = (uint8_t) (report_len - 2);
+    }
+
+    if (ring->count + report_len + len > TRACE_RING_SIZE) {
+        if (ring->dropped < UINT16_MAX) {
+            ring->dropped++;
+        }
+        return 0;
+    }
+    ring_write(ring, report, report_len);
+    ring_write(ring, record, len);
+    ring->dropped = 0;
+    return 1;
+}
+
+const uint8_t* trace_ring_peek(const TraceRing* ring, uint16_t* len) {
+    uint16_t to_end = (uint16_t) (TRACE_RING_SIZE - ring->head);
+    *len = ring->count < to_end ? ring->count : to_end;
+    return &ring->buf[ring->head];
+}
+
+void trace_ring_consume(TraceRing* ring, uint16_t len) {
+    if (len > ring->count) {
+        len = ring->count;
+    }
+    ring->head = (uint16_t) ((ring->head + len) % TRACE_RING_SIZE);
+    ring->count = (uint16_t) (ring->count - len);
+}
@@ -0,0 +1,125 @@
+/**
+ * @file trace.h
+ * @brief Binary log records for builds with LOG_TRACE set
+ *
+ * Formatting a log line with snprintf() and pushing 40-80 characters over a
+ * slow debug UART costs more than most of the work being logged. In trace
+ * builds LOG_INFO()/LOG_DEBUG() instead hand hal_trace() an ID that names the
+ * call site, and the HAL encodes the ID, a timestamp and the raw arguments
+ * into a record of typically 8-16 bytes. Records wait in a small ring buffer
+ * that the platform drains to its log output in idle time; when the ring is
+ * full a record is dropped rather than waiting for the UART.
+ *
+ * The host rebuilds the text with the format table that
+ * utilities/trace_table.py extracts from the sources (`make trace-table`),
+ * see utilities/trace_decode.py.
+ *
+ * Record Format:
+ * [0xFE][Len][ID (2B)][Timestamp (4B)][Args...]
+ *
+ * - 0xFE never occurs in UTF-8 text, so records can be mixed with plain lines
+ * - Len: bytes after the Len field
+ * - ID: (LOG_FILE_ID << 11) | line of the log call (little-endian)
+ * - Timestamp: hal_millis() when the record was made (little-endian)
+ * - Args, one per conversion in the format: integers as LEB128 varints
+ *   (%d and %i zigzag-encoded), strings as [length][bytes]
+ *
+ * ID 0 reports records lost to a full ring; its one argument is the count.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** First byte of every record */
+#define TRACE_MARKER 0xFE
+
+/** Largest encoded record */
+#define TRACE_RECORD_MAX 64
+
+/** Longest string argument kept in a record; longer ones are truncated */
+#define TRACE_STRING_MAX 40
+
+/** Record ID reporting dropped records */
+#define TRACE_ID_DROPPED 0
+
+/** Bytes of records a ring can hold (per profile, config.h) */
+#define TRACE_RING_SIZE CONFIG_TRACE_RING_SIZE
+
+/** @brief Records waiting to be written out */
+typedef struct {
+    uint8_t buf[TRACE_RING_SIZE]; /**< Record bytes */
+    uint16_t head;                /**< Index of the oldest byte */
+    uint16_t count;               /**< Bytes held */
+    uint16_t dropped;             /**< Records lost since the last drop report */
+} TraceRing;
+
+/**
+ * @brief Encode one record
+ *
+ * Supports the conversions the firmware uses: %d %i %u %x %X %c and %s, with
+ * flags, width and an optional l modifier. Arguments that do not fit in
+ * TRACE_RECORD_MAX bytes are left out.
+ *
+ * @param out Output buffer (TRACE_RECORD_MAX bytes)
+ * @param id Call site ID
+ * @param ms Timestamp
+ * @param fmt printf-style format the arguments belong to (read with
+ *            HAL_FMT_CHAR(), so in flash on AVR)
+ * @param ap Arguments
+ * @return Record length
+ */
+uint8_t trace_encode(uint8_t* out, uint16_t id, uint32_t ms, const char* fmt, va_list ap);
+
+/**
+ * @brief Reset a ring to empty
+ *
+ * @param ring Ring buffer
+ */
+void trace_ring_init(TraceRing* ring);
+
+/**
+ * @brief Append a record, or drop it if the ring has no room
+ *
+ * The first record that fits after a drop is preceded by a TRACE_ID_DROPPED
+ * record carrying the number of records lost.
+ *
+ * @param ring Ring buffer
+ * @param record Encoded record
+ * @param len Record length
+ * @param ms Timestamp for a drop report
+ * @return 1 if stored, 0 if dropped
+ */
+int trace_ring_push(TraceRing* ring, const uint8_t* record, uint8_t len, uint32_t ms);
+
+/**
+ * @brief Oldest bytes in the ring that are contiguous in memory
+ *
+ * @param ring Ring buffer
+ * @param len Output: number of bytes available at the returned pointer
+ * @return Pointer to the bytes (len is 0 when the ring is empty)
+ */
+const uint8_t* trace_ring_peek(const TraceRing* ring, uint16_t* len);
+
+/**
+ * @brief Discard bytes that have been written out
+ *
+ * @param ring Ring buffer
+ * @param len Number of bytes written (at most what trace_ring_peek() returned)
+ */
+void trace_ring_consume(TraceRing* ring, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TRACE_H
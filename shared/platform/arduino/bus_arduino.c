@@ -1,14 +1,27 @@
 // Note: SoftwareSerial.h is included by the .ino file before extern "C"
 #include <Arduino.h>
-#include <stdlib.h>
+#include <new.h>  // Placement new for the pooled SoftwareSerial ports
 
 #include "../../core/bus_interface.h"
 #include "../../core/hal.h"
+#include "../../core/timesync.h"
+
+#undef LOG_FILE_ID
+#define LOG_FILE_ID 3  // Binary trace call site IDs (hal.h)
 
 struct Bus {
     SoftwareSerial* serial;
+    uint32_t baud;  // For frame airtime when fitting frames into TDMA slots
+    MacTdma tdma;
+    uint32_t quiet_since_ms;  // Last time we heard a byte from the line (carrier sense)
+    uint32_t csma_next_ms;    // Next backoff slot boundary
 };
 
+// Buses and their ports live in static storage (BUS_POOL_SIZE of each); a
+// bus is in use while its serial pointer is set
+static Bus g_pool[BUS_POOL_SIZE];
+alignas(SoftwareSerial) static uint8_t g_serial_storage[BUS_POOL_SIZE][sizeof(SoftwareSerial)];
+
 int bus_global_init(uint8_t max_nodes) {
     (void) max_nodes;  // Not needed for Arduino
     return 0;
@@ -21,19 +34,23 @@ void bus_global_shutdown(void) {
 int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
     (void) node_index;  // Not used for UART
 
-    Bus* b = (Bus*) malloc(sizeof(Bus));
-    if (!b)
+    uint8_t i = 0;
+    while (i < BUS_POOL_SIZE && g_pool[i].serial)
+        i++;
+    if (i == BUS_POOL_SIZE)
         return -1;
 
-    b->serial = new SoftwareSerial(rx_pin, tx_pin, false);  // false = normal logic
-    if (!b->serial) {
-        free(b);
-        return -1;
-    }
+    Bus* b = &g_pool[i];
+    // false = normal logic
+    b->serial = new (g_serial_storage[i]) SoftwareSerial(rx_pin, tx_pin, false);
 
     // Start with default baud rate - this gets immediately overridden by bus_set_baud()
     // in AutoSort.ino with board-specific rates (4800 for ATmega328P, 9600 for Arduino Uno)
     b->serial->begin(9600);
+    b->baud = 9600;
+    mac_tdma_init(&b->tdma);
+    b->quiet_since_ms = 0;
+    b->csma_next_ms = 0;
     *bus = b;
     return 0;
 }
@@ -41,9 +58,9 @@ int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
 void bus_destroy(Bus* bus) {
     if (bus) {
         if (bus->serial) {
-            delete bus->serial;
+            bus->serial->~SoftwareSerial();
+            bus->serial = NULL;  // Back to the pool
         }
-        free(bus);
     }
 }
 
@@ -52,51 +69,112 @@ void bus_set_baud(Bus* bus, uint32_t baud) {
     if (bus && bus->serial) {
         bus->serial->end();
         bus->serial->begin(baud);
+        bus->baud = baud;
     }
 }
 
-int bus_send(Bus* bus, const Frame* frame) {
-    if (!bus || !bus->serial || !frame)
-        return -1;
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        // SoftwareSerial cannot listen while it transmits, so there is no echo to check
+        bus->tdma.csma.mode = mode == MAC_CSMA_ECHO ? MAC_CSMA_ON : mode;
+    }
+}
 
+static int transmit(Bus* bus, const Frame* frame) {
     Frame f = *frame;
     proto_finalize(&f);
+    timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
 
-    // Manually serialize frame to avoid struct padding issues
-    uint8_t buffer[5 + MAX_PAYLOAD_SIZE + 1]; // max possible frame size
-    buffer[0] = f.sof;
-    buffer[1] = f.type;
-    buffer[2] = f.source;
-    buffer[3] = f.payload_len;
-    
-    // Copy only the used payload bytes
-    for (uint8_t i = 0; i < f.payload_len; i++) {
-        buffer[4 + i] = f.payload[i];
-    }
-    
-    buffer[4 + f.payload_len] = f.checksum;
-    
-    size_t len = 5 + f.payload_len;  // sof + type + source + len + payload + checksum
+    uint8_t buffer[PROTO_MAX_FRAME_BYTES];
+    size_t len = proto_serialize(&f, buffer);
 
-    // Debug output
-    Serial.print("DEBUG: [UNO] Sending frame: ");
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    char hex[3 * sizeof(buffer) + 1];
     for (size_t i = 0; i < len; i++) {
-        Serial.print("0x");
-        Serial.print(buffer[i], HEX);
-        Serial.print(" ");
+        snprintf(&hex[3 * i], 4, "%02X ", buffer[i]);
     }
-    Serial.println();
+    LOG_DEBUG("DEBUG: [UNO] Sending frame: %s", hex);
+#endif
 
-    int result = bus->serial->write(buffer, len) == (int) len ? 1 : 0;
-    Serial.println("DEBUG: [UNO] Send result: " + String(result));
+    int result = bus->serial->write(buffer, len) == len ? 1 : 0;
+    LOG_DEBUG("DEBUG: [UNO] Send result: %d", result);
     return result;
 }
 
-static int read_byte(SoftwareSerial* serial, uint8_t* byte, uint16_t timeout_ms) {
+// Time for n characters on the line, rounded up to whole milliseconds
+static uint32_t chars_ms(const Bus* bus, uint8_t n) {
+    return (n * 10000UL + bus->baud - 1) / bus->baud;
+}
+
+// Carrier sense: unread bytes mean another board is talking right now
+static uint32_t line_quiet_since(Bus* bus) {
+    if (bus->serial->available()) {
+        bus->quiet_since_ms = hal_millis();
+    }
+    return bus->quiet_since_ms;
+}
+
+// Run carrier sense for the held frame, one backoff slot at a time
+static int csma_ready(Bus* bus, const Frame* frame) {
+    uint32_t now = hal_millis();
+    if ((int32_t) (now - bus->csma_next_ms) < 0) {
+        return 0;
+    }
+    // Backoff slots start when the line went quiet, as on every other board
+    uint32_t idle_at = line_quiet_since(bus) + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+    int idle = (int32_t) (now - idle_at) >= 0;
+    bus->csma_next_ms = idle ? now + chars_ms(bus, MAC_CSMA_SLOT_CHARS) : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+// Send held frames whose TDMA slot has come or that won carrier sense
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if (!csma_ready(bus, f))
+                break;
+            transmit(bus, f);  // Blocks until the frame is out
+            mac_csma_sent(&bus->tdma.csma, 0);
+            mac_tdma_pop(&bus->tdma);
+            bus->csma_next_ms = hal_millis() + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+        uint16_t airtime_ms = (uint16_t) ((5 + f->payload_len) * 10000UL / bus->baud + 1);
+        if (mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms) != 0)
+            break;
+        transmit(bus, f);
+        mac_tdma_pop(&bus->tdma);
+    }
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || !bus->serial || !frame)
+        return -1;
+
+    // Hold the frame for carrier sense or our slot (and behind anything already held)
+    if (bus->tdma.count || bus->tdma.csma.mode != MAC_CSMA_OFF ||
+        mac_tdma_active(&bus->tdma, hal_network_millis())) {
+        int queued = mac_tdma_enqueue(&bus->tdma, frame);
+        tdma_flush(bus);
+        return queued;
+    }
+    return transmit(bus, frame);
+}
+
+static int read_byte(Bus* bus, uint8_t* byte, uint16_t timeout_ms) {
     uint32_t start = hal_millis();
     while ((hal_millis() - start) < timeout_ms) {
-        if (serial->available()) {
-            *byte = (uint8_t) serial->read();
+        if (bus->serial->available()) {
+            *byte = (uint8_t) bus->serial->read();
+            bus->quiet_since_ms = hal_millis();  // Read as it arrives: close to its end
             return 1;
         }
         hal_yield();
@@ -109,22 +187,27 @@ int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
         return -1;
 
     uint32_t start = hal_millis();
+    tdma_flush(bus);
 
     // Find start-of-frame
     while ((hal_millis() - start) < timeout_ms) {
+        if (bus->tdma.count && !bus->serial->available()) {
+            tdma_flush(bus);  // Our slot (or backoff slot) may have come while we wait
+        }
         if (bus->serial->available()) {
             uint8_t b = (uint8_t) bus->serial->read();
-            Serial.println("DEBUG: [UNO] Received byte: 0x" + String(b, HEX));
+            bus->quiet_since_ms = hal_millis();
+            LOG_DEBUG("DEBUG: [UNO] Received byte: 0x%02X", b);
             if (b == SOF) {
-                Serial.println("DEBUG: [UNO] Found SOF, reading frame...");
+                LOG_DEBUG("DEBUG: [UNO] Found SOF, reading frame...");
                 frame->sof = b;
 
                 // Read fixed header
-                if (!read_byte(bus->serial, &frame->type, timeout_ms))
+                if (!read_byte(bus, &frame->type, timeout_ms))
                     return 0;
-                if (!read_byte(bus->serial, &frame->source, timeout_ms))
+                if (!read_byte(bus, &frame->source, timeout_ms))
                     return 0;
-                if (!read_byte(bus->serial, &frame->payload_len, timeout_ms))
+                if (!read_byte(bus, &frame->payload_len, timeout_ms))
                     return 0;
 
                 if (frame->payload_len > MAX_PAYLOAD_SIZE)
@@ -132,17 +215,17 @@ int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
 
                 // Read payload
                 for (uint8_t i = 0; i < frame->payload_len; ++i) {
-                    if (!read_byte(bus->serial, &frame->payload[i], timeout_ms))
+                    if (!read_byte(bus, &frame->payload[i], timeout_ms))
                         return 0;
                 }
 
                 // Read checksum
-                if (!read_byte(bus->serial, &frame->checksum, timeout_ms))
+                if (!read_byte(bus, &frame->checksum, timeout_ms))
                     return 0;
 
-                Serial.println("DEBUG: [UNO] Frame complete - type=" + String(frame->type) + " source=" + String(frame->source));
                 int valid = proto_is_valid(frame);
-                Serial.println("DEBUG: [UNO] Frame valid: " + String(valid));
+                LOG_DEBUG("DEBUG: [UNO] Frame complete - type=%u source=%u valid=%d", frame->type,
+                          frame->source, valid);
                 return valid ? 1 : 0;
             }
         }
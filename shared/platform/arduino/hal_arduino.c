@@ -1,30 +1,156 @@
+// Note: EEPROM.h is included by the .ino file before extern "C"
 #include <Arduino.h>
+#include <stdarg.h>
 
 #include "../../core/hal.h"
+#include "../../core/rng.h"
+#include "../../core/trace.h"
+
+// Identity cache layout in EEPROM (UNO R4: emulated in data flash):
+// [magic][id][epoch hi][epoch lo][check] per slot
+#define IDENTITY_MAGIC 0x5A
+#define IDENTITY_RECORD_SIZE 5
+
+// Network clock correction installed by the time sync service
+static uint32_t g_ref_local_ms = 0;
+static uint32_t g_ref_network_ms = 0;
+static int32_t g_drift_ppm = 0;
+
+// hal_random32() state, seeded from ADC noise unless hal_random_seed() is called
+static Rng g_rng;
+
+// Binary log records waiting for room in Serial's transmit buffer (LOG_TRACE)
+static TraceRing g_trace;
+
+#if !defined(ARDUINO_ARCH_AVR)
+// Bytes written per idle call where Serial does not report its free space
+#define TRACE_DRAIN_CHUNK 8
+#endif
 
 void hal_init(void) {
-    randomSeed(analogRead(A0));
+    // The floating pin's lowest bit and the time each conversion takes both jitter
+    uint32_t seed = micros();
+    for (uint8_t i = 0; i < 32; i++) {
+        seed = ((seed << 1) | (seed >> 31)) ^ (uint32_t) analogRead(A0) ^ micros();
+    }
+    rng_seed(&g_rng, seed);
+    trace_ring_init(&g_trace);
+}
+
+// Write out as much of the trace ring as Serial takes without waiting
+static void trace_drain(void) {
+    while (g_trace.count) {
+#if defined(ARDUINO_ARCH_AVR)
+        int room = Serial.availableForWrite();
+#else
+        int room = TRACE_DRAIN_CHUNK;
+#endif
+        if (room <= 0)
+            return;
+        uint16_t len;
+        const uint8_t* bytes = trace_ring_peek(&g_trace, &len);
+        if (len > room)
+            len = (uint16_t) room;
+        Serial.write(bytes, len);
+        trace_ring_consume(&g_trace, len);
+#if !defined(ARDUINO_ARCH_AVR)
+        return;  // One chunk per idle call
+#endif
+    }
 }
 
 uint32_t hal_millis(void) {
     return millis();
 }
 
+uint32_t hal_network_millis(void) {
+    int32_t elapsed = (int32_t) (millis() - g_ref_local_ms);
+    int64_t corrected = (int64_t) elapsed + (int64_t) elapsed * g_drift_ppm / 1000000;
+    return g_ref_network_ms + (uint32_t) corrected;
+}
+
+void hal_set_network_clock(uint32_t ref_local_ms, uint32_t ref_network_ms, int32_t drift_ppm) {
+    g_ref_local_ms = ref_local_ms;
+    g_ref_network_ms = ref_network_ms;
+    g_drift_ppm = drift_ppm;
+}
+
 void hal_delay(uint32_t ms) {
     delay(ms);
 }
 
 void hal_yield(void) {
+    trace_drain();
     yield();
 }
 
 uint32_t hal_random32(void) {
-    uint32_t a = (uint32_t) random(0, 65536);
-    uint32_t b = (uint32_t) random(0, 65536);
-    return (a << 16) | b;
+    return rng_next(&g_rng);
+}
+
+void hal_random_seed(uint64_t seed) {
+    rng_seed(&g_rng, seed);
 }
 
 void hal_log(const char* msg) {
     Serial.println(msg);
 }
 
+void hal_logf(const char* fmt, ...) {
+    char line[HAL_LOG_MAX];
+
+    va_list ap;
+    va_start(ap, fmt);
+#if defined(__AVR__)
+    vsnprintf_P(line, sizeof(line), fmt, ap);  // Format kept in flash (HAL_LOG_ARGS)
+#else
+    vsnprintf(line, sizeof(line), fmt, ap);
+#endif
+    va_end(ap);
+
+    hal_log(line);
+}
+
+void hal_trace(uint16_t id, const char* fmt, ...) {
+    uint8_t record[TRACE_RECORD_MAX];
+    uint32_t ms = millis();
+
+    va_list ap;
+    va_start(ap, fmt);
+    uint8_t len = trace_encode(record, id, ms, fmt, ap);
+    va_end(ap);
+
+    trace_ring_push(&g_trace, record, len, ms);
+}
+
+
+int hal_identity_load(uint8_t slot, uint8_t* id, uint16_t* epoch) {
+    int addr = slot * IDENTITY_RECORD_SIZE;
+    uint8_t magic = EEPROM.read(addr);
+    uint8_t stored_id = EEPROM.read(addr + 1);
+    uint8_t hi = EEPROM.read(addr + 2);
+    uint8_t lo = EEPROM.read(addr + 3);
+    uint8_t check = EEPROM.read(addr + 4);
+
+    // Erased or never written EEPROM reads back as 0xFF
+    if (magic != IDENTITY_MAGIC || check != (uint8_t) (magic ^ stored_id ^ hi ^ lo) ||
+        stored_id == 0) {
+        return 0;
+    }
+    *id = stored_id;
+    *epoch = (uint16_t) ((hi << 8) | lo);
+    return 1;
+}
+
+void hal_identity_store(uint8_t slot, uint8_t id, uint16_t epoch) {
+    int addr = slot * IDENTITY_RECORD_SIZE;
+    uint8_t hi = (uint8_t) (epoch >> 8);
+    uint8_t lo = (uint8_t) epoch;
+
+    // update() only writes bytes that changed, sparing EEPROM wear
+    EEPROM.update(addr, IDENTITY_MAGIC);
+    EEPROM.update(addr + 1, id);
+    EEPROM.update(addr + 2, hi);
+    EEPROM.update(addr + 3, lo);
+    EEPROM.update(addr + 4, (uint8_t) (IDENTITY_MAGIC ^ id ^ hi ^ lo));
+}
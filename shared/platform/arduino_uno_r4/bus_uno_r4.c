@@ -4,18 +4,52 @@
  *
  * Uses hardware Serial1 (pins 0 RX, 1 TX) instead of SoftwareSerial.
  * This avoids all the SoftwareSerial issues on the Renesas RA4M1 architecture.
+ *
+ * Nothing here waits on the wire. The UART's interrupt-driven buffer is
+ * drained into a frame parser whenever the bus is touched, and complete
+ * frames land in a small ring, so bus_recv(bus, frame, 0) returns at once.
+ * Outgoing frames always go through the MAC hold queue and are written to
+ * the UART only once the previous frame has left the line, so write()
+ * never blocks on a full transmit buffer.
  */
 
 #include <Arduino.h>
-#include <stdlib.h>
+#include <string.h>
 
 #include "../../core/bus_interface.h"
 #include "../../core/hal.h"
+#include "../../core/timesync.h"
+
+#undef LOG_FILE_ID
+#define LOG_FILE_ID 4  // Binary trace call site IDs (hal.h)
+
+/** Complete frames buffered between bus_recv() calls */
+#define R4_RX_FRAMES 8
 
 struct Bus {
     HardwareSerial* serial;
+    uint32_t baud;  // For frame airtime when fitting frames into TDMA slots
+    MacTdma tdma;
+    uint32_t quiet_since_ms;  // Last time we heard a byte from the line (carrier sense)
+    uint32_t csma_next_ms;    // Next backoff slot boundary
+
+    // Receive side: bytes are parsed into frames as they are drained
+    ProtoParser parser;           // Frame being assembled (proto.h)
+    Frame rx_ring[R4_RX_FRAMES];  // Complete, valid frames
+    uint8_t rx_head;              // Index of the oldest complete frame
+    uint8_t rx_count;             // Number of complete frames
+
+    // Transmit side
+    uint32_t tx_done_ms;                  // When the frame last written has left the line
+    uint8_t echo[PROTO_MAX_FRAME_BYTES];  // Bytes we expect to hear back (MAC_CSMA_ECHO)
+    uint8_t echo_len;                     // Length of the pending echo (0 = none)
+    uint8_t echo_pos;                     // Echo bytes matched so far
+    uint8_t echo_bad;                     // A byte did not match: collision
 };
 
+// Static pool of BUS_POOL_SIZE buses; a bus is in use while its serial pointer is set
+static Bus g_pool[BUS_POOL_SIZE];
+
 int bus_global_init(uint8_t max_nodes) {
     (void) max_nodes;  // Not needed for hardware serial
     return 0;
@@ -30,14 +64,21 @@ int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
     (void) rx_pin;      // Hardware serial pins are fixed (0 RX, 1 TX)
     (void) tx_pin;      // Hardware serial pins are fixed (0 RX, 1 TX)
 
-    Bus* b = (Bus*) malloc(sizeof(Bus));
-    if (!b)
+    uint8_t i = 0;
+    while (i < BUS_POOL_SIZE && g_pool[i].serial)
+        i++;
+    if (i == BUS_POOL_SIZE)
         return -1;
 
+    Bus* b = &g_pool[i];
+    memset(b, 0, sizeof(*b));
+
     // Use Serial1 (pins 0 RX, 1 TX) on Arduino UNO R4 WiFi
     b->serial = &Serial1;
     b->serial->begin(9600);  // Match ping-pong baud rate
-    
+    b->baud = 9600;
+    mac_tdma_init(&b->tdma);
+
     *bus = b;
     return 0;
 }
@@ -47,7 +88,7 @@ void bus_destroy(Bus* bus) {
         if (bus->serial) {
             bus->serial->end();
         }
-        free(bus);
+        bus->serial = NULL;  // Back to the pool
     }
 }
 
@@ -55,56 +96,175 @@ void bus_set_baud(Bus* bus, uint32_t baud) {
     if (bus && bus->serial) {
         bus->serial->end();
         bus->serial->begin(baud);
+        bus->baud = baud;
     }
 }
 
-int bus_send(Bus* bus, const Frame* frame) {
-    if (!bus || !bus->serial || !frame)
-        return -1;
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        bus->tdma.csma.mode = mode;
+    }
+}
+
+// Time for n characters on the line, rounded up to whole milliseconds
+static uint32_t chars_ms(const Bus* bus, uint8_t n) {
+    return (n * 10000UL + bus->baud - 1) / bus->baud;
+}
+
+// Feed one received byte to the frame parser
+static void rx_byte(Bus* bus, uint8_t b) {
+    int result = proto_parse_byte(&bus->parser, b);
+    if (result == 0) {
+        return;
+    }
+    const Frame* f = &bus->parser.frame;
+    LOG_DEBUG("DEBUG: [R4] Frame complete - type=%u source=%u valid=%d", f->type, f->source,
+              result > 0);
+    if (result > 0 && bus->rx_count < R4_RX_FRAMES) {
+        bus->rx_ring[(bus->rx_head + bus->rx_count) % R4_RX_FRAMES] = *f;
+        bus->rx_count++;
+    }
+}
+
+// Drain the UART receive buffer without waiting for more
+static void rx_pump(Bus* bus) {
+    while (bus->serial->available()) {
+        uint8_t b = (uint8_t) bus->serial->read();
+        bus->quiet_since_ms = hal_millis();  // Drained as it arrives: close to its end
+
+        if (bus->echo_pos < bus->echo_len && !bus->echo_bad) {
+            // Our own frame coming back on a shared wire
+            if (b == bus->echo[bus->echo_pos]) {
+                bus->echo_pos++;
+                continue;
+            }
+            bus->echo_bad = 1;  // Garbled: let the parser look for a frame in it
+        }
+        rx_byte(bus, b);
+    }
+}
+
+// Hand a frame to the UART; returns 0 if the line is still busy with our last one
+static int transmit(Bus* bus, const Frame* frame) {
+    if ((int32_t) (hal_millis() - bus->tx_done_ms) < 0) {
+        return 0;
+    }
 
     Frame f = *frame;
     proto_finalize(&f);
+    timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
 
-    // Manually serialize frame to avoid struct padding issues
-    uint8_t buffer[5 + MAX_PAYLOAD_SIZE + 1]; // max possible frame size
-    buffer[0] = f.sof;
-    buffer[1] = f.type;
-    buffer[2] = f.source;
-    buffer[3] = f.payload_len;
-    
-    // Copy only the used payload bytes
-    for (uint8_t i = 0; i < f.payload_len; i++) {
-        buffer[4 + i] = f.payload[i];
-    }
-    
-    buffer[4 + f.payload_len] = f.checksum;
-    
-    size_t len = 5 + f.payload_len;  // sof + type + source + len + payload + checksum
-
-    // Debug output
-    Serial.print("DEBUG: [R4] Sending frame: ");
-    for (size_t i = 0; i < len; i++) {
-        Serial.print("0x");
-        Serial.print(buffer[i], HEX);
-        Serial.print(" ");
-    }
-    Serial.println();
-
-    int result = bus->serial->write(buffer, len) == (int) len ? 1 : 0;
-    Serial.println("DEBUG: [R4] Send result: " + String(result));
-    return result;
-}
-
-static int read_byte(HardwareSerial* serial, uint8_t* byte, uint16_t timeout_ms) {
-    uint32_t start = hal_millis();
-    while ((hal_millis() - start) < timeout_ms) {
-        if (serial->available()) {
-            *byte = (uint8_t) serial->read();
-            return 1;
+    uint8_t buffer[PROTO_MAX_FRAME_BYTES];
+    uint8_t len = proto_serialize(&f, buffer);
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    char hex[3 * PROTO_MAX_FRAME_BYTES + 1];
+    for (uint8_t i = 0; i < len; i++) {
+        snprintf(&hex[3 * i], 4, "%02X ", buffer[i]);
+    }
+    LOG_DEBUG("DEBUG: [R4] Sending frame: %s", hex);
+#endif
+
+    // The transmit buffer has drained by now, so this returns without waiting
+    bus->serial->write(buffer, len);
+    bus->tx_done_ms = hal_millis() + chars_ms(bus, len);
+
+    if (bus->tdma.csma.mode == MAC_CSMA_ECHO) {
+        memcpy(bus->echo, buffer, len);
+        bus->echo_len = len;
+        bus->echo_pos = 0;
+        bus->echo_bad = 0;
+    }
+    return 1;
+}
+
+// Carrier sense: when did we last hear a byte from the line?
+static uint32_t line_quiet_since(Bus* bus) {
+    rx_pump(bus);
+    return bus->quiet_since_ms;
+}
+
+// Run carrier sense for the held frame, one backoff slot at a time
+static int csma_ready(Bus* bus, const Frame* frame) {
+    uint32_t now = hal_millis();
+    if ((int32_t) (now - bus->csma_next_ms) < 0) {
+        return 0;
+    }
+    // Backoff slots start when the line went quiet, as on every other board
+    uint32_t idle_at = line_quiet_since(bus) + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+    int idle = (int32_t) (now - idle_at) >= 0;
+    bus->csma_next_ms = idle ? now + chars_ms(bus, MAC_CSMA_SLOT_CHARS) : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+// Echo check for the frame just sent: -1 while it is still arriving, else 1 if it collided
+static int echo_result(Bus* bus) {
+    if (bus->echo_bad) {
+        return 1;
+    }
+    if (bus->echo_pos == bus->echo_len) {
+        return 0;
+    }
+    // Allow two character times past the end of the frame for the last byte
+    if ((int32_t) (hal_millis() - (bus->tx_done_ms + chars_ms(bus, 2))) < 0) {
+        return -1;
+    }
+    return 1;  // Missing bytes: a collision can swallow characters too
+}
+
+// Send held frames whose TDMA slot has come or that won carrier sense
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->echo_len) {
+            int collided = echo_result(bus);
+            if (collided < 0)
+                break;  // Pop once the echo has been checked
+            bus->echo_len = 0;
+            if (!mac_csma_sent(&bus->tdma.csma, collided))
+                mac_tdma_pop(&bus->tdma);
+            bus->csma_next_ms = bus->tx_done_ms + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
         }
-        hal_yield();
+
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if ((int32_t) (hal_millis() - bus->tx_done_ms) < 0 || !csma_ready(bus, f))
+                break;
+            transmit(bus, f);
+            if (bus->echo_len)
+                continue;
+            mac_csma_sent(&bus->tdma.csma, 0);
+            mac_tdma_pop(&bus->tdma);
+            bus->csma_next_ms = bus->tx_done_ms + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+
+        uint16_t airtime_ms = (uint16_t) ((5 + f->payload_len) * 10000UL / bus->baud + 1);
+        if (mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms) != 0)
+            break;
+        if (!transmit(bus, f))
+            break;
+        bus->echo_len = 0;  // Only carrier sense acts on the echo
+        mac_tdma_pop(&bus->tdma);
     }
-    return 0;
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || !bus->serial || !frame)
+        return -1;
+
+    // Every frame goes through the hold queue so the caller never waits on the line
+    rx_pump(bus);
+    int queued = mac_tdma_enqueue(&bus->tdma, frame);
+    tdma_flush(bus);
+    return queued;
 }
 
 int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
@@ -112,45 +272,19 @@ int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
         return -1;
 
     uint32_t start = hal_millis();
+    for (;;) {
+        rx_pump(bus);
+        tdma_flush(bus);  // Our slot (or backoff slot) may have come while we wait
 
-    // Find start-of-frame
-    while ((hal_millis() - start) < timeout_ms) {
-        if (bus->serial->available()) {
-            uint8_t b = (uint8_t) bus->serial->read();
-            Serial.println("DEBUG: [R4] Received byte: 0x" + String(b, HEX));
-            if (b == SOF) {
-                Serial.println("DEBUG: [R4] Found SOF, reading frame...");
-                frame->sof = b;
-
-                // Read fixed header
-                if (!read_byte(bus->serial, &frame->type, timeout_ms))
-                    return 0;
-                if (!read_byte(bus->serial, &frame->source, timeout_ms))
-                    return 0;
-                if (!read_byte(bus->serial, &frame->payload_len, timeout_ms))
-                    return 0;
-
-                if (frame->payload_len > MAX_PAYLOAD_SIZE)
-                    return 0;
-
-                // Read payload
-                for (uint8_t i = 0; i < frame->payload_len; ++i) {
-                    if (!read_byte(bus->serial, &frame->payload[i], timeout_ms))
-                        return 0;
-                }
-
-                // Read checksum
-                if (!read_byte(bus->serial, &frame->checksum, timeout_ms))
-                    return 0;
-
-                Serial.println("DEBUG: [R4] Frame complete - type=" + String(frame->type) + " source=" + String(frame->source));
-                int valid = proto_is_valid(frame);
-                Serial.println("DEBUG: [R4] Frame valid: " + String(valid));
-                return valid ? 1 : 0;
-            }
+        if (bus->rx_count) {
+            *frame = bus->rx_ring[bus->rx_head];
+            bus->rx_head = (uint8_t) ((bus->rx_head + 1) % R4_RX_FRAMES);
+            bus->rx_count--;
+            return 1;
+        }
+        if ((hal_millis() - start) >= timeout_ms) {
+            return 0;  // Timeout (or no frame yet, non-blocking)
         }
         hal_yield();
     }
-
-    return 0;  // Timeout
 }
@@ -0,0 +1,406 @@
+/**
+ * @file bus_pty.c
+ * @brief Bus implementation over a pseudo-terminal joined to sim/pty_hub
+ *
+ * This is the UART backend of the UNO R4 (bus_uno_r4.c) with the serial
+ * port swapped for a pseudo-terminal: frames go out as their wire bytes,
+ * received bytes are drained into the shared frame parser whenever the bus
+ * is touched, and complete frames land in a small ring. Outgoing frames go
+ * through the MAC hold queue and are written only once the previous frame
+ * has left the line. Carrier sense listens for bytes, and MAC_CSMA_ECHO
+ * compares the bytes that come back with the ones sent.
+ *
+ * A real UART frames every byte with start and stop bits; here bytes come
+ * through the hub in bursts, so a frame cut off mid-way (its sender
+ * crashed, or noise ate its length byte) is dropped once no byte has
+ * arrived for PTY_GAP_CHARS character times, as the ATmega backend does
+ * when a byte is late.
+ */
+
+#define _GNU_SOURCE  // cfmakeraw()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../core/bus_interface.h"
+#include "../../core/hal.h"
+#include "../../core/timesync.h"
+#include "bus_pty.h"
+
+/** Complete frames buffered between bus_recv() calls */
+#define PTY_RX_FRAMES 8
+
+/** A partial frame is dropped after this many character times without a byte */
+#define PTY_GAP_CHARS 20
+
+/** ...but never sooner than this: the hub and the scheduler add delays a UART does not */
+#define PTY_GAP_MIN_MS 10
+
+/** Extra time allowed for our own bytes to come back through the hub */
+#define PTY_ECHO_SLACK_MS 5
+
+/** How long bus_create() waits for the hub to link the port */
+#define PTY_OPEN_TIMEOUT_MS 2000
+
+struct Bus {
+    int fd;  // Our port; -1 while the bus is free
+    uint32_t baud;
+    MacTdma tdma;
+    uint32_t quiet_since_ms;  // Last time we heard a byte from the line (carrier sense)
+    uint32_t csma_next_ms;    // Next backoff slot boundary
+
+    // Receive side: bytes are parsed into frames as they are drained
+    ProtoParser parser;            // Frame being assembled (proto.h)
+    uint32_t last_byte_ms;         // When the last byte arrived, to time out partial frames
+    Frame rx_ring[PTY_RX_FRAMES];  // Complete, valid frames
+    uint8_t rx_head;               // Index of the oldest complete frame
+    uint8_t rx_count;              // Number of complete frames
+    uint8_t rx_buf[256];           // Bytes read from the port, parsed up to rx_pos
+    uint16_t rx_pos;
+    uint16_t rx_len;
+
+    // Transmit side
+    uint32_t tx_done_ms;                  // When the frame last written has left the line
+    uint8_t echo[PROTO_MAX_FRAME_BYTES];  // Bytes we expect to hear back (MAC_CSMA_ECHO)
+    uint8_t echo_len;                     // Length of the pending echo (0 = none)
+    uint8_t echo_pos;                     // Echo bytes matched so far
+    uint8_t echo_bad;                     // A byte did not match: collision
+};
+
+static const char* g_dir = BUS_PTY_DEFAULT_DIR;
+static Bus g_pool[BUS_POOL_SIZE];
+static int g_pool_ready = 0;
+
+// Counters for bus_pty_get_stats(), per process (one node per process)
+static uint32_t g_sent;
+static uint32_t g_bad;
+static uint32_t g_cut;
+static uint64_t g_bytes;
+static uint64_t g_parse_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void bus_pty_set_dir(const char* dir) {
+    g_dir = dir ? dir : BUS_PTY_DEFAULT_DIR;
+}
+
+void bus_pty_get_stats(uint32_t* frames_sent, uint32_t* frames_bad, uint32_t* frames_cut,
+                       uint64_t* bytes_parsed, uint64_t* parse_ns) {
+    *frames_sent = g_sent;
+    *frames_bad = g_bad;
+    *frames_cut = g_cut;
+    *bytes_parsed = g_bytes;
+    *parse_ns = g_parse_ns;
+}
+
+int bus_global_init(uint8_t max_nodes) {
+    (void) max_nodes;  // The hub sets the number of ports
+    if (!g_pool_ready) {
+        for (size_t i = 0; i < BUS_POOL_SIZE; ++i)
+            g_pool[i].fd = -1;
+        g_pool_ready = 1;
+    }
+    return 0;
+}
+
+void bus_global_shutdown(void) {
+    // Nothing to do: the ports belong to the buses
+}
+
+// Open the hub's port for this node in raw mode, waiting for the hub to link it
+static int open_port(uint8_t node_index) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/node%u", g_dir, node_index);
+    uint32_t start = hal_millis();
+    int fd;
+    while ((fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)) < 0) {
+        if (errno != ENOENT || hal_millis() - start > PTY_OPEN_TIMEOUT_MS)
+            return -1;
+        hal_delay(10);
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIFLUSH);  // Whatever the line carried before we were powered up
+    return fd;
+}
+
+int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
+    (void) rx_pin;  // The port is chosen by node_index
+    (void) tx_pin;
+
+    if (!g_pool_ready || node_index >= BUS_PTY_MAX_NODES)
+        return -1;
+    size_t i = 0;
+    while (i < BUS_POOL_SIZE && g_pool[i].fd >= 0)
+        i++;
+    if (i == BUS_POOL_SIZE)
+        return -1;
+
+    int fd = open_port(node_index);
+    if (fd < 0)
+        return -1;
+    Bus* b = &g_pool[i];
+    memset(b, 0, sizeof(*b));
+    b->fd = fd;
+    mac_tdma_init(&b->tdma);
+    *bus = b;
+    return 0;
+}
+
+void bus_destroy(Bus* bus) {
+    if (bus && bus->fd >= 0) {
+        close(bus->fd);
+        bus->fd = -1;  // Back to the pool
+    }
+}
+
+void bus_set_baud(Bus* bus, uint32_t baud) {
+    if (bus) {
+        bus->baud = baud;  // The hub clocks the line; this is for our own timing
+    }
+}
+
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        bus->tdma.csma.mode = mode;
+    }
+}
+
+// Time for n characters on the line, rounded up to whole milliseconds (0 = no baud rate)
+static uint32_t chars_ms(const Bus* bus, uint8_t n) {
+    if (bus->baud == 0)
+        return 0;
+    return (n * 10000UL + bus->baud - 1) / bus->baud;
+}
+
+// Feed one received byte to the frame parser
+static void rx_byte(Bus* bus, uint8_t b) {
+    int result = proto_parse_byte(&bus->parser, b);
+    if (result < 0) {
+        g_bad++;
+    } else if (result > 0 && bus->rx_count < PTY_RX_FRAMES) {
+        bus->rx_ring[(bus->rx_head + bus->rx_count) % PTY_RX_FRAMES] = bus->parser.frame;
+        bus->rx_count++;
+    }
+}
+
+// Drain the port without waiting for more, until the frame ring is full: then the
+// bytes wait in the port and the hub holds the line, like a UART with flow control
+static void rx_pump(Bus* bus) {
+    while (bus->rx_count < PTY_RX_FRAMES) {
+        if (bus->rx_pos == bus->rx_len) {
+            ssize_t n = read(bus->fd, bus->rx_buf, sizeof(bus->rx_buf));
+            if (n <= 0)
+                break;
+            bus->rx_pos = 0;
+            bus->rx_len = (uint16_t) n;
+            uint32_t now = hal_millis();
+            bus->quiet_since_ms = now;  // Drained as it arrives: close to its end
+            bus->last_byte_ms = now;
+        }
+
+        uint64_t start = now_ns();
+        uint16_t first = bus->rx_pos;
+        while (bus->rx_pos < bus->rx_len && bus->rx_count < PTY_RX_FRAMES) {
+            uint8_t b = bus->rx_buf[bus->rx_pos++];
+            if (bus->echo_pos < bus->echo_len && !bus->echo_bad) {
+                // Our own frame coming back on the shared line
+                if (b == bus->echo[bus->echo_pos]) {
+                    bus->echo_pos++;
+                    continue;
+                }
+                bus->echo_bad = 1;  // Garbled: let the parser look for a frame in it
+            }
+            rx_byte(bus, b);
+        }
+        g_parse_ns += now_ns() - start;
+        g_bytes += (uint64_t) (bus->rx_pos - first);
+    }
+
+    // Drained, and still no byte for the partial frame: the rest is not coming
+    if (bus->rx_count == PTY_RX_FRAMES || bus->rx_pos < bus->rx_len)
+        return;  // Not drained: more bytes are waiting
+    uint32_t gap_ms = chars_ms(bus, PTY_GAP_CHARS);
+    if (gap_ms < PTY_GAP_MIN_MS)
+        gap_ms = PTY_GAP_MIN_MS;
+    if (bus->parser.pos && hal_millis() - bus->last_byte_ms > gap_ms) {
+        proto_parser_reset(&bus->parser);
+        g_cut++;
+    }
+}
+
+// Hand a frame to the port; returns 0 if the line is still busy with our last one
+static int transmit(Bus* bus, const Frame* frame) {
+    if ((int32_t) (hal_millis() - bus->tx_done_ms) < 0) {
+        return 0;
+    }
+
+    Frame f = *frame;
+    proto_finalize(&f);
+    timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
+
+    uint8_t buffer[PROTO_MAX_FRAME_BYTES];
+    uint8_t len = proto_serialize(&f, buffer);
+
+    // A full port means the hub is behind: keep the frame for later. Once part
+    // of it is out, finish it, as a UART does not stop mid-frame
+    ssize_t n = write(bus->fd, buffer, len);
+    if (n < 0 && errno == EAGAIN)
+        return 0;
+    size_t done = n > 0 ? (size_t) n : 0;
+    while (n >= 0 && done < len) {
+        struct pollfd pfd = {bus->fd, POLLOUT, 0};
+        poll(&pfd, 1, 10);
+        n = write(bus->fd, buffer + done, len - done);
+        if (n > 0)
+            done += (size_t) n;
+        else if (n < 0 && errno == EAGAIN)
+            n = 0;
+    }
+    if (done == len)
+        g_sent++;  // Otherwise the hub is gone
+    bus->tx_done_ms = hal_millis() + chars_ms(bus, len);
+
+    if (bus->tdma.csma.mode == MAC_CSMA_ECHO) {
+        memcpy(bus->echo, buffer, len);
+        bus->echo_len = len;
+        bus->echo_pos = 0;
+        bus->echo_bad = 0;
+    }
+    return 1;
+}
+
+// Carrier sense: when did we last hear a byte from the line?
+static uint32_t line_quiet_since(Bus* bus) {
+    rx_pump(bus);
+    return bus->quiet_since_ms;
+}
+
+// Run carrier sense for the held frame, one backoff slot at a time
+static int csma_ready(Bus* bus, const Frame* frame) {
+    uint32_t now = hal_millis();
+    if ((int32_t) (now - bus->csma_next_ms) < 0) {
+        return 0;
+    }
+    // Backoff slots start when the line went quiet, as on every other board
+    uint32_t idle_at = line_quiet_since(bus) + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+    int idle = (int32_t) (now - idle_at) >= 0;
+    bus->csma_next_ms = idle ? now + chars_ms(bus, MAC_CSMA_SLOT_CHARS) : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+// Echo check for the frame just sent: -1 while it is still arriving, else 1 if it collided
+static int echo_result(Bus* bus) {
+    if (bus->echo_bad) {
+        return 1;
+    }
+    if (bus->echo_pos == bus->echo_len) {
+        return 0;
+    }
+    // Allow two character times past the end of the frame for the last byte
+    uint32_t deadline = bus->tx_done_ms + chars_ms(bus, 2) + PTY_ECHO_SLACK_MS;
+    if ((int32_t) (hal_millis() - deadline) < 0) {
+        return -1;
+    }
+    return 1;  // Missing bytes: a collision can swallow characters too
+}
+
+// Send held frames whose TDMA slot has come or that won carrier sense
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->echo_len) {
+            int collided = echo_result(bus);
+            if (collided < 0)
+                break;  // Pop once the echo has been checked
+            bus->echo_len = 0;
+            if (!mac_csma_sent(&bus->tdma.csma, collided))
+                mac_tdma_pop(&bus->tdma);
+            bus->csma_next_ms = bus->tx_done_ms + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if ((int32_t) (hal_millis() - bus->tx_done_ms) < 0 || !csma_ready(bus, f))
+                break;
+            if (!transmit(bus, f))
+                break;
+            if (bus->echo_len)
+                continue;
+            mac_csma_sent(&bus->tdma.csma, 0);
+            mac_tdma_pop(&bus->tdma);
+            bus->csma_next_ms = bus->tx_done_ms + chars_ms(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+
+        uint16_t airtime_ms = (uint16_t) (chars_ms(bus, (uint8_t) (5 + f->payload_len)) + 1);
+        if (mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms) != 0)
+            break;
+        if (!transmit(bus, f))
+            break;
+        bus->echo_len = 0;  // Only carrier sense acts on the echo
+        mac_tdma_pop(&bus->tdma);
+    }
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || bus->fd < 0 || !frame)
+        return -1;
+
+    // Every frame goes through the hold queue so the caller never waits on the line
+    rx_pump(bus);
+    int queued = mac_tdma_enqueue(&bus->tdma, frame);
+    tdma_flush(bus);
+    return queued;
+}
+
+int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
+    if (!bus || bus->fd < 0 || !frame)
+        return -1;
+
+    uint32_t start = hal_millis();
+    for (;;) {
+        rx_pump(bus);
+        tdma_flush(bus);  // Our slot (or backoff slot) may have come while we wait
+
+        if (bus->rx_count) {
+            *frame = bus->rx_ring[bus->rx_head];
+            bus->rx_head = (uint8_t) ((bus->rx_head + 1) % PTY_RX_FRAMES);
+            bus->rx_count--;
+            return 1;
+        }
+        uint32_t elapsed = hal_millis() - start;
+        if (elapsed >= timeout_ms) {
+            return 0;  // Timeout (or no frame yet, non-blocking)
+        }
+
+        // Sleep until a byte arrives; check back every millisecond while frames
+        // are held or a partial frame may time out
+        int wait_ms = (int) (timeout_ms - elapsed);
+        if ((bus->tdma.count || bus->parser.pos) && wait_ms > 1)
+            wait_ms = 1;
+        struct pollfd pfd = {bus->fd, POLLIN, 0};
+        poll(&pfd, 1, wait_ms);
+    }
+}
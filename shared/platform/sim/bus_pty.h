@@ -0,0 +1,63 @@
+/**
+ * @file bus_pty.h
+ * @brief Byte-stream bus over pseudo-terminals, one process per node
+ *
+ * bus_pty.c implements bus_interface.h the way the UART backends do: frames
+ * are serialized to the exact wire bytes, written to a serial port, and
+ * received bytes are run through the shared frame parser (proto.h) with SOF
+ * resynchronization and a timeout for frames cut off mid-way. The serial
+ * port is a pseudo-terminal opened by sim/pty_hub, which joins the ports of
+ * all nodes into one broadcast line. At a set baud rate the hub clocks
+ * bytes out one character time apart, and bytes that two nodes send in the
+ * same character time reach every port garbled. A node hears its own
+ * bytes, as on a shared wire, so MAC_CSMA_ECHO works.
+ *
+ * The hub also offers a monitor port carrying everything on the line, for
+ * `utilities/serial_monitor.py --frames`.
+ *
+ * Linux only. Nodes are identified by the node_index passed to
+ * bus_create(), which selects the hub port to open.
+ */
+
+#ifndef BUS_PTY_H
+#define BUS_PTY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Directory in which the hub links its ports, unless bus_pty_set_dir() picks another */
+#define BUS_PTY_DEFAULT_DIR "/tmp/self-organizing-mcus"
+
+/** Most ports a hub serves */
+#define BUS_PTY_MAX_NODES 32
+
+/**
+ * @brief Select the hub whose ports bus_create() opens
+ *
+ * Node i opens DIR/node<i>, a link to the pseudo-terminal the hub made for
+ * it. Call before bus_create().
+ *
+ * @param dir Directory given to sim/pty_hub with --bus (kept, not copied)
+ */
+void bus_pty_set_dir(const char* dir);
+
+/**
+ * @brief Read this process's line and parser counters
+ *
+ * @param frames_sent Output: frames our buses wrote to their ports
+ * @param frames_bad Output: frames received complete but with a bad checksum
+ * @param frames_cut Output: partial frames dropped when the line went quiet mid-frame
+ * @param bytes_parsed Output: bytes run through the frame parser
+ * @param parse_ns Output: time spent in the parser, in nanoseconds
+ */
+void bus_pty_get_stats(uint32_t* frames_sent, uint32_t* frames_bad, uint32_t* frames_cut,
+                       uint64_t* bytes_parsed, uint64_t* parse_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BUS_PTY_H
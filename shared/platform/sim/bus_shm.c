@@ -0,0 +1,480 @@
+/**
+ * @file bus_shm.c
+ * @brief Bus implementation over POSIX shared memory, one process per node
+ *
+ * Every process maps the same segment. It holds a ring of frame slots that
+ * all senders share: a sender claims the next index with an atomic
+ * increment, copies its frame into the slot and then publishes the slot's
+ * sequence number. Receivers keep their own read position and check the
+ * sequence number before and after copying a frame out (a seqlock), so a
+ * slot overwritten by a sender one lap ahead is never returned half-old.
+ * Idle receivers sleep on a futex word in the segment, bumped after every
+ * publish.
+ *
+ * The airtime, collision and carrier sense model is bus_sim.c's, with each
+ * node's last frame on the line kept in the segment instead of behind a
+ * mutex. CLOCK_MONOTONIC is shared by all processes, so the windows compare
+ * directly.
+ */
+
+#define _GNU_SOURCE  // syscall() for futexes
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../core/bus_interface.h"
+#include "../../core/hal.h"
+#include "../../core/timesync.h"
+#include "bus_shm.h"
+
+/** Frame slots in the ring; a receiver may fall this far behind */
+#define SHM_RING_FRAMES 1024u
+
+/** Segment layout version, bumped whenever ShmSegment changes */
+#define SHM_MAGIC 0x53484D31u
+
+/** UART character: start bit + 8 data bits + stop bit (8N1) */
+#define BITS_PER_BYTE 10
+
+/** A claimed slot still unpublished after this long belongs to a sender that died */
+#define SHM_STALL_US 20000ULL
+
+/** How long bus_global_init() waits for another process to set up a new segment */
+#define SHM_ATTACH_TIMEOUT_MS 1000
+
+// The segment is shared between processes, so its atomics must not hide a lock
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "bus_shm needs lock-free 64-bit atomics");
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "bus_shm needs lock-free 32-bit atomics");
+
+/** One frame in the ring */
+typedef struct {
+    _Atomic uint64_t seq;  // Ring index + 1 once published, 0 while being written
+    Frame frame;
+} ShmSlot;
+
+/** A node's latest frame on the line (carrier sense and collisions) */
+typedef struct {
+    _Atomic uint64_t start_us;
+    _Atomic uint64_t end_us;
+    atomic_uint collided;  // Another frame overlapped it
+} ShmLine;
+
+/** Layout of the shared segment (zero-filled when created) */
+typedef struct {
+    atomic_uint magic;          // SHM_MAGIC once the creator has set it up
+    atomic_uint wake;           // Futex word: bumped after every publish
+    atomic_uint sleepers;       // Receivers waiting on wake
+    atomic_uint frames_sent;
+    atomic_uint frames_collided;
+    _Atomic uint64_t claimed;   // Ring indices handed to senders so far
+    ShmLine line[BUS_SHM_MAX_NODES];
+    ShmSlot slots[SHM_RING_FRAMES];
+} ShmSegment;
+
+struct Bus {
+    int in_use;
+    uint8_t node_index;  // Our line entry
+    uint64_t next;       // Ring index of the next frame to read
+    uint64_t stall_us;   // When the frame at next was first found claimed but unpublished
+    uint32_t baud;       // 0 = deliver instantly
+    MacTdma tdma;
+    uint64_t csma_next_us;  // Next backoff slot boundary
+};
+
+static const char* g_name = BUS_SHM_DEFAULT_NAME;
+static ShmSegment* g_seg = NULL;
+static Bus g_pool[BUS_POOL_SIZE];
+static atomic_uint g_missed;  // Frames our buses lost by falling a ring behind
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) (us / 1000000ULL);
+    ts.tv_nsec = (long) (us % 1000000ULL) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+// Sleep until *word no longer holds expected, a wake-up, or the timeout
+static void futex_wait(atomic_uint* word, unsigned expected, uint64_t timeout_us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) (timeout_us / 1000000ULL);
+    ts.tv_nsec = (long) (timeout_us % 1000000ULL) * 1000L;
+    syscall(SYS_futex, (uint32_t*) word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+static void futex_wake_all(atomic_uint* word) {
+    syscall(SYS_futex, (uint32_t*) word, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+}
+
+void bus_shm_set_name(const char* name) {
+    g_name = name ? name : BUS_SHM_DEFAULT_NAME;
+}
+
+int bus_shm_unlink(void) {
+    return shm_unlink(g_name) == 0;
+}
+
+void bus_shm_get_stats(uint32_t* frames_sent, uint32_t* frames_collided, uint32_t* frames_missed) {
+    *frames_sent = g_seg ? atomic_load(&g_seg->frames_sent) : 0;
+    *frames_collided = g_seg ? atomic_load(&g_seg->frames_collided) : 0;
+    *frames_missed = atomic_load(&g_missed);
+}
+
+int bus_global_init(uint8_t max_nodes) {
+    (void) max_nodes;  // The segment is sized for BUS_SHM_MAX_NODES
+    if (g_seg) {
+        return 0;  // Already mapped (several nodes in one process)
+    }
+
+    // The first process creates and sets up the segment; the others wait for its magic
+    int created = 1;
+    int fd = shm_open(g_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(g_name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    if (created && ftruncate(fd, sizeof(ShmSegment)) != 0) {
+        close(fd);
+        shm_unlink(g_name);
+        return -1;
+    }
+    struct stat st;
+    uint32_t start = hal_millis();
+    while (fstat(fd, &st) == 0 && (size_t) st.st_size < sizeof(ShmSegment)) {
+        if (hal_millis() - start > SHM_ATTACH_TIMEOUT_MS) {
+            close(fd);
+            return -1;  // Not ours, or a different layout
+        }
+        sleep_us(1000);
+    }
+
+    void* mem = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+    g_seg = (ShmSegment*) mem;
+
+    if (created) {
+        atomic_store(&g_seg->magic, SHM_MAGIC);
+    }
+    while (atomic_load(&g_seg->magic) != SHM_MAGIC) {
+        if (hal_millis() - start > SHM_ATTACH_TIMEOUT_MS) {
+            bus_global_shutdown();
+            return -1;
+        }
+        sleep_us(1000);
+    }
+    return 0;
+}
+
+void bus_global_shutdown(void) {
+    if (g_seg) {
+        munmap(g_seg, sizeof(ShmSegment));
+        g_seg = NULL;
+    }
+}
+
+int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
+    (void) rx_pin;  // Unused in simulation
+    (void) tx_pin;  // Unused in simulation
+
+    if (!g_seg || node_index >= BUS_SHM_MAX_NODES) {
+        return -1;
+    }
+    size_t i = 0;
+    while (i < BUS_POOL_SIZE && g_pool[i].in_use)
+        i++;
+    if (i == BUS_POOL_SIZE) {
+        return -1;
+    }
+
+    Bus* b = &g_pool[i];
+    memset(b, 0, sizeof(*b));
+    b->in_use = 1;
+    b->node_index = node_index;
+    b->next = atomic_load(&g_seg->claimed);  // Frames sent before we attached are not ours
+    mac_tdma_init(&b->tdma);
+
+    ShmLine* line = &g_seg->line[node_index];
+    atomic_store(&line->start_us, 0);
+    atomic_store(&line->end_us, 0);  // Clear a window left by an earlier run
+    *bus = b;
+    return 0;
+}
+
+void bus_destroy(Bus* bus) {
+    if (bus) {
+        bus->in_use = 0;  // Back to the pool
+    }
+}
+
+void bus_set_baud(Bus* bus, uint32_t baud) {
+    if (bus) {
+        bus->baud = baud;
+    }
+}
+
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        bus->tdma.csma.mode = mode;
+    }
+}
+
+// Time n characters occupy the line at the bus baud rate
+static uint64_t chars_us(const Bus* bus, uint32_t n) {
+    if (bus->baud == 0) {
+        return 0;
+    }
+    return (uint64_t) n * BITS_PER_BYTE * 1000000ULL / bus->baud;
+}
+
+// Time a frame occupies the line
+static uint64_t airtime_us(const Bus* bus, const Frame* frame) {
+    return chars_us(bus, 5u + frame->payload_len);
+}
+
+// Put a frame in the ring and wake the receivers
+static void publish(const Frame* frame) {
+    uint64_t index = atomic_fetch_add(&g_seg->claimed, 1);
+    ShmSlot* slot = &g_seg->slots[index % SHM_RING_FRAMES];
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);  // Readers see 0 before any new byte
+    memcpy(&slot->frame, frame, sizeof(*frame));
+    atomic_store_explicit(&slot->seq, index + 1, memory_order_release);
+
+    atomic_fetch_add(&g_seg->wake, 1);
+    if (atomic_load(&g_seg->sleepers)) {
+        futex_wake_all(&g_seg->wake);
+    }
+}
+
+/**
+ * @brief Put a frame on the shared line and deliver it unless it collided
+ *
+ * As in bus_sim.c, the sender is held for the frame's airtime and any two
+ * frames whose airtimes overlap are both lost. Our window is stored before
+ * the others are checked, so of two senders starting together each sees
+ * the other.
+ *
+ * @return 1 if delivered, 0 if it collided
+ */
+static int transmit(Bus* bus, const Frame* frame) {
+    Frame f = *frame;
+    timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
+
+    atomic_fetch_add(&g_seg->frames_sent, 1);
+    uint64_t airtime = airtime_us(bus, &f);
+    if (airtime > 0) {
+        ShmLine* me = &g_seg->line[bus->node_index];
+        uint64_t start = now_us();
+        atomic_store(&me->collided, 0);
+        atomic_store(&me->start_us, start);
+        atomic_store(&me->end_us, start + airtime);
+        for (size_t i = 0; i < BUS_SHM_MAX_NODES; ++i) {
+            ShmLine* other = &g_seg->line[i];
+            if (other != me && atomic_load(&other->end_us) > start &&
+                atomic_load(&other->start_us) <= start) {
+                atomic_store(&other->collided, 1);
+                atomic_store(&me->collided, 1);
+            }
+        }
+
+        sleep_us(airtime);
+        if (atomic_load(&me->collided)) {
+            atomic_fetch_add(&g_seg->frames_collided, 1);
+            return 0;
+        }
+    }
+
+    publish(&f);
+    return 1;
+}
+
+/**
+ * @brief Take the next frame from the ring, if one has been published
+ *
+ * @return 1 if a frame was copied out, 0 if there is none yet
+ */
+static int ring_read(Bus* bus, Frame* out) {
+    for (;;) {
+        uint64_t claimed = atomic_load(&g_seg->claimed);
+        if (claimed == bus->next) {
+            return 0;
+        }
+        if (claimed - bus->next > SHM_RING_FRAMES) {
+            // Lapped: the oldest frames we had not read are gone
+            atomic_fetch_add(&g_missed, (unsigned) (claimed - SHM_RING_FRAMES - bus->next));
+            bus->next = claimed - SHM_RING_FRAMES;
+        }
+
+        ShmSlot* slot = &g_seg->slots[bus->next % SHM_RING_FRAMES];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == bus->next + 1) {
+            Frame f;
+            memcpy(&f, &slot->frame, sizeof(f));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+                continue;  // Overwritten while we copied: we have been lapped
+            }
+            bus->next++;
+            bus->stall_us = 0;
+            *out = f;
+            return 1;
+        }
+        if (seq > bus->next + 1) {
+            continue;  // Already reused by a later lap; the check above skips ahead
+        }
+
+        // Claimed but not yet published. A sender that died there would block
+        // the ring for good, so give up on the slot after a while.
+        uint64_t now = now_us();
+        if (!bus->stall_us) {
+            bus->stall_us = now;
+        } else if (now - bus->stall_us > SHM_STALL_US) {
+            atomic_fetch_add(&g_missed, 1);
+            bus->next++;
+            bus->stall_us = 0;
+            continue;
+        }
+        return 0;
+    }
+}
+
+/**
+ * @brief Carrier sense: when did (or will) the last frame we can hear end?
+ *
+ * A frame is only noticed once its first character has arrived, as in
+ * bus_sim.c.
+ */
+static uint64_t line_quiet_since(const Bus* bus, uint64_t char_us) {
+    uint64_t now = now_us();
+    uint64_t quiet = 0;
+    for (size_t i = 0; i < BUS_SHM_MAX_NODES; ++i) {
+        if (i == bus->node_index)
+            continue;
+        const ShmLine* other = &g_seg->line[i];
+        uint64_t start = atomic_load(&other->start_us);
+        uint64_t end = atomic_load(&other->end_us);
+        if (start + char_us <= now && end > quiet) {
+            quiet = end;
+        }
+    }
+    return quiet;
+}
+
+// Run carrier sense for the held frame, one backoff slot at a time
+static int csma_ready(Bus* bus, const Frame* frame) {
+    uint64_t char_us = chars_us(bus, 1);
+    uint64_t now = now_us();
+    if (now < bus->csma_next_us) {
+        return 0;
+    }
+    uint64_t idle_at = line_quiet_since(bus, char_us) + MAC_CSMA_IDLE_CHARS * char_us;
+    int idle = now >= idle_at;
+    bus->csma_next_us = idle ? now + MAC_CSMA_SLOT_CHARS * char_us : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+// Send held frames whose TDMA slot has come or that won carrier sense
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if (!csma_ready(bus, f))
+                break;
+            int collided = !transmit(bus, f);
+            if (!mac_csma_sent(&bus->tdma.csma, collided))
+                mac_tdma_pop(&bus->tdma);
+            bus->csma_next_us = now_us() + chars_us(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+        uint16_t airtime_ms = (uint16_t) ((airtime_us(bus, f) + 999) / 1000);
+        if (mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms) != 0)
+            break;
+        transmit(bus, f);
+        mac_tdma_pop(&bus->tdma);
+    }
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || !bus->in_use || !frame)
+        return -1;
+
+    // Hold the frame for our slot or a quiet line (and behind anything already held)
+    if (bus->tdma.count || bus->tdma.csma.mode != MAC_CSMA_OFF ||
+        mac_tdma_active(&bus->tdma, hal_network_millis())) {
+        int queued = mac_tdma_enqueue(&bus->tdma, frame);
+        tdma_flush(bus);
+        return queued;
+    }
+
+    transmit(bus, frame);
+    return 1;
+}
+
+int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
+    if (!bus || !bus->in_use || !frame)
+        return -1;
+
+    uint32_t start = hal_millis();
+    for (;;) {
+        tdma_flush(bus);
+
+        // Read the futex word before looking, so a publish in between ends the wait at once
+        unsigned wake = atomic_load(&g_seg->wake);
+        if (ring_read(bus, frame)) {
+            return 1;
+        }
+
+        uint32_t elapsed = hal_millis() - start;
+        if (elapsed >= timeout_ms) {
+            return 0;  // Timeout (or no data, non-blocking)
+        }
+
+        // Wake up for our TDMA slot (or next backoff slot) if frames are held,
+        // and to skip a slot whose sender died
+        uint64_t wait_us = (uint64_t) (timeout_ms - elapsed) * 1000ULL;
+        if (bus->stall_us && wait_us > SHM_STALL_US)
+            wait_us = SHM_STALL_US;
+        Frame* held = mac_tdma_peek(&bus->tdma);
+        if (held && bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            uint64_t now = now_us();
+            uint64_t slot_us = bus->csma_next_us > now ? bus->csma_next_us - now : 1;
+            if (slot_us < wait_us)
+                wait_us = slot_us;
+        } else if (held) {
+            uint16_t airtime_ms = (uint16_t) ((airtime_us(bus, held) + 999) / 1000);
+            uint32_t slot_ms = mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms);
+            if (slot_ms * 1000ULL < wait_us)
+                wait_us = slot_ms ? slot_ms * 1000ULL : 1000ULL;
+        }
+
+        atomic_fetch_add(&g_seg->sleepers, 1);
+        futex_wait(&g_seg->wake, wake, wait_us);
+        atomic_fetch_sub(&g_seg->sleepers, 1);
+    }
+}
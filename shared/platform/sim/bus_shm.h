@@ -0,0 +1,71 @@
+/**
+ * @file bus_shm.h
+ * @brief Shared-memory bus for running every node in its own process
+ *
+ * bus_shm.c implements bus_interface.h over a POSIX shared-memory segment,
+ * so separately started programs (see sim/shm_node.c) share one line. A
+ * node that crashes takes only its own process down. Frames go into one
+ * broadcast ring that senders claim slots in with an atomic counter and
+ * every receiver reads at its own pace; idle receivers sleep on a futex
+ * that each send wakes. No lock is taken on the frame path.
+ *
+ * The line model follows bus_sim.c: with a baud rate set, a frame occupies
+ * the line for its 8N1 airtime and is lost if it overlaps another, and
+ * TDMA and carrier sense work as on the other backends. Every node hears
+ * its own frames. A receiver more than a ring behind loses the oldest
+ * frames (bus_shm_get_stats()).
+ *
+ * Linux only (futexes). Nodes are identified by the node_index passed to
+ * bus_create(), which must be unique across all processes on a segment.
+ */
+
+#ifndef BUS_SHM_H
+#define BUS_SHM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Segment used unless bus_shm_set_name() picks another */
+#define BUS_SHM_DEFAULT_NAME "/self-organizing-mcus"
+
+/** Highest node_index + 1 a segment has line state for */
+#define BUS_SHM_MAX_NODES 32
+
+/**
+ * @brief Select the segment that bus_global_init() opens
+ *
+ * Processes using the same name share a line; use different names to run
+ * several networks side by side. Call before bus_global_init().
+ *
+ * @param name POSIX shared memory name, starting with '/' (kept, not copied)
+ */
+void bus_shm_set_name(const char* name);
+
+/**
+ * @brief Remove the segment name
+ *
+ * Processes that have it mapped keep using it; the next bus_global_init()
+ * creates a fresh one. Launchers call this before starting a run (to drop
+ * a segment left by a crashed run) and after it.
+ *
+ * @return 1 if a segment was removed, 0 if there was none
+ */
+int bus_shm_unlink(void);
+
+/**
+ * @brief Read the line counters
+ *
+ * @param frames_sent Output: frames put on the line by all processes
+ * @param frames_collided Output: frames lost because they overlapped another
+ * @param frames_missed Output: frames this process's buses lost by falling a ring behind
+ */
+void bus_shm_get_stats(uint32_t* frames_sent, uint32_t* frames_collided, uint32_t* frames_missed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BUS_SHM_H
@@ -1,124 +1,907 @@
 #define _POSIX_C_SOURCE 200809L
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "../../core/bus_interface.h"
 #include "../../core/hal.h"
+#include "../../core/timesync.h"
+#include "bus_sim.h"
 
-#define MAX_NODES 32
+#define MAX_NODES BUS_POOL_SIZE
 #define RING_CAPACITY 64
 
+/** Default UART character: start bit + 8 data bits + stop bit (8N1) */
+#define BITS_PER_BYTE 10
+
+/** Most timed partitions that can be scheduled */
+#define MAX_PARTITIONS 4
+
+/** Extra delay for a frame picked for reordering: long enough for later frames to pass it */
+#define REORDER_HOLD_US 20000ULL
+
+/** JOIN nonces waiting for their ASSIGN, for the JOIN latency histogram */
+#define MAX_PENDING_JOINS 32
+
+/** No route between two segments */
+#define NO_ROUTE 0xFF
+
+/** Frames a bridge holds for forwarding in each direction; it drops frames beyond that */
+#define BRIDGE_QUEUE_FRAMES 16
+
+/** Upper bounds of the JOIN latency histogram buckets */
+static const uint32_t k_join_bucket_ms[BUS_SIM_JOIN_BUCKETS] = {10,  25,   50,   100,  250,
+                                                                500, 1000, 2500, 5000, 10000};
+
 typedef struct {
-    Frame buffer[RING_CAPACITY];
-    size_t head, tail, count;
+    Frame frame;
+    uint64_t due_us;  // Delivery time, later than now with latency, jitter or reordering
+} Pending;
+
+typedef struct {
+    Pending buffer[RING_CAPACITY];  // In arrival order
+    size_t count;
+    atomic_uint depth;  // Copy of count that bus_sim_get_metrics() reads without the mutex
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 } Queue;
 
+/** Fault settings of one directed link */
+typedef struct {
+    double loss;         // Probability the frame is lost
+    double corrupt;      // Probability one bit is flipped
+    double reorder;      // Probability the frame is held back behind later ones
+    uint32_t latency_us; // Fixed delivery delay
+    uint32_t jitter_us;  // Uniformly distributed extra delay, 0 to jitter_us
+} LinkFaults;
+
+/** Nodes in group cannot hear nodes outside it (and vice versa) during [start, end) */
+typedef struct {
+    uint32_t group;
+    uint32_t start_ms;
+    uint32_t end_ms;
+} Partition;
+
+/** A board joining two segments, forwarding every frame heard on one onto the other */
+typedef struct {
+    uint8_t seg[2];           // The segments it joins
+    uint32_t latency_us;      // Processing delay per forwarded frame
+    uint32_t baud;            // Line rate of the forwarding side (0 = the sender's)
+    uint64_t busy_until_us[2];  // Forwarding toward seg[1], toward seg[0] (guarded by global_mutex)
+} Bridge;
+
 struct Bus {
+    SimNet* net;  // Network whose line we share
     uint8_t node_index;
+    uint8_t slot;  // Creation order: index of our queue and row of the fault matrix
     Queue* queue;
+    uint64_t rng;  // Fault decisions for frames we send (seeded, so runs repeat)
+    uint32_t baud;  // 0 = deliver instantly
+    MacTdma tdma;
+    atomic_uint tx_depth;   // Frames held in tdma, for bus_sim_get_metrics()
+    uint64_t csma_next_us;  // Next backoff slot boundary
+
+    // Shared medium model (guarded by net->medium_mutex)
+    uint64_t tx_start_us;  // Start of our latest frame on the line
+    uint64_t tx_end_us;    // End of our latest frame, in the past once it is done
+    int tx_collided;       // Another frame overlapped ours
+};
+
+/**
+ * Everything one simulated network shares: the buses on its line and their
+ * queues, the medium and fault model, and its statistics. Networks are
+ * independent, so several can run side by side in one process.
+ */
+struct SimNet {
+    // Buses and their queues are handed out in creation order; bus_global_init()
+    // resets both pools, so building a large network never touches the heap
+    Bus bus_pool[MAX_NODES];
+    Queue queues[MAX_NODES];
+    size_t num_queues;  // Queues set up by bus_global_init()
+    size_t num_nodes;
+    pthread_mutex_t global_mutex;
+
+    Bus* buses[MAX_NODES];  // Transmitters sharing the line
+    pthread_mutex_t medium_mutex;
+    uint8_t char_bits;  // Bit times per character on the line
+
+    // Counters are atomic so they can be read without stalling the nodes
+    atomic_uint frames_sent;
+    atomic_uint frames_collided;
+    atomic_uint frames_by_type[256];
+    atomic_uint rx_dropped;  // Deliveries pushed out of a full receive queue
+    atomic_uint tx_dropped;  // Frames refused by a full hold queue
+
+    // First JOIN of each nonce still waiting for its ASSIGN (guarded by medium_mutex)
+    struct {
+        uint32_t nonce;
+        uint64_t at_us;
+        uint8_t slot;  // Node that sent it, whose receipt of the ASSIGN ends the wait
+    } joins[MAX_PENDING_JOINS];
+    size_t num_joins;
+    atomic_uint join_buckets[BUS_SIM_JOIN_BUCKETS + 1];  // The last one is past every bound
+    atomic_uint join_sum_ms;
+
+    // Fault injection, configured before the nodes start
+    LinkFaults faults[MAX_NODES][MAX_NODES];  // [sender][receiver]
+    Partition partitions[MAX_PARTITIONS];
+    size_t num_partitions;
+    uint64_t fault_seed;
+    uint64_t epoch_us;  // Partition times count from bus_global_init()
+    atomic_uint frames_lost;
+    atomic_uint frames_corrupted;
+    atomic_uint frames_reordered;
+
+    // Topology, configured before the nodes start: every node starts on segment 0
+    uint8_t segment[MAX_NODES];  // Segment of each node
+    Bridge bridges[BUS_SIM_MAX_BRIDGES];
+    size_t num_bridges;
+    uint8_t hops[BUS_SIM_MAX_SEGMENTS][BUS_SIM_MAX_SEGMENTS];   // Bridges crossed, or NO_ROUTE
+    uint8_t route[BUS_SIM_MAX_SEGMENTS][BUS_SIM_MAX_SEGMENTS];  // First bridge toward a segment
+    atomic_uint frames_bridged;
+    atomic_uint frames_relayed;  // Copies put on the line by relay nodes (hop count above 0)
+};
+
+/** Network used by threads that have not picked one with bus_sim_use_net() */
+static SimNet g_default_net = {
+    .global_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .medium_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .char_bits = BITS_PER_BYTE,
+    .fault_seed = 1,
 };
 
-static Queue g_queues[MAX_NODES];
-static size_t g_num_nodes = 0;
-static pthread_mutex_t g_global_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Network the calling thread creates buses on and configures */
+static _Thread_local SimNet* t_net = &g_default_net;
 
-static int ring_push(Queue* q, const Frame* f) {
-    if (q->count == RING_CAPACITY) {
-        // Drop oldest frame
-        q->head = (q->head + 1) % RING_CAPACITY;
-        q->count--;
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void count(atomic_uint* counter, uint32_t n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static uint32_t read_count(atomic_uint* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void queue_remove(Queue* q, size_t i) {
+    memmove(&q->buffer[i], &q->buffer[i + 1], (q->count - i - 1) * sizeof(Pending));
+    q->count--;
+    atomic_store_explicit(&q->depth, (unsigned) q->count, memory_order_relaxed);
+}
+
+/**
+ * @return 1 if the queue was full and its oldest frame was dropped, 0 otherwise
+ */
+static int queue_push(Queue* q, const Frame* f, uint64_t due_us) {
+    int dropped = q->count == RING_CAPACITY;
+    if (dropped) {
+        queue_remove(q, 0);  // Drop oldest frame
     }
-    q->buffer[q->tail] = *f;
-    q->tail = (q->tail + 1) % RING_CAPACITY;
+    q->buffer[q->count].frame = *f;
+    q->buffer[q->count].due_us = due_us;
     q->count++;
-    return 0;
+    atomic_store_explicit(&q->depth, (unsigned) q->count, memory_order_relaxed);
+    return dropped;
 }
 
-static int ring_pop(Queue* q, Frame* out) {
-    if (q->count == 0)
+/**
+ * @brief Take the frame that is due first; frames due together leave in arrival order
+ *
+ * @param next_due_us Output when nothing is due yet: when the next frame will be (0 = none)
+ */
+static int queue_pop(Queue* q, Frame* out, uint64_t now, uint64_t* next_due_us) {
+    size_t best = q->count;
+    for (size_t i = 0; i < q->count; ++i) {
+        if (best == q->count || q->buffer[i].due_us < q->buffer[best].due_us)
+            best = i;
+    }
+    *next_due_us = 0;
+    if (best == q->count)
         return -1;
-    *out = q->buffer[q->head];
-    q->head = (q->head + 1) % RING_CAPACITY;
-    q->count--;
+    if (q->buffer[best].due_us > now) {
+        *next_due_us = q->buffer[best].due_us;
+        return -1;
+    }
+    *out = q->buffer[best].frame;
+    queue_remove(q, best);
+    return 0;
+}
+
+/**
+ * @brief Next value of a sender's fault generator (xorshift64*)
+ */
+static uint64_t rng_next(Bus* bus) {
+    bus->rng ^= bus->rng >> 12;
+    bus->rng ^= bus->rng << 25;
+    bus->rng ^= bus->rng >> 27;
+    return bus->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Uniform draw in [0, 1)
+ */
+static double rng_unit(Bus* bus) {
+    return (double) (rng_next(bus) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Check whether a timed partition separates two nodes right now
+ */
+static int partitioned(const SimNet* net, size_t from, size_t to, uint64_t now) {
+    uint32_t ms = (uint32_t) ((now - net->epoch_us) / 1000ULL);
+    for (size_t i = 0; i < net->num_partitions; ++i) {
+        const Partition* p = &net->partitions[i];
+        if (ms >= p->start_ms && ms < p->end_ms &&
+            ((p->group >> from) & 1u) != ((p->group >> to) & 1u))
+            return 1;
+    }
     return 0;
 }
 
+/**
+ * @brief Flip one random bit of the frame as it would appear on the wire
+ */
+static void flip_bit(Bus* bus, Frame* f) {
+    uint64_t r = rng_next(bus);
+    size_t len = 5u + (f->payload_len <= MAX_PAYLOAD_SIZE ? f->payload_len : 0);
+    size_t byte = (size_t) (r % len);
+    uint8_t mask = (uint8_t) (1u << ((r >> 32) % 8));
+    if (byte == 0) {
+        f->sof ^= mask;
+    } else if (byte == 1) {
+        f->type ^= mask;
+    } else if (byte == 2) {
+        f->source ^= mask;
+    } else if (byte == 3) {
+        f->payload_len ^= mask;
+    } else if (byte == len - 1) {
+        f->checksum ^= mask;
+    } else {
+        f->payload[byte - 4] ^= mask;
+    }
+}
+
+/**
+ * @brief Find the route with the fewest bridges between every two segments
+ *
+ * Floyd-Warshall over at most BUS_SIM_MAX_SEGMENTS segments. route[a][b] is
+ * the first bridge on the way from a to b, so route[b][a] is the last one
+ * on a shortest way from a to b.
+ */
+static void update_routes(SimNet* net) {
+    for (size_t a = 0; a < BUS_SIM_MAX_SEGMENTS; ++a) {
+        for (size_t b = 0; b < BUS_SIM_MAX_SEGMENTS; ++b) {
+            net->hops[a][b] = a == b ? 0 : NO_ROUTE;
+            net->route[a][b] = NO_ROUTE;
+        }
+    }
+    for (size_t k = 0; k < net->num_bridges; ++k) {
+        uint8_t a = net->bridges[k].seg[0], b = net->bridges[k].seg[1];
+        if (net->hops[a][b] > 1) {
+            net->hops[a][b] = net->hops[b][a] = 1;
+            net->route[a][b] = net->route[b][a] = (uint8_t) k;
+        }
+    }
+    for (size_t m = 0; m < BUS_SIM_MAX_SEGMENTS; ++m) {
+        for (size_t a = 0; a < BUS_SIM_MAX_SEGMENTS; ++a) {
+            for (size_t b = 0; b < BUS_SIM_MAX_SEGMENTS; ++b) {
+                if (net->hops[a][m] == NO_ROUTE || net->hops[m][b] == NO_ROUTE ||
+                    net->hops[a][m] + net->hops[m][b] >= net->hops[a][b])
+                    continue;
+                net->hops[a][b] = (uint8_t) (net->hops[a][m] + net->hops[m][b]);
+                net->route[a][b] = net->route[a][m];
+            }
+        }
+    }
+}
+
 int bus_global_init(uint8_t max_nodes) {
-    pthread_mutex_lock(&g_global_mutex);
-    g_num_nodes = 0;
-    for (size_t i = 0; i < MAX_NODES && i < max_nodes; ++i) {
-        Queue* q = &g_queues[i];
-        q->head = q->tail = q->count = 0;
+    SimNet* net = t_net;
+    pthread_mutex_lock(&net->global_mutex);
+    net->num_nodes = 0;
+    net->num_queues = max_nodes < MAX_NODES ? max_nodes : MAX_NODES;
+    for (size_t i = 0; i < net->num_queues; ++i) {
+        Queue* q = &net->queues[i];
+        q->count = 0;
+        atomic_store(&q->depth, 0);
         pthread_mutex_init(&q->mutex, NULL);
         pthread_cond_init(&q->cond, NULL);
     }
-    pthread_mutex_unlock(&g_global_mutex);
+    for (size_t i = 0; i < net->num_bridges; ++i) {
+        net->bridges[i].busy_until_us[0] = 0;
+        net->bridges[i].busy_until_us[1] = 0;
+    }
+    update_routes(net);
+    net->epoch_us = now_us();
+    pthread_mutex_unlock(&net->global_mutex);
     return 0;
 }
 
 void bus_global_shutdown(void) {
-    pthread_mutex_lock(&g_global_mutex);
-    for (size_t i = 0; i < g_num_nodes; ++i) {
-        pthread_mutex_destroy(&g_queues[i].mutex);
-        pthread_cond_destroy(&g_queues[i].cond);
+    SimNet* net = t_net;
+    pthread_mutex_lock(&net->global_mutex);
+    for (size_t i = 0; i < net->num_queues; ++i) {
+        pthread_mutex_destroy(&net->queues[i].mutex);
+        pthread_cond_destroy(&net->queues[i].cond);
     }
-    g_num_nodes = 0;
-    pthread_mutex_unlock(&g_global_mutex);
+    net->num_nodes = 0;
+    net->num_queues = 0;
+    pthread_mutex_unlock(&net->global_mutex);
 }
 
 int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
     (void) rx_pin;
     (void) tx_pin;  // Unused in simulation
 
-    pthread_mutex_lock(&g_global_mutex);
-    if (g_num_nodes >= MAX_NODES) {
-        pthread_mutex_unlock(&g_global_mutex);
-        return -1;
-    }
-
-    Bus* b = (Bus*) malloc(sizeof(Bus));
-    if (!b) {
-        pthread_mutex_unlock(&g_global_mutex);
+    SimNet* net = t_net;
+    pthread_mutex_lock(&net->global_mutex);
+    if (net->num_nodes >= net->num_queues) {
+        pthread_mutex_unlock(&net->global_mutex);
         return -1;
     }
 
+    Bus* b = &net->bus_pool[net->num_nodes];
+    memset(b, 0, sizeof(*b));
+    b->net = net;
     b->node_index = node_index;
-    b->queue = &g_queues[g_num_nodes++];
+    b->slot = (uint8_t) net->num_nodes;
+    b->queue = &net->queues[net->num_nodes];
+    b->rng = (net->fault_seed + net->num_nodes + 1) * 0x9E3779B97F4A7C15ULL;  // Never 0
+    mac_tdma_init(&b->tdma);
+
+    pthread_mutex_lock(&net->medium_mutex);
+    net->buses[net->num_nodes++] = b;
+    pthread_mutex_unlock(&net->medium_mutex);
     *bus = b;
 
-    pthread_mutex_unlock(&g_global_mutex);
+    pthread_mutex_unlock(&net->global_mutex);
     return 0;
 }
 
 void bus_destroy(Bus* bus) {
     if (bus) {
-        free(bus);
+        SimNet* net = bus->net;
+        pthread_mutex_lock(&net->medium_mutex);
+        for (size_t i = 0; i < MAX_NODES; ++i) {
+            if (net->buses[i] == bus)
+                net->buses[i] = NULL;
+        }
+        pthread_mutex_unlock(&net->medium_mutex);
     }
 }
 
 void bus_set_baud(Bus* bus, uint32_t baud) {
-    (void) bus;   // Unused
-    (void) baud;  // Unused - simulation doesn't use baud rates
+    // Frames occupy the shared line for their serialization time at this rate
+    if (bus) {
+        bus->baud = baud;
+    }
 }
 
-int bus_send(Bus* bus, const Frame* frame) {
-    if (!bus || !frame)
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        bus->tdma.csma.mode = mode;
+    }
+}
+
+int bus_sim_set_framing(uint8_t data_bits, uint8_t parity_bits, uint8_t stop_bits) {
+    SimNet* net = t_net;
+    if (data_bits < 5 || data_bits > 8 || parity_bits > 1 || stop_bits < 1 || stop_bits > 2) {
+        return 0;
+    }
+    net->char_bits = (uint8_t) (1 + data_bits + parity_bits + stop_bits);
+    return 1;
+}
+
+void bus_sim_get_stats(uint32_t* frames_sent, uint32_t* frames_collided) {
+    SimNet* net = t_net;
+    *frames_sent = read_count(&net->frames_sent);
+    *frames_collided = read_count(&net->frames_collided);
+}
+
+uint32_t bus_sim_frames_of_type(uint8_t type) {
+    return read_count(&t_net->frames_by_type[type]);
+}
+
+void bus_sim_get_metrics(BusSimMetrics* m) {
+    SimNet* net = t_net;
+    memset(m, 0, sizeof(*m));
+    m->frames_sent = read_count(&net->frames_sent);
+    m->frames_collided = read_count(&net->frames_collided);
+    for (size_t t = 0; t < 256; ++t)
+        m->frames_by_type[t] = read_count(&net->frames_by_type[t]);
+    m->frames_lost = read_count(&net->frames_lost);
+    m->frames_corrupted = read_count(&net->frames_corrupted);
+    m->frames_reordered = read_count(&net->frames_reordered);
+    m->rx_dropped = read_count(&net->rx_dropped);
+    m->tx_dropped = read_count(&net->tx_dropped);
+    m->frames_bridged = read_count(&net->frames_bridged);
+    m->frames_relayed = read_count(&net->frames_relayed);
+
+    // Buses are only added before the nodes start, so the count is stable by now
+    m->num_nodes = (uint8_t) net->num_nodes;
+    for (size_t i = 0; i < net->num_nodes; ++i) {
+        m->rx_depth[i] = read_count(&net->queues[i].depth);
+        m->tx_depth[i] = read_count(&net->bus_pool[i].tx_depth);
+    }
+
+    for (size_t b = 0; b < BUS_SIM_JOIN_BUCKETS; ++b)
+        m->join_bucket_ms[b] = k_join_bucket_ms[b];
+    for (size_t b = 0; b <= BUS_SIM_JOIN_BUCKETS; ++b) {
+        m->join_count += read_count(&net->join_buckets[b]);
+        m->join_buckets[b] = m->join_count;  // Cumulative, as histograms are exported
+    }
+    m->join_sum_ms = read_count(&net->join_sum_ms);
+}
+
+void bus_sim_set_seed(uint64_t seed) {
+    SimNet* net = t_net;
+    net->fault_seed = seed;
+}
+
+int bus_sim_set_fault(BusSimFault fault, double value, int from, int to) {
+    SimNet* net = t_net;
+    if (from < -1 || to < -1 || from >= MAX_NODES || to >= MAX_NODES || value < 0 ||
+        (fault <= BUS_FAULT_REORDER && value > 1)) {
+        return 0;
+    }
+    for (int i = 0; i < MAX_NODES; ++i) {
+        for (int j = 0; j < MAX_NODES; ++j) {
+            if ((from >= 0 && i != from) || (to >= 0 && j != to))
+                continue;
+            LinkFaults* l = &net->faults[i][j];
+            switch (fault) {
+                case BUS_FAULT_LOSS:
+                    l->loss = value;
+                    break;
+                case BUS_FAULT_CORRUPT:
+                    l->corrupt = value;
+                    break;
+                case BUS_FAULT_REORDER:
+                    l->reorder = value;
+                    break;
+                case BUS_FAULT_LATENCY_MS:
+                    l->latency_us = (uint32_t) (value * 1000);
+                    break;
+                case BUS_FAULT_JITTER_MS:
+                    l->jitter_us = (uint32_t) (value * 1000);
+                    break;
+            }
+        }
+    }
+    return 1;
+}
+
+int bus_sim_add_partition(uint32_t group, uint32_t start_ms, uint32_t end_ms) {
+    SimNet* net = t_net;
+    if (net->num_partitions == MAX_PARTITIONS || end_ms <= start_ms) {
+        return 0;
+    }
+    net->partitions[net->num_partitions].group = group;
+    net->partitions[net->num_partitions].start_ms = start_ms;
+    net->partitions[net->num_partitions].end_ms = end_ms;
+    net->num_partitions++;
+    return 1;
+}
+
+void bus_sim_get_fault_stats(uint32_t* lost, uint32_t* corrupted, uint32_t* reordered) {
+    SimNet* net = t_net;
+    *lost = read_count(&net->frames_lost);
+    *corrupted = read_count(&net->frames_corrupted);
+    *reordered = read_count(&net->frames_reordered);
+}
+
+int bus_sim_set_segment(uint8_t segment, uint32_t nodes) {
+    SimNet* net = t_net;
+    if (segment >= BUS_SIM_MAX_SEGMENTS) {
+        return 0;
+    }
+    for (size_t i = 0; i < MAX_NODES && i < 32; ++i) {
+        if ((nodes >> i) & 1u)
+            net->segment[i] = segment;
+    }
+    return 1;
+}
+
+int bus_sim_add_bridge(uint8_t a, uint8_t b, double latency_ms, uint32_t baud) {
+    SimNet* net = t_net;
+    if (net->num_bridges == BUS_SIM_MAX_BRIDGES || a >= BUS_SIM_MAX_SEGMENTS ||
+        b >= BUS_SIM_MAX_SEGMENTS || a == b || latency_ms < 0) {
+        return 0;
+    }
+    Bridge* br = &net->bridges[net->num_bridges++];
+    memset(br, 0, sizeof(*br));
+    br->seg[0] = a;
+    br->seg[1] = b;
+    br->latency_us = (uint32_t) (latency_ms * 1000);
+    br->baud = baud;
+    update_routes(net);
+    return 1;
+}
+
+int bus_sim_hops(int from, int to) {
+    SimNet* net = t_net;
+    if (from < 0 || to < 0 || from >= MAX_NODES || to >= MAX_NODES) {
         return -1;
+    }
+    uint8_t hops = net->hops[net->segment[from]][net->segment[to]];
+    return hops == NO_ROUTE ? -1 : hops;
+}
+
+SimNet* bus_sim_net_create(void) {
+    SimNet* net = calloc(1, sizeof(*net));
+    if (!net) {
+        return NULL;
+    }
+    // Start from the default network's configuration, so one set of options applies to all
+    const SimNet* base = &g_default_net;
+    net->char_bits = base->char_bits;
+    net->fault_seed = base->fault_seed;
+    memcpy(net->faults, base->faults, sizeof(net->faults));
+    memcpy(net->partitions, base->partitions, sizeof(net->partitions));
+    net->num_partitions = base->num_partitions;
+    memcpy(net->segment, base->segment, sizeof(net->segment));
+    memcpy(net->bridges, base->bridges, sizeof(net->bridges));
+    net->num_bridges = base->num_bridges;
+    update_routes(net);
+    pthread_mutex_init(&net->global_mutex, NULL);
+    pthread_mutex_init(&net->medium_mutex, NULL);
+    return net;
+}
+
+void bus_sim_net_destroy(SimNet* net) {
+    if (net && net != &g_default_net) {
+        pthread_mutex_destroy(&net->global_mutex);
+        pthread_mutex_destroy(&net->medium_mutex);
+        free(net);
+    }
+}
+
+void bus_sim_use_net(SimNet* net) {
+    t_net = net ? net : &g_default_net;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) (us / 1000000ULL);
+    ts.tv_nsec = (long) (us % 1000000ULL) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Time n characters take at a baud rate, in the network's framing (0 baud = no time)
+ */
+static uint64_t line_us(const SimNet* net, uint32_t n, uint32_t baud) {
+    if (baud == 0) {
+        return 0;
+    }
+    return (uint64_t) n * net->char_bits * 1000000ULL / baud;
+}
+
+/**
+ * @brief Time n characters occupy the line at the bus baud rate and framing
+ */
+static uint64_t chars_us(const Bus* bus, uint32_t n) {
+    return line_us(bus->net, n, bus->baud);
+}
+
+/**
+ * @brief Time a frame occupies the line: every byte with its start, parity and stop bits
+ */
+static uint64_t airtime_us(const Bus* bus, const Frame* frame) {
+    return chars_us(bus, 5u + frame->payload_len);
+}
+
+/**
+ * @brief Note when a JOIN request first went on the line (call with medium_mutex held)
+ *
+ * Retries carry the same nonce, so the latency runs from the first JOIN a
+ * node put on the line until the coordinator's reply reaches it (see
+ * track_assign()).
+ */
+static void track_join(SimNet* net, const Bus* bus, const Frame* f, uint64_t now) {
+    if (f->type == MSG_JOIN && f->payload_len >= 4) {  // A relayed copy is not a new request
+        uint32_t nonce = bytes_to_u32(f->payload);
+        for (size_t i = 0; i < net->num_joins; ++i) {
+            if (net->joins[i].nonce == nonce)
+                return;  // A retry
+        }
+        if (net->num_joins == MAX_PENDING_JOINS) {
+            // Forget the oldest request, which is probably from a node that died
+            memmove(&net->joins[0], &net->joins[1],
+                    (MAX_PENDING_JOINS - 1) * sizeof(net->joins[0]));
+            net->num_joins--;
+        }
+        net->joins[net->num_joins].nonce = nonce;
+        net->joins[net->num_joins].at_us = now;
+        net->joins[net->num_joins].slot = bus->slot;
+        net->num_joins++;
+    }
+}
+
+/**
+ * @brief Time a JOIN request to the ASSIGN echoing its nonce (call with medium_mutex held)
+ *
+ * @param due_us When the ASSIGN reaches each node, 0 where it was lost
+ */
+static void track_assign(SimNet* net, const Frame* f, const uint64_t due_us[MAX_NODES]) {
+    if (proto_type(f) == MSG_ASSIGN && f->payload_len >= 5) {
+        uint32_t nonce = bytes_to_u32(&f->payload[1]);
+        for (size_t i = 0; i < net->num_joins; ++i) {
+            uint64_t due = due_us[net->joins[i].slot];
+            if (net->joins[i].nonce != nonce || due == 0)
+                continue;  // Not this request, or the reply was lost: the retry will tell
+            uint32_t ms = (uint32_t) ((due - net->joins[i].at_us) / 1000ULL);
+            size_t b = 0;
+            while (b < BUS_SIM_JOIN_BUCKETS && ms > k_join_bucket_ms[b])
+                b++;
+            count(&net->join_buckets[b], 1);
+            count(&net->join_sum_ms, ms);
+            net->joins[i] = net->joins[--net->num_joins];
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Carry a frame across the bridges to every segment it can reach
+ *
+ * Bridges store and forward: a frame leaves a bridge one frame time (at the
+ * bridge's baud rate) plus its latency after it has fully arrived, and a
+ * bridge still busy with earlier frames in that direction queues it, up to
+ * BRIDGE_QUEUE_FRAMES frames. Call with global_mutex held.
+ *
+ * @param t When the frame was complete on the sender's segment
+ * @param arrive Output: when it is complete on each segment (the sender's: t),
+ *        0 where a full bridge dropped it on the way
+ */
+static void bridge_frame(SimNet* net, const Bus* bus, const Frame* f, uint64_t t,
+                         uint64_t arrive[BUS_SIM_MAX_SEGMENTS]) {
+    uint8_t src = net->segment[bus->slot];
+    arrive[src] = t;
+    if (net->num_bridges == 0) {
+        return;
+    }
+
+    // Segments in order of distance, each reached over the last bridge of its route
+    for (uint8_t h = 1; h < BUS_SIM_MAX_SEGMENTS; ++h) {
+        for (uint8_t seg = 0; seg < BUS_SIM_MAX_SEGMENTS; ++seg) {
+            if (net->hops[src][seg] != h)
+                continue;
+            Bridge* br = &net->bridges[net->route[seg][src]];
+            int dir = br->seg[1] == seg ? 0 : 1;
+            uint64_t ready = arrive[br->seg[dir]];
+            uint32_t baud = br->baud ? br->baud : bus->baud;
+            uint64_t frame_us = line_us(net, 5u + f->payload_len, baud);
+            arrive[seg] = 0;
+            if (ready == 0 || br->busy_until_us[dir] > ready + BRIDGE_QUEUE_FRAMES * frame_us)
+                continue;  // Dropped before this bridge, or by it
+            uint64_t start = ready > br->busy_until_us[dir] ? ready : br->busy_until_us[dir];
+            br->busy_until_us[dir] = start + frame_us;
+            arrive[seg] = br->busy_until_us[dir] + br->latency_us;
+            count(&net->frames_bridged, 1);
+        }
+    }
+}
+
+/**
+ * @brief Put a frame on the shared line and deliver it unless it collided
+ *
+ * With a baud rate set, the sender is held for the frame's serialization
+ * time, like a blocking UART write on the real boards. Any two frames whose
+ * airtimes overlap garble each other: receivers see a checksum failure, so
+ * neither is delivered.
+ *
+ * @return 1 if delivered, 0 if it collided (what an echo check would see)
+ */
+static int transmit(Bus* bus, const Frame* frame) {
+    SimNet* net = bus->net;
+    Frame f = *frame;
+    timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
+
+    uint64_t airtime = airtime_us(bus, &f);
+    uint8_t type = proto_type(&f);
+    int collided = 0;
+    HAL_EVENT(HAL_EVENT_TX, type, airtime);
 
-    // Broadcast to all queues
-    pthread_mutex_lock(&g_global_mutex);
-    for (size_t i = 0; i < g_num_nodes; ++i) {
-        Queue* q = &g_queues[i];
+    pthread_mutex_lock(&net->medium_mutex);
+    count(&net->frames_sent, 1);
+    if (proto_hops(&f))
+        count(&net->frames_relayed, 1);
+    else
+        count(&net->frames_by_type[type], 1);
+    track_join(net, bus, &f, now_us());
+    if (airtime > 0) {
+        uint64_t start = now_us();
+        for (size_t i = 0; i < MAX_NODES; ++i) {
+            Bus* other = net->buses[i];
+            if (other && other != bus && other->tx_end_us > start &&
+                net->segment[other->slot] == net->segment[bus->slot]) {
+                other->tx_collided = 1;
+                collided = 1;
+            }
+        }
+        bus->tx_start_us = start;
+        bus->tx_end_us = start + airtime;
+        bus->tx_collided = collided;
+    }
+    pthread_mutex_unlock(&net->medium_mutex);
+
+    if (airtime > 0) {
+        sleep_us(airtime);
+
+        pthread_mutex_lock(&net->medium_mutex);
+        collided = bus->tx_collided;
+        if (collided)
+            count(&net->frames_collided, 1);
+        pthread_mutex_unlock(&net->medium_mutex);
+        if (collided) {
+            HAL_EVENT(HAL_EVENT_COLLISION, type, 0);
+            return 0;
+        }
+    }
+
+    // Broadcast to all queues on every segment we reach, through each link's faults
+    uint32_t lost = 0, corrupted = 0, reordered = 0, overflowed = 0;
+    uint64_t now = now_us();
+    uint64_t arrive[BUS_SIM_MAX_SEGMENTS];
+    uint64_t due_at[MAX_NODES] = {0};
+    pthread_mutex_lock(&net->global_mutex);
+    bridge_frame(net, bus, &f, now, arrive);
+    uint8_t src = net->segment[bus->slot];
+    for (size_t i = 0; i < net->num_nodes; ++i) {
+        Frame copy = f;
+        uint8_t seg = net->segment[i];
+        if (net->hops[src][seg] == NO_ROUTE)
+            continue;  // A separate network
+        if (arrive[seg] == 0) {
+            lost++;  // A bridge on the way had no room for it
+            continue;
+        }
+        uint64_t due = arrive[seg];
+        if (i != bus->slot) {  // We always hear ourselves
+            const LinkFaults* l = &net->faults[bus->slot][i];
+            if (partitioned(net, bus->slot, i, now) || (l->loss > 0 && rng_unit(bus) < l->loss)) {
+                lost++;
+                continue;
+            }
+            if (l->corrupt > 0 && rng_unit(bus) < l->corrupt) {
+                flip_bit(bus, &copy);  // Caught by proto_is_valid() on the receiver
+                corrupted++;
+            }
+            due += l->latency_us;
+            if (l->jitter_us)
+                due += rng_next(bus) % (l->jitter_us + 1ULL);
+            if (l->reorder > 0 && rng_unit(bus) < l->reorder) {
+                due += REORDER_HOLD_US;
+                reordered++;
+            }
+        }
+
+        Queue* q = &net->queues[i];
         pthread_mutex_lock(&q->mutex);
-        ring_push(q, frame);
+        overflowed += (uint32_t) queue_push(q, &copy, due);
         pthread_cond_signal(&q->cond);
         pthread_mutex_unlock(&q->mutex);
+        due_at[i] = due;
     }
-    pthread_mutex_unlock(&g_global_mutex);
+    pthread_mutex_unlock(&net->global_mutex);
+
+    if (type == MSG_ASSIGN) {
+        pthread_mutex_lock(&net->medium_mutex);
+        track_assign(net, &f, due_at);
+        pthread_mutex_unlock(&net->medium_mutex);
+    }
+
+    count(&net->frames_lost, lost);
+    count(&net->frames_corrupted, corrupted);
+    count(&net->frames_reordered, reordered);
+    count(&net->rx_dropped, overflowed);
+    return 1;
+}
+
+/**
+ * @brief Carrier sense: when did (or will) the last frame we can hear end?
+ *
+ * A receiver only notices a frame once its first character has arrived, so
+ * two nodes that start within one character time of each other both find
+ * the line idle - the window in which CSMA still collides.
+ *
+ * @return End of the latest frame from another node that we have sensed, 0 if none
+ */
+static uint64_t line_quiet_since(const Bus* bus, uint64_t char_us) {
+    SimNet* net = bus->net;
+    uint64_t now = now_us();
+    uint64_t quiet = 0;
+    pthread_mutex_lock(&net->medium_mutex);
+    for (size_t i = 0; i < MAX_NODES; ++i) {
+        const Bus* other = net->buses[i];
+        if (other && other != bus && net->segment[other->slot] == net->segment[bus->slot] &&
+            other->tx_start_us + char_us <= now && other->tx_end_us > quiet) {
+            quiet = other->tx_end_us;
+        }
+    }
+    pthread_mutex_unlock(&net->medium_mutex);
+    return quiet;
+}
+
+/**
+ * @brief Run carrier sense for the held frame, one backoff slot at a time
+ *
+ * @return 1 if the frame may go on the line now
+ */
+static int csma_ready(Bus* bus, const Frame* frame) {
+    if (bus->baud == 0) {
+        return 1;  // No medium model, nothing to sense
+    }
+    uint64_t char_us = chars_us(bus, 1);
+    uint64_t now = now_us();
+    if (now < bus->csma_next_us) {
+        return 0;
+    }
+
+    // Backoff slots start when the line went quiet, so every waiting node
+    // counts on the same boundaries and only equal draws collide
+    uint64_t idle_at = line_quiet_since(bus, char_us) + MAC_CSMA_IDLE_CHARS * char_us;
+    int idle = now >= idle_at;
+    bus->csma_next_us = idle ? now + MAC_CSMA_SLOT_CHARS * char_us : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+/**
+ * @brief Send held frames whose TDMA slot has come or that won carrier sense
+ */
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if (!csma_ready(bus, f))
+                break;
+            int collided = !transmit(bus, f);
+            if (!mac_csma_sent(&bus->tdma.csma, collided))
+                mac_tdma_pop(&bus->tdma);
+            else
+                HAL_EVENT(HAL_EVENT_RETRY, proto_type(f), 0);  // The echo: a collision
+            // Count the next backoff from the end of our frame, as the others do
+            bus->csma_next_us = now_us() + chars_us(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+        uint16_t airtime_ms = (uint16_t) ((airtime_us(bus, f) + 999) / 1000);
+        if (mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms) != 0)
+            break;
+        transmit(bus, f);
+        mac_tdma_pop(&bus->tdma);
+    }
+    atomic_store_explicit(&bus->tx_depth, bus->tdma.count, memory_order_relaxed);
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || !frame)
+        return -1;
+
+    // Hold the frame for our slot or a quiet line (and behind anything already held)
+    if (bus->tdma.count || bus->tdma.csma.mode != MAC_CSMA_OFF ||
+        mac_tdma_active(&bus->tdma, hal_network_millis())) {
+        int queued = mac_tdma_enqueue(&bus->tdma, frame);
+        if (!queued)
+            count(&bus->net->tx_dropped, 1);
+        tdma_flush(bus);
+        return queued;
+    }
+
+    transmit(bus, frame);
     return 1;
 }
 
@@ -127,32 +910,57 @@ int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
         return -1;
 
     Queue* q = bus->queue;
-    pthread_mutex_lock(&q->mutex);
+    uint32_t start = hal_millis();
+
+    for (;;) {
+        tdma_flush(bus);
+
+        pthread_mutex_lock(&q->mutex);
+        uint64_t next_due = 0;
+        if (queue_pop(q, frame, now_us(), &next_due) == 0) {
+            pthread_mutex_unlock(&q->mutex);
+            HAL_EVENT(HAL_EVENT_RX, proto_type(frame), frame->source);
+            return 1;
+        }
 
-    if (q->count == 0) {
-        if (timeout_ms == 0) {
+        uint32_t elapsed = hal_millis() - start;
+        if (elapsed >= timeout_ms) {
             pthread_mutex_unlock(&q->mutex);
-            return 0;  // No data, non-blocking
+            return 0;  // Timeout (or no data, non-blocking)
+        }
+
+        // Wake up for our TDMA slot (or next backoff slot) if frames are waiting,
+        // and when a delayed frame becomes due
+        uint64_t wait_us = (uint64_t) (timeout_ms - elapsed) * 1000ULL;
+        if (next_due) {
+            uint64_t now = now_us();
+            uint64_t due_us = next_due > now ? next_due - now : 1;
+            if (due_us < wait_us)
+                wait_us = due_us;
+        }
+        Frame* held = mac_tdma_peek(&bus->tdma);
+        if (held && bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            uint64_t now = now_us();
+            uint64_t slot_us = bus->csma_next_us > now ? bus->csma_next_us - now : 1;
+            if (slot_us < wait_us)
+                wait_us = slot_us;
+        } else if (held) {
+            uint16_t airtime_ms = (uint16_t) ((airtime_us(bus, held) + 999) / 1000);
+            uint32_t slot_ms = mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms);
+            if (slot_ms * 1000ULL < wait_us)
+                wait_us = slot_ms ? slot_ms * 1000ULL : 1000ULL;
         }
 
         struct timespec ts;
         clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += timeout_ms / 1000;
-        ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+        ts.tv_sec += (time_t) (wait_us / 1000000ULL);
+        ts.tv_nsec += (long) (wait_us % 1000000ULL) * 1000L;
         if (ts.tv_nsec >= 1000000000L) {
             ts.tv_sec += 1;
             ts.tv_nsec -= 1000000000L;
         }
-
-        int rc = pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
-        if (rc != 0) {
-            pthread_mutex_unlock(&q->mutex);
-            return 0;  // Timeout
-        }
+        pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
+        pthread_mutex_unlock(&q->mutex);
     }
-
-    int result = ring_pop(q, frame) == 0 ? 1 : 0;
-    pthread_mutex_unlock(&q->mutex);
-    return result;
 }
-
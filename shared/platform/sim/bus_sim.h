@@ -0,0 +1,249 @@
+/**
+ * @file bus_sim.h
+ * @brief Simulation-only extensions to the bus interface
+ *
+ * With a baud rate set (bus_set_baud()), the simulated bus models a single
+ * shared line: every frame occupies it for its serialization time (start,
+ * data, parity and stop bits of each byte) and is delivered when its last
+ * byte has arrived. Frames whose airtimes overlap are lost, as they would be
+ * to checksum failures on real wiring. These counters let the harness
+ * measure that.
+ *
+ * On top of that, each directed link between two nodes can lose, corrupt,
+ * delay and reorder frames, and timed partitions can split the network.
+ * Fault decisions come from a per-sender generator seeded with
+ * bus_sim_set_seed(), so a run with the same settings sees the same faults
+ * on each node's frames (thread timing still varies between runs).
+ *
+ * By default all nodes share one line. A topology splits them over several
+ * segments (bus_sim_set_segment()) joined by bridges (bus_sim_add_bridge()),
+ * like UART segments chained through bridge boards: frames collide and are
+ * sensed only on their own segment, and reach the others over the route
+ * with the fewest bridges, delayed by each bridge's latency and bandwidth.
+ *
+ * All of this state belongs to a network (SimNet). A process starts with one
+ * default network; bus_sim_net_create() makes more, and bus_sim_use_net()
+ * picks the one the calling thread's bus_* and bus_sim_* calls act on, so
+ * independent simulations can run in parallel (see the Monte Carlo runner in
+ * sim/main.c). A bus stays on the network it was created on.
+ */
+
+#ifndef BUS_SIM_H
+#define BUS_SIM_H
+
+#include <stdint.h>
+
+#include "../../core/bus_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Buckets of the JOIN latency histogram in BusSimMetrics (plus one for the rest) */
+#define BUS_SIM_JOIN_BUCKETS 10
+
+/** @brief Most segments in a topology (numbered from 0) */
+#define BUS_SIM_MAX_SEGMENTS 8
+
+/** @brief Most bridges in a topology */
+#define BUS_SIM_MAX_BRIDGES 8
+
+/** @brief One simulated network: its line, queues, fault model and counters */
+typedef struct SimNet SimNet;
+
+/** @brief Fault kinds for bus_sim_set_fault() */
+typedef enum {
+    BUS_FAULT_LOSS = 0,       /**< Probability (0-1) a frame is lost */
+    BUS_FAULT_CORRUPT = 1,    /**< Probability (0-1) one bit is flipped (fails proto_is_valid()) */
+    BUS_FAULT_REORDER = 2,    /**< Probability (0-1) a frame is held back 20ms, behind later ones */
+    BUS_FAULT_LATENCY_MS = 3, /**< Fixed delivery delay */
+    BUS_FAULT_JITTER_MS = 4   /**< Uniformly distributed extra delay, 0 to this value */
+} BusSimFault;
+
+/**
+ * @brief Create an independent network
+ *
+ * It starts with the default network's framing, seed, faults and
+ * partitions, so options set once in the harness carry over. Counters
+ * start at zero.
+ *
+ * @return The network, or NULL if out of memory
+ */
+SimNet* bus_sim_net_create(void);
+
+/**
+ * @brief Free a network made by bus_sim_net_create()
+ *
+ * Call after bus_global_shutdown() on it, once no thread uses it.
+ *
+ * @param net Network to free (NULL is ignored)
+ */
+void bus_sim_net_destroy(SimNet* net);
+
+/**
+ * @brief Pick the network for the calling thread
+ *
+ * bus_global_init(), bus_create() and the bus_sim_* calls of this thread
+ * then act on net. Each thread starts on the default network.
+ *
+ * @param net Network to use, or NULL for the default network
+ */
+void bus_sim_use_net(SimNet* net);
+
+/**
+ * @brief Set the UART character format used for airtime
+ *
+ * Applies to every bus of the network; call before the nodes start. The boards use 8N1
+ * (10 bit times per byte), which is also the default.
+ *
+ * @param data_bits Data bits per character (5-8)
+ * @param parity_bits 1 with a parity bit, 0 without
+ * @param stop_bits Stop bits (1 or 2)
+ * @return 1 if the format was accepted, 0 if it is out of range
+ */
+int bus_sim_set_framing(uint8_t data_bits, uint8_t parity_bits, uint8_t stop_bits);
+
+/**
+ * @brief Read the shared medium counters
+ *
+ * @param frames_sent Output: frames put on the line by all nodes
+ * @param frames_collided Output: frames lost because they overlapped another
+ */
+void bus_sim_get_stats(uint32_t* frames_sent, uint32_t* frames_collided);
+
+/**
+ * @brief Count frames of one message type put on the line
+ *
+ * Lets benchmarks report retries, e.g. JOIN frames beyond one per member.
+ *
+ * @param type Message type (MSG_*)
+ * @return Frames of that type sent by all nodes, including ones that collided
+ */
+uint32_t bus_sim_frames_of_type(uint8_t type);
+
+/** @brief Snapshot of a network's counters and queues, from bus_sim_get_metrics() */
+typedef struct {
+    uint32_t frames_sent;                            /**< Frames put on the line by all nodes */
+    uint32_t frames_collided;                        /**< Frames lost to overlapping another */
+    uint32_t frames_by_type[256];                    /**< The same, by message type (not relayed) */
+    uint32_t frames_lost;                            /**< Deliveries lost or cut off on the way */
+    uint32_t frames_corrupted;                       /**< Deliveries with a flipped bit */
+    uint32_t frames_reordered;                       /**< Deliveries held behind later frames */
+    uint32_t rx_dropped;                             /**< Deliveries pushed out of full queues */
+    uint32_t tx_dropped;                             /**< Frames refused by a full hold queue */
+    uint32_t frames_bridged;                         /**< Frames forwarded by a bridge */
+    uint32_t frames_relayed;                         /**< Copies sent on by relay nodes */
+    uint8_t num_nodes;                               /**< Buses on the network, in creation order */
+    uint32_t rx_depth[BUS_POOL_SIZE];                /**< Frames in each receive queue */
+    uint32_t tx_depth[BUS_POOL_SIZE];                /**< Frames held for a slot or the line */
+    uint32_t join_bucket_ms[BUS_SIM_JOIN_BUCKETS];   /**< Upper bound of each bucket */
+    uint32_t join_buckets[BUS_SIM_JOIN_BUCKETS + 1]; /**< JOINs answered in time (cumulative) */
+    uint32_t join_count;                             /**< JOINs answered by an ASSIGN */
+    uint32_t join_sum_ms;                            /**< Total JOIN latency */
+} BusSimMetrics;
+
+/**
+ * @brief Read every counter of the network at once, without taking its locks
+ *
+ * The counters are atomic, so a reader in another thread (e.g. a metrics
+ * exporter) never makes a node wait. Values are read one by one, so a
+ * snapshot taken while frames flow may be off by the frames in flight.
+ *
+ * JOIN latency is the time from a node's first JOIN on the line (retries
+ * share its nonce) until the ASSIGN echoing that nonce reaches the node.
+ *
+ * @param m Output
+ */
+void bus_sim_get_metrics(BusSimMetrics* m);
+
+/**
+ * @brief Seed the fault generators (call before bus_create())
+ *
+ * @param seed Any value; the default is 1
+ */
+void bus_sim_set_seed(uint64_t seed);
+
+/**
+ * @brief Configure one kind of fault on a link, or on many
+ *
+ * Links are identified by node index (creation order of the buses). Later
+ * calls override earlier ones, so set the global value first and then the
+ * exceptions. A node always hears its own frames unharmed.
+ *
+ * @param fault Fault kind
+ * @param value Probability (0-1) or time in ms, see BusSimFault
+ * @param from Sending node, or -1 for every sender
+ * @param to Receiving node, or -1 for every receiver
+ * @return 1 if applied, 0 if a value or node index is out of range
+ */
+int bus_sim_set_fault(BusSimFault fault, double value, int from, int to);
+
+/**
+ * @brief Split the network for a while
+ *
+ * Between start_ms and end_ms after bus_global_init(), nodes whose bit is
+ * set in group hear no frames from the other nodes and vice versa.
+ *
+ * @param group Bit mask of node indices on one side of the split
+ * @param start_ms Start of the partition
+ * @param end_ms End of the partition (exclusive)
+ * @return 1 if scheduled, 0 if the table is full or the window is empty
+ */
+int bus_sim_add_partition(uint32_t group, uint32_t start_ms, uint32_t end_ms);
+
+/**
+ * @brief Put nodes on a segment of the topology (call before bus_global_init())
+ *
+ * Nodes are identified by index, as for bus_sim_set_fault(). Every node
+ * starts on segment 0.
+ *
+ * @param segment Segment (0 to BUS_SIM_MAX_SEGMENTS - 1)
+ * @param nodes Bit mask of the node indices to move there
+ * @return 1 if applied, 0 if the segment is out of range
+ */
+int bus_sim_set_segment(uint8_t segment, uint32_t nodes);
+
+/**
+ * @brief Join two segments with a bridge (call before bus_global_init())
+ *
+ * The bridge forwards every frame, in both directions. Each frame leaves it
+ * once it has been received in full, re-sent at the bridge's baud rate and
+ * held for its latency; frames wait while the bridge is still sending
+ * earlier ones the same way, and past 16 waiting frames the bridge drops
+ * them (counted as lost deliveries). Forwarded frames do not collide on the far
+ * segment: the bridge is taken to wait for a quiet line. When several
+ * routes join two segments, frames take the one with the fewest bridges.
+ *
+ * @param a One segment
+ * @param b The other segment
+ * @param latency_ms Delay added to each frame on top of its forwarding time
+ * @param baud Line rate of the forwarding side (0 = the sender's)
+ * @return 1 if added, 0 if the table is full or a segment is out of range
+ */
+int bus_sim_add_bridge(uint8_t a, uint8_t b, double latency_ms, uint32_t baud);
+
+/**
+ * @brief Bridges a frame crosses between two nodes
+ *
+ * @param from Sending node index
+ * @param to Receiving node index
+ * @return Number of bridges (0 on the same segment), or -1 if no route joins them
+ */
+int bus_sim_hops(int from, int to);
+
+/**
+ * @brief Read the fault injection counters
+ *
+ * Counted per receiver: a broadcast lost on two links counts twice.
+ *
+ * @param lost Output: deliveries dropped by loss or a partition
+ * @param corrupted Output: deliveries with a flipped bit
+ * @param reordered Output: deliveries held back behind later frames
+ */
+void bus_sim_get_fault_stats(uint32_t* lost, uint32_t* corrupted, uint32_t* reordered);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BUS_SIM_H
@@ -0,0 +1,574 @@
+/**
+ * @file bus_udp.c
+ * @brief Bus implementation over UDP multicast, one process per node
+ *
+ * Every bus has its own socket joined to the group, and multicast loopback
+ * is on, so each datagram reaches every node, the sender included. A
+ * datagram carries the frame and the window [start, end) in which it
+ * occupies the line. A receiver keeps the frames it has heard in arrival
+ * order, delivers each one once its window has passed, and marks any two
+ * with overlapping windows from different senders as collided; neither is
+ * delivered, as in bus_sim.c. The sender learns of a collision from the
+ * datagrams it heard while its own frame was on the line.
+ *
+ * Frames released together (a TDMA slot, or a queue left when TDMA ends)
+ * are put on the line back to back and handed to the kernel in one
+ * sendmmsg() call; received datagrams are drained up to UDP_BATCH per
+ * recvmmsg() call. Windows are on CLOCK_MONOTONIC, which every network
+ * namespace on a host shares, so they compare directly across processes.
+ */
+
+#define _GNU_SOURCE  // sendmmsg(), recvmmsg() and ppoll()
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../core/bus_interface.h"
+#include "../../core/hal.h"
+#include "../../core/timesync.h"
+#include "bus_udp.h"
+
+/** Datagram format version, bumped whenever UdpDatagram changes */
+#define UDP_MAGIC 0x55445031u
+
+/** Frames heard but not yet delivered; any more wait in the kernel's receive buffer */
+#define UDP_PENDING 64
+
+/** Datagrams per sendmmsg()/recvmmsg() call */
+#define UDP_BATCH 16
+
+/** Socket receive buffer, so a burst from many senders is not dropped by the kernel */
+#define UDP_RCVBUF (1 << 20)
+
+/** UART character: start bit + 8 data bits + stop bit (8N1) */
+#define BITS_PER_BYTE 10
+
+/** Longest frame on the wire: sof + type + source + len + payload + checksum */
+#define UDP_FRAME_BYTES (5 + MAX_PAYLOAD_SIZE)
+
+/**
+ * One frame on the wire. Fields are in host byte order: CLOCK_MONOTONIC
+ * only means anything on one host anyway.
+ */
+typedef struct {
+    uint32_t magic;
+    uint8_t node_index;  // Sender, for collisions and carrier sense
+    uint8_t frame_len;   // Bytes used in frame[]
+    uint8_t reserved[2];
+    uint64_t start_us;  // Window the frame occupies the line (CLOCK_MONOTONIC)
+    uint64_t end_us;
+    uint8_t frame[UDP_FRAME_BYTES];  // Serialized as on a UART
+} UdpDatagram;
+
+#define UDP_HEADER_BYTES offsetof(UdpDatagram, frame)
+
+/** A frame heard and not yet delivered */
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint8_t source;    // Sender's node_index
+    uint8_t collided;  // Another sender's frame overlapped it
+    Frame frame;
+} UdpHeard;
+
+struct Bus {
+    int in_use;
+    int fd;              // Socket joined to the group
+    uint8_t node_index;  // Goes out with every frame
+    uint32_t baud;       // 0 = deliver instantly
+    MacTdma tdma;
+    uint64_t csma_next_us;  // Next backoff slot boundary
+
+    // Our latest transmission, checked against every frame heard
+    uint64_t tx_start_us;
+    uint64_t tx_end_us;
+    uint8_t tx_collided;
+
+    uint64_t quiet_us;  // End of the last frame from another node taken off pending
+    UdpHeard pending[UDP_PENDING];
+    uint8_t pending_head;
+    uint8_t pending_count;
+    uint32_t kernel_drops;  // SO_RXQ_OVFL total seen so far
+};
+
+static struct sockaddr_in g_group;
+static struct in_addr g_iface;
+static int g_configured = 0;
+static Bus g_pool[BUS_POOL_SIZE];
+
+// Nodes of one process may run in separate threads
+static atomic_uint g_sent;
+static atomic_uint g_collided;
+static atomic_uint g_missed;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) (us / 1000000ULL);
+    ts.tv_nsec = (long) (us % 1000000ULL) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+int bus_udp_set_group(const char* group, uint16_t port, const char* iface) {
+    struct in_addr addr, ifaddr;
+    if (inet_pton(AF_INET, group ? group : BUS_UDP_DEFAULT_GROUP, &addr) != 1 ||
+        !IN_MULTICAST(ntohl(addr.s_addr)) ||
+        inet_pton(AF_INET, iface ? iface : BUS_UDP_DEFAULT_IFACE, &ifaddr) != 1) {
+        return -1;
+    }
+    memset(&g_group, 0, sizeof(g_group));
+    g_group.sin_family = AF_INET;
+    g_group.sin_port = htons(port ? port : BUS_UDP_DEFAULT_PORT);
+    g_group.sin_addr = addr;
+    g_iface = ifaddr;
+    g_configured = 1;
+    return 0;
+}
+
+void bus_udp_get_stats(uint32_t* frames_sent, uint32_t* frames_collided, uint32_t* frames_missed) {
+    *frames_sent = atomic_load(&g_sent);
+    *frames_collided = atomic_load(&g_collided);
+    *frames_missed = atomic_load(&g_missed);
+}
+
+int bus_global_init(uint8_t max_nodes) {
+    (void) max_nodes;  // Every node has its own socket; there is nothing shared to size
+    if (!g_configured) {
+        return bus_udp_set_group(NULL, 0, NULL);
+    }
+    return 0;
+}
+
+void bus_global_shutdown(void) {
+    // Nothing to do: the sockets belong to the buses
+}
+
+// A socket that sends to and receives from the group on the selected interface
+static int open_socket(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    int rcvbuf = UDP_RCVBUF;
+    unsigned char loop = 1;  // Other nodes on this host, and ourselves, must hear us
+    unsigned char ttl = 1;   // Stay on the local link
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = g_group.sin_addr;
+    mreq.imr_interface = g_iface;
+
+    // Bound to the group address, so only its datagrams arrive; every socket
+    // bound to it gets a copy
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(fd, (const struct sockaddr*) &g_group, sizeof(g_group)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &g_iface, sizeof(g_iface)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0) {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));  // Best effort
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));       // Count drops
+    return fd;
+}
+
+int bus_create(Bus** bus, uint8_t node_index, uint8_t rx_pin, uint8_t tx_pin) {
+    (void) rx_pin;  // Unused in simulation
+    (void) tx_pin;  // Unused in simulation
+
+    if (!g_configured || node_index >= BUS_UDP_MAX_NODES) {
+        return -1;
+    }
+    size_t i = 0;
+    while (i < BUS_POOL_SIZE && g_pool[i].in_use)
+        i++;
+    if (i == BUS_POOL_SIZE) {
+        return -1;
+    }
+
+    int fd = open_socket();
+    if (fd < 0) {
+        return -1;
+    }
+    Bus* b = &g_pool[i];
+    memset(b, 0, sizeof(*b));
+    b->in_use = 1;
+    b->fd = fd;
+    b->node_index = node_index;
+    mac_tdma_init(&b->tdma);
+    *bus = b;
+    return 0;
+}
+
+void bus_destroy(Bus* bus) {
+    if (bus && bus->in_use) {
+        close(bus->fd);
+        bus->in_use = 0;  // Back to the pool
+    }
+}
+
+void bus_set_baud(Bus* bus, uint32_t baud) {
+    if (bus) {
+        bus->baud = baud;
+    }
+}
+
+void bus_set_tdma(Bus* bus, const MacSchedule* sched, uint8_t my_id) {
+    if (bus) {
+        mac_tdma_configure(&bus->tdma, sched, my_id, hal_network_millis());
+    }
+}
+
+void bus_set_csma(Bus* bus, MacCsmaMode mode) {
+    if (bus) {
+        bus->tdma.csma.mode = mode;
+    }
+}
+
+// Time n characters occupy the line at the bus baud rate
+static uint64_t chars_us(const Bus* bus, uint32_t n) {
+    if (bus->baud == 0) {
+        return 0;
+    }
+    return (uint64_t) n * BITS_PER_BYTE * 1000000ULL / bus->baud;
+}
+
+// Time a frame occupies the line
+static uint64_t airtime_us(const Bus* bus, const Frame* frame) {
+    return chars_us(bus, 5u + frame->payload_len);
+}
+
+// Serialize a frame as a datagram; returns its length
+static size_t encode(UdpDatagram* d, const Bus* bus, const Frame* f, uint64_t start,
+                     uint64_t end) {
+    memset(d, 0, UDP_HEADER_BYTES);
+    d->magic = UDP_MAGIC;
+    d->node_index = bus->node_index;
+    d->frame_len = (uint8_t) (5 + f->payload_len);
+    d->start_us = start;
+    d->end_us = end;
+    d->frame[0] = f->sof;
+    d->frame[1] = f->type;
+    d->frame[2] = f->source;
+    d->frame[3] = f->payload_len;
+    memcpy(&d->frame[4], f->payload, f->payload_len);
+    d->frame[4 + f->payload_len] = f->checksum;
+    return UDP_HEADER_BYTES + d->frame_len;
+}
+
+// Parse a datagram; returns 0 for anything that is not a valid frame of ours
+static int decode(const UdpDatagram* d, size_t len, Frame* f) {
+    if (len < UDP_HEADER_BYTES + 5 || d->magic != UDP_MAGIC ||
+        d->node_index >= BUS_UDP_MAX_NODES || d->frame[3] > MAX_PAYLOAD_SIZE ||
+        d->frame_len != 5 + d->frame[3] || len != UDP_HEADER_BYTES + d->frame_len) {
+        return 0;
+    }
+    memset(f, 0, sizeof(*f));
+    f->sof = d->frame[0];
+    f->type = d->frame[1];
+    f->source = d->frame[2];
+    f->payload_len = d->frame[3];
+    memcpy(f->payload, &d->frame[4], f->payload_len);
+    f->checksum = d->frame[4 + f->payload_len];
+    return proto_is_valid(f);
+}
+
+// Count datagrams the kernel dropped because our receive buffer was full
+static void note_drops(Bus* bus, struct msghdr* msg) {
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(c), sizeof(drops));  // Running total for the socket
+            atomic_fetch_add(&g_missed, drops - bus->kernel_drops);
+            bus->kernel_drops = drops;
+        }
+    }
+}
+
+// Record a frame heard from the line, marking whatever it overlapped as collided
+static void hear(Bus* bus, const UdpDatagram* d, size_t len) {
+    Frame f;
+    if (!decode(d, len, &f)) {
+        return;  // Not our format, or garbled
+    }
+    uint64_t start = d->start_us;
+    uint64_t end = d->end_us;
+    uint8_t collided = 0;
+
+    if (d->node_index != bus->node_index && start < bus->tx_end_us && bus->tx_start_us < end) {
+        bus->tx_collided = 1;
+    }
+    for (uint8_t i = 0; i < bus->pending_count; ++i) {
+        UdpHeard* p = &bus->pending[(bus->pending_head + i) % UDP_PENDING];
+        if (p->source != d->node_index && start < p->end_us && p->start_us < end) {
+            p->collided = 1;
+            collided = 1;
+        }
+    }
+
+    UdpHeard* h = &bus->pending[(bus->pending_head + bus->pending_count) % UDP_PENDING];
+    h->start_us = start;
+    h->end_us = end;
+    h->source = d->node_index;
+    h->collided = collided;
+    h->frame = f;
+    bus->pending_count++;
+}
+
+// Drain the socket without waiting, UDP_BATCH datagrams per call. Datagrams
+// that do not fit in pending stay queued in the kernel until frames are taken.
+static void rx_pump(Bus* bus) {
+    UdpDatagram in[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    struct mmsghdr msgs[UDP_BATCH];
+    char control[UDP_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+
+    for (;;) {
+        unsigned room = UDP_PENDING - bus->pending_count;
+        unsigned batch = room < UDP_BATCH ? room : UDP_BATCH;
+        if (batch == 0) {
+            return;
+        }
+        memset(msgs, 0, sizeof(msgs));
+        for (unsigned i = 0; i < batch; ++i) {
+            iov[i].iov_base = &in[i];
+            iov[i].iov_len = sizeof(in[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+
+        int n = recvmmsg(bus->fd, msgs, batch, MSG_DONTWAIT, NULL);
+        for (int i = 0; i < n; ++i) {
+            hear(bus, &in[i], msgs[i].msg_len);
+            note_drops(bus, &msgs[i].msg_hdr);
+        }
+        if (n < (int) batch) {
+            return;  // Drained (or an error, which the next call sees again)
+        }
+    }
+}
+
+// Take the oldest frame whose airtime has passed; collided frames are dropped
+static int take(Bus* bus, Frame* out) {
+    uint64_t now = now_us();
+    while (bus->pending_count) {
+        UdpHeard* h = &bus->pending[bus->pending_head];
+        if (h->end_us > now) {
+            return 0;  // Still on the line (later arrivals end later)
+        }
+        bus->pending_head = (uint8_t) ((bus->pending_head + 1) % UDP_PENDING);
+        bus->pending_count--;
+        if (h->source != bus->node_index && h->end_us > bus->quiet_us) {
+            bus->quiet_us = h->end_us;
+        }
+        if (h->collided) {
+            if (h->source == bus->node_index) {
+                atomic_fetch_add(&g_collided, 1);  // Counted once, from our own copy
+            }
+            continue;
+        }
+        *out = h->frame;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Put frames on the line back to back, in one sendmmsg() call
+ *
+ * The sender is held until the last one has left the line, as in
+ * bus_sim.c, and then looks at what it heard meanwhile.
+ *
+ * @return 1 if no other node's frame overlapped ours, 0 if one did
+ */
+static int transmit(Bus* bus, const Frame* frames, unsigned count) {
+    UdpDatagram out[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    struct mmsghdr msgs[UDP_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+
+    uint64_t t = now_us();
+    bus->tx_start_us = t;
+    for (unsigned i = 0; i < count; ++i) {
+        Frame f = frames[i];
+        timesync_stamp(&f);  // Timestamps reflect the moment the frame hits the line
+        uint64_t airtime = airtime_us(bus, &f);
+        iov[i].iov_base = &out[i];
+        iov[i].iov_len = encode(&out[i], bus, &f, t, t + airtime);
+        msgs[i].msg_hdr.msg_name = &g_group;
+        msgs[i].msg_hdr.msg_namelen = sizeof(g_group);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        t += airtime;
+    }
+    bus->tx_end_us = t;
+    bus->tx_collided = 0;
+
+    for (unsigned sent = 0; sent < count;) {
+        int n = sendmmsg(bus->fd, &msgs[sent], count - sent, 0);
+        if (n <= 0) {
+            break;  // Lost, like a frame nobody heard
+        }
+        sent += (unsigned) n;
+    }
+    atomic_fetch_add(&g_sent, count);
+
+    uint64_t now = now_us();
+    if (t > now) {
+        sleep_us(t - now);
+    }
+    rx_pump(bus);
+    return !bus->tx_collided;
+}
+
+/**
+ * @brief Carrier sense: when did (or will) the last frame we can hear end?
+ *
+ * A frame is only noticed once its first character has arrived, as in
+ * bus_sim.c.
+ */
+static uint64_t line_quiet_since(Bus* bus, uint64_t char_us) {
+    rx_pump(bus);
+    uint64_t now = now_us();
+    uint64_t quiet = bus->quiet_us;
+    for (uint8_t i = 0; i < bus->pending_count; ++i) {
+        const UdpHeard* h = &bus->pending[(bus->pending_head + i) % UDP_PENDING];
+        if (h->source != bus->node_index && h->start_us + char_us <= now && h->end_us > quiet) {
+            quiet = h->end_us;
+        }
+    }
+    return quiet;
+}
+
+// Run carrier sense for the held frame, one backoff slot at a time
+static int csma_ready(Bus* bus, const Frame* frame) {
+    uint64_t char_us = chars_us(bus, 1);
+    uint64_t now = now_us();
+    if (now < bus->csma_next_us) {
+        return 0;
+    }
+    uint64_t idle_at = line_quiet_since(bus, char_us) + MAC_CSMA_IDLE_CHARS * char_us;
+    int idle = now >= idle_at;
+    bus->csma_next_us = idle ? now + MAC_CSMA_SLOT_CHARS * char_us : idle_at;
+    return mac_csma_step(&bus->tdma.csma, frame, idle);
+}
+
+// Frames whose timestamp must be taken as they go out; they only start a batch
+static int is_stamped(const Frame* f) {
+    return f->type == MSG_TIME_REQ || f->type == MSG_TIME;
+}
+
+// Send held frames whose TDMA slot has come or that won carrier sense
+static void tdma_flush(Bus* bus) {
+    Frame* f;
+    while ((f = mac_tdma_peek(&bus->tdma)) != NULL) {
+        if (bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            if (!csma_ready(bus, f))
+                break;
+            int collided = !transmit(bus, f, 1);
+            if (!mac_csma_sent(&bus->tdma.csma, collided))
+                mac_tdma_pop(&bus->tdma);
+            bus->csma_next_us = now_us() + chars_us(bus, MAC_CSMA_IDLE_CHARS);
+            continue;
+        }
+
+        // Everything that still fits in the slot when sent back to back
+        Frame batch[UDP_BATCH];
+        unsigned count = 0;
+        uint64_t offset_us = 0;
+        uint32_t now = hal_network_millis();
+        while (count < UDP_BATCH && (f = mac_tdma_peek(&bus->tdma)) != NULL) {
+            if (count > 0 && is_stamped(f))
+                break;
+            uint64_t airtime = airtime_us(bus, f);
+            uint16_t airtime_ms = (uint16_t) ((airtime + 999) / 1000);
+            if (mac_tdma_wait_ms(&bus->tdma, now + (uint32_t) (offset_us / 1000), airtime_ms) != 0)
+                break;
+            batch[count++] = *f;
+            mac_tdma_pop(&bus->tdma);
+            offset_us += airtime;
+        }
+        if (count == 0)
+            break;
+        transmit(bus, batch, count);
+    }
+}
+
+int bus_send(Bus* bus, const Frame* frame) {
+    if (!bus || !bus->in_use || !frame)
+        return -1;
+
+    // Hold the frame for our slot or a quiet line (and behind anything already held)
+    if (bus->tdma.count || bus->tdma.csma.mode != MAC_CSMA_OFF ||
+        mac_tdma_active(&bus->tdma, hal_network_millis())) {
+        int queued = mac_tdma_enqueue(&bus->tdma, frame);
+        tdma_flush(bus);
+        return queued;
+    }
+
+    transmit(bus, frame, 1);
+    return 1;
+}
+
+int bus_recv(Bus* bus, Frame* frame, uint16_t timeout_ms) {
+    if (!bus || !bus->in_use || !frame)
+        return -1;
+
+    uint32_t start = hal_millis();
+    for (;;) {
+        tdma_flush(bus);
+        rx_pump(bus);
+        if (take(bus, frame)) {
+            return 1;
+        }
+
+        uint32_t elapsed = hal_millis() - start;
+        if (elapsed >= timeout_ms) {
+            return 0;  // Timeout (or no data, non-blocking)
+        }
+
+        // Wake up when the oldest frame heard leaves the line, and for our
+        // TDMA slot (or next backoff slot) if frames are held
+        uint64_t now = now_us();
+        uint64_t wait_us = (uint64_t) (timeout_ms - elapsed) * 1000ULL;
+        if (bus->pending_count) {
+            uint64_t end = bus->pending[bus->pending_head].end_us;
+            uint64_t left = end > now ? end - now : 1;
+            if (left < wait_us)
+                wait_us = left;
+        }
+        Frame* held = mac_tdma_peek(&bus->tdma);
+        if (held && bus->tdma.csma.mode != MAC_CSMA_OFF &&
+            !mac_tdma_active(&bus->tdma, hal_network_millis())) {
+            uint64_t slot_us = bus->csma_next_us > now ? bus->csma_next_us - now : 1;
+            if (slot_us < wait_us)
+                wait_us = slot_us;
+        } else if (held) {
+            uint16_t airtime_ms = (uint16_t) ((airtime_us(bus, held) + 999) / 1000);
+            uint32_t slot_ms = mac_tdma_wait_ms(&bus->tdma, hal_network_millis(), airtime_ms);
+            if (slot_ms * 1000ULL < wait_us)
+                wait_us = slot_ms ? slot_ms * 1000ULL : 1000ULL;
+        }
+
+        struct pollfd pfd = {bus->fd, POLLIN, 0};
+        struct timespec ts;
+        ts.tv_sec = (time_t) (wait_us / 1000000ULL);
+        ts.tv_nsec = (long) (wait_us % 1000000ULL) * 1000L;
+        ppoll(&pfd, 1, &ts, NULL);
+    }
+}
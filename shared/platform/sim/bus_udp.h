@@ -0,0 +1,70 @@
+/**
+ * @file bus_udp.h
+ * @brief UDP multicast bus for running nodes in separate network namespaces
+ *
+ * bus_udp.c implements bus_interface.h with one UDP multicast group as the
+ * line, so node processes can run in separate containers or network
+ * namespaces on one Linux host: over the loopback interface, or over veth
+ * pairs and a bridge, where `ip link set ... down` or a dropping netfilter
+ * rule partitions the network. Frames held for a TDMA slot go out in one
+ * sendmmsg() call, and receivers drain the socket with recvmmsg().
+ *
+ * The line model follows bus_sim.c. Each datagram carries the frame's
+ * airtime window on CLOCK_MONOTONIC, which every namespace on a host
+ * shares. Receivers deliver a frame when its airtime has passed and drop
+ * any two that overlap, so collisions, carrier sense and TDMA behave as on
+ * the other backends as long as a datagram takes less than a character
+ * time to arrive. Every node hears its own frames.
+ *
+ * Linux only. Nodes are identified by the node_index passed to
+ * bus_create(), which must be unique within a group.
+ */
+
+#ifndef BUS_UDP_H
+#define BUS_UDP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Group, port and interface used unless bus_udp_set_group() picks others */
+#define BUS_UDP_DEFAULT_GROUP "239.255.77.1"
+#define BUS_UDP_DEFAULT_PORT 47701
+#define BUS_UDP_DEFAULT_IFACE "127.0.0.1"
+
+/** Highest node_index + 1 on a group */
+#define BUS_UDP_MAX_NODES 32
+
+/**
+ * @brief Select the multicast group that later bus_create() calls join
+ *
+ * Processes using the same group and port share a line; use different
+ * ones to run several networks side by side.
+ *
+ * @param group IPv4 multicast address, or NULL for the default
+ * @param port UDP port, or 0 for the default
+ * @param iface IPv4 address of the interface to send and join on (a veth
+ *              end inside a namespace), or NULL for the loopback interface
+ * @return 0 on success, -1 if an address does not parse or is not multicast
+ */
+int bus_udp_set_group(const char* group, uint16_t port, const char* iface);
+
+/**
+ * @brief Read this process's line counters
+ *
+ * Datagrams travel between processes, so unlike bus_shm_get_stats() these
+ * only count what this process's buses did.
+ *
+ * @param frames_sent Output: frames our buses put on the line
+ * @param frames_collided Output: frames of ours lost because they overlapped another
+ * @param frames_missed Output: frames the kernel dropped because one of our buses fell behind
+ */
+void bus_udp_get_stats(uint32_t* frames_sent, uint32_t* frames_collided, uint32_t* frames_missed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BUS_UDP_H
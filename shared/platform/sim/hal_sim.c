@@ -9,53 +9,429 @@
  *
  * Platform Features:
  * - High-resolution monotonic timing via clock_gettime()
- * - Thread-safe random number generation
- * - Console logging with printf()
+ * - Per-node simulated clocks (boot offset and oscillator drift)
+ * - Per-node seeded random number generators (repeatable, no shared state)
+ * - Independent sets of boards, so whole simulations can run side by side
+ * - Logging through per-thread buffers and one writer thread, or binary
+ *   trace records (LOG_TRACE)
+ * - Timeline events as Chrome trace-event JSON, one track per node
  * - Cooperative multitasking via short sleeps
+ * - File-backed identity cache (one file per node slot)
  */
 
 #define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "../../core/hal.h"
+#include "../../core/proto.h"
+#include "../../core/rng.h"
+#include "../../core/trace.h"
+#include "hal_sim.h"
 
-/** Baseline timestamp for relative millisecond calculations */
-static uint32_t g_start_time_ms = 0;
+/** Baseline timestamp (µs since CLOCK_MONOTONIC epoch) for relative time */
+static uint64_t g_start_time_us = 0;
+
+/** Binary log records from all nodes, written out by whichever thread yields */
+static TraceRing g_trace;
+
+/** Guards g_trace */
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Timeline JSON file (hal_sim_set_timeline()), NULL = events are dropped */
+static FILE* g_timeline = NULL;
+
+/** Set while g_timeline is open, so hal_event() can return without the lock */
+static atomic_int g_timeline_on;
+
+/** Guards g_timeline and the track state below */
+static pthread_mutex_t g_timeline_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Per track (node, or the harness last): named yet, and the role slice that is open */
+static uint8_t g_timeline_named[HAL_SIM_MAX_NODES + 1];
+static int g_timeline_role[HAL_SIM_MAX_NODES + 1];
+
+/** Directory holding identity cache files (NULL = persistence disabled) */
+static const char* g_identity_dir = NULL;
+
+/**
+ * @brief Simulated board clock
+ *
+ * Each node thread reads its own oscillator: a boot offset plus a rate error
+ * against true (host) time, so nodes disagree like separate boards would.
+ * The network correction is whatever the time sync service last installed.
+ */
+typedef struct {
+    int32_t offset_ms;       /**< Local clock reading when the simulation started */
+    int32_t skew_ppm;        /**< Oscillator rate error vs true time, in ppm */
+    uint32_t ref_local_ms;   /**< Network correction: local reference time */
+    uint32_t ref_network_ms; /**< Network correction: network time at the reference */
+    int32_t drift_ppm;       /**< Network correction: rate of network vs local clock */
+} SimClock;
+
+/**
+ * @brief The boards of one simulation
+ *
+ * Per-node clocks and random number generators, plus one of each for
+ * threads not bound to a node (the harness).
+ */
+struct SimBoards {
+    SimClock clocks[HAL_SIM_MAX_NODES + 1];
+    Rng rngs[HAL_SIM_MAX_NODES + 1];
+    pthread_mutex_t clock_lock; /**< Guards network corrections, read by the harness */
+    uint64_t seed;              /**< Seed of the generators, names the identity files */
+};
+
+/** Boards used by threads that have not picked others with hal_sim_use_boards() */
+static SimBoards g_default_boards = {.clock_lock = PTHREAD_MUTEX_INITIALIZER};
+
+/** Boards of the simulation running on the calling thread */
+static _Thread_local SimBoards* t_boards = &g_default_boards;
+
+/** Clock of the node running on the calling thread */
+static _Thread_local SimClock* t_clock = &g_default_boards.clocks[HAL_SIM_MAX_NODES];
+
+/** Generator of the node running on the calling thread */
+static _Thread_local Rng* t_rng = &g_default_boards.rngs[HAL_SIM_MAX_NODES];
+
+/** Nonzero to drop log output (hal_sim_set_quiet()) */
+static volatile int g_quiet = 0;
+
+/** Log lines one thread can queue before the writer thread catches up */
+#define LOG_RING_RECORDS 256
+
+/** How often the writer thread drains the buffers */
+#define LOG_DRAIN_US 5000ULL
+
+/** Lines younger than this wait for the next pass, so late publishers still sort in */
+#define LOG_HOLD_US 2000ULL
+
+/** Node tag of threads not bound to a node (the harness) */
+#define LOG_HARNESS 0xFF
+
+/** One buffered log line */
+typedef struct {
+    uint64_t t_us;          /**< True time of the call, µs since hal_init() */
+    uint8_t node;           /**< Node index of the logging thread, or LOG_HARNESS */
+    char text[HAL_LOG_MAX]; /**< The line, truncated to HAL_LOG_MAX - 1 characters */
+} LogRecord;
+
+/**
+ * @brief Log lines of one thread, waiting for the writer thread
+ *
+ * Single producer (the owning thread), single consumer (the writer thread):
+ * the owner only advances head and the writer only advances tail, so
+ * logging takes no lock. A full buffer drops the line and counts it.
+ */
+typedef struct LogBuffer {
+    LogRecord records[LOG_RING_RECORDS];
+    atomic_uint head;        /**< Lines written (owning thread) */
+    atomic_uint tail;        /**< Lines printed (writer thread) */
+    atomic_uint dropped;     /**< Lines lost to a full buffer since the last report */
+    int released;            /**< Owner has exited: reusable once empty (g_log_lock) */
+    struct LogBuffer* next;  /**< Every buffer ever handed out (g_log_lock) */
+} LogBuffer;
+
+/** Guards the buffer list; held by the writer thread during a pass */
+static pthread_mutex_t g_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Buffers of all threads that have logged, live or waiting for reuse */
+static LogBuffer* g_log_buffers = NULL;
+
+/** Releases a thread's buffer when the thread exits */
+static pthread_key_t g_log_key;
+static pthread_once_t g_log_key_once = PTHREAD_ONCE_INIT;
+
+/** Writer thread draining the buffers */
+static pthread_t g_log_thread;
+static atomic_int g_log_running;
+
+/** Where log lines go (NULL = stdout) */
+static FILE* g_log_file = NULL;
+
+/** Log buffer of the calling thread (NULL until it first logs) */
+static _Thread_local LogBuffer* t_log = NULL;
+
+/** Node index shown on the calling thread's log lines */
+static _Thread_local uint8_t t_log_node = LOG_HARNESS;
+
+/**
+ * @brief True microseconds elapsed since hal_init()
+ */
+static uint64_t elapsed_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u - g_start_time_us;
+}
+
+/**
+ * @brief Local millisecond reading of a simulated clock at a true instant
+ */
+static uint32_t local_millis(const SimClock* c, uint64_t true_us) {
+    int64_t local_us = (int64_t) true_us + (int64_t) true_us * c->skew_ppm / 1000000;
+    return (uint32_t) c->offset_ms + (uint32_t) (local_us / 1000);
+}
+
+/**
+ * @brief Apply a clock's network correction to one of its local readings
+ */
+static uint32_t network_millis(const SimClock* c, uint32_t local_ms) {
+    int32_t elapsed = (int32_t) (local_ms - c->ref_local_ms);
+    int64_t corrected = (int64_t) elapsed + (int64_t) elapsed * c->drift_ppm / 1000000;
+    return c->ref_network_ms + (uint32_t) corrected;
+}
+
+/**
+ * @brief Print buffered log lines up to a point in time, oldest first
+ *
+ * Every buffer is in time order, so repeatedly taking the oldest head line
+ * across all buffers merges them. Lines newer than cutoff_us stay queued.
+ */
+static void log_drain(uint64_t cutoff_us) {
+    FILE* out = g_log_file ? g_log_file : stdout;
+    pthread_mutex_lock(&g_log_lock);
+    for (;;) {
+        LogBuffer* oldest = NULL;
+        const LogRecord* r = NULL;
+        for (LogBuffer* b = g_log_buffers; b; b = b->next) {
+            unsigned tail = atomic_load_explicit(&b->tail, memory_order_relaxed);
+            if (tail == atomic_load_explicit(&b->head, memory_order_acquire))
+                continue;
+            const LogRecord* head_line = &b->records[tail % LOG_RING_RECORDS];
+            if (head_line->t_us <= cutoff_us && (!r || head_line->t_us < r->t_us)) {
+                oldest = b;
+                r = head_line;
+            }
+        }
+        if (!oldest)
+            break;
+
+        unsigned long long ms = (unsigned long long) (r->t_us / 1000u);
+        unsigned us = (unsigned) (r->t_us % 1000u);
+        if (r->node == LOG_HARNESS)
+            fprintf(out, "[%7llu.%03u] sim     %s\n", ms, us, r->text);
+        else
+            fprintf(out, "[%7llu.%03u] node %-2u %s\n", ms, us, r->node, r->text);
+        atomic_fetch_add_explicit(&oldest->tail, 1, memory_order_release);
+    }
+    for (LogBuffer* b = g_log_buffers; b; b = b->next) {
+        unsigned dropped = atomic_exchange_explicit(&b->dropped, 0, memory_order_relaxed);
+        if (dropped)
+            fprintf(out, "LOG: %u lines dropped (buffer full)\n", dropped);
+    }
+    fflush(out);
+    pthread_mutex_unlock(&g_log_lock);
+}
+
+/**
+ * @brief Writer thread: drain the buffers until logging stops
+ */
+static void* log_writer(void* arg) {
+    (void) arg;
+    while (atomic_load(&g_log_running)) {
+        struct timespec pause = {0, (long) LOG_DRAIN_US * 1000L};
+        nanosleep(&pause, NULL);
+        uint64_t now = elapsed_us();
+        log_drain(now > LOG_HOLD_US ? now - LOG_HOLD_US : 0);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Stop the writer thread and print what is still queued (atexit)
+ */
+static void log_stop(void) {
+    if (atomic_exchange(&g_log_running, 0)) {
+        pthread_join(g_log_thread, NULL);
+    }
+    log_drain(UINT64_MAX);
+}
+
+/**
+ * @brief Start the writer thread (once)
+ */
+static void log_start(void) {
+    if (atomic_load(&g_log_running)) {
+        return;
+    }
+    atomic_store(&g_log_running, 1);
+    if (pthread_create(&g_log_thread, NULL, log_writer, NULL) != 0) {
+        atomic_store(&g_log_running, 0);  // hal_log() prints directly instead
+        return;
+    }
+    atexit(log_stop);
+}
+
+/**
+ * @brief Mark a thread's buffer for reuse once the writer has emptied it
+ */
+static void log_release(void* buffer) {
+    pthread_mutex_lock(&g_log_lock);
+    ((LogBuffer*) buffer)->released = 1;
+    pthread_mutex_unlock(&g_log_lock);
+}
+
+static void log_make_key(void) {
+    pthread_key_create(&g_log_key, log_release);
+}
+
+/**
+ * @brief Give the calling thread a buffer: an emptied one of an exited thread, or a new one
+ */
+static LogBuffer* log_attach(void) {
+    pthread_once(&g_log_key_once, log_make_key);
+    pthread_mutex_lock(&g_log_lock);
+    LogBuffer* b = g_log_buffers;
+    while (b && !(b->released && atomic_load(&b->tail) == atomic_load(&b->head)))
+        b = b->next;
+    if (b) {
+        b->released = 0;
+    } else if ((b = calloc(1, sizeof(*b))) != NULL) {
+        b->next = g_log_buffers;
+        g_log_buffers = b;
+    }
+    pthread_mutex_unlock(&g_log_lock);
+    if (b) {
+        pthread_setspecific(g_log_key, b);
+        t_log = b;
+    }
+    return b;
+}
 
 /**
  * @brief Initialize simulation HAL subsystem
  *
- * Sets up timing baseline and seeds the random number generator.
+ * Sets up timing baseline, seeds the random number generators and starts
+ * the log writer thread.
  * This implementation uses CLOCK_MONOTONIC for reliable timing
- * and current time for random seed.
+ * and current time for the seed (see hal_sim_set_seed() for repeatable runs).
  */
 void hal_init(void) {
     // Establish timing baseline using high-resolution monotonic clock
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    g_start_time_ms = (uint32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    g_start_time_us = 0;
+    g_start_time_us = elapsed_us();
+
+    // Seed every node's generator from the current time
+    hal_sim_set_seed((uint64_t) time(NULL));
 
-    // Seed random number generator with current time
-    srand((unsigned) time(NULL));
+    trace_ring_init(&g_trace);
+    log_start();
 }
 
 /**
- * @brief Get milliseconds elapsed since hal_init() was called
+ * @brief Get milliseconds elapsed on the calling node's clock
  *
  * Uses CLOCK_MONOTONIC to provide a stable time reference that
- * isn't affected by system clock adjustments. Resolution is
- * typically 1ms or better on modern systems.
+ * isn't affected by system clock adjustments, then applies the node's
+ * simulated boot offset and oscillator error (see hal_sim_set_clock()).
+ * Threads not bound to a node see true time since hal_init().
  *
- * @return Milliseconds since initialization
+ * @return Milliseconds on this node's local clock
  */
 uint32_t hal_millis(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    uint32_t now = (uint32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
-    return now - g_start_time_ms;
+    return local_millis(t_clock, elapsed_us());
+}
+
+uint32_t hal_network_millis(void) {
+    pthread_mutex_lock(&t_boards->clock_lock);
+    uint32_t now = network_millis(t_clock, local_millis(t_clock, elapsed_us()));
+    pthread_mutex_unlock(&t_boards->clock_lock);
+    return now;
+}
+
+void hal_set_network_clock(uint32_t ref_local_ms, uint32_t ref_network_ms, int32_t drift_ppm) {
+    pthread_mutex_lock(&t_boards->clock_lock);
+    t_clock->ref_local_ms = ref_local_ms;
+    t_clock->ref_network_ms = ref_network_ms;
+    t_clock->drift_ppm = drift_ppm;
+    pthread_mutex_unlock(&t_boards->clock_lock);
+}
+
+void hal_sim_set_clock(uint8_t index, int32_t offset_ms, int32_t skew_ppm) {
+    if (index < HAL_SIM_MAX_NODES) {
+        t_boards->clocks[index].offset_ms = offset_ms;
+        t_boards->clocks[index].skew_ppm = skew_ppm;
+    }
+}
+
+void hal_sim_bind_node(uint8_t index) {
+    if (index < HAL_SIM_MAX_NODES) {
+        t_clock = &t_boards->clocks[index];
+        t_rng = &t_boards->rngs[index];
+        t_log_node = index;
+    }
+}
+
+/**
+ * @brief Seed every generator of a set of boards from one master seed
+ */
+static void seed_boards(SimBoards* boards, uint64_t seed) {
+    boards->seed = seed;
+    for (uint64_t i = 0; i <= HAL_SIM_MAX_NODES; ++i) {
+        rng_seed(&boards->rngs[i], seed * (HAL_SIM_MAX_NODES + 1) + i);  // Unique per (seed, node)
+    }
+}
+
+void hal_sim_set_seed(uint64_t seed) {
+    seed_boards(t_boards, seed);
+}
+
+SimBoards* hal_sim_boards_create(uint64_t seed) {
+    SimBoards* boards = calloc(1, sizeof(*boards));
+    if (boards) {
+        pthread_mutex_init(&boards->clock_lock, NULL);
+        seed_boards(boards, seed);
+    }
+    return boards;
+}
+
+void hal_sim_boards_destroy(SimBoards* boards) {
+    if (boards && boards != &g_default_boards) {
+        pthread_mutex_destroy(&boards->clock_lock);
+        free(boards);
+    }
+}
+
+void hal_sim_use_boards(SimBoards* boards) {
+    t_boards = boards ? boards : &g_default_boards;
+    t_clock = &t_boards->clocks[HAL_SIM_MAX_NODES];
+    t_rng = &t_boards->rngs[HAL_SIM_MAX_NODES];
+}
+
+void hal_sim_set_quiet(int quiet) {
+    g_quiet = quiet;
+}
+
+uint32_t hal_sim_node_network_millis(uint8_t index) {
+    if (index >= HAL_SIM_MAX_NODES) {
+        return 0;
+    }
+    pthread_mutex_lock(&t_boards->clock_lock);
+    const SimClock* c = &t_boards->clocks[index];
+    uint32_t now = network_millis(c, local_millis(c, elapsed_us()));
+    pthread_mutex_unlock(&t_boards->clock_lock);
+    return now;
+}
+
+/**
+ * @brief Write queued trace records to stdout
+ */
+static void trace_drain(void) {
+    pthread_mutex_lock(&g_trace_lock);
+    uint16_t len;
+    const uint8_t* bytes = trace_ring_peek(&g_trace, &len);
+    while (len) {
+        fwrite(bytes, 1, len, stdout);
+        trace_ring_consume(&g_trace, len);
+        bytes = trace_ring_peek(&g_trace, &len);
+    }
+    pthread_mutex_unlock(&g_trace_lock);
 }
 
 /**
@@ -68,6 +444,7 @@ uint32_t hal_millis(void) {
  * @param ms Number of milliseconds to delay
  */
 void hal_delay(uint32_t ms) {
+    trace_drain();
     usleep((useconds_t) (ms * 1000));
 }
 
@@ -76,36 +453,323 @@ void hal_delay(uint32_t ms) {
  *
  * Provides a short 1ms delay to allow other threads in the
  * simulation to make progress. This prevents busy-waiting
- * from consuming 100% CPU during polling loops.
+ * from consuming 100% CPU during polling loops. Idle time is also when
+ * queued trace records are written out.
  */
 void hal_yield(void) {
+    trace_drain();
     usleep(1000);  // 1ms yield for cooperative multitasking
 }
 
 /**
  * @brief Generate 32-bit pseudo-random number
  *
- * Combines two 16-bit rand() calls to create a 32-bit value
- * with reasonable distribution. Not cryptographically secure,
- * but sufficient for coordinator election tie-breaking.
+ * Draws from the generator of the node bound to the calling thread, so
+ * threads never share generator state and each node's sequence depends only
+ * on the seed.
  *
  * @return 32-bit pseudo-random value
  */
 uint32_t hal_random32(void) {
-    uint32_t high = (uint32_t) rand();
-    uint32_t low = (uint32_t) rand();
-    return (high << 16) ^ low;
+    return rng_next(t_rng);
+}
+
+void hal_random_seed(uint64_t seed) {
+    rng_seed(t_rng, seed);
 }
 
 /**
- * @brief Log message to standard output
+ * @brief Log message to standard output (or the --log file)
  *
- * Outputs messages to stdout with automatic newline.
- * In a real simulation, this might be enhanced with
- * timestamps, node IDs, or log levels.
+ * Queues the line, tagged with the node index and the true time in µs, in
+ * the calling thread's own buffer; the writer thread prints the lines of all
+ * threads in time order every few milliseconds. Logging therefore never
+ * takes a lock or waits for the terminal, and lines from different nodes
+ * never interleave. Before hal_init() lines are printed directly.
  *
  * @param msg Null-terminated message string
  */
 void hal_log(const char* msg) {
-    printf("%s\n", msg);
+    if (g_quiet) {
+        return;
+    }
+    LogBuffer* b = t_log;
+    if (!atomic_load_explicit(&g_log_running, memory_order_relaxed) ||
+        (!b && (b = log_attach()) == NULL)) {
+        printf("%s\n", msg);
+        return;
+    }
+
+    unsigned head = atomic_load_explicit(&b->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&b->tail, memory_order_acquire) == LOG_RING_RECORDS) {
+        atomic_fetch_add_explicit(&b->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    LogRecord* r = &b->records[head % LOG_RING_RECORDS];
+    r->t_us = elapsed_us();
+    r->node = t_log_node;
+    size_t len = strlen(msg);
+    if (len >= sizeof(r->text))
+        len = sizeof(r->text) - 1;
+    memcpy(r->text, msg, len);
+    r->text[len] = '\0';
+    atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+int hal_sim_set_log_file(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_log_lock);
+    FILE* old = g_log_file;
+    g_log_file = f;
+    pthread_mutex_unlock(&g_log_lock);
+    if (old) {
+        fclose(old);
+    }
+    return 1;
+}
+
+void hal_logf(const char* fmt, ...) {
+    if (g_quiet) {
+        return;  // Skip the formatting too
+    }
+    char line[HAL_LOG_MAX];
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+
+    hal_log(line);
+}
+
+void hal_trace(uint16_t id, const char* fmt, ...) {
+    if (g_quiet) {
+        return;
+    }
+    uint8_t record[TRACE_RECORD_MAX];
+    uint32_t ms = hal_millis();
+
+    va_list ap;
+    va_start(ap, fmt);
+    uint8_t len = trace_encode(record, id, ms, fmt, ap);
+    va_end(ap);
+
+    pthread_mutex_lock(&g_trace_lock);
+    trace_ring_push(&g_trace, record, len, ms);
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+int hal_sim_set_timeline(const char* path) {
+    FILE* f = NULL;
+    if (path && (f = fopen(path, "w")) == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_timeline_lock);
+    if (g_timeline) {
+        uint64_t ts = elapsed_us();
+        for (int pid = 0; pid <= HAL_SIM_MAX_NODES; ++pid) {
+            if (g_timeline_role[pid] >= 0)  // End the role slices at the end of the run
+                fprintf(g_timeline, ",\n{\"ph\":\"E\",\"ts\":%llu,\"pid\":%d,\"tid\":1}",
+                        (unsigned long long) ts, pid);
+        }
+        fprintf(g_timeline, "\n]\n");
+        fclose(g_timeline);
+    }
+    g_timeline = f;
+    if (f) {
+        // Events follow as ",\n{...}", so the array is valid JSON once closed
+        fprintf(f, "[{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+                   "\"args\":{\"name\":\"harness\"}}",
+                HAL_SIM_MAX_NODES);
+        memset(g_timeline_named, 0, sizeof(g_timeline_named));
+        g_timeline_named[HAL_SIM_MAX_NODES] = 1;
+        for (size_t i = 0; i <= HAL_SIM_MAX_NODES; ++i)
+            g_timeline_role[i] = -1;
+    }
+    atomic_store_explicit(&g_timeline_on, f != NULL, memory_order_relaxed);
+    pthread_mutex_unlock(&g_timeline_lock);
+    return 1;
+}
+
+/**
+ * @brief Name a track the first time it has an event (g_timeline_lock held)
+ *
+ * Each node is a process in the viewer with two threads: its activity
+ * (waits, frames, retries) and its role over time.
+ */
+static void timeline_name_track(int pid) {
+    if (g_timeline_named[pid])
+        return;
+    g_timeline_named[pid] = 1;
+    fprintf(g_timeline,
+            ",\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+            "\"args\":{\"name\":\"node %d\"}}",
+            pid, pid);
+    fprintf(g_timeline,
+            ",\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_sort_index\","
+            "\"args\":{\"sort_index\":%d}}",
+            pid, pid);
+    fprintf(g_timeline,
+            ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"thread_name\","
+            "\"args\":{\"name\":\"activity\"}}",
+            pid);
+    fprintf(g_timeline,
+            ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"name\":\"thread_name\","
+            "\"args\":{\"name\":\"role\"}}",
+            pid);
+}
+
+void hal_event(uint8_t kind, uint32_t a, uint32_t b) {
+    static const char* const roles[] = {"SEEKING", "COORDINATOR", "MEMBER"};
+    static const char* const waits[] = {"wait for RECLAIM confirmation", "startup jitter",
+                                        "listen for CLAIM", "CLAIM conflict window",
+                                        "wait for ASSIGN"};
+    if (!atomic_load_explicit(&g_timeline_on, memory_order_relaxed)) {
+        return;  // No timeline: one load and out
+    }
+    uint64_t ts = elapsed_us();
+    int pid = t_log_node < HAL_SIM_MAX_NODES ? t_log_node : HAL_SIM_MAX_NODES;
+    const char* type = proto_type_name((uint8_t) a);
+    char type_buf[8];
+    if (!type && kind >= HAL_EVENT_TX) {
+        snprintf(type_buf, sizeof(type_buf), "%u", (unsigned) (a & 0xFF));
+        type = type_buf;
+    }
+
+    pthread_mutex_lock(&g_timeline_lock);
+    FILE* f = g_timeline;
+    if (!f) {
+        pthread_mutex_unlock(&g_timeline_lock);
+        return;
+    }
+    timeline_name_track(pid);
+    switch (kind) {
+        case HAL_EVENT_ROLE:
+            // The role track shows one slice per role, from the change to the next one
+            if (g_timeline_role[pid] >= 0)
+                fprintf(f, ",\n{\"ph\":\"E\",\"ts\":%llu,\"pid\":%d,\"tid\":1}",
+                        (unsigned long long) ts, pid);
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"role\",\"ph\":\"B\",\"ts\":%llu,\"pid\":%d,"
+                       "\"tid\":1,\"args\":{\"id\":%u}}",
+                    a < 3 ? roles[a] : "?", (unsigned long long) ts, pid, b);
+            g_timeline_role[pid] = (int) a;
+            break;
+        case HAL_EVENT_BEGIN:
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"wait\",\"ph\":\"B\",\"ts\":%llu,\"pid\":%d,"
+                       "\"tid\":0}",
+                    a < 5 ? waits[a] : "?", (unsigned long long) ts, pid);
+            break;
+        case HAL_EVENT_END:
+            fprintf(f, ",\n{\"ph\":\"E\",\"ts\":%llu,\"pid\":%d,\"tid\":0,"
+                       "\"args\":{\"succeeded\":%u}}",
+                    (unsigned long long) ts, pid, b);
+            break;
+        case HAL_EVENT_TX:
+            // The frame occupies the line for its airtime (0 on an instant bus)
+            fprintf(f, ",\n{\"name\":\"TX %s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%llu,"
+                       "\"dur\":%u,\"pid\":%d,\"tid\":0}",
+                    type, (unsigned long long) ts, b, pid);
+            break;
+        case HAL_EVENT_RX:
+            fprintf(f, ",\n{\"name\":\"RX %s\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\","
+                       "\"ts\":%llu,\"pid\":%d,\"tid\":0,\"args\":{\"source\":%u}}",
+                    type, (unsigned long long) ts, pid, b);
+            break;
+        case HAL_EVENT_COLLISION:
+        case HAL_EVENT_RETRY:
+            fprintf(f, ",\n{\"name\":\"%s %s\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\","
+                       "\"ts\":%llu,\"pid\":%d,\"tid\":0}",
+                    kind == HAL_EVENT_COLLISION ? "collision" : "retry", type,
+                    (unsigned long long) ts, pid);
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&g_timeline_lock);
+}
+
+void hal_sim_set_identity_dir(const char* dir) {
+    g_identity_dir = dir;
+}
+
+/**
+ * @brief Build the identity cache file path for a slot
+ *
+ * The name carries the process ID and the seed of the calling thread's
+ * boards as well as the slot, so simulations sharing the directory (make -j,
+ * --monte-carlo) do not read each other's IDs.
+ *
+ * @param path Output buffer
+ * @param size Size of the output buffer
+ * @param slot Node slot (instance index)
+ * @return 1 if persistence is enabled and the path fits, 0 otherwise
+ */
+static int identity_path(char* path, size_t size, uint8_t slot) {
+    if (!g_identity_dir) {
+        return 0;
+    }
+    int len = snprintf(path, size, "%s/%ld-%llx-node%u.id", g_identity_dir, (long) getpid(),
+                       (unsigned long long) t_boards->seed, slot);
+    return len > 0 && (size_t) len < size;
+}
+
+/**
+ * @brief Load a node identity from its cache file
+ *
+ * The file holds "<id> <epoch>" in plain text so it can be inspected or
+ * edited by hand when experimenting with reboots.
+ *
+ * @param slot Node slot (instance index)
+ * @param id Output: cached ID
+ * @param epoch Output: cached network epoch
+ * @return 1 if a non-zero ID was loaded, 0 otherwise
+ */
+int hal_identity_load(uint8_t slot, uint8_t* id, uint16_t* epoch) {
+    char path[256];
+    if (!identity_path(path, sizeof(path), slot)) {
+        return 0;
+    }
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    unsigned stored_id = 0;
+    unsigned stored_epoch = 0;
+    int fields = fscanf(f, "%u %u", &stored_id, &stored_epoch);
+    fclose(f);
+
+    if (fields != 2 || stored_id == 0 || stored_id > 255) {
+        return 0;
+    }
+    *id = (uint8_t) stored_id;
+    *epoch = (uint16_t) stored_epoch;
+    return 1;
+}
+
+/**
+ * @brief Store a node identity in its cache file
+ *
+ * @param slot Node slot (instance index)
+ * @param id Assigned ID (0 clears the cache)
+ * @param epoch Network epoch
+ */
+void hal_identity_store(uint8_t slot, uint8_t id, uint16_t epoch) {
+    char path[256];
+    if (!identity_path(path, sizeof(path), slot)) {
+        return;
+    }
+
+    if (id == 0) {
+        remove(path);
+        return;
+    }
+    FILE* f = fopen(path, "w");
+    if (f) {
+        fprintf(f, "%u %u\n", id, epoch);
+        fclose(f);
+    }
 }
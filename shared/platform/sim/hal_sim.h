@@ -0,0 +1,160 @@
+/**
+ * @file hal_sim.h
+ * @brief Simulation-only extensions to the HAL
+ *
+ * These functions configure behavior that only exists in the simulation
+ * (where many nodes share one process). Core code never calls them - they
+ * are used by the simulation harness in sim/.
+ *
+ * Clocks and random number generators belong to a set of boards
+ * (SimBoards). A process starts with one default set; the harness can create
+ * more and pick the set a thread works on with hal_sim_use_boards(), so
+ * independent simulations can run in parallel.
+ */
+
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of node clocks the simulation can model */
+#define HAL_SIM_MAX_NODES 16
+
+/** @brief Clocks and random number generators of one simulation */
+typedef struct SimBoards SimBoards;
+
+/**
+ * @brief Enable the file-backed identity cache
+ *
+ * hal_identity_store() writes one small file per slot into this directory
+ * and hal_identity_load() reads it back. Files are named after the process,
+ * the seed of the boards and the slot, so simulations running side by side
+ * can share the directory; a new run never sees an earlier run's IDs. With
+ * no directory configured (the default) nothing is persisted and every
+ * boot is a cold boot.
+ *
+ * @param dir Existing directory for identity files, or NULL to disable
+ */
+void hal_sim_set_identity_dir(const char* dir);
+
+/**
+ * @brief Give a simulated node its own imperfect clock
+ *
+ * Real boards boot at different times and their oscillators run at slightly
+ * different rates. Once a thread is bound to the node, hal_millis() returns
+ * offset_ms + true elapsed time * (1 + skew_ppm / 1e6). All clocks are ideal
+ * with no offset by default.
+ *
+ * @param index Node index (0 to HAL_SIM_MAX_NODES - 1)
+ * @param offset_ms Local clock reading at simulation start
+ * @param skew_ppm Oscillator rate error in ppm (positive = runs fast)
+ */
+void hal_sim_set_clock(uint8_t index, int32_t offset_ms, int32_t skew_ppm);
+
+/**
+ * @brief Make the calling thread use a node's clock
+ *
+ * Call at the start of the node's thread. hal_millis(), hal_network_millis()
+ * and hal_set_network_clock() then act on that node's clock, and
+ * hal_random32() draws from that node's generator.
+ *
+ * @param index Node index (0 to HAL_SIM_MAX_NODES - 1)
+ */
+void hal_sim_bind_node(uint8_t index);
+
+/**
+ * @brief Seed every node's random number generator from one master seed
+ *
+ * Each node (and the harness) gets its own generator seeded from the master
+ * seed and its index, so a run repeats its random choices exactly. hal_init()
+ * seeds from the current time; call this after it.
+ *
+ * @param seed Master seed
+ */
+void hal_sim_set_seed(uint64_t seed);
+
+/**
+ * @brief Create an independent set of boards
+ *
+ * Clocks start ideal with no offset; the generators are seeded as by
+ * hal_sim_set_seed().
+ *
+ * @param seed Master seed
+ * @return The boards, or NULL if out of memory
+ */
+SimBoards* hal_sim_boards_create(uint64_t seed);
+
+/**
+ * @brief Free boards made by hal_sim_boards_create(), once no thread uses them
+ *
+ * @param boards Boards to free (NULL is ignored)
+ */
+void hal_sim_boards_destroy(SimBoards* boards);
+
+/**
+ * @brief Pick the boards for the calling thread
+ *
+ * The thread then acts as the harness of those boards: hal_sim_set_clock(),
+ * hal_sim_set_seed(), hal_sim_node_network_millis() and hal_sim_bind_node()
+ * refer to them, and hal_random32() draws from their harness generator.
+ * Each thread starts on the default boards.
+ *
+ * @param boards Boards to use, or NULL for the default boards
+ */
+void hal_sim_use_boards(SimBoards* boards);
+
+/**
+ * @brief Drop all log output (hal_log(), hal_logf() and trace records)
+ *
+ * For runs whose harness only reports aggregate results.
+ *
+ * @param quiet Nonzero to drop log output, 0 to print it again
+ */
+void hal_sim_set_quiet(int quiet);
+
+/**
+ * @brief Send log lines to a file instead of stdout
+ *
+ * Lines keep their format: "[ms.µs] node N <text>", or "sim" for the
+ * harness, in time order across all nodes.
+ *
+ * @param path File to create (an existing file is replaced)
+ * @return 1 if the file was opened, 0 otherwise
+ */
+int hal_sim_set_log_file(const char* path);
+
+/**
+ * @brief Write the nodes' timeline events to a Chrome trace-event JSON file
+ *
+ * Open the file in Perfetto (ui.perfetto.dev) or chrome://tracing. Each node
+ * is a track with its role over time, the waits of the election and join
+ * process (HAL_EVENT_BEGIN/END), frames sent (for their airtime) and
+ * received, collisions and retries. Times are true time since hal_init(),
+ * so the tracks line up whatever the nodes' clocks say.
+ *
+ * @param path File to create (an existing file is replaced), or NULL to
+ *             finish and close the current one
+ * @return 1 on success, 0 if the file could not be created
+ */
+int hal_sim_set_timeline(const char* path);
+
+/**
+ * @brief Read a node's network clock from any thread
+ *
+ * Lets the harness compare nodes' ideas of network time at the same instant
+ * to report synchronization accuracy.
+ *
+ * @param index Node index (0 to HAL_SIM_MAX_NODES - 1)
+ * @return The node's hal_network_millis() value right now
+ */
+uint32_t hal_sim_node_network_millis(uint8_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HAL_SIM_H
@@ -0,0 +1,377 @@
+/**
+ * @file metrics_sim.c
+ * @brief Prometheus text exporter for the simulation (see metrics_sim.h)
+ *
+ * Node threads store their role in an atomic slot and count role changes
+ * with atomic adds; the bus keeps its own atomic counters (bus_sim.c). The
+ * exporter thread reads both without locks, so the only cost a scrape puts
+ * on the simulation is the cache traffic of those loads. The page is
+ * rendered into one static buffer, which only the exporter thread touches.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "metrics_sim.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bus_sim.h"
+
+/** Nodes whose role is tracked */
+#define METRICS_MAX_NODES BUS_POOL_SIZE
+
+/** Role slots: powered off, then the NodeRole values shifted by one */
+#define ROLE_OFF 0
+#define NUM_ROLES 4
+
+/** Longest the exporter sleeps before checking whether it should stop */
+#define METRICS_POLL_MS 100
+
+/** How long a client has to send its request before it gets a bare page */
+#define METRICS_REQUEST_MS 100
+
+/** Room for the rendered page: a few lines per message type and per node */
+#define METRICS_PAGE_SIZE 32768
+
+static const char* const k_role_names[NUM_ROLES] = {"off", "seeking", "coordinator", "member"};
+
+static atomic_int g_running;
+static pthread_t g_thread;
+static int g_listen_fd = -1;
+static char g_socket_path[108];  // sizeof(sockaddr_un.sun_path)
+static char g_file_path[256];
+static uint32_t g_interval_ms;
+static uint8_t g_num_nodes;
+
+// Written by node threads, read by the exporter
+static atomic_int g_role[METRICS_MAX_NODES];  // ROLE_OFF or 1 + NodeRole
+static atomic_int g_standby[METRICS_MAX_NODES];
+static atomic_uint g_transitions[NUM_ROLES][NUM_ROLES];  // [from][to]
+
+// Exporter thread only
+static uint64_t g_start_ms;
+static uint64_t g_rate_ms;      // When the frame rate was last measured
+static uint32_t g_rate_frames;  // frames_sent at that time
+static double g_frames_per_second;
+static char g_page[METRICS_PAGE_SIZE];
+static size_t g_page_len;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000ULL + (uint64_t) ts.tv_nsec / 1000000ULL;
+}
+
+/**
+ * @brief Append to the page (output past METRICS_PAGE_SIZE is cut off)
+ */
+static void emit(const char* fmt, ...) {
+    if (g_page_len >= sizeof(g_page))
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(&g_page[g_page_len], sizeof(g_page) - g_page_len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        g_page_len += (size_t) n < sizeof(g_page) - g_page_len ? (size_t) n
+                                                                : sizeof(g_page) - g_page_len - 1;
+}
+
+static void emit_header(const char* name, const char* type, const char* help) {
+    emit("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Measure the frame rate since the last refresh
+ */
+static void update_rate(const BusSimMetrics* bus, uint64_t now) {
+    if (now > g_rate_ms) {
+        g_frames_per_second = (double) (bus->frames_sent - g_rate_frames) * 1000.0 /
+                              (double) (now - g_rate_ms);
+    }
+    g_rate_ms = now;
+    g_rate_frames = bus->frames_sent;
+}
+
+/**
+ * @brief Render every metric into g_page
+ */
+static void render(const BusSimMetrics* bus, uint64_t now) {
+    g_page_len = 0;
+
+    emit_header("sim_uptime_seconds", "gauge", "Time since the exporter started");
+    emit("sim_uptime_seconds %.3f\n", (double) (now - g_start_ms) / 1000.0);
+
+    emit_header("sim_bus_frames_total", "counter",
+                "Frames put on the line, by message type (relayed copies excluded)");
+    for (int t = 0; t < 256; ++t) {
+        if (bus->frames_by_type[t] == 0)
+            continue;
+        const char* name = proto_type_name((uint8_t) t);
+        if (name)
+            emit("sim_bus_frames_total{type=\"%s\"} %u\n", name, bus->frames_by_type[t]);
+        else
+            emit("sim_bus_frames_total{type=\"%d\"} %u\n", t, bus->frames_by_type[t]);
+    }
+    emit_header("sim_bus_frames_per_second", "gauge",
+                "Frames put on the line per second over the last refresh interval");
+    emit("sim_bus_frames_per_second %.1f\n", g_frames_per_second);
+    emit_header("sim_bus_collisions_total", "counter", "Frames lost to overlapping another");
+    emit("sim_bus_collisions_total %u\n", bus->frames_collided);
+    emit_header("sim_bus_bridged_frames_total", "counter",
+                "Frames forwarded by a bridge between segments");
+    emit("sim_bus_bridged_frames_total %u\n", bus->frames_bridged);
+    emit_header("sim_bus_relayed_frames_total", "counter",
+                "Copies of control frames sent on by relay nodes");
+    emit("sim_bus_relayed_frames_total %u\n", bus->frames_relayed);
+
+    emit_header("sim_bus_faults_total", "counter", "Deliveries hit by injected faults");
+    emit("sim_bus_faults_total{fault=\"lost\"} %u\n", bus->frames_lost);
+    emit("sim_bus_faults_total{fault=\"corrupted\"} %u\n", bus->frames_corrupted);
+    emit("sim_bus_faults_total{fault=\"reordered\"} %u\n", bus->frames_reordered);
+
+    emit_header("sim_bus_drops_total", "counter", "Frames dropped by a full queue");
+    emit("sim_bus_drops_total{queue=\"rx\"} %u\n", bus->rx_dropped);
+    emit("sim_bus_drops_total{queue=\"tx\"} %u\n", bus->tx_dropped);
+    emit_header("sim_bus_queue_depth", "gauge",
+                "Frames waiting to be received (rx) or held for the line (tx)");
+    for (uint8_t i = 0; i < bus->num_nodes; ++i) {
+        emit("sim_bus_queue_depth{node=\"%u\",queue=\"rx\"} %u\n", i, bus->rx_depth[i]);
+        emit("sim_bus_queue_depth{node=\"%u\",queue=\"tx\"} %u\n", i, bus->tx_depth[i]);
+    }
+
+    int per_role[NUM_ROLES] = {0};
+    int standbys = 0;
+    for (uint8_t i = 0; i < g_num_nodes; ++i) {
+        per_role[atomic_load_explicit(&g_role[i], memory_order_relaxed)]++;
+        standbys += atomic_load_explicit(&g_standby[i], memory_order_relaxed);
+    }
+    emit_header("sim_nodes", "gauge", "Nodes in each role");
+    for (int r = 0; r < NUM_ROLES; ++r)
+        emit("sim_nodes{role=\"%s\"} %d\n", k_role_names[r], per_role[r]);
+    emit_header("sim_standby_nodes", "gauge", "Members named hot standby by their coordinator");
+    emit("sim_standby_nodes %d\n", standbys);
+
+    uint32_t elections = 0;
+    emit_header("sim_role_transitions_total", "counter", "Role changes of all nodes");
+    for (int from = 0; from < NUM_ROLES; ++from) {
+        for (int to = 0; to < NUM_ROLES; ++to) {
+            if (from == to)
+                continue;
+            uint32_t n = atomic_load_explicit(&g_transitions[from][to], memory_order_relaxed);
+            emit("sim_role_transitions_total{from=\"%s\",to=\"%s\"} %u\n", k_role_names[from],
+                 k_role_names[to], n);
+            if (to == 1 + NODE_COORDINATOR)
+                elections += n;
+        }
+    }
+    emit_header("sim_elections_total", "counter",
+                "Nodes that became coordinator, by winning a claim or taking over as standby");
+    emit("sim_elections_total %u\n", elections);
+
+    emit_header("sim_join_latency_seconds", "histogram",
+                "Time from a node's first JOIN on the line until the ASSIGN answering it arrives");
+    for (int b = 0; b < BUS_SIM_JOIN_BUCKETS; ++b) {
+        emit("sim_join_latency_seconds_bucket{le=\"%g\"} %u\n", bus->join_bucket_ms[b] / 1000.0,
+             bus->join_buckets[b]);
+    }
+    emit("sim_join_latency_seconds_bucket{le=\"+Inf\"} %u\n", bus->join_count);
+    emit("sim_join_latency_seconds_sum %.3f\n", bus->join_sum_ms / 1000.0);
+    emit("sim_join_latency_seconds_count %u\n", bus->join_count);
+}
+
+static void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;  // The client went away
+        data += n;
+        len -= (size_t) n;
+    }
+}
+
+/**
+ * @brief Answer one client: HTTP if it sent a request, else just the page
+ */
+static void serve_client(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    char request[512];
+    ssize_t n = 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, METRICS_REQUEST_MS) > 0)
+        n = recv(fd, request, sizeof(request), 0);
+
+    BusSimMetrics bus;
+    bus_sim_get_metrics(&bus);
+    render(&bus, now_ms());
+    if (n >= 4 && memcmp(request, "GET ", 4) == 0) {
+        char head[128];
+        int len = snprintf(head, sizeof(head),
+                           "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: %zu\r\n\r\n",
+                           g_page_len);
+        write_all(fd, head, (size_t) len);
+    }
+    write_all(fd, g_page, g_page_len);
+    close(fd);
+}
+
+/**
+ * @brief Replace the metrics file with the current page
+ */
+static void write_file(const BusSimMetrics* bus, uint64_t now) {
+    char tmp[sizeof(g_file_path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_file_path);
+    FILE* f = fopen(tmp, "w");
+    if (!f)
+        return;
+    render(bus, now);
+    fwrite(g_page, 1, g_page_len, f);
+    if (fclose(f) == 0)
+        rename(tmp, g_file_path);  // Readers see the old page or the new one, never half
+}
+
+/**
+ * @brief Exporter thread: answer scrapes and refresh the rate and file every interval
+ */
+static void* exporter(void* arg) {
+    (void) arg;
+    uint64_t next = now_ms() + g_interval_ms;
+    while (atomic_load(&g_running)) {
+        uint64_t now = now_ms();
+        if (now >= next) {
+            BusSimMetrics bus;
+            bus_sim_get_metrics(&bus);
+            update_rate(&bus, now);
+            if (g_file_path[0])
+                write_file(&bus, now);
+            next += g_interval_ms;
+            if (next <= now)
+                next = now + g_interval_ms;  // Fell behind: skip the missed refreshes
+            continue;
+        }
+
+        uint64_t wait = next - now < METRICS_POLL_MS ? next - now : METRICS_POLL_MS;
+        if (g_listen_fd >= 0) {
+            struct pollfd pfd = {g_listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, (int) wait) > 0)
+                serve_client(g_listen_fd);
+        } else {
+            struct timespec pause = {0, (long) wait * 1000000L};
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Listen on a Unix socket, replacing a stale one left by an earlier run
+ * @return The listening socket, or -1 on error
+ */
+static int open_socket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int metrics_sim_start(const char* socket_path, const char* file_path, uint32_t interval_ms,
+                      uint8_t num_nodes) {
+    if (atomic_load(&g_running) || (!socket_path && !file_path))
+        return 0;
+
+    g_interval_ms = interval_ms ? interval_ms : METRICS_SIM_INTERVAL_MS;
+    g_num_nodes = num_nodes < METRICS_MAX_NODES ? num_nodes : METRICS_MAX_NODES;
+    for (int i = 0; i < METRICS_MAX_NODES; ++i) {
+        atomic_store(&g_role[i], ROLE_OFF);
+        atomic_store(&g_standby[i], 0);
+    }
+    g_file_path[0] = '\0';
+    if (file_path)
+        snprintf(g_file_path, sizeof(g_file_path), "%s", file_path);
+    g_socket_path[0] = '\0';
+    g_listen_fd = -1;
+    if (socket_path) {
+        g_listen_fd = open_socket(socket_path);
+        if (g_listen_fd < 0)
+            return 0;
+        snprintf(g_socket_path, sizeof(g_socket_path), "%s", socket_path);
+    }
+
+    g_start_ms = g_rate_ms = now_ms();
+    g_rate_frames = 0;
+    g_frames_per_second = 0;
+    atomic_store(&g_running, 1);
+    if (pthread_create(&g_thread, NULL, exporter, NULL) != 0) {
+        atomic_store(&g_running, 0);
+        if (g_listen_fd >= 0) {
+            close(g_listen_fd);
+            unlink(g_socket_path);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+void metrics_sim_stop(void) {
+    if (!atomic_exchange(&g_running, 0))
+        return;
+    pthread_join(g_thread, NULL);
+
+    // The final state, for whoever reads the file after the run
+    if (g_file_path[0]) {
+        BusSimMetrics bus;
+        bus_sim_get_metrics(&bus);
+        uint64_t now = now_ms();
+        update_rate(&bus, now);
+        write_file(&bus, now);
+    }
+    if (g_listen_fd >= 0) {
+        close(g_listen_fd);
+        unlink(g_socket_path);
+        g_listen_fd = -1;
+    }
+}
+
+void metrics_sim_node(uint8_t index, const Node* node) {
+    if (index >= METRICS_MAX_NODES || !atomic_load_explicit(&g_running, memory_order_relaxed))
+        return;
+    int role = 1 + (int) node->role;
+    int was = atomic_exchange_explicit(&g_role[index], role, memory_order_relaxed);
+    if (was != role)
+        atomic_fetch_add_explicit(&g_transitions[was][role], 1, memory_order_relaxed);
+    atomic_store_explicit(&g_standby[index], node->role == NODE_MEMBER && node->is_standby,
+                          memory_order_relaxed);
+}
+
+void metrics_sim_node_off(uint8_t index) {
+    if (index >= METRICS_MAX_NODES || !atomic_load_explicit(&g_running, memory_order_relaxed))
+        return;
+    int was = atomic_exchange_explicit(&g_role[index], ROLE_OFF, memory_order_relaxed);
+    if (was != ROLE_OFF)
+        atomic_fetch_add_explicit(&g_transitions[was][ROLE_OFF], 1, memory_order_relaxed);
+    atomic_store_explicit(&g_standby[index], 0, memory_order_relaxed);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file metrics_sim.h
+ * @brief Live metrics of a running simulation in Prometheus text format
+ *
+ * An exporter thread renders the default network's bus counters (frames per
+ * type and per second, collisions, injected faults, queue depths and drops,
+ * JOIN latency) together with the role of every node and the role changes
+ * they went through. The page is served on a Unix socket, rewritten to a
+ * file every interval, or both:
+ *
+ *     curl -s --unix-socket /tmp/sim.sock http://sim/metrics
+ *     socat - UNIX-CONNECT:/tmp/sim.sock
+ *
+ * The file is replaced atomically (written aside, then renamed), so it can
+ * be read at any time or collected by node_exporter's textfile collector.
+ *
+ * Node threads only store and add to atomic counters; everything else,
+ * including answering scrapes, happens on the exporter thread, so a slow
+ * or stuck client never holds up the simulation.
+ */
+
+#ifndef METRICS_SIM_H
+#define METRICS_SIM_H
+
+#include <stdint.h>
+
+#include "../../core/node.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Default refresh interval of the metrics file and of the frame rate */
+#define METRICS_SIM_INTERVAL_MS 1000
+
+/**
+ * @brief Start the exporter thread
+ *
+ * Call after the buses are created, on the thread using the network to
+ * export (the default one).
+ *
+ * @param socket_path Unix socket to serve the page on, or NULL
+ * @param file_path File to rewrite every interval, or NULL
+ * @param interval_ms Refresh interval (0 = METRICS_SIM_INTERVAL_MS)
+ * @param num_nodes Nodes in the simulation; they count as off until they report
+ * @return 1 if started, 0 if the socket could not be set up or the thread not started
+ */
+int metrics_sim_start(const char* socket_path, const char* file_path, uint32_t interval_ms,
+                      uint8_t num_nodes);
+
+/**
+ * @brief Write the file one last time, stop the thread and remove the socket
+ *
+ * Does nothing if the exporter is not running.
+ */
+void metrics_sim_stop(void);
+
+/**
+ * @brief Report a node's role (call from the node's thread after node_service())
+ *
+ * Lock-free; does nothing unless the exporter is running.
+ *
+ * @param index Node index
+ * @param node The node
+ */
+void metrics_sim_node(uint8_t index, const Node* node);
+
+/**
+ * @brief Report that a node was powered off
+ *
+ * @param index Node index
+ */
+void metrics_sim_node_off(uint8_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // METRICS_SIM_H
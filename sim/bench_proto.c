@@ -0,0 +1,180 @@
+/* Enable POSIX.1-2008 features for clock_gettime() */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../shared/core/proto.h"
+#include "../shared/core/rng.h"
+
+/** Frames per batch unless --frames says otherwise: one busy gateway wakeup */
+#define DEFAULT_FRAMES 512
+
+/** Passes over the batch unless --rounds says otherwise; the fastest one counts */
+#define DEFAULT_ROUNDS 2000
+
+/** Fraction of frames damaged unless --corrupt says otherwise */
+#define DEFAULT_CORRUPT 0.05
+
+/** Written by every pass so the compiler cannot drop the work */
+static volatile uint32_t g_sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Fill frames the way a busy line delivers them
+ *
+ * Random types, sources and payload lengths; a fraction of the frames get a
+ * flipped bit, a lost SOF or an impossible length. Bytes past payload_len
+ * are left as garbage, as a receive buffer would hold them.
+ */
+static void make_frames(Frame* frames, int n, double corrupt, Rng* rng) {
+    for (int k = 0; k < n; ++k) {
+        Frame* f = &frames[k];
+        for (int i = 0; i < MAX_PAYLOAD_SIZE; ++i)
+            f->payload[i] = (uint8_t) rng_next(rng);
+        f->type = (uint8_t) (1 + rng_next(rng) % MSG_SCHEDULE);
+        f->source = (uint8_t) rng_next(rng);
+        f->payload_len = (uint8_t) (rng_next(rng) % (MAX_PAYLOAD_SIZE + 1));
+        proto_finalize(f);
+        for (int i = f->payload_len; i < MAX_PAYLOAD_SIZE; ++i)
+            f->payload[i] = (uint8_t) rng_next(rng);
+        if (rng_next(rng) >= corrupt * 4294967296.0)
+            continue;
+        switch (rng_next(rng) % 3) {
+            case 0:
+                f->source ^= (uint8_t) (1u << (rng_next(rng) % 8)); /* Caught by the checksum */
+                break;
+            case 1:
+                f->sof = 0;
+                break;
+            default:
+                f->payload_len = (uint8_t) (MAX_PAYLOAD_SIZE + 1 + rng_next(rng) % 8);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief One frame at a time, as the nodes do: proto_is_valid() then bytes_to_u32()
+ * @return ns per frame for this pass
+ */
+static double pass_single(const Frame* frames, int n) {
+    uint32_t sink = 0;
+    uint64_t start = now_ns();
+    for (int k = 0; k < n; ++k) {
+        if (proto_is_valid(&frames[k]))
+            sink += frames[k].type + bytes_to_u32(frames[k].payload);
+    }
+    uint64_t ns = now_ns() - start;
+    g_sink = sink;
+    return (double) ns / n;
+}
+
+/**
+ * @brief The whole array through proto_decode_batch()
+ * @return ns per frame for this pass
+ */
+static double pass_batch(const Frame* frames, int n, ProtoFrameInfo* info) {
+    uint32_t sink = 0;
+    uint64_t start = now_ns();
+    proto_decode_batch(frames, (size_t) n, info);
+    for (int k = 0; k < n; ++k) {
+        if (info[k].valid)
+            sink += info[k].type + info[k].lead;
+    }
+    uint64_t ns = now_ns() - start;
+    g_sink = sink;
+    return (double) ns / n;
+}
+
+/**
+ * @brief Check that the batch decoder agrees with the single-frame functions
+ * @return Number of frames on which they differ
+ */
+static int cross_check(const Frame* frames, int n, const ProtoFrameInfo* info) {
+    int bad = 0;
+    for (int k = 0; k < n; ++k) {
+        const Frame* f = &frames[k];
+        int valid = proto_is_valid(f);
+        uint8_t lead[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4 && i < f->payload_len; ++i)
+            lead[i] = f->payload[i];
+        if (info[k].valid != valid || info[k].type != f->type || info[k].source != f->source ||
+            info[k].payload_len != f->payload_len || (valid && info[k].lead != bytes_to_u32(lead)))
+            ++bad;
+    }
+    return bad;
+}
+
+/**
+ * @brief Cost of frame validation and decoding, one frame at a time vs in a batch
+ * @param argc Number of command line arguments
+ * @param argv Array of command line argument strings
+ * @return 0 on success, 1 if the two paths disagree on any frame
+ *
+ * Usage: ./bench_proto [--frames N] [--rounds N] [--corrupt P] [--seed N]
+ *
+ * Builds N frames, a fraction P of them damaged, and validates and decodes
+ * them over and over, first with proto_is_valid() and bytes_to_u32() per
+ * frame, then with proto_decode_batch(). The fastest of the rounds is
+ * reported in ns per frame (see `make bench-proto`).
+ */
+int main(int argc, char** argv) {
+    int frames = DEFAULT_FRAMES;
+    int rounds = DEFAULT_ROUNDS;
+    double corrupt = DEFAULT_CORRUPT;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--corrupt") == 0 && i + 1 < argc)
+            corrupt = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+    }
+    if (frames < 1)
+        frames = 1;
+    if (rounds < 1)
+        rounds = 1;
+
+    Frame* batch = malloc((size_t) frames * sizeof(*batch));
+    ProtoFrameInfo* info = malloc((size_t) frames * sizeof(*info));
+    if (!batch || !info) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    Rng rng;
+    rng_seed(&rng, seed);
+    make_frames(batch, frames, corrupt, &rng);
+
+    size_t valid = proto_decode_batch(batch, (size_t) frames, info);
+    int bad = cross_check(batch, frames, info);
+
+    /* Alternate the two so frequency changes and noise hit both alike */
+    double single = 1e9, batched = 1e9;
+    for (int r = 0; r < rounds; ++r) {
+        double s = pass_single(batch, frames);
+        double b = pass_batch(batch, frames, info);
+        if (s < single)
+            single = s;
+        if (b < batched)
+            batched = b;
+    }
+
+    printf("PROTO: %d frames (%zu valid) x %d rounds: single %.2f ns/frame, batch %.2f ns/frame "
+           "(%.1fx)\n",
+           frames, valid, rounds, single, batched, batched > 0 ? single / batched : 0.0);
+    if (bad)
+        printf("PROTO: batch and single-frame decoding disagree on %d frames\n", bad);
+    free(batch);
+    free(info);
+    return bad ? 1 : 0;
+}
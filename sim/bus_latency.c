@@ -0,0 +1,416 @@
+/* Enable POSIX.1-2008 features for clock_gettime(), fork() and other functions */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../shared/core/bus_interface.h"
+#include "../shared/core/hal.h"
+#include "hal_sim.h"
+
+/* Built against bus_shm.c, bus_udp.c or bus_pty.c: every other side is a separate process */
+#if defined(BUS_LATENCY_SHM)
+#include "bus_shm.h"
+#define USE_FORK 1
+#elif defined(BUS_LATENCY_UDP)
+#include "bus_udp.h"
+#define USE_FORK 1
+#elif defined(BUS_LATENCY_PTY)
+#include "bus_pty.h"
+#define USE_FORK 1
+#define LATENCY_PTY_DIR "/tmp/self-organizing-mcus-latency"
+#else
+#define USE_FORK 0
+#endif
+
+/** Pings (and flood frames) sent unless --frames says otherwise */
+#define DEFAULT_FRAMES 10000
+
+/** Give up on a ping after this long (counted as lost) */
+#define PING_TIMEOUT_MS 1000
+
+/** How long to wait for every listener's hello, and for their flood reports */
+#define GATHER_TIMEOUT_MS 3000
+
+/** Sequence numbers with a meaning of their own; pings count up from 0 */
+#define SEQ_STOP 0xFFFFFFFFu      /* Every listener stops */
+#define SEQ_HELLO 0xFFFFFFFEu     /* A listener is on the bus */
+#define SEQ_FLOOD_END 0xFFFFFFFDu /* Flood over: listeners report what they got */
+#define SEQ_FLOOD 0x80000000u     /* Set in every flood frame */
+
+/** Node indices: the ping side, the echo side, then the other listeners */
+#define PING_NODE 0
+#define ECHO_NODE 1
+
+/** Most listeners (echo side included); node indices must fit every backend */
+#define MAX_LISTENERS 31
+
+/** Line speed from --baud, the same for every side (0 = instant delivery) */
+static uint32_t g_baud = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void make_frame(Frame* f, uint8_t source, uint32_t seq) {
+    memset(f, 0, sizeof(*f));
+    f->type = MSG_DATA;
+    f->source = source;
+    f->payload_len = 4;
+    u32_to_bytes(seq, f->payload);
+    proto_finalize(f);
+}
+
+/**
+ * @brief Listener: count flood frames, and on the echo side send every ping straight back
+ * @param arg Node index, cast to a pointer
+ */
+static void* listener_main(void* arg) {
+    uint8_t index = (uint8_t) (uintptr_t) arg;
+    Bus* bus = NULL;
+    if (bus_create(&bus, index, 0, 0) != 0) {
+        fprintf(stderr, "Listener %u: no bus\n", index);
+        return NULL;
+    }
+    bus_set_baud(bus, g_baud);
+    Frame f;
+    make_frame(&f, index, SEQ_HELLO);
+    bus_send(bus, &f);
+
+    uint32_t flood = 0;
+    uint64_t first = 0, last = 0;
+    for (;;) {
+        if (bus_recv(bus, &f, 100) != 1 || f.source != PING_NODE || f.payload_len != 4)
+            continue;
+        uint32_t seq = bytes_to_u32(f.payload);
+        if (seq == SEQ_STOP) {
+            break;
+        } else if (seq == SEQ_FLOOD_END) {
+            /* Report: frames received, and microseconds from the first to the last */
+            Frame report;
+            make_frame(&report, index, flood);
+            report.payload_len = 8;
+            u32_to_bytes((uint32_t) ((last - first) / 1000), &report.payload[4]);
+            proto_finalize(&report);
+            bus_send(bus, &report);
+        } else if (seq & SEQ_FLOOD) {
+            last = now_ns();
+            if (flood++ == 0)
+                first = last;
+        } else if (index == ECHO_NODE) {
+            Frame reply;
+            make_frame(&reply, ECHO_NODE, seq);
+            bus_send(bus, &reply);
+        }
+    }
+    bus_destroy(bus);
+    return NULL;
+}
+
+/**
+ * @brief Wait for a frame of the given payload length from each listener
+ * @param got Per node index: set once its frame has arrived
+ * @param payload Per node index: payload of that frame (may be NULL)
+ * @return Number of listeners heard from
+ */
+static int gather(Bus* bus, int listeners, uint8_t payload_len, int* got,
+                  uint8_t (*payload)[MAX_PAYLOAD_SIZE]) {
+    int heard = 0;
+    uint64_t start = now_ns();
+    Frame f;
+    while (heard < listeners && now_ns() - start < GATHER_TIMEOUT_MS * 1000000ULL) {
+        if (bus_recv(bus, &f, 100) != 1 || f.source < ECHO_NODE ||
+            f.source > listeners || f.payload_len != payload_len || got[f.source])
+            continue;
+        got[f.source] = 1;
+        if (payload)
+            memcpy(payload[f.source], f.payload, MAX_PAYLOAD_SIZE);
+        heard++;
+    }
+    return heard;
+}
+
+/**
+ * @brief Send a ping and wait for its echo
+ * @return Round trip in ns, or 0 if it timed out
+ */
+static uint64_t ping(Bus* bus, uint32_t seq, uint16_t timeout_ms) {
+    Frame f;
+    make_frame(&f, PING_NODE, seq);
+    uint64_t sent = now_ns();
+    bus_send(bus, &f);
+    while (now_ns() - sent < timeout_ms * 1000000ULL) {
+        if (bus_recv(bus, &f, timeout_ms) == 1 && f.source == ECHO_NODE &&
+            bytes_to_u32(f.payload) == seq)
+            return now_ns() - sent;
+    }
+    return 0;
+}
+
+#ifdef BUS_LATENCY_PTY
+/**
+ * @brief Start sim/pty_hub, from the directory this program lives in
+ * @param ports Number of node ports
+ * @param baud Baud rate argument for the hub ("0" = forward bytes at once)
+ * @param noise Noise argument for the hub
+ * @return The hub's pid, or -1 if it could not be started
+ */
+static pid_t start_hub(const char* argv0, int ports, char* baud, char* noise) {
+    char path[512];
+    const char* slash = strrchr(argv0, '/');
+    if (slash)
+        snprintf(path, sizeof(path), "%.*s/pty_hub", (int) (slash - argv0), argv0);
+    else
+        snprintf(path, sizeof(path), "./pty_hub");
+    for (int i = 0; i < ports; ++i) {
+        char link[256];
+        snprintf(link, sizeof(link), LATENCY_PTY_DIR "/node%d", i);
+        unlink(link); /* So no node opens a port left by an earlier run */
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        char count[8];
+        snprintf(count, sizeof(count), "%d", ports);
+        char* args[] = {path,  count, "--baud",  baud, "--bus", LATENCY_PTY_DIR,
+                        "--noise", noise, "--seed", "1", NULL};
+        execv(path, args);
+        fprintf(stderr, "Cannot start %s\n", path);
+        _exit(127);
+    }
+    return pid;
+}
+#endif
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Flood the bus and report what the slowest listener received
+ */
+static void flood(Bus* bus, const char* name, const char* kind, int listeners, int frames) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < frames; ++i) {
+        Frame f;
+        make_frame(&f, PING_NODE, SEQ_FLOOD | (uint32_t) i);
+        while (bus_send(bus, &f) != 1) {
+            /* Hold queue full at this baud rate: let the line take a frame */
+            Frame heard;
+            bus_recv(bus, &heard, 1);
+        }
+    }
+    double send_s = (now_ns() - start) / 1e9;
+
+    /* We hear our own flood too: drain it, or the reports may not fit */
+    Frame f;
+    while (bus_recv(bus, &f, 50) == 1) {
+    }
+    Frame end;
+    make_frame(&end, PING_NODE, SEQ_FLOOD_END);
+    bus_send(bus, &end);
+
+    int got[MAX_LISTENERS + 1] = {0};
+    uint8_t report[MAX_LISTENERS + 1][MAX_PAYLOAD_SIZE];
+    int heard = gather(bus, listeners, 8, got, report);
+    if (!heard) {
+        printf("THROUGHPUT: %s (%s): sent %d frames, no listener reported\n", name, kind, frames);
+        return;
+    }
+
+    /* The slowest listener: fewest frames, and its rate while they arrived */
+    uint32_t least = (uint32_t) frames;
+    double rate = 0;
+    for (int i = ECHO_NODE; i <= listeners; ++i) {
+        if (!got[i])
+            continue;
+        uint32_t count = bytes_to_u32(report[i]);
+        uint32_t us = bytes_to_u32(&report[i][4]);
+        double r = us ? count * 1e6 / us : 0;
+        if (count < least || (count == least && (rate == 0 || r < rate))) {
+            least = count;
+            rate = r;
+        }
+    }
+    printf("THROUGHPUT: %s (%s): sent %d frames at %.0f/s; slowest of %d/%d listeners got %u "
+           "(%.1f%%) at %.0f/s\n",
+           name, kind, frames, send_s > 0 ? frames / send_s : 0.0, heard, listeners, least,
+           100.0 * least / frames, rate);
+}
+
+/**
+ * @brief Per-frame latency and throughput of a bus backend
+ * @param argc Number of command line arguments
+ * @param argv Array of command line argument strings
+ * @return 0 on success, 1 if the echo side never answered
+ *
+ * Usage: ./bus_latency_sim [--frames N] [--listeners N] [--baud N]   threads (bus_sim.c)
+ *        ./bus_latency_shm [...]   processes (bus_shm.c)
+ *        ./bus_latency_udp [...]   processes (bus_udp.c)
+ *        ./bus_latency_pty [...] [--noise P]   processes (bus_pty.c)
+ *
+ * One side sends a frame, the other sends it straight back; half the round
+ * trip is the one-way latency of a frame through the backend, including the
+ * receiver's wake-up. The ping side then sends N frames as fast as the bus
+ * takes them and every listener reports how many it received and how fast.
+ * --listeners N adds N nodes that only receive, so every frame fans out to
+ * more processes. The bus runs without a baud rate unless --baud N sets
+ * one, so this is the backend's own cost, not airtime. Built once against
+ * each backend (see `make bench-latency` and `make bench-udp`).
+ *
+ * bus_latency_pty starts its own sim/pty_hub, passing it --baud and
+ * --noise P (bit flips in a fraction P of the bytes), and also prints what
+ * the ping side's frame parser cost per byte: it parses every byte on the
+ * line (see `make bench-pty`).
+ */
+int main(int argc, char** argv) {
+    int frames = DEFAULT_FRAMES;
+    int extra = 0;
+    int use_fork = USE_FORK;
+    char* baud = "0";
+    char* noise = "0";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--listeners") == 0 && i + 1 < argc)
+            extra = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+            g_baud = (uint32_t) strtoul(baud = argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc)
+            noise = argv[++i];
+    }
+    if (frames < 1)
+        frames = 1;
+    if (extra < 0)
+        extra = 0;
+    if (extra > MAX_LISTENERS - 1)
+        extra = MAX_LISTENERS - 1;
+    int listeners = 1 + extra; /* The echo side listens too */
+    const char* name = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    char kind[32];
+    snprintf(kind, sizeof(kind), "%d %s", 1 + listeners, use_fork ? "processes" : "threads");
+
+    hal_init();
+    hal_sim_set_quiet(1);
+#ifdef BUS_LATENCY_SHM
+    bus_shm_set_name("/self-organizing-mcus-latency");
+    bus_shm_unlink(); /* A fresh segment, not one a crashed run left */
+#endif
+#ifdef BUS_LATENCY_UDP
+    bus_udp_set_group(NULL, BUS_UDP_DEFAULT_PORT + 1, NULL); /* Clear of running nodes */
+#endif
+#ifdef BUS_LATENCY_PTY
+    bus_pty_set_dir(LATENCY_PTY_DIR); /* Clear of running nodes */
+    pid_t hub = start_hub(argv[0], 1 + listeners, baud, noise);
+#else
+    (void) noise; /* Only the hub adds noise */
+#endif
+    if (bus_global_init((uint8_t) (1 + listeners)) != 0) {
+        fprintf(stderr, "Cannot set up the bus\n");
+        return 1;
+    }
+
+    /* Our bus first, so no listener's hello goes out before we can hear it */
+    Bus* bus = NULL;
+    if (bus_create(&bus, PING_NODE, 0, 0) != 0) {
+        fprintf(stderr, "No bus\n");
+        return 1;
+    }
+    bus_set_baud(bus, g_baud);
+
+    pid_t child[MAX_LISTENERS + 1];
+    pthread_t thread[MAX_LISTENERS + 1];
+    int started = 0;
+    fflush(stdout);
+    for (int i = ECHO_NODE; i <= listeners; ++i) {
+        void* arg = (void*) (uintptr_t) i;
+        if (use_fork) {
+            child[i] = fork();
+            if (child[i] == 0) {
+                listener_main(arg);
+                _exit(0);
+            }
+            if (child[i] < 0)
+                break;
+        } else if (pthread_create(&thread[i], NULL, listener_main, arg) != 0) {
+            break;
+        }
+        started = i;
+    }
+    if (started < listeners)
+        fprintf(stderr, "Only %d of %d listeners started\n", started, listeners);
+
+    int got[MAX_LISTENERS + 1] = {0};
+    gather(bus, started, 4, got, NULL);
+
+    /* The echo side may not be listening yet */
+    int ready = 0;
+    for (int i = 0; i < 100 && !ready; ++i)
+        ready = ping(bus, (uint32_t) i, 20) != 0;
+
+    uint64_t* rtt = (uint64_t*) calloc((size_t) frames, sizeof(uint64_t));
+    int answered = 0;
+    for (int i = 0; ready && rtt && i < frames; ++i) {
+        uint64_t ns = ping(bus, (uint32_t) (1000 + i), PING_TIMEOUT_MS);
+        if (ns)
+            rtt[answered++] = ns;
+    }
+    if (answered) {
+        qsort(rtt, (size_t) answered, sizeof(uint64_t), compare_u64);
+        uint64_t sum = 0;
+        for (int i = 0; i < answered; ++i)
+            sum += rtt[i];
+        /* One way = half the round trip */
+        printf("LATENCY: %s (%s): %d/%d frames, one-way mean %.1fus p50 %.1fus p99 %.1fus "
+               "max %.1fus\n",
+               name, kind, answered, frames, sum / 2000.0 / answered, rtt[answered / 2] / 2000.0,
+               rtt[(answered - 1) * 99 / 100] / 2000.0, rtt[answered - 1] / 2000.0);
+        fflush(stdout);
+        flood(bus, name, kind, started, frames);
+    } else {
+        printf("LATENCY: %s: no answer from the echo side\n", name);
+    }
+    free(rtt);
+
+    Frame stop;
+    make_frame(&stop, PING_NODE, SEQ_STOP);
+    bus_send(bus, &stop);
+    while (bus_recv(bus, &stop, 50) == 1) {
+        /* At a baud rate the stop frame may still be held for the line */
+    }
+    for (int i = ECHO_NODE; i <= started; ++i) {
+        if (use_fork)
+            waitpid(child[i], NULL, 0);
+        else
+            pthread_join(thread[i], NULL);
+    }
+    bus_destroy(bus);
+    bus_global_shutdown();
+#ifdef BUS_LATENCY_SHM
+    bus_shm_unlink();
+#endif
+#ifdef BUS_LATENCY_PTY
+    uint32_t sent = 0, bad = 0, cut = 0;
+    uint64_t bytes = 0, parse_ns = 0;
+    bus_pty_get_stats(&sent, &bad, &cut, &bytes, &parse_ns);
+    printf("PARSER: %s: %llu bytes at %.1f ns/byte, %u bad checksums, %u frames cut off\n", name,
+           (unsigned long long) bytes, bytes ? (double) parse_ns / (double) bytes : 0.0, bad, cut);
+    fflush(stdout);
+    if (hub > 0) {
+        kill(hub, SIGTERM);
+        waitpid(hub, NULL, 0);
+    }
+#endif
+
+    return answered ? 0 : 1;
+}
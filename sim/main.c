@@ -1,13 +1,84 @@
 /* Enable POSIX.1-2008 features for usleep() and other functions */
 #define _POSIX_C_SOURCE 200809L
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../shared/core/bus_interface.h"
 #include "../shared/core/hal.h"
 #include "../shared/core/node.h"
+#include "../shared/core/pubsub.h"
+#include "bus_sim.h"
+#include "hal_sim.h"
+#include "metrics_sim.h"
+
+/** Topic used by the pub/sub throughput benchmark */
+#define BENCH_TOPIC 1
+
+/** How long the publisher runs during the throughput benchmark */
+#define BENCH_DURATION_MS 5000
+
+/** Failover: the standby checks for silence once per service pass (up to 50ms) */
+#define FAILOVER_SLACK_MS 50
+
+/**
+ * Time sync benchmark: let the network converge before sampling. Drift is
+ * fitted over at least TIMESYNC_DRIFT_SPAN_MS of samples and applied once a
+ * second estimate agrees, about 80s after the first sync.
+ */
+#define TIME_BENCH_SETTLE_MS 100000
+
+/** Boot benchmark: give up if the network has not formed by then */
+#define BOOT_BENCH_TIMEOUT_MS 30000
+
+/** Time sync benchmark: sampling period and interval */
+#define TIME_BENCH_SAMPLE_MS 30000
+#define TIME_BENCH_INTERVAL_MS 100
+
+/** Time sync benchmark: fail if an applied drift is further than this from the truth */
+#define TIME_BENCH_MAX_DRIFT_ERR_PPM 50
+
+/** Monte Carlo runner: give up on a scenario's network after this long */
+#define MONTE_CARLO_TIMEOUT_MS 10000
+
+/** Monte Carlo runner: default spread of the boards' power-up times */
+#define MONTE_CARLO_STAGGER_MS 500
+
+/** Monte Carlo runner: how often a scenario's nodes are checked */
+#define MONTE_CARLO_POLL_MS 5
+
+/** Monte Carlo runner: failed scenarios listed with a command to rerun them */
+#define MONTE_CARLO_REPRO_MAX 5
+
+/** Scenario run: fail if the network has not converged this long after startup */
+#define SCENARIO_DEADLINE_MS 10000
+
+/** Scenario run: how often the nodes are checked for convergence */
+#define SCENARIO_POLL_MS 5
+
+/** Scenario run: two nodes holding one ID for this long is a failure, not a transient */
+#define SCENARIO_CONFLICT_MS 1000
+
+/** Most timed events in a scenario file */
+#define SCENARIO_MAX_EVENTS 64
+
+/** Soak run: how often the end of the run is checked for */
+#define SOAK_POLL_MS 100
+
+/** Set by SIGINT/SIGTERM to end a soak run */
+static volatile sig_atomic_t g_stop = 0;
+
+/** Segments of the --relays line (0 = no relays); node i is on i * segments / num_nodes */
+static int g_relay_segments = 0;
+
+static void on_signal(int sig) {
+    (void) sig;
+    g_stop = 1;
+}
 
 /**
  * @brief Structure representing a node running in its own thread
@@ -21,8 +92,27 @@ typedef struct {
     uint8_t index;      /* Unique identifier for this node */
     int running;        /* Flag to control thread execution (1=running, 0=stop) */
     pthread_t thread;   /* POSIX thread handle */
+    PubSub pubsub;      /* Application messaging endpoint */
+    int publish_size;   /* Benchmark: publish messages of this size (0 = idle) */
+    uint32_t rx_bytes;  /* Benchmark: application bytes received on BENCH_TOPIC */
+    int32_t skew_ppm;   /* Simulated oscillator error (--clock-skew) */
+    SimBoards* boards;  /* Clocks and generators of this simulation (NULL = default) */
+    uint32_t start_delay_ms; /* Power-up time after the first board (--stagger) */
+    Bus* relay_bus;          /* Second bus if this node relays to the next segment */
+    uint8_t relay_max_hops;  /* Hop limit of its relay (--relays) */
 } ThreadedNode;
 
+/**
+ * @brief Benchmark subscriber: count received application bytes
+ */
+static void bench_on_message(void* ctx, uint8_t source, uint8_t address, const uint8_t* data,
+                             uint8_t len) {
+    (void) source;
+    (void) address;
+    (void) data;
+    ((ThreadedNode*) ctx)->rx_bytes += len;
+}
+
 /**
  * @brief Thread function that runs a single node's main loop
  * @param arg Pointer to ThreadedNode structure (cast from void*)
@@ -34,49 +124,1761 @@ typedef struct {
 static void* node_thread(void* arg) {
     ThreadedNode* tn = (ThreadedNode*) arg;  /* Cast void* back to ThreadedNode* */
 
+    hal_sim_use_boards(tn->boards); /* The simulation this node belongs to */
+    hal_sim_bind_node(tn->index);  /* hal_millis() now reads this board's own clock */
+    if (tn->start_delay_ms)
+        usleep(tn->start_delay_ms * 1000); /* Board powered up later than the first one */
+
     /* Initialize the node (similar to Arduino setup() function) */
     node_begin(&tn->node);
 
     /* Main service loop (similar to Arduino loop() function) */
     while (tn->running) {
         node_service(&tn->node);  /* Process node logic and communications */
-        usleep(10000);            /* Sleep for 10ms to simulate real-time behavior */
+        metrics_sim_node(tn->index, &tn->node); /* Role for the exporter (lock-free) */
+
+        /* Benchmark publisher: one message per loop, as fast as the bus allows */
+        if (tn->publish_size > 0 && tn->node.role != NODE_SEEKING) {
+            uint8_t msg[PUBSUB_MAX_MESSAGE];
+            memset(msg, tn->index, sizeof(msg));
+            pubsub_publish(&tn->pubsub, PUBSUB_TOPIC(BENCH_TOPIC), msg,
+                           (uint8_t) tn->publish_size);
+        }
+
+        hal_delay(10); /* Sleep for 10ms to simulate real-time behavior (drains trace records) */
     }
+    hal_yield(); /* Write out this node's last trace records */
 
     return NULL;  /* Thread cleanup - return NULL to indicate success */
 }
 
+/**
+ * @brief Power a node off: stop its thread, which takes its state with it
+ */
+static void stop_node(ThreadedNode* tn) {
+    tn->running = 0;
+    pthread_join(tn->thread, NULL);
+    metrics_sim_node_off(tn->index);
+}
+
+/**
+ * @brief Power a stopped node up again with its RAM state wiped, as after a reset
+ * @return 0 on success, -1 if its thread could not be started
+ */
+static int restart_node(ThreadedNode* tn) {
+    node_init(&tn->node, tn->bus, tn->index);
+    node_set_relay(&tn->node, tn->relay_bus, tn->relay_max_hops);
+    tn->running = 1;
+    tn->start_delay_ms = 0;
+    if (pthread_create(&tn->thread, NULL, node_thread, tn) != 0) {
+        tn->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Kill the coordinator and measure how long the hot standby takes to replace it
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @return 0 if a standby took over in time, 1 otherwise
+ *
+ * Stops the coordinator's thread (its state dies with it), then polls the
+ * remaining nodes until one of them is promoted. The target is the standby's
+ * takeover threshold, NODE_TAKEOVER_MS (two heartbeat intervals) plus a TDMA
+ * frame when a schedule is running: the coordinator can die right after a
+ * heartbeat. A takeover later than that (give or take one service pass)
+ * fails. The old coordinator's member table is compared with the new one
+ * after shutdown to count preserved IDs.
+ */
+static int run_failover(ThreadedNode* nodes, int num_nodes) {
+    int old = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (nodes[i].node.role == NODE_COORDINATOR) {
+            old = i;
+            break;
+        }
+    }
+    if (old < 0) {
+        printf("FAILOVER: no coordinator to kill\n");
+        return 1;
+    }
+
+    uint32_t target_ms = NODE_TAKEOVER_MS;
+    if (nodes[old].node.has_schedule)
+        target_ms += mac_frame_ms(&nodes[old].node.schedule);
+
+    /* Kill the coordinator: its thread stops and never transmits again */
+    stop_node(&nodes[old]);
+    uint32_t killed_ms = hal_millis();
+    printf("FAILOVER: killed coordinator (node %d)\n", old);
+
+    /* Wait for the standby to notice and take over */
+    int successor = -1;
+    while (successor < 0 && hal_millis() - killed_ms <= target_ms + FAILOVER_SLACK_MS) {
+        for (int i = 0; i < num_nodes; ++i) {
+            if (i != old && nodes[i].node.role == NODE_COORDINATOR) {
+                successor = i;
+            }
+        }
+        usleep(1000);
+    }
+    if (successor < 0) {
+        printf("FAILOVER: no standby took over within %ums\n", target_ms);
+        return 1;
+    }
+
+    uint32_t latency = hal_millis() - killed_ms;
+    printf("FAILOVER: node %d took over after %ums (heartbeat interval %ums, target %ums)\n",
+           successor, latency, NODE_HEARTBEAT_MS, target_ms);
+    return 0;
+}
+
+/**
+ * @brief Count member IDs that survived a failover
+ * @param old_coord Coordinator that was killed
+ * @param new_coord Standby that took over
+ *
+ * Every member entry of the old coordinator must appear with the same nonce
+ * and ID in the new coordinator's table. The standby's own entry is retired
+ * when it takes ID 1, so it is reported separately.
+ */
+static void report_preserved_ids(const Node* old_coord, const Node* new_coord) {
+    int members = 0;
+    int preserved = 0;
+    for (uint8_t i = 0; i < old_coord->seen_count; ++i) {
+        uint8_t id = old_coord->seen_join_id[i];
+        if (id == 0) {
+            continue;
+        }
+        if (new_coord->seen_join_nonce[i] == old_coord->seen_join_nonce[i] &&
+            new_coord->seen_join_id[i] == 0) {
+            continue;  // The standby's own entry, now promoted to ID 1
+        }
+        members++;
+        for (uint8_t j = 0; j < new_coord->seen_count; ++j) {
+            if (new_coord->seen_join_nonce[j] == old_coord->seen_join_nonce[i] &&
+                new_coord->seen_join_id[j] == id) {
+                preserved++;
+                break;
+            }
+        }
+    }
+    printf("FAILOVER: %d/%d member IDs preserved, next ID %u → %u\n", preserved, members,
+           old_coord->next_assign_id, new_coord->next_assign_id);
+}
+
+/**
+ * @brief Reset a member and measure how long it takes to rejoin
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @return 0 if the member rejoined, 1 otherwise
+ *
+ * Simulates a brownout: the member's thread is stopped, its RAM state is
+ * wiped with node_init() and it boots again through node_begin(). With an
+ * identity cache (--persist) it should reclaim its old ID in one round trip.
+ */
+static int run_reboot(ThreadedNode* nodes, int num_nodes) {
+    int victim = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (nodes[i].node.role == NODE_MEMBER)
+            victim = i; /* Highest index member has the longest startup jitter */
+    }
+    if (victim < 0) {
+        printf("REBOOT: no member to reset\n");
+        return 1;
+    }
+
+    ThreadedNode* tn = &nodes[victim];
+    uint8_t old_id = tn->node.assigned_id;
+    stop_node(tn);
+
+    uint32_t boot_ms = hal_millis();
+    if (restart_node(tn) != 0) {
+        printf("REBOOT: failed to restart node %d\n", victim);
+        return 1;
+    }
+
+    while (tn->node.role != NODE_MEMBER && hal_millis() - boot_ms < 5000)
+        usleep(1000);
+    if (tn->node.role != NODE_MEMBER) {
+        printf("REBOOT: node %d did not rejoin\n", victim);
+        return 1;
+    }
+
+    printf("REBOOT: node %d rejoined in %ums, ID %u → %u (%s)\n", victim,
+           hal_millis() - boot_ms, old_id, tn->node.assigned_id,
+           tn->node.assigned_id == old_id ? "kept" : "changed");
+    return 0;
+}
+
+/**
+ * @brief Find two live nodes that hold the same ID
+ * @param nodes Array of nodes (stopped ones are skipped)
+ * @param num_nodes Number of nodes in the array
+ * @param other Output: index of the second node holding it
+ * @return Index of the first node holding a shared ID, or -1 if every ID is unique
+ */
+static int find_id_conflict(const ThreadedNode* nodes, int num_nodes, int* other) {
+    for (int i = 0; i < num_nodes; ++i) {
+        if (!nodes[i].running || nodes[i].node.role == NODE_SEEKING)
+            continue;
+        for (int j = i + 1; j < num_nodes; ++j) {
+            if (nodes[j].running && nodes[j].node.role != NODE_SEEKING &&
+                nodes[j].node.assigned_id == nodes[i].node.assigned_id) {
+                *other = j;
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Check whether every live node has a unique ID in one network
+ * @param nodes Array of nodes (stopped ones are skipped)
+ * @param num_nodes Number of nodes in the array
+ * @param tdma Nonzero if members must also be time-synchronized
+ * @param coordinators Output: nodes that are coordinator right now
+ * @return 1 if the network has converged, 0 otherwise
+ */
+static int is_converged(const ThreadedNode* nodes, int num_nodes, int tdma, int* coordinators) {
+    int live = 0;
+    int ready = 0;
+    *coordinators = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        const Node* n = &nodes[i].node;
+        if (!nodes[i].running)
+            continue; /* Killed: not part of the network any more */
+        live++;
+        *coordinators += n->role == NODE_COORDINATOR;
+        if (n->role == NODE_COORDINATOR ||
+            (n->role == NODE_MEMBER && (!tdma || (n->timesync.synced && n->has_schedule))))
+            ready++;
+    }
+    int other = 0;
+    return ready == live && *coordinators == 1 && /* Not split into separate networks */
+           find_id_conflict(nodes, num_nodes, &other) < 0;
+}
+
+/**
+ * @brief Wait until every node has an ID (and, with TDMA, follows the schedule)
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @param tdma Nonzero if members must also be time-synchronized
+ * @param timeout_ms Give up after this long
+ * @return 1 if the network converged, 0 on timeout
+ */
+static int wait_converged(ThreadedNode* nodes, int num_nodes, int tdma, uint32_t timeout_ms) {
+    uint32_t start = hal_millis();
+    while (hal_millis() - start < timeout_ms) {
+        int coordinators = 0;
+        if (is_converged(nodes, num_nodes, tdma, &coordinators))
+            return 1;
+        usleep(10000);
+    }
+    return 0;
+}
+
+/**
+ * @brief Measure pub/sub throughput from one member to all other nodes
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @param size Application message size in bytes
+ * @param baud Bus baud rate (0 = instant delivery)
+ * @param slot_ms TDMA slot length (0 = no TDMA)
+ * @return 0 on success, 1 if the benchmark could not run or no message arrived
+ *
+ * Once the network has converged, the publisher sends fragmented messages
+ * back to back for BENCH_DURATION_MS; every other node subscribes to the
+ * topic. Reports the application goodput seen by the subscribers and the
+ * wire efficiency (application bytes per byte on the wire).
+ */
+static int run_pubsub_bench(ThreadedNode* nodes, int num_nodes, int size, uint32_t baud,
+                            int slot_ms) {
+    if (!wait_converged(nodes, num_nodes, slot_ms, 20000)) {
+        printf("BENCH: network did not converge\n");
+        return 1;
+    }
+    if (slot_ms)
+        usleep(NODE_SCHEDULE_LEAD_MS * 1000); /* Let the final schedule take effect */
+
+    int pub = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (nodes[i].node.role == NODE_MEMBER)
+            pub = i;
+    }
+    if (pub < 0 || num_nodes < 2) {
+        printf("BENCH: need a member to publish and at least one subscriber\n");
+        return 1;
+    }
+
+    uint32_t sent_before = nodes[pub].pubsub.messages_sent;
+    nodes[pub].publish_size = size;
+    usleep(BENCH_DURATION_MS * 1000);
+    nodes[pub].publish_size = 0;
+    usleep(500 * 1000); /* Let the last fragments drain */
+
+    uint32_t sent = nodes[pub].pubsub.messages_sent - sent_before;
+    uint32_t total_rx = 0;
+    uint32_t dropped = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (i == pub)
+            continue;
+        total_rx += nodes[i].rx_bytes;
+        dropped += nodes[i].pubsub.fragments_dropped;
+    }
+
+    int frags = (size + PUBSUB_FRAG_DATA - 1) / PUBSUB_FRAG_DATA;
+    int wire_bytes = size + frags * (5 + 3); /* Frame header/checksum + DATA header */
+    double goodput = (double) total_rx / (num_nodes - 1) * 1000.0 / BENCH_DURATION_MS;
+    printf("BENCH: %d-byte messages at %u baud: %u sent, %.1f B/s per subscriber, "
+           "%d frames/msg, wire efficiency %.0f%%, %u fragments dropped\n",
+           size, baud, sent, goodput, frags, 100.0 * size / wire_bytes, dropped);
+    return total_rx > 0 ? 0 : 1;
+}
+
+/**
+ * @brief Read a node index from a fault link spec ("*" = every node)
+ * @param p In: start of the index; out: first character after it
+ * @return Node index, or -1 for "*"
+ */
+static int parse_link_node(char** p) {
+    if (**p == '*') {
+        (*p)++;
+        return -1;
+    }
+    return (int) strtol(*p, p, 10);
+}
+
+/**
+ * @brief Apply a fault option: VALUE for every link, or VALUE@FROM:TO for some
+ * @param fault Fault kind
+ * @param arg Option argument, e.g. "0.1" or "0.3@2:*"
+ * @return 1 if applied, 0 if the argument is malformed or out of range
+ */
+static int parse_fault(BusSimFault fault, const char* arg) {
+    char* p;
+    double value = strtod(arg, &p);
+    int from = -1;
+    int to = -1;
+    if (*p == '@') {
+        p++;
+        from = parse_link_node(&p);
+        if (*p++ != ':')
+            return 0;
+        to = parse_link_node(&p);
+    }
+    return *p == '\0' && bus_sim_set_fault(fault, value, from, to);
+}
+
+/**
+ * @brief Schedule a partition given as START_MS:END_MS:MASK
+ * @param arg Option argument, e.g. "3000:6000:0x1"
+ * @return 1 if scheduled, 0 if the argument is malformed
+ */
+static int parse_partition(const char* arg) {
+    char* p;
+    unsigned long start = strtoul(arg, &p, 10);
+    if (*p++ != ':')
+        return 0;
+    unsigned long end = strtoul(p, &p, 10);
+    if (*p++ != ':')
+        return 0;
+    unsigned long group = strtoul(p, &p, 0);
+    return *p == '\0' && bus_sim_add_partition((uint32_t) group, (uint32_t) start, (uint32_t) end);
+}
+
+/**
+ * @brief Put nodes on a segment given as SEG:MASK
+ * @param arg Option argument, e.g. "1:0xF0"
+ * @return 1 if applied, 0 if the argument is malformed
+ */
+static int parse_segment(const char* arg) {
+    char* p;
+    unsigned long segment = strtoul(arg, &p, 10);
+    if (*p++ != ':')
+        return 0;
+    unsigned long nodes = strtoul(p, &p, 0);
+    return *p == '\0' && segment < BUS_SIM_MAX_SEGMENTS &&
+           bus_sim_set_segment((uint8_t) segment, (uint32_t) nodes);
+}
+
+/**
+ * @brief Read the optional ":LATENCY_MS[:BAUD]" tail of a bridge or chain spec
+ * @return 1 if well formed, 0 otherwise
+ */
+static int parse_bridge_link(char* p, double* latency_ms, uint32_t* baud) {
+    *latency_ms = 0;
+    *baud = 0;
+    if (*p == ':')
+        *latency_ms = strtod(p + 1, &p);
+    if (*p == ':')
+        *baud = (uint32_t) strtoul(p + 1, &p, 10);
+    return *p == '\0';
+}
+
+/**
+ * @brief Add a bridge given as A:B[:LATENCY_MS[:BAUD]]
+ * @param arg Option argument, e.g. "0:1:5:9600"
+ * @return 1 if added, 0 if the argument is malformed or the table is full
+ */
+static int parse_bridge(const char* arg) {
+    char* p;
+    unsigned long a = strtoul(arg, &p, 10);
+    if (*p++ != ':')
+        return 0;
+    unsigned long b = strtoul(p, &p, 10);
+    double latency_ms;
+    uint32_t baud;
+    return parse_bridge_link(p, &latency_ms, &baud) && a < BUS_SIM_MAX_SEGMENTS &&
+           b < BUS_SIM_MAX_SEGMENTS &&
+           bus_sim_add_bridge((uint8_t) a, (uint8_t) b, latency_ms, baud);
+}
+
+/**
+ * @brief Spread the nodes over a chain of segments given as SEGMENTS[:LATENCY_MS[:BAUD]]
+ * @param arg Option argument, e.g. "3:5"
+ * @param num_nodes Nodes in the run; each segment gets a run of consecutive indices
+ * @return 1 if applied, 0 if the argument is malformed
+ */
+static int apply_chain(const char* arg, int num_nodes) {
+    char* p;
+    unsigned long segments = strtoul(arg, &p, 10);
+    double latency_ms;
+    uint32_t baud;
+    if (!parse_bridge_link(p, &latency_ms, &baud) || segments < 1 ||
+        segments > BUS_SIM_MAX_SEGMENTS)
+        return 0;
+    for (int i = 0; i < num_nodes; ++i)
+        bus_sim_set_segment((uint8_t) ((unsigned long) i * segments / (unsigned long) num_nodes),
+                            1u << i);
+    for (unsigned long s = 0; s + 1 < segments; ++s) {
+        if (!bus_sim_add_bridge((uint8_t) s, (uint8_t) (s + 1), latency_ms, baud))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Spread the nodes over a line of segments joined by relay nodes
+ * @param arg Option argument RELAYS[:MAX_HOPS], e.g. "3" or "3:2"
+ * @param num_nodes Nodes in the run; each segment gets a run of consecutive indices
+ * @param max_hops Output: hop limit of the relays (default NODE_RELAY_MAX_HOPS)
+ * @return Number of relays, 0 if the argument is malformed or there are too few nodes
+ *
+ * The segments are not bridged: the last node of each segment but the last
+ * relays to the next one over a second bus, on bus slot num_nodes + k for
+ * the k-th relay (see relay_node()).
+ */
+static int apply_relays(const char* arg, int num_nodes, uint8_t* max_hops) {
+    char* p;
+    long relays = strtol(arg, &p, 10);
+    long hops = NODE_RELAY_MAX_HOPS;
+    if (*p == ':')
+        hops = strtol(p + 1, &p, 10);
+    if (*p != '\0' || relays < 1 || relays >= BUS_SIM_MAX_SEGMENTS || relays >= num_nodes ||
+        hops < 0 || hops > PROTO_MAX_HOPS)
+        return 0;
+    g_relay_segments = (int) relays + 1;
+    for (int i = 0; i < num_nodes; ++i)
+        bus_sim_set_segment((uint8_t) (i * g_relay_segments / num_nodes), 1u << i);
+    for (int k = 0; k < relays; ++k)
+        bus_sim_set_segment((uint8_t) (k + 1), 1u << (num_nodes + k));
+    *max_hops = (uint8_t) hops;
+    return (int) relays;
+}
+
+/**
+ * @brief The node relaying from segment k to segment k + 1: the last one on segment k
+ */
+static int relay_node(int k, int num_nodes) {
+    int last = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (i * g_relay_segments / num_nodes == k)
+            last = i;
+    }
+    return last;
+}
+
+/**
+ * @brief Bridges, or with --relays relays, between two nodes' segments
+ * @return Hops, or -1 if they are on separate networks
+ */
+static int hops_between(int a, int b, int num_nodes) {
+    int hops = bus_sim_hops(a, b);
+    if (hops < 0 && g_relay_segments > 0) {
+        hops = a * g_relay_segments / num_nodes - b * g_relay_segments / num_nodes;
+        if (hops < 0)
+            hops = -hops;
+    }
+    return hops;
+}
+
+/** What a scenario event does to its node */
+typedef enum {
+    SCENARIO_BOOT,    /* First power-up (nodes without one boot at 0) */
+    SCENARIO_KILL,    /* Power off: the node and its state are gone */
+    SCENARIO_RESTART, /* Power up again after a kill, or reset a live node */
+} ScenarioAction;
+
+/** Event targets resolved when the event fires */
+#define SCENARIO_COORDINATOR -1 /* Whichever node is coordinator then */
+#define SCENARIO_LAST_KILLED -2 /* The node killed most recently */
+#define SCENARIO_STANDBY -3     /* Whichever member is hot standby then */
+
+/**
+ * @brief One timed event of a scenario
+ */
+typedef struct {
+    uint32_t at_ms;        /* Time after startup */
+    ScenarioAction action;
+    int node;              /* Node index, or one of the SCENARIO_* targets above */
+    int line;              /* Line in the file, to order events given the same time */
+} ScenarioEvent;
+
+/**
+ * @brief A scenario file: node count, deadline and timed events
+ */
+typedef struct {
+    int num_nodes;         /* 0 = as given on the command line */
+    uint32_t deadline_ms;  /* 0 = SCENARIO_DEADLINE_MS */
+    int check_table;       /* Convergence also needs complete member tables */
+    int faults;            /* Fault or partition lines were given */
+    int topology;          /* Segment, bridge or relays lines were given */
+    char relays[32];       /* Relays line, applied once the node count is known */
+    int count;             /* Events, sorted by time once loaded */
+    ScenarioEvent events[SCENARIO_MAX_EVENTS];
+} Scenario;
+
+static int compare_events(const void* a, const void* b) {
+    const ScenarioEvent* x = (const ScenarioEvent*) a;
+    const ScenarioEvent* y = (const ScenarioEvent*) b;
+    if (x->at_ms != y->at_ms)
+        return x->at_ms < y->at_ms ? -1 : 1;
+    return x->line - y->line;
+}
+
+/**
+ * @brief Read a scenario file
+ * @param path File to read
+ * @param sc Output: the scenario
+ * @return 1 on success, 0 if the file cannot be read or a line is malformed (reported)
+ *
+ * One setting or event per line; "#" starts a comment:
+ *
+ *     nodes N                   number of nodes (overrides the command line)
+ *     deadline MS               fail if not converged MS after startup
+ *     check table               converged also needs the coordinator's member
+ *                               table, and the standby's replica, to list
+ *                               every live member (see missing_from_tables())
+ *     loss|corrupt|reorder|latency|jitter VALUE[@A:B]   fault, as the options
+ *     partition START:END:MASK  partition, as the option
+ *     segment SEG:MASK          put nodes on a segment, as the option
+ *     bridge A:B[:MS[:BAUD]]    join two segments, as the option
+ *     relays N[:MAX_HOPS]       line of segments joined by relay nodes, as the option
+ *     MS boot NODE              power NODE up MS after startup (late joiners too)
+ *     MS kill NODE|coordinator|standby  power a node off
+ *     MS restart NODE|last      power a killed node up again, or reset a live one
+ */
+static int load_scenario(const char* path, Scenario* sc) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot read scenario %s\n", path);
+        return 0;
+    }
+    memset(sc, 0, sizeof(*sc));
+    char line[256];
+    int line_no = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line_no++;
+        char* hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char word[3][32];
+        int words = sscanf(line, "%31s %31s %31s", word[0], word[1], word[2]);
+        if (words <= 0)
+            continue; /* Blank or comment */
+
+        if (strcmp(word[0], "nodes") == 0 && words == 2) {
+            sc->num_nodes = atoi(word[1]);
+        } else if (strcmp(word[0], "deadline") == 0 && words == 2) {
+            sc->deadline_ms = (uint32_t) strtoul(word[1], NULL, 10);
+        } else if (strcmp(word[0], "check") == 0 && words == 2 && strcmp(word[1], "table") == 0) {
+            sc->check_table = 1;
+        } else if (strcmp(word[0], "partition") == 0 && words == 2) {
+            ok = parse_partition(word[1]);
+            sc->faults = 1;
+        } else if (strcmp(word[0], "segment") == 0 && words == 2) {
+            ok = parse_segment(word[1]);
+            sc->topology = 1;
+        } else if (strcmp(word[0], "bridge") == 0 && words == 2) {
+            ok = parse_bridge(word[1]);
+            sc->topology = 1;
+        } else if (strcmp(word[0], "relays") == 0 && words == 2) {
+            snprintf(sc->relays, sizeof(sc->relays), "%s", word[1]);
+            sc->topology = 1;
+        } else if (words == 2 && (strcmp(word[0], "loss") == 0 ||
+                                  strcmp(word[0], "corrupt") == 0 ||
+                                  strcmp(word[0], "reorder") == 0 ||
+                                  strcmp(word[0], "latency") == 0 ||
+                                  strcmp(word[0], "jitter") == 0)) {
+            BusSimFault fault = strcmp(word[0], "loss") == 0      ? BUS_FAULT_LOSS
+                                : strcmp(word[0], "corrupt") == 0 ? BUS_FAULT_CORRUPT
+                                : strcmp(word[0], "reorder") == 0 ? BUS_FAULT_REORDER
+                                : strcmp(word[0], "latency") == 0 ? BUS_FAULT_LATENCY_MS
+                                                                  : BUS_FAULT_JITTER_MS;
+            ok = parse_fault(fault, word[1]);
+            sc->faults = 1;
+        } else if (words == 3 && sc->count < SCENARIO_MAX_EVENTS) {
+            ScenarioEvent* ev = &sc->events[sc->count];
+            char* end;
+            ev->at_ms = (uint32_t) strtoul(word[0], &end, 10);
+            ev->line = line_no;
+            ok = *end == '\0';
+            if (strcmp(word[1], "boot") == 0)
+                ev->action = SCENARIO_BOOT;
+            else if (strcmp(word[1], "kill") == 0)
+                ev->action = SCENARIO_KILL;
+            else if (strcmp(word[1], "restart") == 0)
+                ev->action = SCENARIO_RESTART;
+            else
+                ok = 0;
+            if (strcmp(word[2], "coordinator") == 0 && ev->action == SCENARIO_KILL) {
+                ev->node = SCENARIO_COORDINATOR;
+            } else if (strcmp(word[2], "standby") == 0 && ev->action == SCENARIO_KILL) {
+                ev->node = SCENARIO_STANDBY;
+            } else if (strcmp(word[2], "last") == 0 && ev->action == SCENARIO_RESTART) {
+                ev->node = SCENARIO_LAST_KILLED;
+            } else {
+                ev->node = (int) strtol(word[2], &end, 10);
+                ok = ok && *end == '\0' && ev->node >= 0 && ev->node < HAL_SIM_MAX_NODES;
+            }
+            sc->count++;
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "%s:%d: bad scenario line\n", path, line_no);
+        return 0;
+    }
+    qsort(sc->events, (size_t) sc->count, sizeof(ScenarioEvent), compare_events);
+    return 1;
+}
+
+/**
+ * @brief Does a member table list this ID?
+ * @param n Coordinator, or standby with its replica
+ * @param id Member ID to look for
+ * @return 1 if an entry holds the ID, 0 otherwise
+ */
+static int table_lists(const Node* n, uint8_t id) {
+    for (uint8_t i = 0; i < n->seen_count; ++i) {
+        if (n->seen_join_id[i] == id)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Count live members missing from the coordinator's member table or the standby's replica
+ * @param nodes Array of nodes (stopped ones are skipped)
+ * @param num_nodes Number of nodes in the array
+ * @return Members missing from either table (0 with no coordinator)
+ *
+ * The tables are what a new coordinator starts from and what the TDMA
+ * schedule is sized by, so after any amount of churn they must still know
+ * every member that is up.
+ */
+static int missing_from_tables(const ThreadedNode* nodes, int num_nodes) {
+    const Node* coordinator = NULL;
+    const Node* standby = NULL;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (!nodes[i].running)
+            continue;
+        if (nodes[i].node.role == NODE_COORDINATOR)
+            coordinator = &nodes[i].node;
+        else if (nodes[i].node.role == NODE_MEMBER && nodes[i].node.is_standby)
+            standby = &nodes[i].node;
+    }
+    int missing = 0;
+    for (int i = 0; coordinator && i < num_nodes; ++i) {
+        const Node* n = &nodes[i].node;
+        if (!nodes[i].running || n->role != NODE_MEMBER)
+            continue;
+        missing += !table_lists(coordinator, n->assigned_id) ||
+                   (standby && n != standby && !table_lists(standby, n->assigned_id));
+    }
+    return missing;
+}
+
+/**
+ * @brief Play a scenario's kills and restarts, then wait for the network to converge
+ * @param nodes Array of nodes, started with the scenario's boot times
+ * @param num_nodes Number of nodes in the array
+ * @param sc Scenario (with no events: just wait for the network to form)
+ * @param boot_ms hal_millis() when the node threads were started
+ * @param tdma Nonzero if members must also be time-synchronized
+ * @return 0 if every live node ended with a unique ID in one network, 1 otherwise
+ *
+ * Convergence is only checked after the last event, and the run ends as
+ * soon as it is reached. It fails when the deadline passes first, or as
+ * soon as two live nodes have held the same ID for SCENARIO_CONFLICT_MS.
+ */
+static int play_scenario(ThreadedNode* nodes, int num_nodes, const Scenario* sc,
+                         uint32_t boot_ms, int tdma) {
+    uint32_t deadline_ms = sc->deadline_ms ? sc->deadline_ms : SCENARIO_DEADLINE_MS;
+    uint32_t last_event_ms = 0;
+    int last_killed = -1;
+
+    for (int e = 0; e < sc->count; ++e) {
+        const ScenarioEvent* ev = &sc->events[e];
+        last_event_ms = ev->at_ms;
+        if (ev->action == SCENARIO_BOOT)
+            continue; /* Set up as the node's start delay */
+        while (hal_millis() - boot_ms < ev->at_ms)
+            usleep(1000);
+
+        int node = ev->node;
+        if (node == SCENARIO_COORDINATOR) {
+            for (int i = 0; i < num_nodes && node < 0; ++i) {
+                if (nodes[i].running && nodes[i].node.role == NODE_COORDINATOR)
+                    node = i;
+            }
+        } else if (node == SCENARIO_STANDBY) {
+            for (int i = 0; i < num_nodes && node < 0; ++i) {
+                if (nodes[i].running && nodes[i].node.role == NODE_MEMBER &&
+                    nodes[i].node.is_standby)
+                    node = i;
+            }
+        } else if (node == SCENARIO_LAST_KILLED) {
+            node = last_killed;
+        }
+        if (node < 0 || node >= num_nodes) {
+            printf("SCENARIO: %ums: no %s node to %s\n", ev->at_ms,
+                   ev->node == SCENARIO_COORDINATOR   ? "coordinator"
+                   : ev->node == SCENARIO_STANDBY     ? "standby"
+                   : ev->node == SCENARIO_LAST_KILLED ? "killed"
+                                                      : "such",
+                   ev->action == SCENARIO_KILL ? "kill" : "restart");
+            return 1;
+        }
+
+        ThreadedNode* tn = &nodes[node];
+        if (ev->action == SCENARIO_KILL) {
+            if (tn->running) {
+                printf("SCENARIO: %ums: killed node %d (%s, ID %u)\n", ev->at_ms, node,
+                       tn->node.role == NODE_COORDINATOR ? "coordinator"
+                       : tn->node.role == NODE_MEMBER    ? "member"
+                                                         : "seeking",
+                       tn->node.assigned_id);
+                stop_node(tn);
+            }
+            last_killed = node;
+        } else {
+            if (tn->running)
+                stop_node(tn); /* A reset: power off and straight back on */
+            if (restart_node(tn) != 0) {
+                printf("SCENARIO: %ums: failed to restart node %d\n", ev->at_ms, node);
+                return 1;
+            }
+            printf("SCENARIO: %ums: restarted node %d\n", ev->at_ms, node);
+        }
+        fflush(stdout);
+    }
+
+    uint32_t conflict_ms = 0; /* When the current ID conflict was first seen (0 = none) */
+    int coordinators = 0;
+    int a = -1, b = -1;
+    int missing = 0;
+    while (hal_millis() - boot_ms < deadline_ms) {
+        int converged = is_converged(nodes, num_nodes, tdma, &coordinators);
+        if (converged && sc->check_table) {
+            missing = missing_from_tables(nodes, num_nodes);
+            converged = missing == 0;
+        }
+        if (converged) {
+            int live = 0;
+            for (int i = 0; i < num_nodes; ++i)
+                live += nodes[i].running;
+            uint32_t elapsed = hal_millis() - boot_ms;
+            printf("CONVERGED: %d live nodes, one network with unique IDs after %ums", live,
+                   elapsed);
+            if (sc->count)
+                printf(" (%ums after the last event)", elapsed - last_event_ms);
+            printf("\n");
+            return 0;
+        }
+        a = find_id_conflict(nodes, num_nodes, &b);
+        if (a < 0) {
+            conflict_ms = 0;
+        } else if (!conflict_ms) {
+            conflict_ms = hal_millis();
+        } else if (hal_millis() - conflict_ms >= SCENARIO_CONFLICT_MS) {
+            printf("CONFLICT: nodes %d and %d have both held ID %u for %ums\n", a, b,
+                   nodes[a].node.assigned_id, SCENARIO_CONFLICT_MS);
+            return 1;
+        }
+        usleep(SCENARIO_POLL_MS * 1000);
+    }
+
+    int seeking = 0;
+    for (int i = 0; i < num_nodes; ++i)
+        seeking += nodes[i].running && nodes[i].node.role == NODE_SEEKING;
+    printf("DEADLINE: no convergence within %ums: %d coordinators, %d nodes without an ID%s",
+           deadline_ms, coordinators, seeking, a >= 0 ? ", conflicting IDs" : "");
+    if (missing)
+        printf(", %d members missing from the member tables", missing);
+    printf("\n");
+    return 1;
+}
+
+/**
+ * @brief Report election and join latency by distance from the coordinator
+ * @param nodes Array of nodes, converged
+ * @param num_nodes Number of nodes in the array
+ * @param elected_ms When the first coordinator appeared, after startup
+ * @param joined_ms Per node: time from its power-up until it was a member
+ *
+ * Members are grouped by the bridges (or relays) between them and the
+ * coordinator. The JOIN latency is the bus's: from a member's first JOIN on
+ * its segment until the ASSIGN reaches it, across the bridges both ways.
+ */
+static void report_topology(const ThreadedNode* nodes, int num_nodes, uint32_t elected_ms,
+                            const uint32_t* joined_ms) {
+    int coord = 0;
+    uint32_t segments = 0;
+    int max_hops = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (nodes[i].node.role == NODE_COORDINATOR)
+            coord = i;
+        for (int j = 0; j < num_nodes; ++j) {
+            if (hops_between(i, j, num_nodes) > max_hops)
+                max_hops = hops_between(i, j, num_nodes);
+        }
+    }
+    /* Segments with nodes on them: count the nodes sharing one with no earlier node */
+    for (int i = 0; i < num_nodes; ++i) {
+        int first = 1;
+        for (int j = 0; j < i; ++j)
+            first &= hops_between(i, j, num_nodes) != 0;
+        segments += (uint32_t) first;
+    }
+    BusSimMetrics m;
+    bus_sim_get_metrics(&m);
+    printf("TOPOLOGY: %u segment%s, up to %d hops, %u frames bridged: first coordinator after "
+           "%ums, JOIN answered in %ums on average (%u joins)\n",
+           segments, segments == 1 ? "" : "s", max_hops, m.frames_bridged, elected_ms,
+           m.join_count ? m.join_sum_ms / m.join_count : 0, m.join_count);
+
+    for (int hops = 0; hops <= max_hops; ++hops) {
+        uint32_t members = 0;
+        uint64_t sum_ms = 0;
+        uint32_t worst_ms = 0;
+        for (int i = 0; i < num_nodes; ++i) {
+            if (i == coord || hops_between(coord, i, num_nodes) != hops)
+                continue;
+            members++;
+            sum_ms += joined_ms[i];
+            if (joined_ms[i] > worst_ms)
+                worst_ms = joined_ms[i];
+        }
+        if (members)
+            printf("TOPOLOGY: %d hops from the coordinator: %u member%s joined %llums after "
+                   "power-up on average, %ums at most\n",
+                   hops, members, members == 1 ? "" : "s", (unsigned long long) (sum_ms / members),
+                   worst_ms);
+    }
+}
+
+/**
+ * @brief Report what relaying cost and the JOIN latency by relays crossed
+ * @param nodes Array of nodes, converged
+ * @param num_nodes Number of nodes in the array
+ * @param join_ms Per member: time from its first JOIN until it was a member (-1 = not seen)
+ *
+ * The flooding overhead is the relayed copies per frame sent by a node of
+ * its own. Duplicates include every relay's echo of its own copies, which
+ * it hears back on the bus it sent them on.
+ */
+static void report_relays(const ThreadedNode* nodes, int num_nodes, const int32_t* join_ms) {
+    uint32_t duplicates = 0, hop_limited = 0;
+    int relays = 0, coord = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        duplicates += nodes[i].node.relay_duplicates;
+        hop_limited += nodes[i].node.relay_hop_limited;
+        relays += nodes[i].relay_bus != NULL;
+        if (nodes[i].node.role == NODE_COORDINATOR)
+            coord = i;
+    }
+    BusSimMetrics m;
+    bus_sim_get_metrics(&m);
+    uint32_t own = m.frames_sent - m.frames_relayed;
+    printf("RELAY: %d relays, hop limit %u: %u copies relayed for %u frames sent (%u%% flooding "
+           "overhead), %u duplicates dropped, %u stopped at the hop limit\n",
+           relays, nodes[relay_node(0, num_nodes)].relay_max_hops, m.frames_relayed, own,
+           own ? (unsigned) (100ULL * m.frames_relayed / own) : 0, duplicates, hop_limited);
+
+    for (int hops = 0; hops < g_relay_segments; ++hops) {
+        uint32_t members = 0;
+        uint64_t sum_ms = 0;
+        uint32_t worst_ms = 0;
+        for (int i = 0; i < num_nodes; ++i) {
+            if (i == coord || join_ms[i] < 0 || hops_between(coord, i, num_nodes) != hops)
+                continue;
+            members++;
+            sum_ms += (uint32_t) join_ms[i];
+            if ((uint32_t) join_ms[i] > worst_ms)
+                worst_ms = (uint32_t) join_ms[i];
+        }
+        if (members)
+            printf("RELAY: %d relays from the coordinator: %u member%s, first JOIN answered "
+                   "after %llums on average, %ums at most\n",
+                   hops, members, members == 1 ? "" : "s",
+                   (unsigned long long) (sum_ms / members), worst_ms);
+    }
+}
+
+/**
+ * @brief Measure how long the network takes to form from a cold start
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @param boot_ms hal_millis() when the node threads were started
+ * @param slot_ms TDMA slot length (0 = no TDMA)
+ * @param baud Bus baud rate, for the report
+ * @param mode Medium access mode, for the report
+ * @param topology Nonzero to also report latency by segment (see report_topology())
+ * @return 0 if the network formed, 1 on timeout
+ *
+ * With --baud every frame is paced at the hardware line rate, so this
+ * predicts how long real boards take from power-up until every node has an
+ * ID (and, with TDMA, is synchronized and following the schedule).
+ */
+static int run_boot_bench(ThreadedNode* nodes, int num_nodes, uint32_t boot_ms, int slot_ms,
+                          uint32_t baud, const char* mode, int topology) {
+    uint32_t elected_ms = 0;
+    uint32_t joined_ms[HAL_SIM_MAX_NODES] = {0};
+    int joined[HAL_SIM_MAX_NODES] = {0};
+    int joining[HAL_SIM_MAX_NODES] = {0};
+    uint32_t join_start_ms[HAL_SIM_MAX_NODES] = {0}; /* When a node's first JOIN was seen */
+    int32_t join_ms[HAL_SIM_MAX_NODES];             /* First JOIN to member (-1 = not seen) */
+    for (int i = 0; i < HAL_SIM_MAX_NODES; ++i)
+        join_ms[i] = -1;
+    int coordinators = 0;
+    int formed = 0;
+    while (!formed && hal_millis() - boot_ms < BOOT_BENCH_TIMEOUT_MS) {
+        formed = is_converged(nodes, num_nodes, slot_ms, &coordinators);
+        uint32_t now = hal_millis() - boot_ms;
+        if (coordinators && !elected_ms)
+            elected_ms = now;
+        for (int i = 0; i < num_nodes; ++i) {
+            const Node* n = &nodes[i].node;
+            if (!joining[i] && n->role == NODE_SEEKING && !n->in_election && n->join_nonce) {
+                joining[i] = 1;
+                join_start_ms[i] = now;
+            }
+            if (!joined[i] && n->role == NODE_MEMBER) {
+                joined[i] = 1;
+                joined_ms[i] = now - nodes[i].start_delay_ms;
+                if (joining[i])
+                    join_ms[i] = (int32_t) (now - join_start_ms[i]);
+            }
+        }
+        if (!formed)
+            usleep(10000);
+    }
+    if (!formed) {
+        printf("BOOT: network did not form within %ums (%d coordinators)\n",
+               BOOT_BENCH_TIMEOUT_MS, coordinators);
+        return 1;
+    }
+    uint32_t elapsed = hal_millis() - boot_ms;
+    uint32_t frames = 0;
+    uint32_t collided = 0;
+    bus_sim_get_stats(&frames, &collided);
+    uint32_t joins = bus_sim_frames_of_type(MSG_JOIN);
+    uint32_t members = (uint32_t) num_nodes - 1;
+    printf("BOOT: %d nodes at %u baud, %s: formed after %ums, %u frames on the line, "
+           "%u collided, %u JOIN retries\n",
+           num_nodes, baud, mode, elapsed, frames, collided, joins > members ? joins - members : 0);
+    if (topology)
+        report_topology(nodes, num_nodes, elected_ms, joined_ms);
+    if (g_relay_segments)
+        report_relays(nodes, num_nodes, join_ms);
+    return 0;
+}
+
+/**
+ * @brief Measure aggregate goodput when every node publishes at once
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @param size Application message size in bytes
+ * @param slot_ms TDMA slot length (0 = no TDMA)
+ * @param mode Medium access mode, for the report
+ * @return 0 on success, 1 if the benchmark could not run
+ *
+ * All nodes publish on BENCH_TOPIC as fast as their service loop allows
+ * for BENCH_DURATION_MS. Goodput is the application data delivered per
+ * second, averaged over receivers; collisions come from the shared medium
+ * model, which is only active with --baud.
+ */
+static int run_load_bench(ThreadedNode* nodes, int num_nodes, int size, int slot_ms,
+                          const char* mode) {
+    if (num_nodes < 2) {
+        printf("LOAD: need at least two nodes\n");
+        return 1;
+    }
+    if (!wait_converged(nodes, num_nodes, slot_ms, 20000)) {
+        printf("LOAD: network did not converge\n");
+        return 1;
+    }
+    if (slot_ms)
+        usleep(NODE_SCHEDULE_LEAD_MS * 1000); /* Let the final schedule take effect */
+
+    uint32_t frames_before, collided_before;
+    bus_sim_get_stats(&frames_before, &collided_before);
+    uint32_t offered = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        offered += nodes[i].pubsub.messages_sent;
+        nodes[i].rx_bytes = 0;
+        nodes[i].publish_size = size;
+    }
+    usleep(BENCH_DURATION_MS * 1000);
+    for (int i = 0; i < num_nodes; ++i)
+        nodes[i].publish_size = 0;
+    usleep(500 * 1000); /* Let queued frames drain */
+
+    uint32_t frames, collided;
+    bus_sim_get_stats(&frames, &collided);
+    frames -= frames_before;
+    collided -= collided_before;
+
+    uint32_t sent = 0;
+    uint64_t total_rx = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        sent += nodes[i].pubsub.messages_sent;
+        total_rx += nodes[i].rx_bytes;
+    }
+    sent -= offered;
+
+    /* Every message should reach all other nodes */
+    double goodput = (double) total_rx / (num_nodes - 1) * 1000.0 / BENCH_DURATION_MS;
+    double delivery = sent ? 100.0 * total_rx / ((double) sent * size * (num_nodes - 1)) : 0.0;
+    printf("LOAD: %d nodes, %s: %.1f B/s goodput, %u msgs sent, %.0f%% delivered, "
+           "%u/%u frames collided\n",
+           num_nodes, mode, goodput, sent, delivery, collided, frames);
+    return 0;
+}
+
+/**
+ * @brief Measure how closely members track the coordinator's network time
+ * @param nodes Array of running nodes
+ * @param num_nodes Number of nodes in the array
+ * @return 0 on success, 1 if there is nothing to synchronize or a drift is off
+ *
+ * Samples every member's hal_network_millis() against the coordinator's at
+ * the same instant and reports mean/max absolute error, then compares each
+ * member's applied drift with the true rate difference of the two simulated
+ * oscillators. A drift more than TIME_BENCH_MAX_DRIFT_ERR_PPM off (including
+ * none applied against a larger true difference) fails the benchmark.
+ */
+static int run_time_bench(ThreadedNode* nodes, int num_nodes) {
+    int coord = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+        if (nodes[i].node.role == NODE_COORDINATOR)
+            coord = i;
+    }
+    if (coord < 0 || num_nodes < 2) {
+        printf("TIME: need a coordinator and at least one member\n");
+        return 1;
+    }
+
+    double sum_err = 0.0;
+    int32_t max_err = 0;
+    int samples = 0;
+    for (int t = 0; t < TIME_BENCH_SAMPLE_MS; t += TIME_BENCH_INTERVAL_MS) {
+        for (int i = 0; i < num_nodes; ++i) {
+            if (i == coord || !nodes[i].node.timesync.synced)
+                continue;
+            uint32_t ref = hal_sim_node_network_millis((uint8_t) coord);
+            int32_t err = (int32_t) (hal_sim_node_network_millis((uint8_t) i) - ref);
+            if (err < 0)
+                err = -err;
+            sum_err += err;
+            if (err > max_err)
+                max_err = err;
+            samples++;
+        }
+        usleep(TIME_BENCH_INTERVAL_MS * 1000);
+    }
+    if (samples == 0) {
+        printf("TIME: no member synchronized\n");
+        return 1;
+    }
+
+    printf("TIME: %d samples, network time error mean %.2fms max %dms\n", samples,
+           sum_err / samples, max_err);
+    int rc = 0;
+    for (int i = 0; i < num_nodes; ++i) {
+        const TimeSync* ts = &nodes[i].node.timesync;
+        if (i == coord || !ts->synced)
+            continue;
+        int32_t truth = nodes[coord].skew_ppm - nodes[i].skew_ppm;
+        int32_t err = ts->drift_ppm - truth;
+        int off = err > TIME_BENCH_MAX_DRIFT_ERR_PPM || err < -TIME_BENCH_MAX_DRIFT_ERR_PPM;
+        printf("TIME: node %d rtt=%ums drift %ldppm, estimate %ldppm (true %ldppm), %u samples%s\n",
+               i, ts->rtt_ms, (long) ts->drift_ppm, (long) ts->drift_estimate_ppm, (long) truth,
+               ts->samples, off ? " - OFF" : "");
+        rc |= off;
+    }
+    if (rc) {
+        printf("TIME: drift more than %dppm off\n", TIME_BENCH_MAX_DRIFT_ERR_PPM);
+    }
+    return rc;
+}
+
+/**
+ * @brief Outcome of one Monte Carlo boot scenario
+ */
+typedef struct {
+    unsigned long long seed; /* Master seed of the scenario */
+    int num_nodes;           /* Boards in the scenario */
+    int formed;              /* One network with every node in it before the timeout */
+    int split_brain;         /* Two coordinators were seen at the same time */
+    int error;               /* The scenario could not be set up */
+    uint32_t converge_ms;    /* Time from the first power-up until the network formed */
+    uint32_t join_retries;   /* JOIN frames beyond one per member */
+} ScenarioResult;
+
+/**
+ * @brief Settings and shared work list of a Monte Carlo run
+ *
+ * Workers take the next scenario index under the lock; everything else a
+ * scenario touches (network, boards, nodes) is its own.
+ */
+typedef struct {
+    int runs;                /* Scenarios to run */
+    int max_nodes;           /* Scenarios have 2 to max_nodes boards */
+    int stagger_ms;          /* Boards power up within this long of each other */
+    int clock_skew;          /* Max oscillator error in ppm (0 = ideal clocks) */
+    uint32_t baud;           /* Bus baud rate (0 = instant delivery) */
+    MacCsmaMode csma;        /* Medium access mode */
+    int tdma_slot;           /* TDMA slot length (0 = no TDMA) */
+    unsigned long long seed; /* Scenario i uses seed + i */
+    pthread_mutex_t lock;    /* Guards next */
+    int next;                /* Index of the next scenario to hand out */
+    ScenarioResult* results; /* One per scenario */
+} MonteCarlo;
+
+/**
+ * @brief Boot one scenario on its own network and boards and watch it converge
+ * @param mc Run settings
+ * @param seed Master seed of the scenario
+ * @param r Output: what happened
+ *
+ * Node count, power-up times, clock errors, the nodes' random choices and
+ * the injected faults all follow from the seed, so a scenario can be rerun
+ * alone with --monte-carlo 1 --seed SEED.
+ */
+static void run_scenario(const MonteCarlo* mc, unsigned long long seed, ScenarioResult* r) {
+    memset(r, 0, sizeof(*r));
+    r->seed = seed;
+
+    SimNet* net = bus_sim_net_create();
+    SimBoards* boards = hal_sim_boards_create(seed);
+    ThreadedNode* nodes = (ThreadedNode*) calloc(HAL_SIM_MAX_NODES, sizeof(ThreadedNode));
+    if (!net || !boards || !nodes) {
+        r->error = 1;
+        goto cleanup;
+    }
+    bus_sim_use_net(net);
+    hal_sim_use_boards(boards);
+    bus_sim_set_seed(seed);
+
+    r->num_nodes = 2 + (int) (hal_random32() % (uint32_t) (mc->max_nodes - 1));
+    if (bus_global_init((uint8_t) r->num_nodes) != 0) {
+        r->error = 1;
+        goto cleanup;
+    }
+
+    int started = 0;
+    uint32_t boot_ms = hal_millis();
+    for (int i = 0; i < r->num_nodes; ++i) {
+        ThreadedNode* tn = &nodes[i];
+        if (bus_create(&tn->bus, (uint8_t) i, 0, 0) != 0) {
+            r->error = 1;
+            break;
+        }
+        bus_set_baud(tn->bus, mc->baud);
+        bus_set_csma(tn->bus, mc->csma);
+        node_init(&tn->node, tn->bus, (uint8_t) i);
+        node_set_tdma(&tn->node, (uint8_t) mc->tdma_slot);
+        tn->index = (uint8_t) i;
+        tn->boards = boards;
+        tn->start_delay_ms = hal_random32() % (uint32_t) (mc->stagger_ms + 1);
+        if (mc->clock_skew > 0) {
+            tn->skew_ppm = (int32_t) (hal_random32() % (2u * mc->clock_skew + 1)) - mc->clock_skew;
+            hal_sim_set_clock((uint8_t) i, (int32_t) (hal_random32() % 10000), tn->skew_ppm);
+        }
+        tn->running = 1;
+        if (pthread_create(&tn->thread, NULL, node_thread, tn) != 0) {
+            r->error = 1;
+            break;
+        }
+        started++;
+    }
+
+    /* Sample the roles until the network forms, noting any moment with two coordinators */
+    while (!r->error && hal_millis() - boot_ms < MONTE_CARLO_TIMEOUT_MS) {
+        usleep(MONTE_CARLO_POLL_MS * 1000);
+        int coordinators = 0;
+        r->formed = is_converged(nodes, r->num_nodes, mc->tdma_slot, &coordinators);
+        if (coordinators > 1)
+            r->split_brain = 1;
+        if (r->formed) {
+            r->converge_ms = hal_millis() - boot_ms;
+            break;
+        }
+    }
+
+    uint32_t joins = bus_sim_frames_of_type(MSG_JOIN);
+    uint32_t members = (uint32_t) r->num_nodes - 1;
+    r->join_retries = joins > members ? joins - members : 0;
+
+    for (int i = 0; i < started; ++i) {
+        nodes[i].running = 0;
+        pthread_join(nodes[i].thread, NULL);
+    }
+    for (int i = 0; i < r->num_nodes; ++i)
+        bus_destroy(nodes[i].bus);
+    bus_global_shutdown();
+
+cleanup:
+    bus_sim_use_net(NULL);
+    hal_sim_use_boards(NULL);
+    free(nodes);
+    hal_sim_boards_destroy(boards);
+    bus_sim_net_destroy(net);
+}
+
+/**
+ * @brief Worker thread: run scenarios until the work list is empty
+ */
+static void* monte_carlo_worker(void* arg) {
+    MonteCarlo* mc = (MonteCarlo*) arg;
+    for (;;) {
+        pthread_mutex_lock(&mc->lock);
+        int i = mc->next++;
+        pthread_mutex_unlock(&mc->lock);
+        if (i >= mc->runs)
+            break;
+        run_scenario(mc, mc->seed + (unsigned long long) i, &mc->results[i]);
+    }
+    return NULL;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Nearest-rank percentile of sorted values
+ */
+static uint32_t percentile(const uint32_t* sorted, int count, int pct) {
+    return count ? sorted[(count - 1) * pct / 100] : 0;
+}
+
+/**
+ * @brief Boot many independent scenarios in parallel and report the distributions
+ * @param mc Run settings (runs, node count range, stagger, medium, seed)
+ * @param workers Scenarios running at the same time
+ * @return 0 if every scenario formed one network, 1 otherwise
+ *
+ * Every worker runs one scenario at a time on its own SimNet and SimBoards,
+ * so scenarios share no simulation state and nothing but the work list is
+ * locked. Node threads mostly sleep, so more workers than cores still pays.
+ * Reports how often the network formed, split-brain incidents (two
+ * coordinators at once, even if they later merged), and the distributions of
+ * convergence time and JOIN retries.
+ */
+static int run_monte_carlo(MonteCarlo* mc, int workers) {
+    mc->results = (ScenarioResult*) calloc((size_t) mc->runs, sizeof(ScenarioResult));
+    pthread_t* threads = (pthread_t*) calloc((size_t) workers, sizeof(pthread_t));
+    if (!mc->results || !threads) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    pthread_mutex_init(&mc->lock, NULL);
+    mc->next = 0;
+
+    printf("MONTE CARLO: %d scenarios of 2-%d nodes, stagger up to %dms, %d workers, "
+           "seeds %llu-%llu\n",
+           mc->runs, mc->max_nodes, mc->stagger_ms, workers, mc->seed,
+           mc->seed + (unsigned long long) mc->runs - 1);
+    fflush(stdout);
+
+    if (mc->runs > 1)
+        hal_sim_set_quiet(1); /* Thousands of boots: only the summary is of interest */
+    uint32_t start_ms = hal_millis();
+    int spawned = 0;
+    for (; spawned < workers; ++spawned) {
+        if (pthread_create(&threads[spawned], NULL, monte_carlo_worker, mc) != 0)
+            break;
+    }
+    if (spawned == 0)
+        monte_carlo_worker(mc); /* No threads to spare: run the scenarios here */
+    for (int i = 0; i < spawned; ++i)
+        pthread_join(threads[i], NULL);
+    uint32_t wall_ms = hal_millis() - start_ms;
+    hal_sim_set_quiet(0);
+
+    uint32_t* converge = (uint32_t*) calloc((size_t) mc->runs, sizeof(uint32_t));
+    uint32_t* retries = (uint32_t*) calloc((size_t) mc->runs, sizeof(uint32_t));
+    int formed = 0, split = 0, errors = 0;
+    uint64_t retry_sum = 0;
+    for (int i = 0; i < mc->runs && converge && retries; ++i) {
+        const ScenarioResult* r = &mc->results[i];
+        errors += r->error;
+        split += r->split_brain;
+        retries[i] = r->join_retries;
+        retry_sum += r->join_retries;
+        if (r->formed)
+            converge[formed++] = r->converge_ms;
+    }
+    if (converge && retries) {
+        qsort(converge, (size_t) formed, sizeof(uint32_t), compare_u32);
+        qsort(retries, (size_t) mc->runs, sizeof(uint32_t), compare_u32);
+    }
+
+    printf("MONTE CARLO: %d/%d formed (%.1f%%), %d split-brain incidents, %d setup errors, "
+           "%.1fs wall\n",
+           formed, mc->runs, 100.0 * formed / mc->runs, split, errors, wall_ms / 1000.0);
+    if (converge && retries) {
+        if (formed)
+            printf("MONTE CARLO: convergence p50 %ums p90 %ums p99 %ums max %ums\n",
+                   percentile(converge, formed, 50), percentile(converge, formed, 90),
+                   percentile(converge, formed, 99), converge[formed - 1]);
+        printf("MONTE CARLO: JOIN retries mean %.2f p90 %u max %u\n",
+               (double) retry_sum / mc->runs, percentile(retries, mc->runs, 90),
+               retries[mc->runs - 1]);
+    }
+
+    int listed = 0;
+    for (int i = 0; i < mc->runs && listed < MONTE_CARLO_REPRO_MAX; ++i) {
+        const ScenarioResult* r = &mc->results[i];
+        if (r->formed && !r->split_brain)
+            continue;
+        printf("MONTE CARLO: seed %llu (%d nodes) %s, rerun with the same options and "
+               "--monte-carlo 1 --seed %llu\n",
+               r->seed, r->num_nodes, r->formed ? "split brain" : "did not form", r->seed);
+        listed++;
+    }
+
+    free(converge);
+    free(retries);
+    free(threads);
+    free(mc->results);
+    pthread_mutex_destroy(&mc->lock);
+    return formed == mc->runs ? 0 : 1;
+}
+
+/**
+ * @brief Keep the network running after the mode has finished, for soak tests
+ * @param soak_ms How long to run (0 = until SIGINT or SIGTERM)
+ *
+ * The nodes carry on as they are; pair with --metrics-socket or
+ * --metrics-file to watch them.
+ */
+static void run_soak(uint32_t soak_ms) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (soak_ms)
+        printf("SOAK: running for %ums\n", soak_ms);
+    else
+        printf("SOAK: running until interrupted\n");
+    fflush(stdout);
+    uint32_t start = hal_millis();
+    while (!g_stop && (soak_ms == 0 || hal_millis() - start < soak_ms))
+        usleep(SOAK_POLL_MS * 1000);
+    printf("SOAK: ran %ums\n", hal_millis() - start);
+}
+
+/**
+ * @brief Print the command line summary
+ * @param out stdout for --help, stderr for a bad command line
+ *
+ * See main() for what each option does.
+ */
+static void print_usage(FILE* out, const char* prog) {
+    fprintf(out,
+            "Usage: %s [num_nodes] [--failover MS] [--reboot MS] [--persist DIR]\n"
+            "       [--baud N] [--bench-pubsub SIZE] [--clock-skew PPM] [--bench-time]\n"
+            "       [--tdma SLOT_MS] [--csma | --csma-echo] [--bench-load SIZE]\n"
+            "       [--uart FORMAT] [--bench-boot] [--seed N] [--loss P[@A:B]]\n"
+            "       [--corrupt P[@A:B]] [--reorder P[@A:B]] [--latency MS[@A:B]]\n"
+            "       [--jitter MS[@A:B]] [--partition START:END:MASK] [--stagger MS]\n"
+            "       [--monte-carlo RUNS] [--workers N] [--log FILE]\n"
+            "       [--scenario FILE] [--deadline MS] [--soak MS]\n"
+            "       [--metrics-socket PATH] [--metrics-file PATH] [--metrics-interval MS]\n"
+            "       [--timeline FILE] [--segment SEG:MASK]\n"
+            "       [--bridge A:B[:LATENCY_MS[:BAUD]]] [--chain SEGMENTS[:LATENCY_MS[:BAUD]]]\n"
+            "       [--relays RELAYS[:MAX_HOPS]]\n"
+            "       (default: 3 nodes, max: 16)\n",
+            prog);
+}
+
 /**
  * @brief Main simulation entry point
  * @param argc Number of command line arguments
  * @param argv Array of command line argument strings
- * @return 0 on success, 1 on failure
+ * @return 0 on success, 1 on failure or a bad command line
  * 
  * Creates and runs a multi-threaded simulation of interconnected nodes.
  * Each node runs in its own thread and can communicate with others via a shared bus.
- * Usage: ./sim [num_nodes] (default: 3 nodes, max: 16)
+ * Usage: ./sim [num_nodes] [--failover MS] [--reboot MS] [--persist DIR]
+ *              [--baud N] [--bench-pubsub SIZE] [--clock-skew PPM] [--bench-time]
+ *              [--tdma SLOT_MS] [--csma | --csma-echo] [--bench-load SIZE]
+ *              [--uart FORMAT] [--bench-boot] [--seed N] [--loss P[@A:B]]
+ *              [--corrupt P[@A:B]] [--reorder P[@A:B]] [--latency MS[@A:B]]
+ *              [--jitter MS[@A:B]] [--partition START:END:MASK] [--stagger MS]
+ *              [--monte-carlo RUNS] [--workers N] [--log FILE]
+ *              [--scenario FILE] [--deadline MS] [--soak MS]
+ *              [--metrics-socket PATH] [--metrics-file PATH] [--metrics-interval MS]
+ *              [--timeline FILE] [--segment SEG:MASK]
+ *              [--bridge A:B[:LATENCY_MS[:BAUD]]] [--chain SEGMENTS[:LATENCY_MS[:BAUD]]]
+ *              [--relays RELAYS[:MAX_HOPS]]
+ *              (default: 3 nodes, max: 16)
+ *
+ * --failover MS kills the coordinator MS milliseconds after startup and
+ * reports standby takeover latency and how many member IDs were preserved.
+ * --reboot MS resets a member MS milliseconds after startup and reports how
+ * long it takes to rejoin. --persist DIR enables the file-backed identity
+ * cache so the reset member can reclaim its ID. --baud N paces every frame
+ * at N baud. --bench-pubsub SIZE measures fragmented pub/sub throughput.
+ * --clock-skew PPM gives every node a random boot offset and an oscillator
+ * error of up to ±PPM. --bench-time reports time synchronization accuracy.
+ * --tdma SLOT_MS lets the coordinator schedule bus access in slots of
+ * SLOT_MS. --csma makes nodes listen before talking, with random backoff;
+ * --csma-echo also resends frames whose echo shows a collision.
+ * --bench-load SIZE has every node publish at once and reports goodput and
+ * collisions (the medium model needs --baud). --uart FORMAT sets the
+ * character format the airtime is charged for, e.g. 8N1 (default) or 8E2.
+ * --bench-boot reports how long the network takes to form from power-up.
+ * --stagger MS powers the boards up at random times up to MS apart.
+ * --log FILE writes the nodes' log lines to FILE instead of stdout.
+ *
+ * Without one of the modes above the run ends as soon as every live node
+ * has a unique ID in one network, printing how long that took, and fails
+ * if that has not happened --deadline MS after startup (default 10000) or
+ * two nodes keep the same ID. --scenario FILE first plays the power-ups,
+ * kills and restarts listed in FILE (see load_scenario()), e.g. one of
+ * sim/scenarios/.
+ *
+ * --soak MS keeps the nodes running MS milliseconds after the mode has
+ * finished (0 = until Ctrl-C or SIGTERM). --metrics-socket PATH serves live
+ * metrics in Prometheus text format on a Unix socket, and --metrics-file
+ * PATH rewrites them to a file every --metrics-interval MS (default 1000);
+ * see metrics_sim.h. --timeline FILE records every node's role changes,
+ * election and join waits, frames and retries as Chrome trace-event JSON,
+ * for Perfetto or chrome://tracing (see hal_sim_set_timeline()).
+ *
+ * --monte-carlo RUNS boots RUNS independent scenarios instead, up to
+ * --workers N at a time (default: one per core), each on its own network
+ * with 2 to num_nodes boards, seed SEED + i and a stagger of up to 500ms
+ * unless --stagger is given. The other options (medium, faults) apply to
+ * every scenario. Reports the distributions of convergence time and JOIN
+ * retries and lists the seeds of scenarios that split or did not form.
+ *
+ * Fault injection: --loss, --corrupt and --reorder take a probability,
+ * --latency and --jitter a time in ms; a plain value applies to every link
+ * and VALUE@A:B to frames from node A to node B ("*" = any node), with later
+ * options overriding earlier ones. --partition START:END:MASK cuts the nodes
+ * in MASK off from the rest between START and END ms after startup.
+ * --seed N fixes the master seed that every node's random number generator
+ * and the injected faults derive from, so a run's random choices repeat
+ * exactly (default: the current time; the seed is printed at startup).
+ *
+ * Topology: --segment SEG:MASK puts the nodes in MASK on segment SEG (all
+ * start on segment 0) and --bridge A:B:LATENCY_MS:BAUD joins segments A and
+ * B with a bridge that forwards every frame at BAUD (default: the line
+ * rate) and holds it LATENCY_MS (default 0); see bus_sim_add_bridge().
+ * --chain SEGMENTS:LATENCY_MS:BAUD splits the nodes into SEGMENTS runs of
+ * consecutive indices joined in a line by such bridges. With a topology,
+ * --bench-boot also reports when the first coordinator appeared and how
+ * long members took to join, by their distance from the coordinator.
+ * --relays RELAYS:MAX_HOPS splits the nodes into RELAYS + 1 segments with
+ * no bridges; the last node of each segment but the last relays control
+ * frames to the next one over a second bus, up to MAX_HOPS relays (default
+ * NODE_RELAY_MAX_HOPS; see node_set_relay()). --bench-boot then also
+ * reports the flooding overhead and the JOIN latency by relays crossed.
  */
 int main(int argc, char** argv) {
     /* Default to 3 nodes if no argument provided */
     int num_nodes = 3;
-    
-    /* Parse command line argument for number of nodes */
-    if (argc >= 2) {
-        num_nodes = atoi(argv[1]);  /* Convert string to integer */
-        /* Clamp to valid range [1, 16] */
-        if (num_nodes < 1)
-            num_nodes = 1;
-        if (num_nodes > 16)
-            num_nodes = 16;
+    int failover_ms = 0; /* 0 = don't kill the coordinator */
+    int reboot_ms = 0;   /* 0 = don't reset a member */
+    const char* persist_dir = NULL;
+    uint32_t baud = 0;   /* 0 = instant delivery */
+    int bench_size = 0;  /* 0 = no pub/sub benchmark */
+    int clock_skew = 0;  /* Max oscillator error in ppm (0 = ideal clocks) */
+    int bench_time = 0;
+    int tdma_slot = 0;   /* 0 = free transmission */
+    MacCsmaMode csma = MAC_CSMA_OFF;
+    int load_size = 0;   /* 0 = no load benchmark */
+    int bench_boot = 0;
+    int faults = 0;      /* Any fault injection option given */
+    int stagger = -1;    /* Max power-up delay in ms (-1 = default of the mode) */
+    int monte_carlo = 0; /* 0 = one simulation, else the number of scenarios */
+    int workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long seed = (unsigned long long) time(NULL);
+    const char* scenario_file = NULL;
+    uint32_t deadline_ms = 0; /* 0 = the scenario's, or SCENARIO_DEADLINE_MS */
+    int soak_ms = -1;         /* -1 = end with the mode, 0 = run until interrupted */
+    const char* metrics_socket = NULL;
+    const char* metrics_file = NULL;
+    uint32_t metrics_interval_ms = 0; /* 0 = METRICS_SIM_INTERVAL_MS */
+    const char* timeline_file = NULL;
+    const char* chain = NULL; /* --chain spec, applied once the node count is known */
+    const char* relays_spec = NULL; /* --relays spec, likewise */
+    int relays = 0;           /* Relay nodes, each with a second bus */
+    uint8_t relay_hops = 0;   /* Their hop limit */
+    int topology = 0;         /* Any segment, bridge, chain or relays option given */
+
+    /* Parse command line arguments */
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--failover") == 0 && i + 1 < argc) {
+            failover_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reboot") == 0 && i + 1 < argc) {
+            reboot_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--persist") == 0 && i + 1 < argc) {
+            persist_dir = argv[++i];
+        } else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+            baud = (uint32_t) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-pubsub") == 0 && i + 1 < argc) {
+            bench_size = atoi(argv[++i]);
+            if (bench_size < 1 || bench_size > PUBSUB_MAX_MESSAGE)
+                bench_size = PUBSUB_MAX_MESSAGE;
+        } else if (strcmp(argv[i], "--clock-skew") == 0 && i + 1 < argc) {
+            clock_skew = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-time") == 0) {
+            bench_time = 1;
+        } else if (strcmp(argv[i], "--tdma") == 0 && i + 1 < argc) {
+            tdma_slot = atoi(argv[++i]);
+            if (tdma_slot < 0 || tdma_slot > 255)
+                tdma_slot = 0;
+        } else if (strcmp(argv[i], "--csma") == 0) {
+            csma = MAC_CSMA_ON;
+        } else if (strcmp(argv[i], "--csma-echo") == 0) {
+            csma = MAC_CSMA_ECHO;
+        } else if (strcmp(argv[i], "--bench-load") == 0 && i + 1 < argc) {
+            load_size = atoi(argv[++i]);
+            if (load_size < 1 || load_size > PUBSUB_MAX_MESSAGE)
+                load_size = PUBSUB_FRAG_DATA;
+        } else if (strcmp(argv[i], "--uart") == 0 && i + 1 < argc) {
+            /* Data bits, parity (N, E or O) and stop bits, as in "8N1" */
+            const char* fmt = argv[++i];
+            if (strlen(fmt) != 3 || !strchr("NEO", fmt[1]) ||
+                !bus_sim_set_framing((uint8_t) (fmt[0] - '0'), fmt[1] != 'N',
+                                     (uint8_t) (fmt[2] - '0'))) {
+                fprintf(stderr, "Unsupported UART format %s (expected e.g. 8N1)\n", fmt);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench-boot") == 0) {
+            bench_boot = 1;
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            if (!hal_sim_set_log_file(argv[++i])) {
+                fprintf(stderr, "Cannot create log file %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stagger") == 0 && i + 1 < argc) {
+            stagger = atoi(argv[++i]);
+            if (stagger < 0)
+                stagger = 0;
+        } else if (strcmp(argv[i], "--monte-carlo") == 0 && i + 1 < argc) {
+            monte_carlo = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenario_file = argv[++i];
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            deadline_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--soak") == 0 && i + 1 < argc) {
+            soak_ms = atoi(argv[++i]);
+            if (soak_ms < 0)
+                soak_ms = 0;
+        } else if (strcmp(argv[i], "--metrics-socket") == 0 && i + 1 < argc) {
+            metrics_socket = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            metrics_interval_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timeline_file = argv[++i];
+        } else if (strcmp(argv[i], "--segment") == 0 && i + 1 < argc) {
+            if (!parse_segment(argv[++i])) {
+                fprintf(stderr, "Bad segment %s (expected SEG:MASK)\n", argv[i]);
+                return 1;
+            }
+            topology = 1;
+        } else if (strcmp(argv[i], "--bridge") == 0 && i + 1 < argc) {
+            if (!parse_bridge(argv[++i])) {
+                fprintf(stderr, "Bad bridge %s (expected A:B[:LATENCY_MS[:BAUD]])\n", argv[i]);
+                return 1;
+            }
+            topology = 1;
+        } else if (strcmp(argv[i], "--chain") == 0 && i + 1 < argc) {
+            chain = argv[++i];
+            topology = 1;
+        } else if (strcmp(argv[i], "--relays") == 0 && i + 1 < argc) {
+            relays_spec = argv[++i];
+            topology = 1;
+        } else if (strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+            if (!parse_partition(argv[++i])) {
+                fprintf(stderr, "Bad partition %s (expected START_MS:END_MS:MASK)\n", argv[i]);
+                return 1;
+            }
+            faults = 1;
+        } else if (i + 1 < argc && (strcmp(argv[i], "--loss") == 0 ||
+                                    strcmp(argv[i], "--corrupt") == 0 ||
+                                    strcmp(argv[i], "--reorder") == 0 ||
+                                    strcmp(argv[i], "--latency") == 0 ||
+                                    strcmp(argv[i], "--jitter") == 0)) {
+            BusSimFault fault = strcmp(argv[i], "--loss") == 0      ? BUS_FAULT_LOSS
+                                : strcmp(argv[i], "--corrupt") == 0 ? BUS_FAULT_CORRUPT
+                                : strcmp(argv[i], "--reorder") == 0 ? BUS_FAULT_REORDER
+                                : strcmp(argv[i], "--latency") == 0 ? BUS_FAULT_LATENCY_MS
+                                                                    : BUS_FAULT_JITTER_MS;
+            if (!parse_fault(fault, argv[i + 1])) {
+                fprintf(stderr, "Bad %s value %s (expected VALUE or VALUE@FROM:TO)\n", argv[i],
+                        argv[i + 1]);
+                return 1;
+            }
+            i++;
+            faults = 1;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(stdout, argv[0]);
+            return 0;
+        } else {
+            /* Anything else must be the node count; unknown or incomplete options fail */
+            char* end;
+            long n = strtol(argv[i], &end, 10);
+            if (argv[i][0] == '-' || end == argv[i] || *end != '\0') {
+                fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+                print_usage(stderr, argv[0]);
+                return 1;
+            }
+            num_nodes = (int) n;
+        }
     }
 
-    printf("Starting simulation with %d nodes...\n", num_nodes);
+    Scenario scenario;
+    memset(&scenario, 0, sizeof(scenario));
+    if (scenario_file) {
+        if (!load_scenario(scenario_file, &scenario))
+            return 1;
+        if (scenario.num_nodes)
+            num_nodes = scenario.num_nodes;
+        faults |= scenario.faults;
+        topology |= scenario.topology;
+        if (scenario.relays[0] && !relays_spec)
+            relays_spec = scenario.relays;
+    }
+    if (deadline_ms)
+        scenario.deadline_ms = deadline_ms;
+    /* Clamp to valid range [1, 16] */
+    if (num_nodes < 1)
+        num_nodes = 1;
+    if (num_nodes > 16)
+        num_nodes = 16;
+    if (chain && !apply_chain(chain, num_nodes)) {
+        fprintf(stderr, "Bad chain %s (expected SEGMENTS[:LATENCY_MS[:BAUD]])\n", chain);
+        return 1;
+    }
+    if (relays_spec) {
+        /* Relays carry the control plane only: no TDMA schedules or time sync */
+        if (chain || tdma_slot || monte_carlo > 0) {
+            fprintf(stderr, "--relays cannot be combined with --chain, --tdma or --monte-carlo\n");
+            return 1;
+        }
+        relays = apply_relays(relays_spec, num_nodes, &relay_hops);
+        if (!relays) {
+            fprintf(stderr, "Bad relays %s (expected RELAYS[:MAX_HOPS], fewer than %d and the "
+                    "node count)\n", relays_spec, BUS_SIM_MAX_SEGMENTS);
+            return 1;
+        }
+    }
+    for (int e = 0; e < scenario.count; ++e) {
+        const ScenarioEvent* ev = &scenario.events[e];
+        if (ev->node >= num_nodes) {
+            fprintf(stderr, "%s:%d: no node %d in a run of %d nodes\n", scenario_file, ev->line,
+                    ev->node, num_nodes);
+            return 1;
+        }
+        for (int prev = 0; prev < e && ev->action == SCENARIO_BOOT; ++prev) {
+            /* A node boots once, before anything else happens to it */
+            if (scenario.events[prev].node == ev->node) {
+                fprintf(stderr, "%s:%d: node %d must boot once, before its other events\n",
+                        scenario_file, ev->line, ev->node);
+                return 1;
+            }
+        }
+    }
+
+    if (workers < 1)
+        workers = 1;
+
+    if (monte_carlo > 0) {
+        if (metrics_socket || metrics_file || timeline_file) {
+            fprintf(stderr, "Metrics and timelines cover one simulation, not --monte-carlo\n");
+            return 1;
+        }
+        hal_init();
+        MonteCarlo mc;
+        memset(&mc, 0, sizeof(mc));
+        mc.runs = monte_carlo;
+        mc.max_nodes = num_nodes < 2 ? 2 : num_nodes;
+        mc.stagger_ms = stagger >= 0 ? stagger : MONTE_CARLO_STAGGER_MS;
+        mc.clock_skew = clock_skew;
+        mc.baud = baud;
+        mc.csma = csma;
+        mc.tdma_slot = tdma_slot;
+        mc.seed = seed;
+        return run_monte_carlo(&mc, workers);
+    }
+
+    printf("Starting simulation with %d nodes (seed %llu)...\n", num_nodes, seed);
 
     /* Initialize hardware abstraction layer (HAL) */
     hal_init();
+    if (timeline_file && !hal_sim_set_timeline(timeline_file)) {
+        fprintf(stderr, "Cannot create timeline file %s\n", timeline_file);
+        return 1;
+    }
+
+    /* Every node's random choices and the injected faults follow from the seed */
+    hal_sim_set_seed(seed);
+    bus_sim_set_seed(seed);
+
+    /* Every simulated board starts factory-fresh: clear stale cached identities */
+    if (persist_dir) {
+        hal_sim_set_identity_dir(persist_dir);
+        for (int i = 0; i < num_nodes; ++i)
+            hal_identity_store((uint8_t) i, 0, 0);
+    }
 
-    /* Initialize the global bus system that connects all nodes */
-    if (bus_global_init((uint8_t) num_nodes) != 0) {
+    /* Initialize the global bus system that connects all nodes (and the relays' second buses) */
+    if (bus_global_init((uint8_t) (num_nodes + relays)) != 0) {
         fprintf(stderr, "Failed to initialize bus system\n");
         return 1;
     }
@@ -88,17 +1890,49 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    /* Create and initialize each node with its own bus and thread */
+    /* Create a bus interface for each node (parameters: bus_ptr, node_id, tx_pin, rx_pin) */
     for (int i = 0; i < num_nodes; ++i) {
-        /* Create a bus interface for this node (parameters: bus_ptr, node_id, tx_pin, rx_pin) */
         if (bus_create(&nodes[i].bus, (uint8_t) i, 0, 0) != 0) {
             fprintf(stderr, "Failed to create bus for node %d\n", i);
             return 1;
         }
+        bus_set_baud(nodes[i].bus, baud);
+        bus_set_csma(nodes[i].bus, csma);
+    }
 
+    /* Relays get a second bus, on the slots after the nodes' and the next segment */
+    for (int k = 0; k < relays; ++k) {
+        ThreadedNode* tn = &nodes[relay_node(k, num_nodes)];
+        if (bus_create(&tn->relay_bus, (uint8_t) (num_nodes + k), 0, 0) != 0) {
+            fprintf(stderr, "Failed to create bus for relay %d\n", k);
+            return 1;
+        }
+        bus_set_baud(tn->relay_bus, baud);
+        bus_set_csma(tn->relay_bus, csma);
+        tn->relay_max_hops = relay_hops;
+    }
+
+    /* Initialize each node and start its thread */
+    uint32_t boot_ms = hal_millis();
+    for (int i = 0; i < num_nodes; ++i) {
         /* Initialize the node with its bus and unique ID */
         node_init(&nodes[i].node, nodes[i].bus, (uint8_t) i);
+        node_set_tdma(&nodes[i].node, (uint8_t) tdma_slot);
+        node_set_relay(&nodes[i].node, nodes[i].relay_bus, nodes[i].relay_max_hops);
+        pubsub_init(&nodes[i].pubsub, &nodes[i].node);
+        pubsub_subscribe(&nodes[i].pubsub, BENCH_TOPIC, bench_on_message, &nodes[i]);
         nodes[i].index = (uint8_t) i;  /* Store the node index for reference */
+        if (clock_skew > 0) {
+            /* Boards boot up to 10s apart and their crystals disagree */
+            nodes[i].skew_ppm = (int32_t) (hal_random32() % (2u * clock_skew + 1)) - clock_skew;
+            hal_sim_set_clock((uint8_t) i, (int32_t) (hal_random32() % 10000), nodes[i].skew_ppm);
+        }
+        if (stagger > 0)
+            nodes[i].start_delay_ms = hal_random32() % (uint32_t) (stagger + 1);
+        for (int e = 0; e < scenario.count; ++e) {
+            if (scenario.events[e].action == SCENARIO_BOOT && scenario.events[e].node == i)
+                nodes[i].start_delay_ms = scenario.events[e].at_ms; /* Scenario power-up time */
+        }
         nodes[i].running = 1;          /* Set running flag to start the node */
 
         /* Create a new thread to run this node independently */
@@ -108,27 +1942,94 @@ int main(int argc, char** argv) {
         }
     }
 
-    /* Let the simulation run for 3 seconds */
+    /* Export the network's counters and the nodes' roles while it runs */
+    if ((metrics_socket || metrics_file) &&
+        !metrics_sim_start(metrics_socket, metrics_file, metrics_interval_ms,
+                           (uint8_t) num_nodes)) {
+        fprintf(stderr, "Cannot serve metrics on %s\n",
+                metrics_socket ? metrics_socket : metrics_file);
+        return 1;
+    }
+
     printf("Simulation running...\n");
-    sleep(3);
+    const char* mode = tdma_slot ? "TDMA"
+                       : csma == MAC_CSMA_ECHO ? "CSMA+echo"
+                       : csma == MAC_CSMA_ON   ? "CSMA"
+                                               : "free";
+    int failover_rc = 0;
+    int old_coord = -1;
+    Node old_state;
+    memset(&old_state, 0, sizeof(old_state));
+    if (failover_ms > 0) {
+        usleep((useconds_t) failover_ms * 1000);
+        for (int i = 0; i < num_nodes; ++i) {
+            if (nodes[i].node.role == NODE_COORDINATOR)
+                old_coord = i;
+        }
+        failover_rc = run_failover(nodes, num_nodes);
+        if (old_coord >= 0)
+            old_state = nodes[old_coord].node; /* Thread is stopped, safe to copy */
+        sleep(1); /* Let the new coordinator settle */
+    } else if (bench_size > 0) {
+        failover_rc = run_pubsub_bench(nodes, num_nodes, bench_size, baud, tdma_slot);
+    } else if (load_size > 0) {
+        failover_rc = run_load_bench(nodes, num_nodes, load_size, tdma_slot, mode);
+    } else if (bench_boot) {
+        failover_rc = run_boot_bench(nodes, num_nodes, boot_ms, tdma_slot, baud, mode, topology);
+    } else if (bench_time) {
+        usleep(TIME_BENCH_SETTLE_MS * 1000);
+        failover_rc = run_time_bench(nodes, num_nodes);
+    } else if (reboot_ms > 0) {
+        usleep((useconds_t) reboot_ms * 1000);
+        failover_rc = run_reboot(nodes, num_nodes);
+    } else {
+        /* Until every node has an ID, or the deadline */
+        failover_rc = play_scenario(nodes, num_nodes, &scenario, boot_ms, tdma_slot);
+    }
+    if (soak_ms >= 0)
+        run_soak((uint32_t) soak_ms);
+
+    metrics_sim_stop(); /* The file keeps the network as it was at the end */
 
     /* Graceful shutdown sequence */
     printf("Shutting down simulation...\n");
     for (int i = 0; i < num_nodes; ++i) {
-        /* Signal the node thread to stop */
-        nodes[i].running = 0;
-        
-        /* Wait for the thread to finish (blocking call) */
-        pthread_join(nodes[i].thread, NULL);
-        
+        /* Signal the node thread to stop (killed nodes are already stopped) */
+        if (nodes[i].running) {
+            stop_node(&nodes[i]); /* Waits for the thread to finish */
+        }
+
         /* Clean up the bus resources for this node */
         bus_destroy(nodes[i].bus);
+        if (nodes[i].relay_bus)
+            bus_destroy(nodes[i].relay_bus);
+    }
+
+    /* Compare member tables now that every thread has stopped */
+    if (failover_rc == 0 && old_coord >= 0) {
+        for (int i = 0; i < num_nodes; ++i) {
+            if (i != old_coord && nodes[i].node.role == NODE_COORDINATOR)
+                report_preserved_ids(&old_state, &nodes[i].node);
+        }
+    }
+
+    if (faults) {
+        uint32_t lost = 0, corrupted = 0, reordered = 0;
+        bus_sim_get_fault_stats(&lost, &corrupted, &reordered);
+        printf("FAULTS: %u deliveries lost, %u corrupted, %u reordered\n", lost, corrupted,
+               reordered);
     }
 
     /* Clean up global resources */
+    hal_sim_set_timeline(NULL); /* Finish the timeline file, if any */
     bus_global_shutdown();  /* Shutdown the global bus system */
     free(nodes);           /* Free the allocated node array */
 
+    if (failover_rc != 0) {
+        printf("Simulation failed.\n");
+        return 1;
+    }
+
     printf("Simulation completed successfully.\n");
     return 0;  /* Success */
 }
@@ -0,0 +1,281 @@
+/* Enable GNU extensions for posix_openpt(), ptsname() and cfmakeraw() */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../shared/core/rng.h"
+#include "bus_pty.h"
+
+/** Bytes a node may write ahead of the line before its port blocks */
+#define HUB_FIFO 4096
+
+/** The line is clocked out in rounds at most this often (a character time if longer) */
+#define HUB_ROUND_NS 1000000ULL
+
+/** How long an idle hub sleeps before checking whether it should stop */
+#define HUB_IDLE_MS 100
+
+/** The line waits while a port has this many bytes its node has not read yet... */
+#define HUB_BACKLOG 2048
+
+/** ...unless the node has not read any of them for this long (it is gone, or stuck) */
+#define HUB_STALL_NS 50000000ULL
+
+/** One pseudo-terminal: a node's serial port, or the monitor port */
+typedef struct {
+    int master;              // Our end
+    int slave;               // Held open so the port outlives the node using it
+    char link[256];          // DIR/node<i> or DIR/monitor, pointing at the slave
+    uint8_t fifo[HUB_FIFO];  // Bytes the node has sent that are not on the line yet
+    uint16_t head;
+    uint16_t count;
+    int backlog;             // Bytes on the line the node had not read at the last check
+    uint64_t progress_ns;    // Last time its backlog was short or shrinking
+} Port;
+
+/** Set by SIGTERM/SIGINT */
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+    (void) sig;
+    g_stop = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Create a pseudo-terminal in raw mode and link its slave as path
+ * @return 0 on success, -1 on error
+ */
+static int open_port(Port* p, const char* path) {
+    memset(p, 0, sizeof(*p));
+    p->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (p->master < 0 || grantpt(p->master) != 0 || unlockpt(p->master) != 0)
+        return -1;
+    const char* name = ptsname(p->master);
+    p->slave = name ? open(name, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC) : -1;
+    if (p->slave < 0)
+        return -1;
+
+    /* A serial line carries bytes, not lines of text: no echo, no translation */
+    struct termios tio;
+    tcgetattr(p->slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(p->slave, TCSANOW, &tio);
+
+    snprintf(p->link, sizeof(p->link), "%s", path);
+    unlink(p->link);
+    return symlink(name, p->link);
+}
+
+/** Read what the node has written since the last round into its FIFO */
+static void drain_port(Port* p) {
+    while (p->count < HUB_FIFO) {
+        uint16_t tail = (uint16_t) ((p->head + p->count) % HUB_FIFO);
+        size_t room = tail >= p->head ? (size_t) (HUB_FIFO - tail) : (size_t) (p->head - tail);
+        if (room > (size_t) (HUB_FIFO - p->count))
+            room = HUB_FIFO - p->count;
+        ssize_t n = read(p->master, &p->fifo[tail], room);
+        if (n <= 0)
+            return;
+        p->count = (uint16_t) (p->count + n);
+    }
+}
+
+/**
+ * @brief Check whether the port's node is behind on the line but still reading
+ * @return 1 if the line should wait for it, 0 if it keeps up or has stopped reading
+ */
+static int port_lagging(Port* p, uint64_t now) {
+    int queued = 0;
+    ioctl(p->slave, FIONREAD, &queued);
+    if (queued < HUB_BACKLOG || queued < p->backlog)
+        p->progress_ns = now;
+    p->backlog = queued;
+    return queued >= HUB_BACKLOG && now - p->progress_ns < HUB_STALL_NS;
+}
+
+static uint8_t fifo_pop(Port* p) {
+    uint8_t b = p->fifo[p->head];
+    p->head = (uint16_t) ((p->head + 1) % HUB_FIFO);
+    p->count--;
+    return b;
+}
+
+/**
+ * @brief Broadcast hub for the pseudo-terminal bus (bus_pty.c)
+ * @param argc Number of command line arguments
+ * @param argv Array of command line argument strings
+ * @return 0 on success, 1 if the ports could not be set up
+ *
+ * Usage: ./pty_hub N [--baud N] [--bus DIR] [--noise P] [--seed N] [--run MS]
+ *
+ * Creates N pseudo-terminals, linked as DIR/node0 .. DIR/node<N-1> (DIR
+ * defaults to /tmp/self-organizing-mcus), plus DIR/monitor, and joins them
+ * into one broadcast line: every byte a node writes reaches every port, its
+ * own included. With --baud N the line is clocked one character time per
+ * byte; nodes sending in the same character time produce the wired-AND of
+ * their bytes, as on an open-drain bus. Without a baud rate bytes are
+ * forwarded as soon as they arrive. Either way the line waits while a node
+ * is more than HUB_BACKLOG bytes behind, as with flow control, unless it
+ * has stopped reading: then bytes for it are dropped. --noise P flips a random bit in a
+ * fraction P of the bytes, to stress the receivers' resynchronization.
+ * Runs until SIGTERM or SIGINT, or for --run MS, then prints its counters.
+ * sim/pty_node --spawn starts one itself.
+ */
+int main(int argc, char** argv) {
+    int nodes = 0;
+    uint32_t baud = 0;
+    double noise = 0;
+    uint64_t seed = (uint64_t) time(NULL);
+    uint32_t run_ms = 0;
+    const char* dir = BUS_PTY_DEFAULT_DIR;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+            baud = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bus") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            noise = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--run") == 0 && i + 1 < argc) {
+            run_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            nodes = atoi(argv[i]);
+        }
+    }
+    if (nodes < 1 || nodes > BUS_PTY_MAX_NODES) {
+        fprintf(stderr, "Usage: %s N [--baud N] [--bus DIR] [--noise P] [--seed N] [--run MS] "
+                        "(N 1-%d)\n",
+                argv[0], BUS_PTY_MAX_NODES);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    /* Ports 0..nodes-1 belong to the nodes; the last one is the monitor */
+    static Port ports[BUS_PTY_MAX_NODES + 1];
+    int count = nodes + 1;
+    mkdir(dir, 0700);
+    for (int i = 0; i < count; ++i) {
+        char path[256];
+        if (i < nodes)
+            snprintf(path, sizeof(path), "%s/node%d", dir, i);
+        else
+            snprintf(path, sizeof(path), "%s/monitor", dir);
+        if (open_port(&ports[i], path) != 0) {
+            fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+    printf("HUB: %d ports in %s, %u baud\n", nodes, dir, baud);
+    fflush(stdout);
+
+    Rng rng;
+    rng_seed(&rng, seed);
+    uint32_t noise_threshold = (uint32_t) (noise * 4294967295.0);
+    uint64_t char_ns = baud ? 10ULL * 1000000000ULL / baud : 0; /* 8N1: 10 bits a byte */
+    uint64_t round_ns = char_ns > HUB_ROUND_NS ? char_ns : HUB_ROUND_NS;
+
+    unsigned long long on_line = 0, garbled = 0, corrupted = 0, dropped = 0;
+    uint64_t start = now_ns();
+    uint64_t line_ns = start; /* Time the line has been clocked out to */
+    struct pollfd pfd[BUS_PTY_MAX_NODES + 1];
+
+    while (!g_stop && (run_ms == 0 || now_ns() - start < run_ms * 1000000ULL)) {
+        int pending = 0;
+        for (int i = 0; i < count; ++i) {
+            drain_port(&ports[i]);
+            if (i == nodes)
+                ports[i].count = 0; /* The monitor listens only */
+            pending += ports[i].count > 0;
+        }
+        if (!pending) {
+            /* Idle line: sleep until a node writes */
+            for (int i = 0; i < count; ++i) {
+                pfd[i].fd = ports[i].master;
+                pfd[i].events = POLLIN;
+            }
+            poll(pfd, (nfds_t) count, HUB_IDLE_MS);
+            line_ns = now_ns();
+            continue;
+        }
+
+        /* Like a UART with flow control, the line waits for a node that falls behind */
+        uint64_t now = now_ns();
+        int lagging = 0;
+        for (int i = 0; i < count; ++i)
+            lagging += port_lagging(&ports[i], now);
+        if (lagging) {
+            struct timespec wait = {0, 100000L};
+            nanosleep(&wait, NULL);
+            continue;
+        }
+
+        /* The bytes whose character times have passed since the last round */
+        uint8_t out[HUB_BACKLOG];
+        size_t len = 0;
+        while (len < sizeof(out) && (char_ns == 0 || line_ns + char_ns <= now)) {
+            uint8_t byte = 0xFF; /* Idle line level */
+            int senders = 0;
+            for (int i = 0; i < nodes; ++i) {
+                if (ports[i].count && (char_ns || senders == 0)) {
+                    byte &= fifo_pop(&ports[i]);
+                    senders++;
+                }
+            }
+            if (!senders) {
+                line_ns = now; /* The line went idle */
+                break;
+            }
+            if (senders > 1)
+                garbled++;
+            if (noise_threshold && rng_next(&rng) < noise_threshold) {
+                byte ^= (uint8_t) (1u << (rng_next(&rng) % 8));
+                corrupted++;
+            }
+            out[len++] = byte;
+            line_ns += char_ns;
+        }
+        for (int i = 0; i < count && len; ++i) {
+            ssize_t n = write(ports[i].master, out, len);
+            dropped += n < 0 ? len : len - (size_t) n; /* Its node is not reading */
+        }
+        on_line += len;
+
+        if (char_ns) {
+            struct timespec wake;
+            uint64_t next = now + round_ns;
+            wake.tv_sec = (time_t) (next / 1000000000ULL);
+            wake.tv_nsec = (long) (next % 1000000000ULL);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        }
+    }
+
+    printf("HUB: %llu bytes on the line, %llu garbled by collisions, %llu corrupted by noise, "
+           "%llu dropped at ports nobody read\n",
+           on_line, garbled, corrupted, dropped);
+    for (int i = 0; i < count; ++i)
+        unlink(ports[i].link);
+    return 0;
+}
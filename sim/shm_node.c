@@ -0,0 +1,411 @@
+/* Enable POSIX.1-2008 features for kill(), nanosleep() and other functions */
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../shared/core/bus_interface.h"
+#include "../shared/core/hal.h"
+#include "../shared/core/node.h"
+#include "hal_sim.h"
+
+/* Built against bus_udp.c with -DBUS_NODE_UDP: the nodes share a multicast group */
+#ifdef BUS_NODE_UDP
+#include "bus_udp.h"
+#define BUS_NODE_MAX BUS_UDP_MAX_NODES
+#define BUS_NODE_TAG "UDP"
+/* Built against bus_pty.c with -DBUS_NODE_PTY: the nodes talk through sim/pty_hub */
+#elif defined(BUS_NODE_PTY)
+#include "bus_pty.h"
+#define BUS_NODE_MAX BUS_PTY_MAX_NODES
+#define BUS_NODE_TAG "PTY"
+#else
+#include "bus_shm.h"
+#define BUS_NODE_MAX BUS_SHM_MAX_NODES
+#define BUS_NODE_TAG "SHM"
+#endif
+
+/** Exit status of a node process: the role it ended in */
+#define EXIT_MEMBER 0
+#define EXIT_COORDINATOR 3
+#define EXIT_SEEKING 4
+#define EXIT_SETUP_FAILED 1
+
+/** Default run time of each node process */
+#define DEFAULT_RUN_MS 5000
+
+/** Set by SIGTERM/SIGINT: leave the service loop and report the role */
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+    (void) sig;
+    g_stop = 1;
+}
+
+/**
+ * @brief Run one node in this process until run_ms has passed or it is told to stop
+ * @param index Node index, unique on the segment
+ * @param run_ms How long to run
+ * @param baud Bus baud rate (0 = instant delivery)
+ * @param csma Medium access mode
+ * @param tdma_slot TDMA slot length (0 = no TDMA)
+ * @return The EXIT_* status for the role the node ended in
+ */
+static int run_node(int index, uint32_t run_ms, uint32_t baud, MacCsmaMode csma, int tdma_slot) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    if (bus_global_init(1) != 0) {
+        fprintf(stderr, "Node %d: cannot attach to the bus\n", index);
+        return EXIT_SETUP_FAILED;
+    }
+    Bus* bus = NULL;
+    if (bus_create(&bus, (uint8_t) index, 0, 0) != 0) {
+        fprintf(stderr, "Node %d: no bus (index must be below %d)\n", index, BUS_NODE_MAX);
+        bus_global_shutdown();
+        return EXIT_SETUP_FAILED;
+    }
+    bus_set_baud(bus, baud);
+    bus_set_csma(bus, csma);
+
+    Node node;
+    node_init(&node, bus, (uint8_t) index);
+    node_set_tdma(&node, (uint8_t) tdma_slot);
+    node_begin(&node);
+
+    uint32_t start = hal_millis();
+    while (!g_stop && hal_millis() - start < run_ms) {
+        node_service(&node);
+        hal_delay(10); /* Same pace as a node thread in sim/main.c */
+    }
+
+    printf("NODE %d: %s, ID %u\n", index,
+           node.role == NODE_COORDINATOR ? "coordinator"
+           : node.role == NODE_MEMBER    ? "member"
+                                         : "seeking",
+           node.assigned_id);
+#ifdef BUS_NODE_UDP
+    uint32_t sent = 0, collided = 0, missed = 0;
+    bus_udp_get_stats(&sent, &collided, &missed);
+    printf("NODE %d: sent %u frames, %u collided, %u missed\n", index, sent, collided, missed);
+#elif defined(BUS_NODE_PTY)
+    uint32_t sent = 0, bad = 0, cut = 0;
+    uint64_t bytes = 0, parse_ns = 0;
+    bus_pty_get_stats(&sent, &bad, &cut, &bytes, &parse_ns);
+    printf("NODE %d: sent %u frames, %u bad checksums, %u cut off; parsed %llu bytes, "
+           "%.1f ns/byte\n",
+           index, sent, bad, cut, (unsigned long long) bytes,
+           bytes ? (double) parse_ns / (double) bytes : 0.0);
+#endif
+    bus_destroy(bus);
+    bus_global_shutdown();
+    return node.role == NODE_COORDINATOR ? EXIT_COORDINATOR
+           : node.role == NODE_MEMBER    ? EXIT_MEMBER
+                                         : EXIT_SEEKING;
+}
+
+#ifdef BUS_NODE_PTY
+/** Hub options collected by main(): directory, baud rate, noise and seed */
+static const char* g_hub_dir = BUS_PTY_DEFAULT_DIR;
+static char* g_hub_baud = "0";
+static char* g_hub_noise = "0";
+static char g_hub_seed[24];
+
+/**
+ * @brief Start sim/pty_hub, from the directory this program lives in, for count nodes
+ * @return The hub's pid, or -1 if it could not be started
+ */
+static pid_t start_hub(const char* argv0, int count) {
+    char path[512];
+    const char* slash = strrchr(argv0, '/');
+    if (slash)
+        snprintf(path, sizeof(path), "%.*s/pty_hub", (int) (slash - argv0), argv0);
+    else
+        snprintf(path, sizeof(path), "./pty_hub");
+
+    /* Old links would send the nodes to ports that are gone: wait for the new ones */
+    for (int i = 0; i < count; ++i) {
+        char link[256];
+        snprintf(link, sizeof(link), "%s/node%d", g_hub_dir, i);
+        unlink(link);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char ports[8];
+        snprintf(ports, sizeof(ports), "%d", count);
+        char* args[] = {path,    ports,       "--baud", g_hub_baud, "--bus", (char*) g_hub_dir,
+                        "--noise", g_hub_noise, "--seed", g_hub_seed, NULL};
+        execv(path, args);
+        fprintf(stderr, "Cannot start %s\n", path);
+        _exit(127);
+    }
+    return pid;
+}
+#endif
+
+/**
+ * @brief Start one process per node, optionally kill one, and check the network formed
+ * @param argv0 Path of this program, started again for every node
+ * @param count Number of node processes
+ * @param node_args Options passed on to every node (NULL-terminated)
+ * @param kill_index Node to SIGKILL, or -1
+ * @param kill_ms When to kill it, after startup
+ * @return 0 if the survivors ended with exactly one coordinator and no seeking node
+ */
+static int run_spawn(const char* argv0, int count, char** node_args, int kill_index,
+                     uint32_t kill_ms) {
+#ifdef BUS_NODE_PTY
+    /* The hub owns the line; the nodes wait for it to link their ports */
+    pid_t hub = start_hub(argv0, count);
+    if (hub < 0) {
+        fprintf(stderr, "Cannot start the hub\n");
+        return 1;
+    }
+#elif !defined(BUS_NODE_UDP)
+    /* Start from a fresh segment, created here so the nodes find it ready */
+    bus_shm_unlink();
+    if (bus_global_init((uint8_t) count) != 0) {
+        fprintf(stderr, "Cannot create the shared bus\n");
+        return 1;
+    }
+#endif
+
+    pid_t pids[BUS_NODE_MAX];
+    for (int i = 0; i < count; ++i) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            char index[8];
+            snprintf(index, sizeof(index), "%d", i);
+            char* args[32] = {(char*) argv0, index};
+            int n = 2;
+            for (int j = 0; node_args[j] && n < 31; ++j)
+                args[n++] = node_args[j];
+            args[n] = NULL;
+            execv(argv0, args);
+            _exit(127); /* exec failed */
+        }
+        if (pids[i] < 0) {
+            fprintf(stderr, "Cannot start node %d\n", i);
+            count = i;
+            break;
+        }
+    }
+
+    if (kill_index >= 0 && kill_index < count) {
+        struct timespec wait = {(time_t) (kill_ms / 1000), (long) (kill_ms % 1000) * 1000000L};
+        nanosleep(&wait, NULL);
+        kill(pids[kill_index], SIGKILL); /* A crash: no cleanup, mid-frame if unlucky */
+        printf(BUS_NODE_TAG ": killed node %d\n", kill_index);
+        fflush(stdout);
+    }
+
+    int coordinators = 0, members = 0, seeking = 0, failed = 0, killed = 0;
+    for (int i = 0; i < count; ++i) {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if (WIFSIGNALED(status))
+            killed++;
+        else if (WEXITSTATUS(status) == EXIT_COORDINATOR)
+            coordinators++;
+        else if (WEXITSTATUS(status) == EXIT_MEMBER)
+            members++;
+        else if (WEXITSTATUS(status) == EXIT_SEEKING)
+            seeking++;
+        else
+            failed++;
+    }
+
+#if defined(BUS_NODE_UDP) || defined(BUS_NODE_PTY)
+#ifdef BUS_NODE_PTY
+    fflush(stdout);
+    kill(hub, SIGTERM); /* It prints the line counters as it goes */
+    waitpid(hub, NULL, 0);
+#endif
+    /* The line counters live in the node processes, which print their own */
+    printf(BUS_NODE_TAG
+           ": %d processes: %d coordinator, %d members, %d seeking, %d killed, %d failed\n",
+           count, coordinators, members, seeking, killed, failed);
+#else
+    uint32_t sent = 0, collided = 0, missed = 0;
+    bus_shm_get_stats(&sent, &collided, &missed);
+    printf("SHM: %d processes: %d coordinator, %d members, %d seeking, %d killed, %d failed; "
+           "%u frames on the line, %u collided\n",
+           count, coordinators, members, seeking, killed, failed, sent, collided);
+    bus_global_shutdown();
+    bus_shm_unlink();
+#endif
+    return coordinators == 1 && seeking == 0 && failed == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Node process for the shared-memory bus (or the UDP multicast bus)
+ * @param argc Number of command line arguments
+ * @param argv Array of command line argument strings
+ * @return EXIT_* status of the node, or 0/1 for a spawned run
+ *
+ * Usage: ./shm_node INDEX [options]       run node INDEX in this process
+ *        ./shm_node --spawn N [options]   run nodes 0..N-1 as separate processes
+ *
+ * Options: [--run MS] [--seed N] [--baud N] [--tdma SLOT_MS] [--csma | --csma-echo]
+ *          [--bus NAME] [--quiet] [--kill INDEX@MS]   (udp_node: [--iface ADDR])
+ *          (pty_node: [--noise P])
+ *
+ * Each node is its own process on the shared-memory bus (bus_shm.c), so
+ * nodes can be started, stopped and crashed independently. --run MS sets
+ * how long each node runs (default 5000); a node exits with its final role
+ * as status. --spawn N starts N node processes with the same options, waits
+ * for them and succeeds if the network ended with one coordinator and every
+ * other survivor a member. --kill INDEX@MS SIGKILLs node INDEX MS after
+ * startup to check that a crash takes down only that node. --bus NAME
+ * selects the shared memory segment (default /self-organizing-mcus),
+ * --seed N the master seed (node i draws from its own generator), --quiet
+ * drops the nodes' log lines.
+ *
+ * Built against bus_udp.c with -DBUS_NODE_UDP (sim/udp_node), the nodes
+ * share a multicast group instead: --bus GROUP[:PORT] selects it (default
+ * 239.255.77.1:47701) and --iface ADDR the interface to use, e.g. a veth
+ * end when each node runs in its own network namespace. Each node also
+ * prints its own line counters.
+ *
+ * Built against bus_pty.c with -DBUS_NODE_PTY (sim/pty_node), each node
+ * opens a pseudo-terminal of sim/pty_hub and speaks the UART wire format:
+ * --bus DIR selects the hub's directory (default /tmp/self-organizing-mcus).
+ * --spawn starts the hub first, with the same --baud, --bus and --seed, and
+ * passes --noise P on to it. Each node prints its parser counters.
+ */
+int main(int argc, char** argv) {
+    int index = -1;
+    int spawn = 0;
+    int kill_index = -1;
+    uint32_t kill_ms = 0;
+    uint32_t run_ms = DEFAULT_RUN_MS;
+    uint32_t baud = 0;
+    int tdma_slot = 0;
+    int quiet = 0;
+    MacCsmaMode csma = MAC_CSMA_OFF;
+    unsigned long long seed = (unsigned long long) time(NULL);
+    char* node_args[32] = {NULL}; /* Options passed on by --spawn */
+    int node_argc = 0;
+    int seed_given = 0;
+#ifdef BUS_NODE_UDP
+    const char* group = NULL; /* GROUP[:PORT] */
+    const char* iface = NULL;
+#endif
+#ifdef BUS_NODE_PTY
+    const char* dir = NULL;
+#endif
+
+    for (int i = 1; i < argc; ++i) {
+        int takes_value = i + 1 < argc;
+        if (strcmp(argv[i], "--spawn") == 0 && takes_value) {
+            spawn = atoi(argv[++i]);
+            continue;
+        } else if (strcmp(argv[i], "--kill") == 0 && takes_value) {
+            char* p;
+            kill_index = (int) strtol(argv[++i], &p, 10);
+            kill_ms = *p == '@' ? (uint32_t) strtoul(p + 1, NULL, 10) : 0;
+            continue;
+        }
+
+        /* Everything else also applies to spawned nodes */
+        int first = i;
+        if (strcmp(argv[i], "--run") == 0 && takes_value) {
+            run_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && takes_value) {
+            seed = strtoull(argv[++i], NULL, 0);
+            seed_given = 1;
+        } else if (strcmp(argv[i], "--baud") == 0 && takes_value) {
+            baud = (uint32_t) strtoul(argv[++i], NULL, 10);
+#ifdef BUS_NODE_PTY
+            g_hub_baud = argv[i];
+#endif
+        } else if (strcmp(argv[i], "--tdma") == 0 && takes_value) {
+            tdma_slot = atoi(argv[++i]);
+            if (tdma_slot < 0 || tdma_slot > 255)
+                tdma_slot = 0;
+        } else if (strcmp(argv[i], "--csma") == 0) {
+            csma = MAC_CSMA_ON;
+        } else if (strcmp(argv[i], "--csma-echo") == 0) {
+            csma = MAC_CSMA_ECHO;
+#ifdef BUS_NODE_UDP
+        } else if (strcmp(argv[i], "--bus") == 0 && takes_value) {
+            group = argv[++i];
+        } else if (strcmp(argv[i], "--iface") == 0 && takes_value) {
+            iface = argv[++i];
+#elif defined(BUS_NODE_PTY)
+        } else if (strcmp(argv[i], "--bus") == 0 && takes_value) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--noise") == 0 && takes_value) {
+            g_hub_noise = argv[++i]; /* Only the hub needs it */
+            continue;
+#else
+        } else if (strcmp(argv[i], "--bus") == 0 && takes_value) {
+            bus_shm_set_name(argv[++i]);
+#endif
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        } else {
+            index = atoi(argv[i]); /* The node index is given per process */
+            continue;
+        }
+        for (int j = first; j <= i && node_argc < 28; ++j)
+            node_args[node_argc++] = argv[j];
+    }
+
+    hal_init();
+    hal_sim_set_quiet(quiet);
+#ifdef BUS_NODE_UDP
+    char addr[64] = "";
+    unsigned long port = 0;
+    if (group) {
+        snprintf(addr, sizeof(addr), "%s", group);
+        char* colon = strchr(addr, ':');
+        if (colon) {
+            *colon = '\0';
+            port = strtoul(colon + 1, NULL, 10);
+        }
+    }
+    if (port > 65535 || bus_udp_set_group(addr[0] ? addr : NULL, (uint16_t) port, iface) != 0) {
+        fprintf(stderr, "Bad multicast group or interface address\n");
+        return EXIT_SETUP_FAILED;
+    }
+#elif defined(BUS_NODE_PTY)
+    bus_pty_set_dir(dir);
+    if (dir)
+        g_hub_dir = dir;
+    snprintf(g_hub_seed, sizeof(g_hub_seed), "%llu", seed);
+#endif
+
+    if (spawn > 0) {
+        if (spawn > HAL_SIM_MAX_NODES)
+            spawn = HAL_SIM_MAX_NODES;
+        /* Every node process must derive its generator from the same master seed */
+        static char seed_arg[24];
+        if (!seed_given) {
+            snprintf(seed_arg, sizeof(seed_arg), "%llu", seed);
+            node_args[node_argc++] = "--seed";
+            node_args[node_argc++] = seed_arg;
+        }
+        printf(BUS_NODE_TAG ": starting %d node processes (seed %llu)...\n", spawn, seed);
+        fflush(stdout); /* Before fork(), or the children repeat it */
+        return run_spawn(argv[0], spawn, node_args, kill_index, kill_ms);
+    }
+
+    if (index < 0 || index >= HAL_SIM_MAX_NODES) {
+        fprintf(stderr, "Usage: %s INDEX [options] | --spawn N [options] (INDEX 0-%d)\n", argv[0],
+                HAL_SIM_MAX_NODES - 1);
+        return EXIT_SETUP_FAILED;
+    }
+    /* Same generators as node INDEX of an in-process run with this seed */
+    hal_sim_set_seed(seed);
+    hal_sim_bind_node((uint8_t) index);
+    return run_node(index, run_ms, baud, csma, tdma_slot);
+}
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+Footprint Report for a Build Profile
+
+Compiles the sources for one profile of shared/core/config.h and reports
+what the ATmega budget is spent on:
+
+- Flash: code and initialized data of the compiled sources
+- Static RAM: data and bss of the sources, plus the size of the structures
+  a sketch or the simulation allocates (Node, PubSub, ...)
+- Stack: the deepest call chain from each public function, from GCC's
+  -fstack-usage / -fcallgraph-info output. Calls into code that was not
+  compiled (HAL, bus, libc) count as zero and are listed.
+
+With a cross compiler (avr-gcc, arm-none-eabi-gcc) the numbers are those of
+the target; with the host compiler the table layout is the profile's but
+pointer-sized fields and code size are the host's.
+
+Usage:
+    ./footprint.py --profile TINY --cc avr-gcc --cflags "-mmcu=atmega328p -Os" shared/core/*.c
+"""
+
+import argparse
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+# Structures whose size decides a node's RAM use (name: header declaring it)
+STRUCTS = {
+    'Node': 'node.h',
+    'PubSub': 'pubsub.h',
+    'MacTdma': 'mac.h',
+    'TimeSync': 'timesync.h',
+    'TraceRing': 'trace.h',
+}
+
+NODE_RE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE_RE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+FRAME_RE = re.compile(r'\\n(\d+) bytes \((\w+)')
+
+
+def run(cmd):
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(f"{' '.join(cmd)}:\n{result.stderr}")
+    return result.stdout
+
+
+def tool(cc, name):
+    """Binutils program matching the compiler (avr-gcc -> avr-size)"""
+    base = os.path.basename(cc)
+    prefix = base[:-len('gcc')] if base.endswith('gcc') else ''
+    return os.path.join(os.path.dirname(cc), prefix + name)
+
+
+def compile_all(cc, cflags, sources, out_dir):
+    probe = os.path.join(out_dir, 'footprint_probe.c')
+    with open(probe, 'w', encoding='utf-8') as f:
+        for header in sorted(set(STRUCTS.values())):
+            f.write(f'#include "{header}"\n')
+        for name in STRUCTS:
+            f.write(f'char footprint_{name}[sizeof({name})];\n')
+
+    callgraph = subprocess.run([cc, '-fcallgraph-info=su', '-x', 'c', '-c', '-o', os.devnull,
+                                '-'], input='', capture_output=True, text=True,
+                               cwd=out_dir).returncode == 0
+    flags = cflags + ['-fstack-usage'] + (['-fcallgraph-info=su'] if callgraph else [])
+
+    objects = []
+    for i, src in enumerate(sources + [probe]):
+        obj = os.path.join(out_dir, f'{i:02d}_{os.path.splitext(os.path.basename(src))[0]}.o')
+        run([cc] + flags + ['-c', src, '-o', obj])
+        objects.append(obj)
+    return objects[:-1], objects[-1], callgraph
+
+
+def section_sizes(cc, objects):
+    """Total (text, data, bss) of the objects"""
+    text = data = bss = 0
+    for line in run([tool(cc, 'size')] + objects).splitlines()[1:]:
+        fields = line.split()
+        text, data, bss = text + int(fields[0]), data + int(fields[1]), bss + int(fields[2])
+    return text, data, bss
+
+
+def struct_sizes(cc, probe):
+    sizes = {}
+    for line in run([tool(cc, 'nm'), '-S', probe]).splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[3].startswith('footprint_'):
+            sizes[fields[3][len('footprint_'):]] = int(fields[1], 16)
+    return sizes
+
+
+def read_callgraph(objects):
+    """Frames {function: (bytes, bounded)} and calls {function: [callees]}"""
+    frames, calls = {}, {}
+    for obj in objects:
+        ci = os.path.splitext(obj)[0] + '.ci'
+        with open(ci, encoding='utf-8') as f:
+            text = f.read()
+        for title, label in NODE_RE.findall(text):
+            match = FRAME_RE.search(label)
+            if match:
+                frames[title] = (int(match.group(1)), match.group(2) == 'static')
+        for source, target in EDGE_RE.findall(text):
+            calls.setdefault(source, [])
+            if target not in calls[source]:
+                calls[source].append(target)
+    return frames, calls
+
+
+def deepest(fn, frames, calls, memo, active):
+    """(bytes, chain, outside callees, recursive) of the deepest chain from fn"""
+    if fn in memo:
+        return memo[fn]
+    if fn not in frames:
+        return (0, [], {fn}, False)
+    if fn in active:
+        return (0, [], set(), True)
+    active.add(fn)
+    best, chain, outside, recursive = 0, [], set(), False
+    for callee in calls.get(fn, []):
+        depth, sub, out, rec = deepest(callee, frames, calls, memo, active)
+        outside |= out
+        recursive |= rec
+        if depth > best:
+            best, chain = depth, sub
+    active.discard(fn)
+    result = (frames[fn][0] + best, [fn] + chain, outside, recursive)
+    memo[fn] = result
+    return result
+
+
+def short(fn):
+    return fn.rsplit(':', 1)[-1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Report flash, static RAM and stack use")
+    parser.add_argument('sources', nargs='+', help='C sources of the build')
+    parser.add_argument('--profile', required=True, help='TINY, R4 or SIM (config.h)')
+    parser.add_argument('--cc', default='cc', help='Compiler (default: cc)')
+    parser.add_argument('--cflags', default='-Os', help='Compiler flags (default: -Os)')
+    parser.add_argument('--roots', default='node_begin,node_service,pubsub_publish',
+                        help='Entry points to report the stack of (comma-separated)')
+    args = parser.parse_args()
+
+    include = sorted({os.path.dirname(os.path.abspath(s)) for s in args.sources})
+    cflags = (shlex.split(args.cflags) + ['-I' + d for d in include] +
+              [f'-DCONFIG_PROFILE=CONFIG_PROFILE_{args.profile.upper()}'])
+
+    with tempfile.TemporaryDirectory() as out_dir:
+        objects, probe, callgraph = compile_all(args.cc, cflags, args.sources, out_dir)
+        text, data, bss = section_sizes(args.cc, objects)
+        sizes = struct_sizes(args.cc, probe)
+        if callgraph:
+            frames, calls = read_callgraph(objects)
+        else:
+            frames, calls = {}, {}
+            for obj in objects:
+                with open(os.path.splitext(obj)[0] + '.su', encoding='utf-8') as f:
+                    for line in f:
+                        where, size, kind = line.rstrip('\n').split('\t')
+                        frames[where.rsplit(':', 1)[-1]] = (int(size), kind == 'static')
+
+    print(f"== Profile {args.profile.lower()} ({args.cc} {args.cflags})")
+    print(f"Flash      {text + data:6} B  code and constant data")
+    print(f"Static RAM {data + bss:6} B  data + bss of the sources")
+    print("Structures " + ', '.join(f"{name} {sizes.get(name, '?')} B" for name in STRUCTS))
+
+    memo = {}
+    for root in args.roots.split(','):
+        if root not in frames:
+            print(f"Stack      {root}: not compiled")
+            continue
+        if not callgraph:
+            print(f"Stack      {root}: own frame {frames[root][0]} B "
+                  "(call graph needs GCC 10 or newer)")
+            continue
+        depth, chain, outside, recursive = deepest(root, frames, calls, memo, set())
+        notes = []
+        if recursive:
+            notes.append('RECURSIVE, depth unbounded')
+        if any(not frames[fn][1] for fn in chain):
+            notes.append('dynamic frames, lower bound')
+        note = f" ({'; '.join(notes)})" if notes else ''
+        print(f"Stack      {depth:6} B  {root}{note}")
+        print("             via " + ' > '.join(f"{short(fn)} {frames[fn][0]}" for fn in chain))
+        print("             not counted: " + ', '.join(sorted(outside)))
+
+
+if __name__ == '__main__':
+    main()
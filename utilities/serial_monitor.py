@@ -9,11 +9,14 @@ self-organizing systems.
 Usage:
     ./serial_monitor.py /dev/ttyAMA2,/dev/ttyAMA3
     ./serial_monitor.py /dev/ttyUSB0 /dev/ttyUSB1 --baud 38400
+    ./serial_monitor.py /dev/ttyACM0 --trace-table trace_table.json  # LOG_TRACE builds
+    ./serial_monitor.py /tmp/self-organizing-mcus/monitor --frames   # sim/pty_hub line
     ./serial_monitor.py --help
 """
 
 import argparse
 import asyncio
+import json
 import sys
 import time
 from datetime import datetime
@@ -22,6 +25,8 @@ import aioserial
 import colorama
 from colorama import Fore, Back, Style
 
+from trace_decode import TraceDecoder
+
 # Initialize colorama for cross-platform colored output
 colorama.init(autoreset=True)
 
@@ -35,10 +40,55 @@ DEVICE_COLORS = [
     Fore.RED,
 ]
 
+# Frame format of shared/core/proto.h: [SOF][Type][Source][PayloadLen][Payload...][Checksum]
+SOF = 0xAA
+MAX_PAYLOAD_SIZE = 8
+MESSAGE_TYPES = {
+    1: 'HELLO', 2: 'CLAIM', 3: 'JOIN', 4: 'ASSIGN', 5: 'HEARTBEAT', 6: 'SYNC',
+    7: 'RECLAIM', 8: 'DATA', 9: 'TIME_REQ', 10: 'TIME', 11: 'SCHEDULE',
+}
+
+
+class FrameDecoder:
+    """Splits the bus byte stream into protocol frames, as proto_parse_byte() does"""
+
+    def __init__(self):
+        self.frame = bytearray()
+
+    def feed(self, data):
+        """Add received bytes; returns a list of text lines, one per frame"""
+        out = []
+        for b in data:
+            if not self.frame:
+                if b == SOF:
+                    self.frame.append(b)
+                continue  # Noise between frames
+            if len(self.frame) == 3 and b > MAX_PAYLOAD_SIZE:
+                self.frame.clear()  # Not a real frame start: resynchronize
+                continue
+            self.frame.append(b)
+            if len(self.frame) < 5 or len(self.frame) < 5 + self.frame[3]:
+                continue
+            msg_type, source, length = self.frame[1], self.frame[2], self.frame[3]
+            payload = self.frame[4:4 + length]
+            checksum = msg_type ^ source ^ length
+            for p in payload:
+                checksum ^= p
+            name = MESSAGE_TYPES.get(msg_type, f'type {msg_type}')
+            text = f'{name} from {source}: {payload.hex(" ") or "(no payload)"}'
+            if checksum != self.frame[-1]:
+                text = f'DEBUG: bad checksum: {self.frame.hex(" ")}'
+            out.append(text)
+            self.frame.clear()
+        return out
+
+
 class SerialMonitor:
-    def __init__(self, devices, baud_rate=38400):
+    def __init__(self, devices, baud_rate=38400, trace_table=None, frames=False):
         self.devices = devices
         self.baud_rate = baud_rate
+        self.trace_table = trace_table
+        self.frames = frames
         self.device_colors = {}
         self.running = True
         
@@ -109,9 +159,24 @@ class SerialMonitor:
             
             print(f"{Fore.GREEN}✓ Connected to {device_path} at {self.baud_rate} baud{Style.RESET_ALL}")
             
+            # Binary trace records (LOG_TRACE builds) arrive mixed with text lines
+            decoder = TraceDecoder(self.trace_table) if self.trace_table else None
+            # The bus itself carries frames, not text
+            frame_decoder = FrameDecoder() if self.frames else None
+
             # Read lines continuously
             while self.running:
                 try:
+                    if frame_decoder:
+                        data = await serial_conn.read_async(max(1, serial_conn.in_waiting))
+                        for message in frame_decoder.feed(data):
+                            self.print_message(device_path, message)
+                        continue
+                    if decoder:
+                        data = await serial_conn.read_async(max(1, serial_conn.in_waiting))
+                        for _, message in decoder.feed(data):
+                            self.print_message(device_path, message)
+                        continue
                     line = await serial_conn.readline_async()
                     if line:
                         message = line.decode('utf-8', errors='replace')
@@ -168,6 +233,8 @@ Examples:
   %(prog)s /dev/ttyAMA2,/dev/ttyAMA3
   %(prog)s /dev/ttyUSB0 /dev/ttyUSB1 --baud 115200
   %(prog)s /dev/ttyAMA2,/dev/ttyAMA3,/dev/ttyAMA4 --baud 38400
+  %(prog)s /dev/ttyACM0 --baud 115200 --trace-table trace_table.json
+  %(prog)s /tmp/self-organizing-mcus/monitor --frames
         """
     )
     
@@ -184,6 +251,17 @@ Examples:
         help='Baud rate for all devices (default: 38400)'
     )
     
+    parser.add_argument(
+        '--trace-table', '-t',
+        help='Format table from `make trace-table`, to decode LOG_TRACE firmware output'
+    )
+    
+    parser.add_argument(
+        '--frames', '-f',
+        action='store_true',
+        help='Decode protocol frames instead of text, e.g. on a bus line or sim/pty_hub monitor port'
+    )
+    
     args = parser.parse_args()
     
     # Parse device list
@@ -205,7 +283,11 @@ Examples:
             sys.exit(1)
     
     # Create and run monitor
-    monitor = SerialMonitor(devices, args.baud)
+    trace_table = None
+    if args.trace_table:
+        with open(args.trace_table, encoding='utf-8') as f:
+            trace_table = json.load(f)
+    monitor = SerialMonitor(devices, args.baud, trace_table, args.frames)
     
     try:
         asyncio.run(monitor.run())
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Trace Decoder for LOG_TRACE Builds
+
+Turns the binary log records of a LOG_TRACE build (see shared/core/trace.h)
+back into text using the format table from trace_table.py. Plain text lines
+in the same stream (boot messages, the simulation harness) pass through.
+
+Usage:
+    ./sim/sim 3 | ./trace_decode.py
+    ./trace_decode.py --table trace_table.json capture.bin
+"""
+
+import argparse
+import json
+import re
+import sys
+
+MARKER = 0xFE
+HEADER_BYTES = 6  # ID and timestamp, after the marker and length
+
+CONVERSION_RE = re.compile(r'%[-+ #0-9.]*[lh]*([diuxXcs%])')
+
+
+class TraceDecoder:
+    """Splits a byte stream into text lines and decoded trace records"""
+
+    def __init__(self, table):
+        self.formats = table['formats']
+        self.buf = bytearray()
+
+    @classmethod
+    def from_file(cls, path):
+        with open(path, encoding='utf-8') as f:
+            return cls(json.load(f))
+
+    def feed(self, data):
+        """Add received bytes; returns a list of (timestamp_ms or None, text)"""
+        self.buf += data
+        out = []
+        while self.buf:
+            if self.buf[0] == MARKER:
+                if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+                    break  # Rest of the record not received yet
+                length = self.buf[1]
+                record = bytes(self.buf[2:2 + length])
+                del self.buf[:2 + length]
+                out.append(self.decode_record(record))
+                continue
+
+            end = self.buf.find(b'\n')
+            marker = self.buf.find(bytes([MARKER]))
+            if 0 <= marker and (end < 0 or marker < end):
+                end = marker  # A record cut into a line without a newline
+            elif end < 0:
+                break
+            line = self.buf[:end].decode('utf-8', errors='replace').rstrip('\r')
+            del self.buf[:end + 1 if self.buf[end:end + 1] == b'\n' else end]
+            if line:
+                out.append((None, line))
+        return out
+
+    def decode_record(self, record):
+        if len(record) < HEADER_BYTES:
+            return (None, f"<short trace record {record.hex()}>")
+        trace_id = int.from_bytes(record[0:2], 'little')
+        ms = int.from_bytes(record[2:6], 'little')
+        entry = self.formats.get(str(trace_id))
+        if entry is None:
+            return (ms, f"<unknown trace id {trace_id}: {record[6:].hex()}> (stale table?)")
+        return (ms, self.render(entry['fmt'], record[6:]))
+
+    @staticmethod
+    def render(fmt, data):
+        pos = 0
+
+        def convert(match):
+            nonlocal pos
+            kind = match.group(1)
+            if kind == '%':
+                return '%'
+            if pos >= len(data):
+                return '?'  # Left out of a full record
+            if kind == 's':
+                length = data[pos]
+                value = data[pos + 1:pos + 1 + length].decode('utf-8', errors='replace')
+                pos += 1 + length
+                return value
+            value, shift = 0, 0
+            while pos < len(data):
+                byte = data[pos]
+                pos += 1
+                value |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+            if kind in 'di':
+                value = (value >> 1) ^ -(value & 1)  # Zigzag
+            return re.sub('[lh]', '', match.group(0)) % value  # Python has no length modifiers
+
+        return CONVERSION_RE.sub(convert, fmt)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode LOG_TRACE output to text")
+    parser.add_argument('input', nargs='?', help='Captured output (default: stdin)')
+    parser.add_argument('--table', '-t', default='trace_table.json',
+                        help='Format table from trace_table.py (default: trace_table.json)')
+    parser.add_argument('--timestamps', action='store_true',
+                        help='Prefix decoded records with their device timestamp')
+    args = parser.parse_args()
+
+    decoder = TraceDecoder.from_file(args.table)
+    stream = open(args.input, 'rb') if args.input else sys.stdin.buffer
+    with stream:
+        while True:
+            data = stream.read1(4096) if hasattr(stream, 'read1') else stream.read(4096)
+            if not data:
+                break
+            for ms, text in decoder.feed(data):
+                if args.timestamps and ms is not None:
+                    text = f"[{ms:>8}ms] {text}"
+                print(text, flush=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Trace Format Table Generator
+
+Firmware built with LOG_TRACE sends binary log records that carry a call
+site ID instead of text (see shared/core/trace.h). This script scans the
+sources for LOG_INFO()/LOG_DEBUG() calls and writes the table that maps each
+ID back to its format string, for trace_decode.py and serial_monitor.py.
+
+An ID is (LOG_FILE_ID << 11) | line, where LOG_FILE_ID is defined near the
+top of every source file that logs.
+
+Usage:
+    ./trace_table.py -o trace_table.json shared/core/*.c shared/platform/*/*.c
+"""
+
+import argparse
+import json
+import re
+import sys
+
+FILE_ID_RE = re.compile(r'^\s*#define\s+LOG_FILE_ID\s+(\d+)', re.MULTILINE)
+CALL_RE = re.compile(r'\b(LOG_INFO|LOG_DEBUG|HAL_LOGF)\s*\(')
+ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '"': '"', '\\': '\\', "'": "'", '0': '\0'}
+
+LINE_BITS = 11
+DROPPED_ID = 0
+
+
+def read_literals(text, pos):
+    """Read adjacent C string literals starting at pos; None if there are none"""
+    parts = []
+    while True:
+        while pos < len(text) and text[pos].isspace():
+            pos += 1
+        if pos >= len(text) or text[pos] != '"':
+            break
+        pos += 1
+        while text[pos] != '"':
+            if text[pos] == '\\':
+                pos += 1
+                parts.append(ESCAPES.get(text[pos], text[pos]))
+            else:
+                parts.append(text[pos])
+            pos += 1
+        pos += 1
+    return ''.join(parts) if parts else None
+
+
+def scan(path, table):
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+
+    file_ids = FILE_ID_RE.findall(text)
+    calls = []
+    for match in CALL_RE.finditer(text):
+        fmt = read_literals(text, match.end())
+        if fmt is None:
+            continue  # Macro definition or a mention in a comment
+        line = text.count('\n', 0, match.start()) + 1
+        level = 'DEBUG' if match.group(1) == 'LOG_DEBUG' else 'INFO'
+        calls.append((line, level, fmt))
+
+    if not calls:
+        return
+    if len(file_ids) != 1:
+        sys.exit(f"{path}: log calls need exactly one '#define LOG_FILE_ID <n>'")
+    file_id = int(file_ids[0])
+    if not 1 <= file_id < 32:
+        sys.exit(f"{path}: LOG_FILE_ID must be 1-31")
+
+    for line, level, fmt in calls:
+        if line >= 1 << LINE_BITS:
+            sys.exit(f"{path}:{line}: log calls must be in the first {(1 << LINE_BITS) - 1} lines")
+        trace_id = (file_id << LINE_BITS) | line
+        if str(trace_id) in table:
+            other = table[str(trace_id)]
+            sys.exit(f"{path}:{line}: trace ID {trace_id} already used by "
+                     f"{other['file']}:{other['line']}")
+        table[str(trace_id)] = {'file': path, 'line': line, 'level': level, 'fmt': fmt}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the LOG_TRACE format table")
+    parser.add_argument('sources', nargs='+', help='C sources to scan')
+    parser.add_argument('--output', '-o', default='-', help='Output JSON file (default: stdout)')
+    args = parser.parse_args()
+
+    table = {str(DROPPED_ID): {'file': '', 'line': 0, 'level': 'INFO',
+                               'fmt': 'TRACE: %u records dropped (ring full)'}}
+    for path in args.sources:
+        scan(path, table)
+
+    out = json.dumps({'line_bits': LINE_BITS, 'formats': table}, indent=1, ensure_ascii=False)
+    if args.output == '-':
+        print(out)
+    else:
+        with open(args.output, 'w', encoding='utf-8') as f:
+            f.write(out + '\n')
+
+
+if __name__ == '__main__':
+    main()